@@ -0,0 +1,192 @@
+/*
+ * This script measures the time a UdpForwarder spends serializing the rxpk
+ * objects of a PUSH_DATA datagram, with the snprintf calls of the Semtech
+ * packet forwarder and with the RxpkWriter, the payloads being base64-encoded
+ * with and without vector instructions.
+ */
+
+#include "ns3/base64.h"
+#include "ns3/command-line.h"
+#include "ns3/log.h"
+#include "ns3/rxpk-writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace ns3;
+using namespace lorawan;
+
+NS_LOG_COMPONENT_DEFINE("UdpForwarderBenchmark");
+
+// Benchmark settings
+int nDatagrams = 100000;
+int nPacketsPerDatagram = 8;
+int payloadSize = 51;
+
+/**
+ * Serialize the rxpk objects of a datagram as the packet forwarder does.
+ *
+ * \param packets The packets of the datagram.
+ * \param buf Where to write.
+ * \param size The room in the buffer.
+ * \return The number of bytes written.
+ */
+int
+SerializeWithSnprintf(const std::vector<lgw_pkt_rx_s>& packets, uint8_t* buf, int size)
+{
+    const char* sf[] = {"SF7", "SF8", "SF9", "SF10", "SF11", "SF12"};
+    int index = 0;
+    for (const auto& p : packets)
+    {
+        int datarate = 0;
+        for (uint32_t d = p.datarate; d > DR_LORA_SF7; d >>= 1)
+        {
+            ++datarate;
+        }
+        if (index > 0)
+        {
+            buf[index++] = ',';
+        }
+        buf[index++] = '{';
+        index += snprintf((char*)buf + index, size - index, "\"tmst\":%u", p.count_us);
+        index += snprintf((char*)buf + index,
+                          size - index,
+                          ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf",
+                          p.if_chain,
+                          p.rf_chain,
+                          ((double)p.freq_hz / 1e6));
+        memcpy(buf + index, ",\"stat\":1,\"modu\":\"LORA\"", 23);
+        index += 23;
+        index += snprintf((char*)buf + index, size - index, ",\"datr\":\"%s", sf[datarate]);
+        memcpy(buf + index, "BW125\",\"codr\":\"4/5\"", 19);
+        index += 19;
+        index += snprintf((char*)buf + index, size - index, ",\"lsnr\":%.1f", p.snr);
+        index += snprintf((char*)buf + index,
+                          size - index,
+                          ",\"rssi\":%.0f,\"size\":%u",
+                          p.rssi,
+                          p.size);
+        memcpy(buf + index, ",\"data\":\"", 9);
+        index += 9;
+        index += bin_to_b64(p.payload, p.size, (char*)buf + index, 341);
+        buf[index++] = '"';
+        buf[index++] = '}';
+    }
+    return index;
+}
+
+/**
+ * Serialize the rxpk objects of a datagram with a RxpkWriter.
+ *
+ * \param writer The writer of the gateway.
+ * \param packets The packets of the datagram.
+ * \param buf Where to write, with room for all packets.
+ * \return The number of bytes written.
+ */
+int
+SerializeWithWriter(RxpkWriter& writer, const std::vector<lgw_pkt_rx_s>& packets, uint8_t* buf)
+{
+    int index = 0;
+    for (const auto& p : packets)
+    {
+        if (index > 0)
+        {
+            buf[index++] = ',';
+        }
+        index += writer.Write(p, buf + index);
+    }
+    return index;
+}
+
+int
+main(int argc, char* argv[])
+{
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("nDatagrams", "Number of datagrams serialized by each method", nDatagrams);
+    cmd.AddValue("nPacketsPerDatagram", "Number of rxpk objects per datagram", nPacketsPerDatagram);
+    cmd.AddValue("payloadSize", "Size of the payload of the packets [B]", payloadSize);
+    cmd.Parse(argc, argv);
+
+    // Packets of a gateway listening on the 3 default EU868 channels
+    std::mt19937 rng(1);
+    std::vector<std::vector<lgw_pkt_rx_s>> datagrams(16);
+    const uint32_t frequencies[] = {868100000, 868300000, 868500000};
+    const uint32_t datarates[] = {DR_LORA_SF7, DR_LORA_SF9, DR_LORA_SF12};
+    for (auto& packets : datagrams)
+    {
+        packets.resize(nPacketsPerDatagram);
+        for (auto& p : packets)
+        {
+            p = {};
+            p.count_us = rng();
+            p.freq_hz = frequencies[rng() % 3];
+            p.status = STAT_CRC_OK;
+            p.modulation = MOD_LORA;
+            p.bandwidth = BW_125KHZ;
+            p.datarate = datarates[rng() % 3];
+            p.coderate = CR_LORA_4_5;
+            p.snr = std::uniform_real_distribution<float>(-20, 10)(rng);
+            p.rssi = std::uniform_real_distribution<float>(-130, -60)(rng);
+            p.size = std::min(payloadSize, 255);
+            for (int i = 0; i < p.size; ++i)
+            {
+                p.payload[i] = rng();
+            }
+        }
+    }
+    std::vector<uint8_t> reference(RxpkWriter::MAX_SIZE * (nPacketsPerDatagram + 1));
+    std::vector<uint8_t> buf(reference.size());
+    RxpkWriter writer;
+
+    // Both methods give the same bytes
+    for (const auto& packets : datagrams)
+    {
+        int size = SerializeWithSnprintf(packets, reference.data(), reference.size());
+        if (SerializeWithWriter(writer, packets, buf.data()) != size ||
+            memcmp(reference.data(), buf.data(), size) != 0)
+        {
+            NS_FATAL_ERROR("The RxpkWriter does not give the output of snprintf");
+        }
+    }
+
+    struct Method
+    {
+        std::string name;
+        bool writer;
+        bool simd;
+    };
+
+    const Method methods[] = {
+        {"snprintf, scalar base64", false, false},
+        {"snprintf, vector base64", false, true},
+        {"RxpkWriter, scalar base64", true, false},
+        {"RxpkWriter, vector base64", true, true},
+    };
+    std::cout << "Vector instructions available for base64: "
+              << (unsigned)b64_simd_available() << " (2 = AVX2, 1 = SSSE3)" << std::endl;
+    uint64_t bytes = 0;
+    for (const auto& method : methods)
+    {
+        b64_simd_enable(method.simd);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < nDatagrams; ++i)
+        {
+            const auto& packets = datagrams[i % datagrams.size()];
+            bytes += method.writer
+                         ? SerializeWithWriter(writer, packets, buf.data())
+                         : SerializeWithSnprintf(packets, buf.data(), buf.size());
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << method.name << ": " << elapsed.count() / nDatagrams << " ns per datagram of "
+                  << nPacketsPerDatagram << " packets" << std::endl;
+    }
+    b64_simd_enable(1);
+    NS_LOG_DEBUG("Serialized " << bytes << " bytes");
+
+    return 0;
+}
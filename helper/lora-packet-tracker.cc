@@ -540,7 +540,7 @@ LoraPacketTracker::PrintSimulationStatistics(Time startTime)
         pd.first->Copy()->RemovePacketTag(tag);
         params.sf = tag.GetTxParameters().sf;
         params.lowDataRateOptimizationEnabled = LoraPhy::GetTSym(params) > MilliSeconds(16);
-        totOffTraff += LoraPhy::GetTimeOnAir(pd.first->Copy(), params).GetSeconds();
+        totOffTraff += LoraPhy::GetTimeOnAir(pd.first->GetSize(), params).GetSeconds();
 
         total++;
         totBytesSent += pd.first->GetSize();
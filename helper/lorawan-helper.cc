@@ -208,7 +208,7 @@ LorawanHelper::DoPrintDeviceStatus(NodeContainer endDevices,
         params.sf = 12 - dr;
         params.lowDataRateOptimizationEnabled = LoraPhy::GetTSym(params) > MilliSeconds(16);
         double maxot =
-            LoraPhy::GetTimeOnAir(Create<Packet>(size + 13), params).GetSeconds() / interval;
+            LoraPhy::GetTimeOnAir(size + 13, params).GetSeconds() / interval;
         maxot = std::min(maxot, 0.01);
 
         double ot = mac->GetAggregatedDutyCycle();
@@ -391,7 +391,7 @@ LorawanHelper::DoPrintSFStatus(NodeContainer endDevices,
         params.sf = 12 - dr;
         params.lowDataRateOptimizationEnabled = LoraPhy::GetTSym(params) > MilliSeconds(16);
         double maxot =
-            LoraPhy::GetTimeOnAir(Create<Packet>(size + 13), params).GetSeconds() / interval;
+            LoraPhy::GetTimeOnAir(size + 13, params).GetSeconds() / interval;
         maxot = std::min(maxot, 0.01);
         double ot = mac->GetAggregatedDutyCycle();
         ot = std::min(ot, maxot);
@@ -331,6 +331,13 @@ LorawanMacHelper::SetSpreadingFactorsUp(NodeContainer endDevices,
     NS_LOG_FUNCTION_NOARGS();
 
     std::vector<int> sfQuantity(6, 0);
+    // Gather the positions of the gateways once for all devices
+    ReceiverBatch gatewayPositions;
+    for (auto gw = gateways.Begin(); gw != gateways.End(); ++gw)
+    {
+        gatewayPositions.Add((*gw)->GetObject<MobilityModel>());
+    }
+    std::vector<double> rxPowers;
     for (auto j = endDevices.Begin(); j != endDevices.End(); ++j)
     {
         auto node = *j;
@@ -340,25 +347,19 @@ LorawanMacHelper::SetSpreadingFactorsUp(NodeContainer endDevices,
         auto mac = DynamicCast<BaseEndDeviceLorawanMac>(loraNetDevice->GetMac());
         NS_ASSERT(bool(position) && bool(mac));
 
-        // Try computing the distance from each gateway and find the best one
-        auto bestGateway = gateways.Get(0);
-        auto bestGatewayPosition = bestGateway->GetObject<MobilityModel>();
+        // Compute the power received by each gateway and find the best one
         // Assume devices transmit at 14 dBm erp
-        double highestRxPower = channel->GetRxPower(14, position, bestGatewayPosition);
-        for (auto currentGw = gateways.Begin() + 1; currentGw != gateways.End(); ++currentGw)
+        channel->GetRxPowers(14, position, gatewayPositions, rxPowers);
+        size_t bestGateway = 0;
+        for (size_t i = 1; i < rxPowers.size(); ++i)
         {
-            // Compute the power received from the current gateway
-            auto curr = *currentGw;
-            auto currPosition = curr->GetObject<MobilityModel>();
-            double currentRxPower = channel->GetRxPower(14, position, currPosition); // dBm
-            if (currentRxPower > highestRxPower)
+            if (rxPowers[i] > rxPowers[bestGateway])
             {
-                bestGateway = curr;
-                bestGatewayPosition = curr->GetObject<MobilityModel>();
-                highestRxPower = currentRxPower;
+                bestGateway = i;
             }
         }
-        double rxPower = highestRxPower;
+        auto bestGatewayPosition = gatewayPositions.mobility[bestGateway];
+        double rxPower = rxPowers[bestGateway];
 
         std::vector<double> snrThresholds = {-7.5, -10, -12.5, -15, -17.5, -20}; // dB
         double noise = -174.0 + 10 * log10(125000.0) + 6;                        // dBm
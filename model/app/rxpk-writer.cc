@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "rxpk-writer.h"
+
+#include "ns3/base64.h"
+#include "ns3/fatal-error.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+namespace
+{
+
+/**
+ * Copy a string literal, without its null character.
+ *
+ * \param buf Where to write.
+ * \param text The literal.
+ * \return The position after the copy.
+ */
+template <size_t N>
+inline uint8_t*
+Append(uint8_t* buf, const char (&text)[N])
+{
+    std::memcpy(buf, text, N - 1);
+    return buf + N - 1;
+}
+
+/// Decimal representations of 00 to 99
+const char DIGIT_PAIRS[] = "00010203040506070809"
+                           "10111213141516171819"
+                           "20212223242526272829"
+                           "30313233343536373839"
+                           "40414243444546474849"
+                           "50515253545556575859"
+                           "60616263646566676869"
+                           "70717273747576777879"
+                           "80818283848586878889"
+                           "90919293949596979899";
+
+} // namespace
+
+RxpkWriter::RxpkWriter()
+{
+    for (auto& channel : m_channels)
+    {
+        channel.size = 0;
+    }
+}
+
+uint32_t
+RxpkWriter::WriteUint(uint8_t* buf, uint32_t value)
+{
+    // Digits are produced two by two from the right, then moved in place
+    uint8_t digits[10];
+    uint32_t i = sizeof(digits);
+    while (value >= 100)
+    {
+        uint32_t pair = (value % 100) * 2;
+        value /= 100;
+        digits[--i] = DIGIT_PAIRS[pair + 1];
+        digits[--i] = DIGIT_PAIRS[pair];
+    }
+    if (value >= 10)
+    {
+        digits[--i] = DIGIT_PAIRS[value * 2 + 1];
+        digits[--i] = DIGIT_PAIRS[value * 2];
+    }
+    else
+    {
+        digits[--i] = '0' + value;
+    }
+    uint32_t n = sizeof(digits) - i;
+    std::memcpy(buf, digits + i, n);
+    return n;
+}
+
+uint32_t
+RxpkWriter::WriteFixed(uint8_t* buf, float value, uint32_t decimals)
+{
+    // A float has 24 significant bits, so its product by 10 is exact in a
+    // double, and rounding it to an integer in the current rounding mode, ties
+    // to even by default, gives the digits printf prints
+    double scaled = (decimals == 1) ? double(value) * 10 : double(value);
+    double rounded = std::nearbyint(scaled);
+    if (!std::isfinite(rounded) || std::fabs(rounded) > UINT32_MAX)
+    {
+        char text[48];
+        int n = std::snprintf(text, sizeof(text), (decimals == 1) ? "%.1f" : "%.0f", value);
+        std::memcpy(buf, text, n);
+        return n;
+    }
+
+    uint32_t n = 0;
+    // printf keeps the sign of negative values rounded to zero
+    if (std::signbit(value))
+    {
+        buf[n++] = '-';
+    }
+    auto digits = uint32_t(std::fabs(rounded));
+    if (decimals == 1)
+    {
+        n += WriteUint(buf + n, digits / 10);
+        buf[n++] = '.';
+        buf[n++] = '0' + digits % 10;
+    }
+    else
+    {
+        n += WriteUint(buf + n, digits);
+    }
+    return n;
+}
+
+const RxpkWriter::Channel&
+RxpkWriter::GetChannel(const lgw_pkt_rx_s& p)
+{
+    // Channels are at least 100 kHz apart
+    Channel& channel = m_channels[(p.freq_hz / 100000 + p.if_chain + p.rf_chain) % N_CHANNELS];
+    if (channel.size && channel.freqHz == p.freq_hz && channel.ifChain == p.if_chain &&
+        channel.rfChain == p.rf_chain)
+    {
+        return channel;
+    }
+
+    channel.freqHz = p.freq_hz;
+    channel.ifChain = p.if_chain;
+    channel.rfChain = p.rf_chain;
+    // As ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf", the frequency in MHz
+    // having exactly 6 decimals
+    uint8_t* q = channel.text;
+    q = Append(q, ",\"chan\":");
+    q += WriteUint(q, p.if_chain);
+    q = Append(q, ",\"rfch\":");
+    q += WriteUint(q, p.rf_chain);
+    q = Append(q, ",\"freq\":");
+    q += WriteUint(q, p.freq_hz / 1000000);
+    *q++ = '.';
+    uint32_t decimals = p.freq_hz % 1000000;
+    for (uint32_t i = 6; i > 0; --i)
+    {
+        q[i - 1] = '0' + decimals % 10;
+        decimals /= 10;
+    }
+    q += 6;
+    channel.size = q - channel.text;
+    return channel;
+}
+
+uint32_t
+RxpkWriter::Write(const lgw_pkt_rx_s& p, uint8_t* buf)
+{
+    uint8_t* q = buf;
+
+    /* RAW timestamp, 8-17 useful chars */
+    q = Append(q, "{\"tmst\":");
+    q += WriteUint(q, p.count_us);
+
+    /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
+    const Channel& channel = GetChannel(p);
+    std::memcpy(q, channel.text, channel.size);
+    q += channel.size;
+
+    /* Packet status, 9-10 useful chars */
+    switch (p.status)
+    {
+    case STAT_CRC_OK:
+        q = Append(q, ",\"stat\":1");
+        break;
+    case STAT_CRC_BAD:
+        q = Append(q, ",\"stat\":-1");
+        break;
+    case STAT_NO_CRC:
+        q = Append(q, ",\"stat\":0");
+        break;
+    default:
+        NS_FATAL_ERROR("[up] received packet with unknown status");
+    }
+
+    /* Packet modulation, 13-14 useful chars */
+    if (p.modulation == MOD_LORA)
+    {
+        q = Append(q, ",\"modu\":\"LORA\"");
+
+        /* Lora datarate & bandwidth, 16-19 useful chars */
+        switch (p.datarate)
+        {
+        case DR_LORA_SF7:
+            q = Append(q, ",\"datr\":\"SF7");
+            break;
+        case DR_LORA_SF8:
+            q = Append(q, ",\"datr\":\"SF8");
+            break;
+        case DR_LORA_SF9:
+            q = Append(q, ",\"datr\":\"SF9");
+            break;
+        case DR_LORA_SF10:
+            q = Append(q, ",\"datr\":\"SF10");
+            break;
+        case DR_LORA_SF11:
+            q = Append(q, ",\"datr\":\"SF11");
+            break;
+        case DR_LORA_SF12:
+            q = Append(q, ",\"datr\":\"SF12");
+            break;
+        default:
+            NS_FATAL_ERROR("[up] lora packet with unknown datarate");
+        }
+        switch (p.bandwidth)
+        {
+        case BW_125KHZ:
+            q = Append(q, "BW125\"");
+            break;
+        case BW_250KHZ:
+            q = Append(q, "BW250\"");
+            break;
+        case BW_500KHZ:
+            q = Append(q, "BW500\"");
+            break;
+        default:
+            NS_FATAL_ERROR("[up] lora packet with unknown bandwidth");
+        }
+
+        /* Packet ECC coding rate, 11-13 useful chars */
+        switch (p.coderate)
+        {
+        case CR_LORA_4_5:
+            q = Append(q, ",\"codr\":\"4/5\"");
+            break;
+        case CR_LORA_4_6:
+            q = Append(q, ",\"codr\":\"4/6\"");
+            break;
+        case CR_LORA_4_7:
+            q = Append(q, ",\"codr\":\"4/7\"");
+            break;
+        case CR_LORA_4_8:
+            q = Append(q, ",\"codr\":\"4/8\"");
+            break;
+        case 0: /* treat the CR0 case (mostly false sync) */
+            q = Append(q, ",\"codr\":\"OFF\"");
+            break;
+        default:
+            NS_FATAL_ERROR("[up] lora packet with unknown coderate");
+        }
+
+        /* Lora SNR, 11-13 useful chars */
+        q = Append(q, ",\"lsnr\":");
+        q += WriteFixed(q, p.snr, 1);
+    }
+    else if (p.modulation == MOD_FSK)
+    {
+        q = Append(q, ",\"modu\":\"FSK\"");
+
+        /* FSK datarate, 11-14 useful chars */
+        q = Append(q, ",\"datr\":");
+        q += WriteUint(q, p.datarate);
+    }
+    else
+    {
+        NS_FATAL_ERROR("[up] received packet with unknown modulation");
+    }
+
+    /* Packet RSSI, payload size, 18-23 useful chars */
+    q = Append(q, ",\"rssi\":");
+    q += WriteFixed(q, p.rssi, 0);
+    q = Append(q, ",\"size\":");
+    q += WriteUint(q, p.size);
+
+    /* Packet base64-encoded payload, 14-350 useful chars */
+    q = Append(q, ",\"data\":\"");
+    int j = bin_to_b64(p.payload,
+                       p.size,
+                       (char*)q,
+                       341); /* 255 bytes = 340 chars in b64 + null char */
+    if (j < 0)
+    {
+        NS_FATAL_ERROR("[up] bin_to_b64 failed");
+    }
+    q += j;
+    q = Append(q, "\"}");
+
+    return q - buf;
+}
+
+} // namespace lorawan
+} // namespace ns3
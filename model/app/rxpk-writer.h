@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef RXPK_WRITER_H
+#define RXPK_WRITER_H
+
+#include "ns3/loragw_hal.h"
+
+#include <array>
+#include <cstdint>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+/**
+ * Serializer of the rxpk objects of the PUSH_DATA datagrams of a UdpForwarder.
+ *
+ * The output is byte for byte the one of the snprintf calls of the Semtech
+ * packet forwarder, but numbers are formatted with integer arithmetic and
+ * constant fields are copied from precomputed strings. The channel fields of
+ * a packet only depend on the configuration of the gateway, so they are
+ * formatted once per channel the gateway receives on and kept in a small
+ * cache. Payloads are encoded with bin_to_b64.
+ */
+class RxpkWriter
+{
+  public:
+    /// Room needed in the buffer for an rxpk object, whatever its values [B]
+    static constexpr uint32_t MAX_SIZE = 580;
+
+    RxpkWriter();
+
+    /**
+     * Serialize the metadata and the payload of a packet as an rxpk object,
+     * from its opening to its closing brace.
+     *
+     * \param p The packet.
+     * \param buf Where to write, with room for MAX_SIZE bytes.
+     * \return The number of bytes written.
+     */
+    uint32_t Write(const lgw_pkt_rx_s& p, uint8_t* buf);
+
+    /**
+     * Format an integer as printf's %u.
+     *
+     * \param buf Where to write, with room for 10 bytes.
+     * \param value The integer.
+     * \return The number of bytes written.
+     */
+    static uint32_t WriteUint(uint8_t* buf, uint32_t value);
+
+    /**
+     * Format a float as printf's %.0f or %.1f.
+     *
+     * \param buf Where to write, with room for 48 bytes.
+     * \param value The float.
+     * \param decimals The number of decimals, 0 or 1.
+     * \return The number of bytes written.
+     */
+    static uint32_t WriteFixed(uint8_t* buf, float value, uint32_t decimals);
+
+  private:
+    /**
+     * The channel fields of the packets received on a channel.
+     */
+    struct Channel
+    {
+        uint32_t freqHz;  //!< Center frequency of the IF chain
+        uint8_t ifChain;  //!< IF chain
+        uint8_t rfChain;  //!< RF chain
+        uint8_t size;     //!< Length of the text, 0 if the entry is unused
+        uint8_t text[48]; //!< The chan, rfch and freq fields
+    };
+
+    /**
+     * Get the channel fields of a packet, formatting them on the first packet
+     * of its channel.
+     *
+     * \param p The packet.
+     * \return The cache entry of the channel.
+     */
+    const Channel& GetChannel(const lgw_pkt_rx_s& p);
+
+    static constexpr uint32_t N_CHANNELS = 16; //!< Size of the cache of channels
+
+    std::array<Channel, N_CHANNELS> m_channels; //!< Channels, by frequency
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* RXPK_WRITER_H */
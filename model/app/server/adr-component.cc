@@ -12,6 +12,10 @@
 
 #include "adr-component.h"
 
+#include "ns3/lora-phy.h"
+
+#include <algorithm>
+
 namespace ns3
 {
 namespace lorawan
@@ -77,9 +81,69 @@ AdrComponent::OnReceivedPacket(Ptr<const Packet> packet,
                                Ptr<NetworkStatus> networkStatus)
 {
     NS_LOG_FUNCTION(this->GetTypeId() << packet << networkStatus);
+    OnReceivedPacket(Create<UplinkContext>(packet, Address(), status), networkStatus);
+}
+
+void
+AdrComponent::OnReceivedPacket(Ptr<const UplinkContext> uplink, Ptr<NetworkStatus> networkStatus)
+{
+    NS_LOG_FUNCTION(this->GetTypeId() << uplink->GetPacket() << networkStatus);
+
+    // The SNR of a packet is only known once all gateways received it, that
+    // is when the next packet arrives or before replying to this one.
+    const EndDeviceStatus* status = uplink->GetEndDeviceStatus();
+    DeviceStats& stats = GetDeviceStats(status);
+    uint16_t fCnt = uplink->GetFrameHeader().GetFCnt();
+    if (stats.received && fCnt == stats.fCnt)
+    {
+        // Copy of the last packet forwarded by another gateway
+        return;
+    }
+    CompleteLastPacket(stats, status);
+    stats.fCnt = fCnt;
+    stats.received = true;
+    stats.pending = true;
+}
+
+uint32_t
+AdrComponent::GetHistoryRange() const
+{
+    // The SNR of past packets is in the windows: only the last packet, still
+    // being received, and the next one are needed
+    return 2;
+}
+
+AdrComponent::DeviceStats&
+AdrComponent::GetDeviceStats(const EndDeviceStatus* status)
+{
+    size_t capacity = std::max(historyRange, 1);
+    // Keyed by address rather than by status, which can be freed and its
+    // memory reused by the status of another device
+    uint32_t address = status->m_endDeviceAddress.Get();
+    auto it = m_deviceStats.find(address);
+    if (it == m_deviceStats.end() || it->second.window.GetCapacity() != capacity)
+    {
+        // New device, or HistoryRange changed since its last packet
+        DeviceStats stats{SnrWindow(capacity), 0, false, false};
+        it = m_deviceStats.insert_or_assign(address, stats).first;
+    }
+    return it->second;
+}
 
-    // We will only act just before reply, when all Gateways will have received
-    // the packet, since we need their respective received power.
+void
+AdrComponent::CompleteLastPacket(DeviceStats& stats, const EndDeviceStatus* status)
+{
+    if (!stats.pending)
+    {
+        return;
+    }
+    stats.pending = false;
+    if (auto entry = status->GetReceivedPacketList().Find(stats.fCnt))
+    {
+        double rxPower = GetReceivedPower(entry->second.gwList);
+        NS_LOG_DEBUG("Received power: " << rxPower);
+        stats.window.Push(LoraPhy::RxPowerToSNR(rxPower));
+    }
 }
 
 void
@@ -87,21 +151,17 @@ AdrComponent::BeforeSendingReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus>
 {
     NS_LOG_FUNCTION(this << status << networkStatus);
 
-    Ptr<Packet> myPacket = status->GetLastPacketReceivedFromDevice()->Copy();
-    LorawanMacHeader mHdr;
-    myPacket->RemoveHeader(mHdr);
-    LoraFrameHeader fHdr;
-    fHdr.SetAsUplink();
-    myPacket->RemoveHeader(fHdr);
+    DeviceStats& stats = GetDeviceStats(PeekPointer(status));
+    CompleteLastPacket(stats, PeekPointer(status));
 
     // Execute the ADR algotithm only if the request bit is set
-    if (fHdr.GetAdr())
+    if (status->GetLastUplinkContext()->GetFrameHeader().GetAdr())
     {
-        if (int(status->GetReceivedPacketList().size()) < historyRange)
+        if (int(stats.window.GetSize()) < historyRange)
         {
             NS_LOG_ERROR("Not enough packets received by this device ("
-                         << status->GetReceivedPacketList().size()
-                         << ") for the algorithm to work (need " << historyRange << ")");
+                         << stats.window.GetSize() << ") for the algorithm to work (need "
+                         << historyRange << ")");
         }
         else
         {
@@ -118,7 +178,7 @@ AdrComponent::BeforeSendingReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus>
             uint8_t newTxPower;
 
             // ADR Algorithm
-            AdrImplementation(&newDataRate, &newTxPower, status);
+            AdrImplementation(&newDataRate, &newTxPower, status, stats.window);
 
             // Change the power back to the default if we don't want to change it
             if (!m_toggleTxPower)
@@ -169,20 +229,21 @@ AdrComponent::OnFailedReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> netw
 void
 AdrComponent::AdrImplementation(uint8_t* newDataRate,
                                 uint8_t* newTxPower,
-                                Ptr<EndDeviceStatus> status)
+                                Ptr<EndDeviceStatus> status,
+                                const SnrWindow& window)
 {
     // Compute the maximum or median SNR, based on the boolean value historyAveraging
     double m_SNR = 0;
     switch (historyAveraging)
     {
     case AdrComponent::AVERAGE:
-        m_SNR = GetAverageSNR(status->GetReceivedPacketList(), historyRange);
+        m_SNR = window.GetAverage();
         break;
     case AdrComponent::MAXIMUM:
-        m_SNR = GetMaxSNR(status->GetReceivedPacketList(), historyRange);
+        m_SNR = window.GetMax();
         break;
     case AdrComponent::MINIMUM:
-        m_SNR = GetMinSNR(status->GetReceivedPacketList(), historyRange);
+        m_SNR = window.GetMin();
     }
 
     NS_LOG_DEBUG("m_SNR = " << m_SNR);
@@ -193,7 +254,7 @@ AdrComponent::AdrImplementation(uint8_t* newDataRate,
     NS_LOG_DEBUG("DR = " << (unsigned)currDataRate);
 
     // Get the device data rate and use it to get the SNR demodulation treshold
-    double req_SNR = treshold[currDataRate];
+    double req_SNR = LoraPhy::GetSnrThreshold(12 - currDataRate);
 
     NS_LOG_DEBUG("Required SNR = " << req_SNR);
 
@@ -248,7 +309,7 @@ AdrComponent::AdrImplementation(uint8_t* newDataRate,
 
 // Get the maximum received power (it considers the values in dB!)
 double
-AdrComponent::GetMinTxFromGateways(EndDeviceStatus::GatewayList gwList)
+AdrComponent::GetMinTxFromGateways(const EndDeviceStatus::GatewayList& gwList)
 {
     auto it = gwList.begin();
     double min = it->second.rxPower;
@@ -266,7 +327,7 @@ AdrComponent::GetMinTxFromGateways(EndDeviceStatus::GatewayList gwList)
 
 // Get the maximum received power (it considers the values in dB!)
 double
-AdrComponent::GetMaxTxFromGateways(EndDeviceStatus::GatewayList gwList)
+AdrComponent::GetMaxTxFromGateways(const EndDeviceStatus::GatewayList& gwList)
 {
     auto it = gwList.begin();
     double max = it->second.rxPower;
@@ -284,7 +345,7 @@ AdrComponent::GetMaxTxFromGateways(EndDeviceStatus::GatewayList gwList)
 
 // Get the maximum received power
 double
-AdrComponent::GetAverageTxFromGateways(EndDeviceStatus::GatewayList gwList)
+AdrComponent::GetAverageTxFromGateways(const EndDeviceStatus::GatewayList& gwList)
 {
     double sum = 0;
 
@@ -302,7 +363,7 @@ AdrComponent::GetAverageTxFromGateways(EndDeviceStatus::GatewayList gwList)
 }
 
 double
-AdrComponent::GetReceivedPower(EndDeviceStatus::GatewayList gwList)
+AdrComponent::GetReceivedPower(const EndDeviceStatus::GatewayList& gwList)
 {
     switch (tpAveraging)
     {
@@ -317,84 +378,100 @@ AdrComponent::GetReceivedPower(EndDeviceStatus::GatewayList gwList)
     }
 }
 
-// TODO Make this more elegant
-double
-AdrComponent::GetMinSNR(const EndDeviceStatus::ReceivedPacketList& packetList, int historyRange)
+AdrComponent::SnrWindow::SnrWindow(size_t capacity)
+    : m_values(capacity),
+      m_count(0),
+      m_sum(0)
 {
-    double m_SNR;
-
-    // Take elements from the list starting at the end
-    auto it = packetList.rbegin();
-    double min = LoraPhy::RxPowerToSNR(GetReceivedPower(it->second.gwList));
+    m_min.positions.resize(capacity);
+    m_max.positions.resize(capacity);
+}
 
-    for (int i = 0; i < historyRange; i++, it++)
+void
+AdrComponent::SnrWindow::Push(double snr)
+{
+    size_t capacity = m_values.size();
+    if (m_count >= capacity)
     {
-        m_SNR = LoraPhy::RxPowerToSNR(GetReceivedPower(it->second.gwList));
-
-        NS_LOG_DEBUG("Received power: " << GetReceivedPower(it->second.gwList));
-        NS_LOG_DEBUG("m_SNR = " << m_SNR);
-
-        if (m_SNR < min)
+        // The oldest value leaves the window, and the queues if it is there
+        uint64_t oldest = m_count - capacity;
+        m_sum -= m_values[oldest % capacity];
+        for (Candidates* queue : {&m_min, &m_max})
+        {
+            if (queue->size > 0 && queue->positions[queue->head] == oldest)
+            {
+                queue->head = (queue->head + 1) % capacity;
+                queue->size--;
+            }
+        }
+    }
+    m_values[m_count % capacity] = snr;
+    m_sum += snr;
+    PushCandidate(m_min, false);
+    PushCandidate(m_max, true);
+    m_count++;
+    if (m_count % capacity == 0)
+    {
+        // Keep rounding errors of the running sum from building up
+        m_sum = 0;
+        for (double value : m_values)
         {
-            min = m_SNR;
+            m_sum += value;
         }
     }
-
-    NS_LOG_DEBUG("SNR (min) = " << min);
-
-    return min;
 }
 
-double
-AdrComponent::GetMaxSNR(const EndDeviceStatus::ReceivedPacketList& packetList, int historyRange)
+void
+AdrComponent::SnrWindow::PushCandidate(Candidates& queue, bool isMax)
 {
-    double m_SNR;
-
-    // Take elements from the list starting at the end
-    auto it = packetList.rbegin();
-    double max = LoraPhy::RxPowerToSNR(GetReceivedPower(it->second.gwList));
-
-    for (int i = 0; i < historyRange; i++, it++)
+    size_t capacity = m_values.size();
+    double snr = m_values[m_count % capacity];
+    // Older values no better than the new one can no longer be the extremum
+    while (queue.size > 0)
     {
-        m_SNR = LoraPhy::RxPowerToSNR(GetReceivedPower(it->second.gwList));
-
-        NS_LOG_DEBUG("Received power: " << GetReceivedPower(it->second.gwList));
-        NS_LOG_DEBUG("m_SNR = " << m_SNR);
-
-        if (m_SNR > max)
+        double newest = m_values[queue.positions[(queue.head + queue.size - 1) % capacity] %
+                                 capacity];
+        if (isMax ? newest > snr : newest < snr)
         {
-            max = m_SNR;
+            break;
         }
+        queue.size--;
     }
+    queue.positions[(queue.head + queue.size) % capacity] = m_count;
+    queue.size++;
+}
 
-    NS_LOG_DEBUG("SNR (max) = " << max);
+size_t
+AdrComponent::SnrWindow::GetSize() const
+{
+    return std::min<uint64_t>(m_count, m_values.size());
+}
 
-    return max;
+size_t
+AdrComponent::SnrWindow::GetCapacity() const
+{
+    return m_values.size();
 }
 
 double
-AdrComponent::GetAverageSNR(const EndDeviceStatus::ReceivedPacketList& packetList, int historyRange)
+AdrComponent::SnrWindow::GetMin() const
 {
-    double sum = 0;
-    double m_SNR;
-
-    // Take elements from the list starting at the end
-    auto it = packetList.rbegin();
-    for (int i = 0; i < historyRange; i++, it++)
-    {
-        m_SNR = LoraPhy::RxPowerToSNR(GetReceivedPower(it->second.gwList));
-
-        NS_LOG_DEBUG("Received power: " << GetReceivedPower(it->second.gwList));
-        NS_LOG_DEBUG("m_SNR = " << m_SNR);
-
-        sum += m_SNR;
-    }
-
-    double average = sum / historyRange;
+    NS_ASSERT(m_min.size > 0);
+    return m_values[m_min.positions[m_min.head] % m_values.size()];
+}
 
-    NS_LOG_DEBUG("SNR (average) = " << average);
+double
+AdrComponent::SnrWindow::GetMax() const
+{
+    NS_ASSERT(m_max.size > 0);
+    return m_values[m_max.positions[m_max.head] % m_values.size()];
+}
 
-    return average;
+double
+AdrComponent::SnrWindow::GetAverage() const
+{
+    NS_ASSERT(m_count > 0);
+    return m_sum / GetSize();
 }
 
 int
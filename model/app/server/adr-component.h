@@ -20,6 +20,9 @@
 #include "ns3/object.h"
 #include "ns3/packet.h"
 
+#include <unordered_map>
+#include <vector>
+
 namespace ns3
 {
 namespace lorawan
@@ -50,29 +53,124 @@ class AdrComponent : public NetworkControllerComponent
                           Ptr<EndDeviceStatus> status,
                           Ptr<NetworkStatus> networkStatus) override;
 
+    void OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                          Ptr<NetworkStatus> networkStatus) override;
+
     void BeforeSendingReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override;
 
     void OnFailedReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override;
 
+    uint32_t GetHistoryRange() const override;
+
+    /**
+     * Sliding window over the SNR of the last packets of a device.
+     *
+     * Along with the values, the window keeps their running sum and, for the
+     * minimum and the maximum, a monotonic queue of the values that can still
+     * become the extremum once older ones leave. All statistics are then read
+     * in constant time, and no memory is allocated after construction.
+     */
+    class SnrWindow
+    {
+      public:
+        /**
+         * \param capacity The number of packets in a full window.
+         */
+        SnrWindow(size_t capacity);
+
+        /**
+         * Add the SNR of a new packet, evicting the oldest one of a full window.
+         *
+         * \param snr The SNR [dB].
+         */
+        void Push(double snr);
+
+        /// \return The number of packets in the window.
+        size_t GetSize() const;
+        /// \return The number of packets in a full window.
+        size_t GetCapacity() const;
+        /// \return The lowest SNR of the window [dB].
+        double GetMin() const;
+        /// \return The highest SNR of the window [dB].
+        double GetMax() const;
+        /// \return The average SNR of the window [dB].
+        double GetAverage() const;
+
+      private:
+        /**
+         * Queue of the positions of candidate extrema, ordered by age, stored
+         * in a ring of the capacity of the window.
+         */
+        struct Candidates
+        {
+            std::vector<uint64_t> positions; //!< Ring of positions in the stream of values
+            size_t head = 0;                 //!< Slot of the oldest candidate
+            size_t size = 0;                 //!< Number of candidates
+        };
+
+        /**
+         * Add the newest value to a queue of candidates, dropping the ones it
+         * dominates.
+         *
+         * \param queue The queue.
+         * \param isMax Whether the queue tracks the maximum, or the minimum.
+         */
+        void PushCandidate(Candidates& queue, bool isMax);
+
+        std::vector<double> m_values; //!< Ring of the values of the window
+        uint64_t m_count;             //!< Number of values pushed so far
+        double m_sum;                 //!< Sum of the values of the window
+        Candidates m_min;             //!< Candidates for the minimum
+        Candidates m_max;             //!< Candidates for the maximum
+    };
+
   private:
-    void AdrImplementation(uint8_t* newDataRate, uint8_t* newTxPower, Ptr<EndDeviceStatus> status);
+    /**
+     * What the component knows about the SNR of a device.
+     */
+    struct DeviceStats
+    {
+        SnrWindow window; //!< SNR of the last packets
+        uint16_t fCnt;    //!< Frame counter of the last packet
+        bool received;    //!< Whether a packet was received
+        bool pending;     //!< Whether the last packet still has to enter the window
+    };
 
-    double GetMinTxFromGateways(EndDeviceStatus::GatewayList gwList);
+    /**
+     * Get the statistics of a device, creating them if needed.
+     *
+     * \param status The status of the device.
+     * \return The statistics.
+     */
+    DeviceStats& GetDeviceStats(const EndDeviceStatus* status);
 
-    double GetMaxTxFromGateways(EndDeviceStatus::GatewayList gwList);
+    /**
+     * Combine the receptions of the last packet of a device, once all
+     * gateways forwarded it, and add its SNR to the window.
+     *
+     * \param stats The statistics of the device.
+     * \param status The status of the device.
+     */
+    void CompleteLastPacket(DeviceStats& stats, const EndDeviceStatus* status);
 
-    double GetAverageTxFromGateways(EndDeviceStatus::GatewayList gwList);
+    void AdrImplementation(uint8_t* newDataRate,
+                           uint8_t* newTxPower,
+                           Ptr<EndDeviceStatus> status,
+                           const SnrWindow& window);
 
-    double GetReceivedPower(EndDeviceStatus::GatewayList gwList);
+    double GetMinTxFromGateways(const EndDeviceStatus::GatewayList& gwList);
 
-    double GetMinSNR(const EndDeviceStatus::ReceivedPacketList& packetList, int historyRange);
+    double GetMaxTxFromGateways(const EndDeviceStatus::GatewayList& gwList);
 
-    double GetMaxSNR(const EndDeviceStatus::ReceivedPacketList& packetList, int historyRange);
+    double GetAverageTxFromGateways(const EndDeviceStatus::GatewayList& gwList);
 
-    double GetAverageSNR(const EndDeviceStatus::ReceivedPacketList& packetList, int historyRange);
+    double GetReceivedPower(const EndDeviceStatus::GatewayList& gwList);
 
     int GetTxPowerIndex(int txPower);
 
+    // SNR statistics of each device, by device address
+    std::unordered_map<uint32_t, DeviceStats> m_deviceStats;
+
     // TX power from gateways policy
     enum CombiningMethod tpAveraging;
 
@@ -91,10 +189,6 @@ class AdrComponent : public NetworkControllerComponent
     // Maximum transmission power (dBm e.r.p) (Europe)
     const int max_transmissionPower = 14;
 
-    // Vector containing the required SNR for the 6 allowed SF levels
-    // ranging from 7 to 12 (the SNR values are in dB).
-    double treshold[6] = {-20.0, -17.5, -15.0, -12.5, -10.0, -7.5};
-
     // Regulate power in the ADR algorithm
     bool m_toggleTxPower;
 
@@ -65,6 +65,221 @@ EndDeviceStatus::~EndDeviceStatus()
     NS_LOG_FUNCTION(this);
 }
 
+EndDeviceStatus::ReceivedPacketList::const_iterator::const_iterator(const ReceivedPacketList* list,
+                                                                   size_t pos)
+    : m_list(list),
+      m_pos(pos)
+{
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator::reference
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator*() const
+{
+    return m_list->m_slots[m_list->GetSlot(m_pos)];
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator::pointer
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator->() const
+{
+    return &m_list->m_slots[m_list->GetSlot(m_pos)];
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator&
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator++()
+{
+    ++m_pos;
+    return *this;
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator&
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator--()
+{
+    --m_pos;
+    return *this;
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator++(int)
+{
+    const_iterator it = *this;
+    ++m_pos;
+    return it;
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator--(int)
+{
+    const_iterator it = *this;
+    --m_pos;
+    return it;
+}
+
+bool
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator==(const const_iterator& other) const
+{
+    return m_list == other.m_list && m_pos == other.m_pos;
+}
+
+bool
+EndDeviceStatus::ReceivedPacketList::const_iterator::operator!=(const const_iterator& other) const
+{
+    return !(*this == other);
+}
+
+EndDeviceStatus::ReceivedPacketList::ReceivedPacketList(size_t capacity)
+    : m_first(0),
+      m_size(0)
+{
+    SetCapacity(capacity);
+}
+
+void
+EndDeviceStatus::ReceivedPacketList::SetCapacity(size_t capacity)
+{
+    NS_ASSERT_MSG(capacity >= 1 && capacity <= 0x7fff, "Invalid history size " << capacity);
+    if (capacity == m_slots.size())
+    {
+        return;
+    }
+    // Keep the newest entries, in order
+    std::vector<value_type> entries;
+    size_t kept = std::min(m_size, capacity);
+    entries.reserve(kept);
+    for (size_t pos = m_size - kept; pos < m_size; ++pos)
+    {
+        entries.push_back(std::move(m_slots[GetSlot(pos)]));
+    }
+    size_t buckets = 1;
+    while (buckets < 2 * capacity)
+    {
+        buckets <<= 1;
+    }
+    m_slots.assign(capacity, value_type());
+    m_next.assign(capacity, 0);
+    m_index.assign(buckets, 0);
+    m_first = 0;
+    m_size = 0;
+    for (auto& entry : entries)
+    {
+        emplace_back(entry.first, entry.second);
+    }
+}
+
+size_t
+EndDeviceStatus::ReceivedPacketList::GetCapacity() const
+{
+    return m_slots.size();
+}
+
+size_t
+EndDeviceStatus::ReceivedPacketList::size() const
+{
+    return m_size;
+}
+
+bool
+EndDeviceStatus::ReceivedPacketList::empty() const
+{
+    return m_size == 0;
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator
+EndDeviceStatus::ReceivedPacketList::begin() const
+{
+    return const_iterator(this, 0);
+}
+
+EndDeviceStatus::ReceivedPacketList::const_iterator
+EndDeviceStatus::ReceivedPacketList::end() const
+{
+    return const_iterator(this, m_size);
+}
+
+EndDeviceStatus::ReceivedPacketList::const_reverse_iterator
+EndDeviceStatus::ReceivedPacketList::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+EndDeviceStatus::ReceivedPacketList::const_reverse_iterator
+EndDeviceStatus::ReceivedPacketList::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+const EndDeviceStatus::ReceivedPacketList::value_type&
+EndDeviceStatus::ReceivedPacketList::back() const
+{
+    NS_ASSERT_MSG(m_size > 0, "Empty history");
+    return m_slots[GetSlot(m_size - 1)];
+}
+
+EndDeviceStatus::ReceivedPacketList::value_type&
+EndDeviceStatus::ReceivedPacketList::emplace_back(Ptr<const Packet> packet,
+                                                  const ReceivedPacketInfo& info)
+{
+    size_t mask = m_index.size() - 1;
+    size_t slot;
+    if (m_size == m_slots.size())
+    {
+        // Evict the oldest entry, which is the last of its bucket
+        slot = m_first;
+        uint16_t* link = &m_index[m_slots[slot].second.fCnt & mask];
+        while (*link != slot + 1)
+        {
+            link = &m_next[*link - 1];
+        }
+        *link = 0;
+        m_first = (m_first + 1) % m_slots.size();
+    }
+    else
+    {
+        slot = GetSlot(m_size);
+        ++m_size;
+    }
+    m_slots[slot] = value_type(packet, info);
+    uint16_t& bucket = m_index[info.fCnt & mask];
+    m_next[slot] = bucket;
+    bucket = slot + 1;
+    return m_slots[slot];
+}
+
+EndDeviceStatus::ReceivedPacketList::value_type*
+EndDeviceStatus::ReceivedPacketList::Find(uint16_t fCnt)
+{
+    return const_cast<value_type*>(static_cast<const ReceivedPacketList*>(this)->Find(fCnt));
+}
+
+const EndDeviceStatus::ReceivedPacketList::value_type*
+EndDeviceStatus::ReceivedPacketList::Find(uint16_t fCnt) const
+{
+    // Newest entries come first in their bucket
+    for (uint16_t entry = m_index[fCnt & (m_index.size() - 1)]; entry; entry = m_next[entry - 1])
+    {
+        if (m_slots[entry - 1].second.fCnt == fCnt)
+        {
+            return &m_slots[entry - 1];
+        }
+    }
+    return nullptr;
+}
+
+void
+EndDeviceStatus::ReceivedPacketList::clear()
+{
+    std::fill(m_slots.begin(), m_slots.end(), value_type());
+    std::fill(m_next.begin(), m_next.end(), 0);
+    std::fill(m_index.begin(), m_index.end(), 0);
+    m_first = 0;
+    m_size = 0;
+}
+
+size_t
+EndDeviceStatus::ReceivedPacketList::GetSlot(size_t pos) const
+{
+    return (m_first + pos) % m_slots.size();
+}
+
 ///////////////
 //  Getters  //
 ///////////////
@@ -174,6 +389,37 @@ EndDeviceStatus::GetMac()
     return m_mac;
 }
 
+void
+EndDeviceStatus::SetSessionKeys(const std::array<uint8_t, 16>& fNwkSIntKey,
+                                const std::array<uint8_t, 16>& nwkSEncKey,
+                                const std::array<uint8_t, 16>& appSKey)
+{
+    NS_LOG_FUNCTION(this);
+    std::copy(fNwkSIntKey.begin(), fNwkSIntKey.end(), m_rawSessionKeys.begin());
+    std::copy(nwkSEncKey.begin(), nwkSEncKey.end(), m_rawSessionKeys.begin() + 16);
+    std::copy(appSKey.begin(), appSKey.end(), m_rawSessionKeys.begin() + 32);
+    m_hasSessionKeys = true;
+    m_sessionKeys.reset();
+}
+
+const EndDeviceStatus::SessionKeys*
+EndDeviceStatus::GetSessionKeys()
+{
+    if (!m_hasSessionKeys)
+    {
+        return nullptr;
+    }
+    if (!m_sessionKeys)
+    {
+        m_sessionKeys = std::make_unique<SessionKeys>();
+        aes_set_key(m_rawSessionKeys.data(), 16, &m_sessionKeys->fNwkSIntKey);
+        AES_CMAC_Subkeys(&m_sessionKeys->fNwkSIntKey, m_sessionKeys->k1, m_sessionKeys->k2);
+        aes_set_key(m_rawSessionKeys.data() + 16, 16, &m_sessionKeys->nwkSEncKey);
+        aes_set_key(m_rawSessionKeys.data() + 32, 16, &m_sessionKeys->appSKey);
+    }
+    return m_sessionKeys.get();
+}
+
 const EndDeviceStatus::ReceivedPacketList&
 EndDeviceStatus::GetReceivedPacketList() const
 {
@@ -181,6 +427,13 @@ EndDeviceStatus::GetReceivedPacketList() const
     return m_receivedPacketList;
 }
 
+void
+EndDeviceStatus::SetReceivedPacketHistorySize(size_t packets)
+{
+    NS_LOG_FUNCTION(this << packets);
+    m_receivedPacketList.SetCapacity(packets);
+}
+
 void
 EndDeviceStatus::SetFirstReceiveWindowDataRate(uint8_t dr)
 {
@@ -238,83 +491,82 @@ void
 EndDeviceStatus::InsertReceivedPacket(Ptr<const Packet> receivedPacket, const Address& gwAddress)
 {
     NS_LOG_FUNCTION_NOARGS();
+    uint32_t gwId = UplinkContext::UNKNOWN_GATEWAY;
+    if (m_gatewayIds)
+    {
+        auto it = m_gatewayIds->find(gwAddress);
+        if (it != m_gatewayIds->end())
+        {
+            gwId = it->second;
+        }
+    }
+    InsertReceivedPacket(Create<UplinkContext>(receivedPacket, gwAddress, this, gwId));
+}
 
-    // Create a copy of the packet
-    Ptr<Packet> myPacket = receivedPacket->Copy();
-
-    // Extract the headers
-    LorawanMacHeader mHdr;
-    myPacket->RemoveHeader(mHdr);
-
-    LoraFrameHeader fHdr;
-    fHdr.SetAsUplink();
-    myPacket->RemoveHeader(fHdr);
+void
+EndDeviceStatus::InsertReceivedPacket(Ptr<const UplinkContext> uplink)
+{
+    NS_LOG_FUNCTION_NOARGS();
 
     // Update current parameters
-    LoraTag tag;
-    myPacket->RemovePacketTag(tag);
+    const LoraTag& tag = uplink->GetTag();
     SetFirstReceiveWindowDataRate(tag.GetDataRate());
     SetFirstReceiveWindowFrequency(tag.GetFrequency());
 
-    // Update Information on the received packet
-    ReceivedPacketInfo info;
-    info.sf = tag.GetTxParameters().sf;
-    info.frequency = tag.GetFrequency();
-
+    uint16_t fCnt = uplink->GetFrameHeader().GetFCnt();
+    const Address& gwAddress = uplink->GetGatewayAddress();
     double rcvPower = tag.GetReceivePower();
 
     // Perform insertion in list, also checking that the packet isn't already in
     // the list (it could have been received by another GW already)
-
-    // Start searching from the end
-    auto it = m_receivedPacketList.rbegin();
-    for (; it != m_receivedPacketList.rend(); it++)
+    if (auto entry = m_receivedPacketList.Find(fCnt))
     {
-        // Get the frame counter of the current packet to compare it with the
-        // newly received one
-        Ptr<Packet> packetCopy = ((*it).first)->Copy();
-        LorawanMacHeader currentMacHdr;
-        packetCopy->RemoveHeader(currentMacHdr);
-        LoraFrameHeader currentFrameHdr;
-        fHdr.SetAsUplink();
-        packetCopy->RemoveHeader(currentFrameHdr);
-
-        NS_LOG_DEBUG("Received packet's frame counter: " << unsigned(fHdr.GetFCnt())
-                                                         << "\nCurrent packet's frame counter: "
-                                                         << unsigned(currentFrameHdr.GetFCnt()));
-
-        if (fHdr.GetFCnt() == currentFrameHdr.GetFCnt())
-        {
-            NS_LOG_INFO("Packet was already received by another gateway");
-
-            // This packet had already been received from another gateway:
-            // add this gateway's reception information.
-            GatewayList& gwList = it->second.gwList;
-
-            PacketInfoPerGw gwInfo;
-            gwInfo.receivedTime = tag.GetReceptionTime();
-            gwInfo.rxPower = rcvPower;
-            gwInfo.gwAddress = gwAddress;
-            gwList.insert(std::pair<Address, PacketInfoPerGw>(gwAddress, gwInfo));
+        NS_LOG_INFO("Packet was already received by another gateway");
 
-            NS_LOG_DEBUG("Size of gateway list: " << gwList.size());
+        // This packet had already been received from another gateway:
+        // add this gateway's reception information.
+        GatewayList& gwList = entry->second.gwList;
 
-            break; // Exit from the cycle
+        PacketInfoPerGw gwInfo;
+        gwInfo.receivedTime = tag.GetReceptionTime();
+        gwInfo.rxPower = rcvPower;
+        gwInfo.gwAddress = gwAddress;
+        bool inserted = gwList.insert({gwAddress, gwInfo}).second;
+        if (inserted && entry == &m_receivedPacketList.back())
+        {
+            AddGatewayCandidate(uplink->GetGatewayId(), rcvPower);
         }
+
+        NS_LOG_DEBUG("Size of gateway list: " << gwList.size());
     }
-    if (it == m_receivedPacketList.rend())
+    else
     {
         NS_LOG_INFO("Packet was received for the first time");
+        // Update Information on the received packet
+        ReceivedPacketInfo info;
+        info.sf = tag.GetTxParameters().sf;
+        info.frequency = tag.GetFrequency();
+        info.fCnt = fCnt;
         PacketInfoPerGw gwInfo;
         gwInfo.receivedTime = tag.GetReceptionTime();
         gwInfo.rxPower = rcvPower;
         gwInfo.gwAddress = gwAddress;
         info.gwList.insert(std::pair<Address, PacketInfoPerGw>(gwAddress, gwInfo));
-        m_receivedPacketList.emplace_back(receivedPacket, info);
+        m_receivedPacketList.emplace_back(uplink->GetPacket(), info);
+        m_lastUplink = uplink;
+        m_nGwCandidates = 0;
+        m_allGwCandidates = true;
+        AddGatewayCandidate(uplink->GetGatewayId(), rcvPower);
     }
     NS_LOG_DEBUG(*this);
 }
 
+Ptr<const UplinkContext>
+EndDeviceStatus::GetLastUplinkContext() const
+{
+    return m_lastUplink;
+}
+
 EndDeviceStatus::ReceivedPacketInfo
 EndDeviceStatus::GetLastReceivedPacketInfo()
 {
@@ -362,7 +614,7 @@ EndDeviceStatus::AddMACCommand(Ptr<MacCommand> macCommand)
 bool
 EndDeviceStatus::HasReceiveWindowOpportunityScheduled()
 {
-    return m_receiveWindowEvent.IsPending();
+    return m_receiveWindowEvent.IsPending() || m_receiveWindowTimer.IsPending();
 }
 
 void
@@ -371,31 +623,73 @@ EndDeviceStatus::SetReceiveWindowOpportunity(EventId event)
     m_receiveWindowEvent = event;
 }
 
+void
+EndDeviceStatus::SetReceiveWindowOpportunity(ReceiveWindowWheel::Timer timer)
+{
+    m_receiveWindowTimer = timer;
+}
+
 void
 EndDeviceStatus::RemoveReceiveWindowOpportunity()
 {
     Simulator::Cancel(m_receiveWindowEvent);
+    m_receiveWindowTimer.Cancel();
+}
+
+size_t
+EndDeviceStatus::GetNGatewayCandidates() const
+{
+    return m_nGwCandidates;
 }
 
-std::map<double, Address>
-EndDeviceStatus::GetPowerGatewayMap()
+const EndDeviceStatus::GatewayCandidate&
+EndDeviceStatus::GetGatewayCandidate(size_t i) const
 {
-    // Create a map of the gateways
-    // Key: received power
-    // Value: address of the corresponding gateway
-    ReceivedPacketInfo info = m_receivedPacketList.back().second;
-    GatewayList gwList = info.gwList;
+    NS_ASSERT(i < m_nGwCandidates);
+    return m_gwCandidates[i];
+}
 
-    std::map<double, Address> gatewayPowers;
+bool
+EndDeviceStatus::HasAllGatewayCandidates() const
+{
+    return m_allGwCandidates;
+}
 
-    for (auto it = gwList.begin(); it != gwList.end(); it++)
+void
+EndDeviceStatus::SetGatewayIds(const std::map<Address, uint32_t>* gatewayIds)
+{
+    m_gatewayIds = gatewayIds;
+}
+
+void
+EndDeviceStatus::AddGatewayCandidate(uint32_t gwId, double rxPower)
+{
+    if (gwId == UplinkContext::UNKNOWN_GATEWAY)
     {
-        Address currentGwAddress = (*it).first;
-        double currentRxPower = (*it).second.rxPower;
-        gatewayPowers.insert(std::pair<double, Address>(currentRxPower, currentGwAddress));
+        m_allGwCandidates = false;
+        return;
     }
-
-    return gatewayPowers;
+    // Insertion sort, after the gateways with the same power
+    size_t pos = 0;
+    while (pos < m_nGwCandidates && m_gwCandidates[pos].rxPower >= rxPower)
+    {
+        ++pos;
+    }
+    if (pos == MAX_GATEWAY_CANDIDATES)
+    {
+        m_allGwCandidates = false;
+        return;
+    }
+    if (m_nGwCandidates == MAX_GATEWAY_CANDIDATES)
+    {
+        m_allGwCandidates = false;
+    }
+    m_nGwCandidates = std::min(m_nGwCandidates + 1, MAX_GATEWAY_CANDIDATES);
+    for (size_t i = m_nGwCandidates - 1; i > pos; --i)
+    {
+        m_gwCandidates[i] = m_gwCandidates[i - 1];
+    }
+    m_gwCandidates[pos] = {gwId, rxPower};
 }
 
 void
@@ -404,6 +698,7 @@ EndDeviceStatus::DoDispose()
     NS_LOG_FUNCTION(this);
     m_receiveWindowEvent.Cancel();
     m_receivedPacketList.clear();
+    m_lastUplink = nullptr;
     m_mac = nullptr;
     Object::DoDispose();
 }
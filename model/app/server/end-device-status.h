@@ -14,14 +14,22 @@
 #ifndef END_DEVICE_STATUS_H
 #define END_DEVICE_STATUS_H
 
+#include "receive-window-wheel.h"
+#include "uplink-context.h"
+
 #include "ns3/class-a-end-device-lorawan-mac.h"
+#include "ns3/cmac.h"
 #include "ns3/lora-device-address.h"
 #include "ns3/lora-frame-header.h"
 #include "ns3/lorawan-mac-header.h"
 #include "ns3/object.h"
 #include "ns3/pointer.h"
 
+#include <array>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <vector>
 
 namespace ns3
 {
@@ -163,9 +171,191 @@ class EndDeviceStatus : public Object
         GatewayList gwList; //!< List of gateways that received this packet.
         uint8_t sf;
         double frequency;
+        uint16_t fCnt = 0; //!< Frame counter of the packet.
+    };
+
+    /**
+     * History of the last packets received from a device, oldest first.
+     *
+     * The history is a ring buffer of fixed capacity: once full, adding a
+     * packet evicts the oldest one. Entries are indexed by frame counter in
+     * a hash table chained through the slots, with at least twice as many
+     * buckets as entries, so that the copies of a packet forwarded by several
+     * gateways are found in constant time.
+     */
+    class ReceivedPacketList
+    {
+      public:
+        /// A packet and the information about its receptions
+        typedef std::pair<Ptr<const Packet>, ReceivedPacketInfo> value_type;
+
+        /**
+         * Iterator over the history, from the oldest packet to the newest.
+         */
+        class const_iterator
+        {
+          public:
+            typedef std::bidirectional_iterator_tag iterator_category; //!< Iterator category
+            typedef ReceivedPacketList::value_type value_type;         //!< Value type
+            typedef std::ptrdiff_t difference_type;                    //!< Difference type
+            typedef const value_type* pointer;                         //!< Pointer type
+            typedef const value_type& reference;                       //!< Reference type
+
+            const_iterator() = default;
+
+            /**
+             * Create an iterator.
+             *
+             * \param list The history.
+             * \param pos The position in the history, 0 being the oldest packet.
+             */
+            const_iterator(const ReceivedPacketList* list, size_t pos);
+
+            reference operator*() const;  //!< \return The entry.
+            pointer operator->() const;   //!< \return The entry.
+            const_iterator& operator++(); //!< \return The next entry.
+            const_iterator& operator--(); //!< \return The previous entry.
+
+            /**
+             * Move to the next entry.
+             * \return The iterator before the move.
+             */
+            const_iterator operator++(int);
+
+            /**
+             * Move to the previous entry.
+             * \return The iterator before the move.
+             */
+            const_iterator operator--(int);
+
+            /**
+             * \param other Another iterator.
+             * \return Whether both iterators point to the same entry.
+             */
+            bool operator==(const const_iterator& other) const;
+
+            /**
+             * \param other Another iterator.
+             * \return Whether the iterators point to different entries.
+             */
+            bool operator!=(const const_iterator& other) const;
+
+          private:
+            const ReceivedPacketList* m_list = nullptr; //!< The history
+            size_t m_pos = 0;                           //!< The position in the history
+        };
+
+        /// Iterator from the newest packet to the oldest
+        typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+        /**
+         * Create an empty history.
+         *
+         * \param capacity The number of packets kept.
+         */
+        ReceivedPacketList(size_t capacity = 1);
+
+        /**
+         * Change the number of packets kept, dropping the oldest ones if
+         * needed.
+         *
+         * \param capacity The number of packets kept, at least 1.
+         */
+        void SetCapacity(size_t capacity);
+
+        /**
+         * \return The number of packets kept.
+         */
+        size_t GetCapacity() const;
+
+        /**
+         * \return The number of packets in the history.
+         */
+        size_t size() const;
+
+        /**
+         * \return Whether the history is empty.
+         */
+        bool empty() const;
+
+        const_iterator begin() const;          //!< \return The oldest entry.
+        const_iterator end() const;            //!< \return Past the newest entry.
+        const_reverse_iterator rbegin() const; //!< \return The newest entry.
+        const_reverse_iterator rend() const;   //!< \return Before the oldest entry.
+
+        /**
+         * \return The newest entry. The history must not be empty.
+         */
+        const value_type& back() const;
+
+        /**
+         * Add a packet as the newest entry, evicting the oldest one if the
+         * history is full.
+         *
+         * \param packet The packet.
+         * \param info The information about its receptions.
+         * \return The new entry.
+         */
+        value_type& emplace_back(Ptr<const Packet> packet, const ReceivedPacketInfo& info);
+
+        /**
+         * Find the entry of a frame counter.
+         *
+         * \param fCnt The frame counter.
+         * \return The entry, or nullptr if it is not in the history.
+         */
+        value_type* Find(uint16_t fCnt);
+
+        /**
+         * Find the entry of a frame counter.
+         *
+         * \param fCnt The frame counter.
+         * \return The entry, or nullptr if it is not in the history.
+         */
+        const value_type* Find(uint16_t fCnt) const;
+
+        /**
+         * Remove all entries.
+         */
+        void clear();
+
+      private:
+        /**
+         * \param pos A position in the history, 0 being the oldest packet.
+         * \return The index of its slot.
+         */
+        size_t GetSlot(size_t pos) const;
+
+        std::vector<value_type> m_slots; //!< Ring of entries
+        std::vector<uint16_t> m_next;    //!< Slot + 1 of the next older entry of the bucket, or 0
+        std::vector<uint16_t> m_index;   //!< Slot + 1 of the newest entry per FCnt bucket, or 0
+        size_t m_first;                  //!< Slot of the oldest entry
+        size_t m_size;                   //!< Number of entries
     };
 
-    typedef std::list<std::pair<Ptr<const Packet>, ReceivedPacketInfo>> ReceivedPacketList;
+    /**
+     * A gateway that can forward a reply to the device.
+     */
+    struct GatewayCandidate
+    {
+        uint32_t gwId;  //!< Index of the gateway in the NetworkStatus
+        double rxPower; //!< Reception power of the last packet at the gateway
+    };
+
+    /// Number of gateways kept as candidates to forward replies
+    static constexpr size_t MAX_GATEWAY_CANDIDATES = 8;
+
+    /**
+     * The session keys of the device, expanded for use by the AES primitives.
+     */
+    struct SessionKeys
+    {
+        aes_context fNwkSIntKey; //!< Key schedule of the forwarding network session integrity key
+        uint8_t k1[16];          //!< First CMAC subkey of fNwkSIntKey
+        uint8_t k2[16];          //!< Second CMAC subkey of fNwkSIntKey
+        aes_context nwkSEncKey;  //!< Key schedule of the network session encryption key
+        aes_context appSKey;     //!< Key schedule of the application session key
+    };
 
     /*******************************************/
     /* Proper EndDeviceStatus class definition */
@@ -211,6 +401,13 @@ class EndDeviceStatus : public Object
      */
     const ReceivedPacketList& GetReceivedPacketList() const;
 
+    /**
+     * Set the number of packets kept in the history of received packets.
+     *
+     * \param packets The number of packets, at least 1.
+     */
+    void SetReceivedPacketHistorySize(size_t packets);
+
     /**
      * Set the data rate this device is using in the first receive window.
      */
@@ -248,6 +445,25 @@ class EndDeviceStatus : public Object
 
     Ptr<ClassAEndDeviceLorawanMac> GetMac();
 
+    /**
+     * Set the session keys the network server shares with this device.
+     *
+     * \param fNwkSIntKey The forwarding network session integrity key.
+     * \param nwkSEncKey The network session encryption key.
+     * \param appSKey The application session key.
+     */
+    void SetSessionKeys(const std::array<uint8_t, 16>& fNwkSIntKey,
+                        const std::array<uint8_t, 16>& nwkSEncKey,
+                        const std::array<uint8_t, 16>& appSKey);
+
+    /**
+     * Get the session keys of this device. Key schedules and subkeys are
+     * expanded on first use.
+     *
+     * \return The session keys, or nullptr if they were not set.
+     */
+    const SessionKeys* GetSessionKeys();
+
     //////////////////////
     //  Other methods  //
     //////////////////////
@@ -257,6 +473,21 @@ class EndDeviceStatus : public Object
      */
     void InsertReceivedPacket(Ptr<const Packet> receivedPacket, const Address& gwAddress);
 
+    /**
+     * Insert a parsed received packet in the packet list.
+     *
+     * \param uplink The uplink and the gateway that forwarded it.
+     */
+    void InsertReceivedPacket(Ptr<const UplinkContext> uplink);
+
+    /**
+     * Return the last uplink that was received from this device, as parsed on
+     * its first reception.
+     *
+     * \return The uplink, or nullptr if none was received.
+     */
+    Ptr<const UplinkContext> GetLastUplinkContext() const;
+
     /**
      * Return the last packet that was received from this device.
      */
@@ -285,12 +516,51 @@ class EndDeviceStatus : public Object
 
     void SetReceiveWindowOpportunity(EventId event);
 
+    /**
+     * Set the next receive window opportunity, when it is kept in the timer
+     * wheel of the scheduler.
+     *
+     * \param timer The handle on the opportunity.
+     */
+    void SetReceiveWindowOpportunity(ReceiveWindowWheel::Timer timer);
+
     void RemoveReceiveWindowOpportunity();
 
     /**
-     * Return an ordered list of the best gateways.
+     * Return the number of gateways that can forward a reply to the last
+     * packet, up to MAX_GATEWAY_CANDIDATES.
+     *
+     * \return The number of candidates.
+     */
+    size_t GetNGatewayCandidates() const;
+
+    /**
+     * Return a gateway that can forward a reply to the last packet. The
+     * candidates are sorted by decreasing reception power, gateways with the
+     * same power in the order their copies arrived.
+     *
+     * \param i The rank of the candidate, below GetNGatewayCandidates.
+     * \return The candidate.
+     */
+    const GatewayCandidate& GetGatewayCandidate(size_t i) const;
+
+    /**
+     * Return whether all the gateways that received the last packet are
+     * candidates, that is whether there were at most MAX_GATEWAY_CANDIDATES of
+     * them and their index was known when the packet was inserted.
+     *
+     * \return Whether the candidates are complete.
      */
-    std::map<double, Address> GetPowerGatewayMap();
+    bool HasAllGatewayCandidates() const;
+
+    /**
+     * Set the index of the gateways, used to rank the gateways of packets
+     * inserted without their index.
+     *
+     * \param gatewayIds The index of each gateway, by address, or nullptr. It
+     * must outlive this object.
+     */
+    void SetGatewayIds(const std::map<Address, uint32_t>* gatewayIds);
 
     struct Reply m_reply; //<! Next reply intended for this device
 
@@ -302,14 +572,34 @@ class EndDeviceStatus : public Object
     void DoDispose() override;
 
   private:
+    /**
+     * Rank a gateway that received the last packet among the candidates,
+     * dropping the worst one if there are too many.
+     *
+     * \param gwId The index of the gateway, or UplinkContext::UNKNOWN_GATEWAY.
+     * \param rxPower The reception power of the packet at the gateway.
+     */
+    void AddGatewayCandidate(uint32_t gwId, double rxPower);
+
     // Receive window data
     uint8_t m_firstReceiveWindowDataRate = 0;
     double m_firstReceiveWindowFrequency = 0;
     uint8_t m_secondReceiveWindowDataRate = 0;
     double m_secondReceiveWindowFrequency = 869525000;
     EventId m_receiveWindowEvent;
+    ReceiveWindowWheel::Timer m_receiveWindowTimer;
 
     ReceivedPacketList m_receivedPacketList; //<! List of received packets
+    Ptr<const UplinkContext> m_lastUplink;   //!< Last packet of the list, parsed
+
+    std::array<GatewayCandidate, MAX_GATEWAY_CANDIDATES> m_gwCandidates; //!< Best gateways first
+    size_t m_nGwCandidates = 0; //!< Number of gateways in m_gwCandidates
+    bool m_allGwCandidates = true; //!< Whether no gateway of the last packet was left out
+    const std::map<Address, uint32_t>* m_gatewayIds = nullptr; //!< Index of the gateways
+
+    std::array<uint8_t, 48> m_rawSessionKeys;   //!< FNwkSIntKey, NwkSEncKey and AppSKey
+    bool m_hasSessionKeys = false;              //!< Whether session keys were set
+    std::unique_ptr<SessionKeys> m_sessionKeys; //!< Expanded session keys, built on first use
 
     // NOTE Using this attribute is 'cheating', since we are assuming perfect
     // synchronization between the info at the device and at the network server
@@ -38,6 +38,20 @@ NetworkControllerComponent::~NetworkControllerComponent()
 {
 }
 
+uint32_t
+NetworkControllerComponent::GetHistoryRange() const
+{
+    // The last packet is always kept
+    return 1;
+}
+
+void
+NetworkControllerComponent::OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                                             Ptr<NetworkStatus> networkStatus)
+{
+    OnReceivedPacket(uplink->GetPacket(), uplink->GetEndDeviceStatus(), networkStatus);
+}
+
 ////////////////////////////////
 // ConfirmedMessagesComponent //
 ////////////////////////////////
@@ -67,14 +81,19 @@ ConfirmedMessagesComponent::OnReceivedPacket(Ptr<const Packet> packet,
                                              Ptr<NetworkStatus> networkStatus)
 {
     NS_LOG_FUNCTION(this->GetTypeId() << packet << networkStatus);
+    OnReceivedPacket(Create<UplinkContext>(packet, Address(), status), networkStatus);
+}
+
+void
+ConfirmedMessagesComponent::OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                                             Ptr<NetworkStatus> networkStatus)
+{
+    NS_LOG_FUNCTION(this->GetTypeId() << uplink->GetPacket() << networkStatus);
 
     // Check whether the received packet requires an acknowledgment.
-    Ptr<Packet> myPacket = packet->Copy();
-    LorawanMacHeader mHdr;
-    myPacket->RemoveHeader(mHdr);
-    LoraFrameHeader fHdr;
-    fHdr.SetAsUplink();
-    myPacket->RemoveHeader(fHdr);
+    const LorawanMacHeader& mHdr = uplink->GetMacHeader();
+    const LoraFrameHeader& fHdr = uplink->GetFrameHeader();
+    EndDeviceStatus* status = uplink->GetEndDeviceStatus();
 
     NS_LOG_INFO("Received packet Mac Header: " << mHdr);
     NS_LOG_INFO("Received packet Frame Header: " << fHdr);
@@ -163,20 +182,21 @@ LinkCheckComponent::OnReceivedPacket(Ptr<const Packet> packet,
     // the packet.
 }
 
+void
+LinkCheckComponent::OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                                     Ptr<NetworkStatus> networkStatus)
+{
+    NS_LOG_FUNCTION(this->GetTypeId() << uplink->GetPacket() << networkStatus);
+}
+
 void
 LinkCheckComponent::BeforeSendingReply(Ptr<EndDeviceStatus> status,
                                        Ptr<NetworkStatus> networkStatus)
 {
     NS_LOG_FUNCTION(this << status << networkStatus);
 
-    Ptr<Packet> myPacket = status->GetLastPacketReceivedFromDevice()->Copy();
-    LorawanMacHeader mHdr;
-    myPacket->RemoveHeader(mHdr);
-    LoraFrameHeader fHdr;
-    fHdr.SetAsUplink();
-    myPacket->RemoveHeader(fHdr);
-
-    Ptr<LinkCheckReq> command = fHdr.GetMacCommand<LinkCheckReq>();
+    Ptr<LinkCheckReq> command =
+        status->GetLastUplinkContext()->GetFrameHeader().GetMacCommand<LinkCheckReq>();
 
     // GetMacCommand returns 0 if no command is found
     if (command)
@@ -14,6 +14,7 @@
 #define NETWORK_CONTROLLER_COMPONENTS_H
 
 #include "network-status.h"
+#include "uplink-context.h"
 
 #include "ns3/log.h"
 #include "ns3/object.h"
@@ -57,6 +58,17 @@ class NetworkControllerComponent : public Object
                                   Ptr<EndDeviceStatus> status,
                                   Ptr<NetworkStatus> networkStatus) = 0;
 
+    /**
+     * Method that is called when a new packet is received by the NetworkServer,
+     * with the packet already parsed. By default, it calls the overload taking
+     * the packet.
+     *
+     * \param uplink The newly received packet
+     * \param networkStatus A pointer to the NetworkStatus object
+     */
+    virtual void OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                                  Ptr<NetworkStatus> networkStatus);
+
     virtual void BeforeSendingReply(Ptr<EndDeviceStatus> status,
                                     Ptr<NetworkStatus> networkStatus) = 0;
 
@@ -68,6 +80,14 @@ class NetworkControllerComponent : public Object
      * \param networkStatus A pointer to the NetworkStatus object
      */
     virtual void OnFailedReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) = 0;
+
+    /**
+     * Get the number of past packets of a device this component looks at.
+     * The NetworkStatus keeps at least this many packets per device.
+     *
+     * \return The number of packets.
+     */
+    virtual uint32_t GetHistoryRange() const;
 };
 
 ///////////////////////////////
@@ -94,6 +114,9 @@ class ConfirmedMessagesComponent : public NetworkControllerComponent
                           Ptr<EndDeviceStatus> status,
                           Ptr<NetworkStatus> networkStatus) override;
 
+    void OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                          Ptr<NetworkStatus> networkStatus) override;
+
     void BeforeSendingReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override;
 
     void OnFailedReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override;
@@ -123,6 +146,9 @@ class LinkCheckComponent : public NetworkControllerComponent
                           Ptr<EndDeviceStatus> status,
                           Ptr<NetworkStatus> networkStatus) override;
 
+    void OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                          Ptr<NetworkStatus> networkStatus) override;
+
     void BeforeSendingReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override;
 
     void OnFailedReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override;
@@ -52,12 +52,24 @@ NetworkController::Install(Ptr<NetworkControllerComponent> component)
 {
     NS_LOG_FUNCTION(this);
     m_components.push_back(component);
+    if (m_status)
+    {
+        m_status->RequireReceivedPacketHistory(component->GetHistoryRange());
+    }
 }
 
 void
 NetworkController::OnNewPacket(Ptr<const Packet> packet)
 {
     NS_LOG_FUNCTION(this << packet);
+    Ptr<const UplinkContext> uplink = Create<UplinkContext>(packet, Address(), m_status);
+    OnNewPacket(uplink);
+}
+
+void
+NetworkController::OnNewPacket(Ptr<const UplinkContext> uplink)
+{
+    NS_LOG_FUNCTION(this << uplink->GetPacket());
 
     // NOTE As a future optimization, we can allow components to register their
     // callbacks and only be called in case a certain MAC command is contained.
@@ -66,7 +78,7 @@ NetworkController::OnNewPacket(Ptr<const Packet> packet)
     // Inform each component about the new packet
     for (auto it = m_components.begin(); it != m_components.end(); ++it)
     {
-        (*it)->OnReceivedPacket(packet, m_status->GetEndDeviceStatus(packet), m_status);
+        (*it)->OnReceivedPacket(uplink, m_status);
     }
 }
 
@@ -15,6 +15,7 @@
 
 #include "network-controller-components.h"
 #include "network-status.h"
+#include "uplink-context.h"
 
 #include "ns3/object.h"
 #include "ns3/packet.h"
@@ -53,6 +54,13 @@ class NetworkController : public Object
      */
     void OnNewPacket(Ptr<const Packet> packet);
 
+    /**
+     * Method that is called by the NetworkServer when a new packet is received.
+     *
+     * \param uplink The newly received packet, already parsed.
+     */
+    void OnNewPacket(Ptr<const UplinkContext> uplink);
+
     /**
      * Method that is called by the NetworkScheduler just before sending a reply
      * to a certain End Device.
@@ -28,6 +28,14 @@ NetworkScheduler::GetTypeId()
         TypeId("ns3::NetworkScheduler")
             .SetParent<Object>()
             .AddConstructor<NetworkScheduler>()
+            .AddAttribute("TimerWheelSlot",
+                          "Slot of the timer wheel receive window opportunities are kept in. "
+                          "Opportunities are handled at the end of their slot, and each slot "
+                          "with opportunities takes a single simulator event. Zero schedules a "
+                          "simulator event per opportunity.",
+                          TimeValue(Seconds(0)),
+                          MakeTimeAccessor(&NetworkScheduler::m_wheelSlot),
+                          MakeTimeChecker(Seconds(0)))
             .AddTraceSource("ReceiveWindowOpened",
                             "Trace source that is fired when a receive window opportunity happens.",
                             MakeTraceSourceAccessor(&NetworkScheduler::m_receiveWindowOpened),
@@ -37,13 +45,15 @@ NetworkScheduler::GetTypeId()
 }
 
 NetworkScheduler::NetworkScheduler()
+    : m_wheelSlot(Seconds(0))
 {
     NS_LOG_FUNCTION(this);
 }
 
 NetworkScheduler::NetworkScheduler(Ptr<NetworkStatus> status, Ptr<NetworkController> controller)
     : m_status(status),
-      m_controller(controller)
+      m_controller(controller),
+      m_wheelSlot(Seconds(0))
 {
     NS_LOG_FUNCTION(this);
 }
@@ -57,29 +67,56 @@ void
 NetworkScheduler::OnReceivedPacket(Ptr<const Packet> packet)
 {
     NS_LOG_FUNCTION(packet);
+    Ptr<const UplinkContext> uplink = Create<UplinkContext>(packet, Address(), m_status);
+    OnReceivedPacket(uplink);
+}
 
-    // Get the current packet's frame counter
-    Ptr<Packet> packetCopy = packet->Copy();
-    LorawanMacHeader receivedMacHdr;
-    packetCopy->RemoveHeader(receivedMacHdr);
-    LoraFrameHeader receivedFrameHdr;
-    receivedFrameHdr.SetAsUplink();
-    packetCopy->RemoveHeader(receivedFrameHdr);
+void
+NetworkScheduler::OnReceivedPacket(Ptr<const UplinkContext> uplink)
+{
+    NS_LOG_FUNCTION(uplink->GetPacket());
 
     // Need to decide whether to schedule a receive window
-    if (!m_status->GetEndDeviceStatus(packet)->HasReceiveWindowOpportunityScheduled())
+    EndDeviceStatus* edStatus = uplink->GetEndDeviceStatus();
+    if (!edStatus->HasReceiveWindowOpportunityScheduled())
     {
         // Extract the address
-        LoraDeviceAddress deviceAddress = receivedFrameHdr.GetAddress();
+        LoraDeviceAddress deviceAddress = uplink->GetDeviceAddress();
 
-        // Schedule OnReceiveWindowOpportunity event
-        m_status->GetEndDeviceStatus(packet)->SetReceiveWindowOpportunity(
-            Simulator::Schedule(Seconds(1),
+        // Schedule OnReceiveWindowOpportunity event, one second after the
+        // arrival of the packet even if it was held for de-duplication
+        Time delay = Seconds(1) - (Simulator::Now() - uplink->GetArrivalTime());
+        // This will be the first receive window
+        ScheduleReceiveWindow(delay, edStatus, deviceAddress, 1);
+    }
+}
+
+void
+NetworkScheduler::ScheduleReceiveWindow(Time delay,
+                                        EndDeviceStatus* edStatus,
+                                        LoraDeviceAddress deviceAddress,
+                                        int window)
+{
+    if (m_wheelSlot.IsZero())
+    {
+        edStatus->SetReceiveWindowOpportunity(
+            Simulator::Schedule(delay,
                                 &NetworkScheduler::OnReceiveWindowOpportunity,
                                 this,
                                 deviceAddress,
-                                1)); // This will be the first receive window
+                                window));
+        return;
+    }
+    if (!m_wheel)
+    {
+        // Enough buckets for opportunities up to a few seconds ahead to be
+        // alone in theirs at 1 ms slots
+        m_wheel = Create<ReceiveWindowWheel>(
+            m_wheelSlot,
+            4096,
+            MakeCallback(&NetworkScheduler::OnReceiveWindowOpportunity, this));
     }
+    edStatus->SetReceiveWindowOpportunity(m_wheel->Schedule(delay, deviceAddress, window));
 }
 
 void
@@ -100,13 +137,11 @@ NetworkScheduler::OnReceiveWindowOpportunity(LoraDeviceAddress deviceAddress, in
         // No suitable GW was found, but there's still hope to find one for the
         // second window.
         // Schedule another OnReceiveWindowOpportunity event
-        m_status->GetEndDeviceStatus(deviceAddress)
-            ->SetReceiveWindowOpportunity(
-                Simulator::Schedule(Seconds(1),
-                                    &NetworkScheduler::OnReceiveWindowOpportunity,
-                                    this,
-                                    deviceAddress,
-                                    2)); // This will be the second receive window
+        // This will be the second receive window
+        ScheduleReceiveWindow(Seconds(1),
+                              PeekPointer(m_status->GetEndDeviceStatus(deviceAddress)),
+                              deviceAddress,
+                              2);
     }
     else if (gwAddress == Address() && window == 2)
     {
@@ -150,6 +185,11 @@ void
 NetworkScheduler::DoDispose()
 {
     NS_LOG_FUNCTION(this);
+    if (m_wheel)
+    {
+        m_wheel->Clear();
+        m_wheel = nullptr;
+    }
     m_status = nullptr;
     m_controller = nullptr;
     Object::DoDispose();
@@ -15,6 +15,8 @@
 
 #include "network-controller.h"
 #include "network-status.h"
+#include "receive-window-wheel.h"
+#include "uplink-context.h"
 
 #include "ns3/core-module.h"
 #include "ns3/lora-device-address.h"
@@ -47,6 +49,15 @@ class NetworkScheduler : public Object
      */
     void OnReceivedPacket(Ptr<const Packet> packet);
 
+    /**
+     * Method called by NetworkServer to inform the Scheduler of a newly arrived
+     * uplink packet, already parsed. The first receive window opportunity is
+     * scheduled 1 second after the arrival of the packet.
+     *
+     * \param uplink The parsed packet.
+     */
+    void OnReceivedPacket(Ptr<const UplinkContext> uplink);
+
     /**
      * Method that is scheduled after packet arrivals in order to act on
      * receive windows 1 and 2 seconds later receptions.
@@ -57,9 +68,26 @@ class NetworkScheduler : public Object
     void DoDispose() override;
 
   private:
+    /**
+     * Schedule a receive window opportunity of a device, with a simulator
+     * event or in the timer wheel.
+     *
+     * \param delay The delay from now.
+     * \param edStatus The status of the device.
+     * \param deviceAddress The address of the device.
+     * \param window The receive window, 1 or 2.
+     */
+    void ScheduleReceiveWindow(Time delay,
+                               EndDeviceStatus* edStatus,
+                               LoraDeviceAddress deviceAddress,
+                               int window);
+
     TracedCallback<Ptr<const Packet>> m_receiveWindowOpened;
     Ptr<NetworkStatus> m_status;
     Ptr<NetworkController> m_controller;
+
+    Time m_wheelSlot;                //!< Slot of the timer wheel, zero to use simulator events
+    Ptr<ReceiveWindowWheel> m_wheel; //!< Receive window opportunities, built on first use
 };
 
 } // namespace lorawan
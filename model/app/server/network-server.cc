@@ -15,6 +15,7 @@
 
 #include "network-status.h"
 
+#include "ns3/boolean.h"
 #include "ns3/class-a-end-device-lorawan-mac.h"
 #include "ns3/lora-device-address.h"
 #include "ns3/lora-frame-header.h"
@@ -25,6 +26,7 @@
 #include "ns3/node-container.h"
 #include "ns3/packet.h"
 #include "ns3/point-to-point-net-device.h"
+#include "ns3/simulator.h"
 
 namespace ns3
 {
@@ -42,6 +44,19 @@ NetworkServer::GetTypeId()
         TypeId("ns3::NetworkServer")
             .SetParent<Application>()
             .AddConstructor<NetworkServer>()
+            .AddAttribute("VerifyUplinks",
+                          "Whether to verify the MIC and decrypt the payload of uplinks before "
+                          "processing them. Devices must have cryptography enabled.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&NetworkServer::m_verifyUplinks),
+                          MakeBooleanChecker())
+            .AddAttribute("DeduplicationWindow",
+                          "Time during which the copies of an uplink forwarded by several "
+                          "gateways are merged before the scheduler and the controller act on "
+                          "it. Zero processes each copy on arrival.",
+                          TimeValue(Seconds(0)),
+                          MakeTimeAccessor(&NetworkServer::m_deduplicationWindow),
+                          MakeTimeChecker(Seconds(0), MilliSeconds(999)))
             .AddTraceSource(
                 "ReceivedPacket",
                 "Trace source that is fired when a packet arrives at the Network Server",
@@ -54,9 +69,13 @@ NetworkServer::GetTypeId()
 NetworkServer::NetworkServer()
     : m_status(CreateObject<NetworkStatus>()),
       m_controller(CreateObject<NetworkController>(m_status)),
-      m_scheduler(CreateObject<NetworkScheduler>(m_status, m_controller))
+      m_scheduler(CreateObject<NetworkScheduler>(m_status, m_controller)),
+      m_cryptoStage(CreateObject<UplinkCryptoStage>(m_status)),
+      m_verifyUplinks(false),
+      m_deduplicationWindow(Seconds(0))
 {
     NS_LOG_FUNCTION(this);
+    m_cryptoStage->SetForwardCallback(MakeCallback(&NetworkServer::ProcessUplink, this));
 }
 
 NetworkServer::~NetworkServer()
@@ -150,22 +169,68 @@ NetworkServer::Receive(Ptr<NetDevice> device,
 {
     NS_LOG_FUNCTION(this << packet << protocol << address);
 
-    // Create a copy of the packet
-    Ptr<Packet> myPacket = packet->Copy();
-
     // Fire the trace source
     m_receivedPacket(packet);
 
+    // Receive windows are timed from now, however long the uplink is held
+    // for verification or de-duplication
+    if (m_verifyUplinks)
+    {
+        m_cryptoStage->Enqueue(packet, address, Simulator::Now());
+    }
+    else
+    {
+        ProcessUplink(packet, address, Simulator::Now());
+    }
+    return true;
+}
+
+void
+NetworkServer::ProcessUplink(Ptr<const Packet> packet, const Address& address, Time arrivalTime)
+{
+    NS_LOG_FUNCTION(this << packet << address << arrivalTime);
+
+    // Parse the packet once for all the stages below
+    Ptr<const UplinkContext> uplink =
+        Create<UplinkContext>(packet, address, m_status, arrivalTime);
+
+    if (m_deduplicationWindow.IsStrictlyPositive())
+    {
+        // Only the status hears about every copy, to record its gateway
+        m_status->OnReceivedPacket(uplink);
+        uint64_t key = uint64_t(uplink->GetDeviceAddress().Get()) << 16 |
+                       uplink->GetFrameHeader().GetFCnt();
+        if (m_deduplication.find(key) == m_deduplication.end())
+        {
+            EventId event = Simulator::Schedule(m_deduplicationWindow,
+                                                &NetworkServer::CloseDeduplicationWindow,
+                                                this,
+                                                key);
+            m_deduplication.emplace(key, std::make_pair(uplink, event));
+        }
+        return;
+    }
+
     // Inform the scheduler of the newly arrived packet
-    m_scheduler->OnReceivedPacket(packet);
+    m_scheduler->OnReceivedPacket(uplink);
 
     // Inform the status of the newly arrived packet
-    m_status->OnReceivedPacket(packet, address);
+    m_status->OnReceivedPacket(uplink);
 
     // Inform the controller of the newly arrived packet
-    m_controller->OnNewPacket(packet);
+    m_controller->OnNewPacket(uplink);
+}
 
-    return true;
+void
+NetworkServer::CloseDeduplicationWindow(uint64_t key)
+{
+    NS_LOG_FUNCTION(this << key);
+    auto it = m_deduplication.find(key);
+    NS_ASSERT(it != m_deduplication.end());
+    Ptr<const UplinkContext> uplink = it->second.first;
+    m_deduplication.erase(it);
+    m_scheduler->OnReceivedPacket(uplink);
+    m_controller->OnNewPacket(uplink);
 }
 
 void
@@ -182,10 +247,21 @@ NetworkServer::GetNetworkStatus()
     return m_status;
 }
 
+Ptr<UplinkCryptoStage>
+NetworkServer::GetUplinkCryptoStage()
+{
+    return m_cryptoStage;
+}
+
 void
 NetworkServer::DoDispose()
 {
     NS_LOG_FUNCTION(this);
+    for (auto& pending : m_deduplication)
+    {
+        pending.second.second.Cancel();
+    }
+    m_deduplication.clear();
     if (m_status)
     {
         m_status->Dispose();
@@ -201,6 +277,11 @@ NetworkServer::DoDispose()
         m_scheduler->Dispose();
     }
     m_scheduler = nullptr;
+    if (m_cryptoStage)
+    {
+        m_cryptoStage->Dispose();
+    }
+    m_cryptoStage = nullptr;
     Application::DoDispose();
 }
 
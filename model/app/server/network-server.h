@@ -18,17 +18,23 @@
 #include "network-controller.h"
 #include "network-scheduler.h"
 #include "network-status.h"
+#include "uplink-context.h"
+#include "uplink-crypto-stage.h"
 
 #include "ns3/application.h"
 #include "ns3/class-a-end-device-lorawan-mac.h"
+#include "ns3/event-id.h"
 #include "ns3/log.h"
 #include "ns3/lora-device-address.h"
 #include "ns3/net-device.h"
 #include "ns3/node-container.h"
+#include "ns3/nstime.h"
 #include "ns3/object.h"
 #include "ns3/packet.h"
 #include "ns3/point-to-point-net-device.h"
 
+#include <unordered_map>
+
 namespace ns3
 {
 namespace lorawan
@@ -96,12 +102,44 @@ class NetworkServer : public Application
 
     Ptr<NetworkStatus> GetNetworkStatus();
 
+    /**
+     * Get the stage verifying and decrypting uplinks, used when the
+     * VerifyUplinks attribute is set.
+     *
+     * \return The stage.
+     */
+    Ptr<UplinkCryptoStage> GetUplinkCryptoStage();
+
   protected:
     void DoDispose() override;
 
+    /**
+     * Hand an uplink over to the scheduler, the status and the controller.
+     *
+     * \param packet The uplink.
+     * \param address The address of the gateway that forwarded it.
+     * \param arrivalTime The time the server received it.
+     */
+    void ProcessUplink(Ptr<const Packet> packet, const Address& address, Time arrivalTime);
+
+    /**
+     * Hand the first copy of an uplink over to the scheduler and the
+     * controller, once the copies forwarded by all gateways were merged.
+     *
+     * \param key The device address and frame counter of the uplink.
+     */
+    void CloseDeduplicationWindow(uint64_t key);
+
     Ptr<NetworkStatus> m_status;
     Ptr<NetworkController> m_controller;
     Ptr<NetworkScheduler> m_scheduler;
+    Ptr<UplinkCryptoStage> m_cryptoStage;
+    bool m_verifyUplinks;
+
+    Time m_deduplicationWindow; //!< Time gateway copies of an uplink are merged for
+    /// First copy and window end event of the uplinks being de-duplicated,
+    /// by device address and frame counter
+    std::unordered_map<uint64_t, std::pair<Ptr<const UplinkContext>, EventId>> m_deduplication;
 
     TracedCallback<Ptr<const Packet>> m_receivedPacket;
 };
@@ -43,6 +43,7 @@ NetworkStatus::GetTypeId()
 }
 
 NetworkStatus::NetworkStatus()
+    : m_historySize(1)
 {
     NS_LOG_FUNCTION(this);
 }
@@ -62,6 +63,12 @@ NetworkStatus::AddNode(Ptr<ClassAEndDeviceLorawanMac> edMac)
     {
         // The device doesn't exist. Create new EndDeviceStatus
         auto edStatus = CreateObject<EndDeviceStatus>(edAddress, edMac);
+        edStatus->SetReceivedPacketHistorySize(m_historySize);
+        edStatus->SetGatewayIds(&m_gatewayIds);
+        // Share the session keys, like an activation by personalization
+        edStatus->SetSessionKeys(edMac->GetKey(F_NWK_S_INT_KEY),
+                                 edMac->GetKey(NWK_S_ENC_KEY),
+                                 edMac->GetKey(APP_S_KEY));
         // Add it to the map
         m_endDeviceStatuses.insert({edAddress, edStatus});
         NS_LOG_DEBUG("Added to the list a device with address " << edAddress.Print());
@@ -78,31 +85,38 @@ NetworkStatus::AddGateway(Address& address, Ptr<GatewayStatus> gwStatus)
     {
         // The device doesn't exist.
 
-        // Add it to the map
-        m_gatewayStatuses.insert(std::pair<Address, Ptr<GatewayStatus>>(address, gwStatus));
+        // Add it to the list, the next index being its identifier
+        m_gatewayStatuses.insert({address, gwStatus});
+        m_gatewayIds.insert({address, m_gatewaysById.size()});
+        m_gatewaysById.push_back(gwStatus);
         NS_LOG_DEBUG("Added to the list a gateway with address " << address);
     }
 }
 
+uint32_t
+NetworkStatus::GetGatewayId(const Address& address) const
+{
+    auto it = m_gatewayIds.find(address);
+    return (it != m_gatewayIds.end()) ? it->second : UplinkContext::UNKNOWN_GATEWAY;
+}
+
 void
 NetworkStatus::OnReceivedPacket(Ptr<const Packet> packet, const Address& gwAddress)
 {
     NS_LOG_FUNCTION(this << packet << gwAddress);
+    OnReceivedPacket(Create<UplinkContext>(packet, gwAddress, this));
+}
 
-    // Create a copy of the packet
-    Ptr<Packet> myPacket = packet->Copy();
-
-    // Extract the headers
-    LorawanMacHeader mHdr;
-    myPacket->RemoveHeader(mHdr);
-    LoraFrameHeader fHdr;
-    fHdr.SetAsUplink();
-    myPacket->RemoveHeader(fHdr);
+void
+NetworkStatus::OnReceivedPacket(Ptr<const UplinkContext> uplink)
+{
+    NS_LOG_FUNCTION(this << uplink->GetPacket() << uplink->GetGatewayAddress());
 
     // Update the correct EndDeviceStatus object
-    LoraDeviceAddress edAddr = fHdr.GetAddress();
-    NS_LOG_DEBUG("Node address: " << edAddr);
-    m_endDeviceStatuses.at(edAddr)->InsertReceivedPacket(packet, gwAddress);
+    NS_LOG_DEBUG("Node address: " << uplink->GetDeviceAddress());
+    EndDeviceStatus* edStatus = uplink->GetEndDeviceStatus();
+    NS_ABORT_MSG_IF(!edStatus, "Unknown device " << uplink->GetDeviceAddress());
+    edStatus->InsertReceivedPacket(uplink);
 }
 
 bool
@@ -131,24 +145,40 @@ NetworkStatus::GetBestGatewayForDevice(LoraDeviceAddress deviceAddress, int wind
         NS_ABORT_MSG("Invalid window value");
     }
 
-    // Get the list of gateways that this device can reach
+    // Go through the gateways that received the last packet of this device,
+    // from the 'best', i.e. the one with the highest received power, to the
+    // worst.
     // NOTE: At this point, we could also take into account the whole network to
     // identify the best gateway according to various metrics. For now, we just
-    // ask the EndDeviceStatus to pick the best gateway for us via its method.
-    std::map<double, Address> gwAddresses = edStatus->GetPowerGatewayMap();
+    // rely on the ranking the EndDeviceStatus keeps as packets arrive.
+    for (size_t i = 0; i < edStatus->GetNGatewayCandidates(); ++i)
+    {
+        const Ptr<GatewayStatus>& gwStatus = m_gatewaysById[edStatus->GetGatewayCandidate(i).gwId];
+        if (gwStatus->IsAvailableForTransmission(replyFrequency))
+        {
+            return gwStatus->GetAddress();
+        }
+    }
+    if (edStatus->HasAllGatewayCandidates())
+    {
+        return Address();
+    }
 
-    // By iterating on the map in reverse, we go from the 'best'
-    // gateway, i.e. the one with the highest received power, to the
-    // worst.
+    // Some gateways that received the packet are not ranked, because there
+    // were too many of them or their index was unknown when the packet was
+    // inserted: look for the best available one among all of them.
+    EndDeviceStatus::ReceivedPacketInfo info = edStatus->GetLastReceivedPacketInfo();
     Address bestGwAddress;
-    for (auto it = gwAddresses.rbegin(); it != gwAddresses.rend(); it++)
+    double bestRxPower = 0;
+    for (const auto& gw : info.gwList)
     {
-        bool isAvailable =
-            m_gatewayStatuses.find(it->second)->second->IsAvailableForTransmission(replyFrequency);
-        if (isAvailable)
+        auto it = m_gatewayStatuses.find(gw.first);
+        if (it != m_gatewayStatuses.end() &&
+            (bestGwAddress.IsInvalid() || gw.second.rxPower > bestRxPower) &&
+            it->second->IsAvailableForTransmission(replyFrequency))
         {
-            bestGwAddress = it->second;
-            break;
+            bestGwAddress = gw.first;
+            bestRxPower = gw.second.rxPower;
         }
     }
 
@@ -229,6 +259,21 @@ NetworkStatus::GetEndDeviceStatus(LoraDeviceAddress address)
     }
 }
 
+void
+NetworkStatus::RequireReceivedPacketHistory(size_t packets)
+{
+    NS_LOG_FUNCTION(this << packets);
+    if (packets <= m_historySize)
+    {
+        return;
+    }
+    m_historySize = packets;
+    for (auto& dev : m_endDeviceStatuses)
+    {
+        dev.second->SetReceivedPacketHistorySize(m_historySize);
+    }
+}
+
 int
 NetworkStatus::CountEndDevices()
 {
@@ -251,6 +296,8 @@ NetworkStatus::DoDispose()
         gw.second->Dispose();
     }
     m_gatewayStatuses.clear();
+    m_gatewayIds.clear();
+    m_gatewaysById.clear();
     Object::DoDispose();
 }
 
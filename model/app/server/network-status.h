@@ -22,6 +22,8 @@
 #include "ns3/lora-device-address.h"
 
 #include <iterator>
+#include <map>
+#include <vector>
 
 namespace ns3
 {
@@ -57,6 +59,15 @@ class NetworkStatus : public Object
      */
     void AddGateway(Address& address, Ptr<GatewayStatus> gwStatus);
 
+    /**
+     * Get the index of a gateway, given in the order gateways were added.
+     *
+     * \param address The address of the gateway in the NS-GW network.
+     * \return The index, or UplinkContext::UNKNOWN_GATEWAY if the gateway was
+     * not added.
+     */
+    uint32_t GetGatewayId(const Address& address) const;
+
     /**
      * Update network status on the received packet.
      *
@@ -65,6 +76,13 @@ class NetworkStatus : public Object
      */
     void OnReceivedPacket(Ptr<const Packet> packet, const Address& gwaddress);
 
+    /**
+     * Update network status on the received packet.
+     *
+     * \param uplink The parsed packet and the gateway it was received from.
+     */
+    void OnReceivedPacket(Ptr<const UplinkContext> uplink);
+
     /**
      * Return whether the specified device needs a reply.
      *
@@ -109,12 +127,25 @@ class NetworkStatus : public Object
      */
     int CountEndDevices();
 
+    /**
+     * Make sure the history of received packets of each device holds at least
+     * a number of packets, for current and future devices.
+     *
+     * \param packets The number of packets.
+     */
+    void RequireReceivedPacketHistory(size_t packets);
+
   protected:
     void DoDispose() override;
 
   public:
     std::map<LoraDeviceAddress, Ptr<EndDeviceStatus>> m_endDeviceStatuses;
     std::map<Address, Ptr<GatewayStatus>> m_gatewayStatuses;
+
+  private:
+    std::map<Address, uint32_t> m_gatewayIds;         //!< Index of each gateway, by address
+    std::vector<Ptr<GatewayStatus>> m_gatewaysById; //!< Gateways, by index
+    size_t m_historySize;                           //!< Number of packets kept per device
 };
 
 } // namespace lorawan
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "receive-window-wheel.h"
+
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+
+namespace ns3
+{
+namespace lorawan
+{
+
+NS_LOG_COMPONENT_DEFINE("ReceiveWindowWheel");
+
+ReceiveWindowWheel::Timer::Timer()
+    : m_wheel(nullptr),
+      m_entry(0),
+      m_generation(0)
+{
+}
+
+bool
+ReceiveWindowWheel::Timer::IsPending() const
+{
+    if (!m_wheel)
+    {
+        return false;
+    }
+    const Entry& entry = m_wheel->m_entries[m_entry];
+    return entry.generation == m_generation && entry.pending;
+}
+
+void
+ReceiveWindowWheel::Timer::Cancel()
+{
+    if (IsPending())
+    {
+        // The entry is released when its bucket is visited
+        m_wheel->m_entries[m_entry].pending = false;
+    }
+}
+
+ReceiveWindowWheel::ReceiveWindowWheel(Time slot, uint32_t buckets, ExpireCallback expire)
+    : m_slot(slot.GetTimeStep()),
+      m_mask(buckets - 1),
+      m_expire(expire),
+      m_buckets(buckets),
+      m_nEvents(0)
+{
+    NS_LOG_FUNCTION(this << slot << buckets);
+    NS_ASSERT_MSG(m_slot > 0, "The slot of the wheel must be positive");
+    NS_ASSERT_MSG(buckets > 0 && (buckets & m_mask) == 0,
+                  "The number of buckets must be a power of two");
+}
+
+ReceiveWindowWheel::~ReceiveWindowWheel()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+ReceiveWindowWheel::Timer
+ReceiveWindowWheel::Schedule(Time delay, LoraDeviceAddress device, int window)
+{
+    NS_LOG_FUNCTION(this << delay << device << window);
+    NS_ASSERT(!delay.IsStrictlyNegative());
+    int64_t deadline = (Simulator::Now() + delay).GetTimeStep();
+    uint64_t slot = (deadline + m_slot - 1) / m_slot;
+
+    uint32_t index;
+    if (m_free.empty())
+    {
+        index = m_entries.size();
+        m_entries.push_back(Entry());
+    }
+    else
+    {
+        index = m_free.back();
+        m_free.pop_back();
+    }
+    Entry& entry = m_entries[index];
+    entry.slot = slot;
+    entry.device = device;
+    entry.window = window;
+    entry.pending = true;
+    uint32_t b = slot & m_mask;
+    Link(m_buckets[b], index);
+    Arm(b, slot);
+
+    Timer timer;
+    timer.m_wheel = this;
+    timer.m_entry = index;
+    timer.m_generation = entry.generation;
+    return timer;
+}
+
+void
+ReceiveWindowWheel::Clear()
+{
+    NS_LOG_FUNCTION(this);
+    for (Bucket& bucket : m_buckets)
+    {
+        bucket.event.Cancel();
+        for (uint32_t entry = bucket.head; entry; entry = m_entries[entry - 1].next)
+        {
+            Release(entry - 1);
+        }
+        bucket.head = 0;
+        bucket.tail = 0;
+    }
+}
+
+uint64_t
+ReceiveWindowWheel::GetNScheduledEvents() const
+{
+    return m_nEvents;
+}
+
+void
+ReceiveWindowWheel::Link(Bucket& bucket, uint32_t entry)
+{
+    m_entries[entry].next = 0;
+    if (bucket.tail)
+    {
+        m_entries[bucket.tail - 1].next = entry + 1;
+    }
+    else
+    {
+        bucket.head = entry + 1;
+    }
+    bucket.tail = entry + 1;
+}
+
+void
+ReceiveWindowWheel::Arm(uint32_t b, uint64_t slot)
+{
+    Bucket& bucket = m_buckets[b];
+    if (!bucket.event.IsPending() || slot < bucket.slot)
+    {
+        bucket.event.Cancel();
+        bucket.slot = slot;
+        bucket.event = Simulator::Schedule(TimeStep(slot * m_slot) - Simulator::Now(),
+                                           &ReceiveWindowWheel::Expire,
+                                           this,
+                                           b);
+        m_nEvents++;
+    }
+}
+
+void
+ReceiveWindowWheel::Expire(uint32_t b)
+{
+    NS_LOG_FUNCTION(this << b);
+    Bucket& bucket = m_buckets[b];
+    uint64_t now = bucket.slot;
+    // Detach the list, so that handlers can add entries to the bucket
+    uint32_t entry = bucket.head;
+    bucket.head = 0;
+    bucket.tail = 0;
+    while (entry)
+    {
+        uint32_t index = entry - 1;
+        entry = m_entries[index].next;
+        const Entry& current = m_entries[index];
+        if (!current.pending)
+        {
+            Release(index);
+        }
+        else if (current.slot <= now)
+        {
+            LoraDeviceAddress device = current.device;
+            int window = current.window;
+            Release(index);
+            m_expire(device, window);
+        }
+        else
+        {
+            // Due in a later turn of the wheel
+            Link(bucket, index);
+            Arm(b, m_entries[index].slot);
+        }
+    }
+}
+
+void
+ReceiveWindowWheel::Release(uint32_t entry)
+{
+    m_entries[entry].pending = false;
+    m_entries[entry].generation++;
+    m_free.push_back(entry);
+}
+
+} // namespace lorawan
+} // namespace ns3
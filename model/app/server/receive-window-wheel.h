@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef RECEIVE_WINDOW_WHEEL_H
+#define RECEIVE_WINDOW_WHEEL_H
+
+#include "ns3/callback.h"
+#include "ns3/event-id.h"
+#include "ns3/lora-device-address.h"
+#include "ns3/nstime.h"
+#include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
+
+#include <vector>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+/**
+ * Hashed timer wheel for the receive window opportunities of the
+ * NetworkScheduler.
+ *
+ * Time is divided in slots, and each opportunity is handled at the first
+ * slot boundary not before its deadline. Opportunities are kept in the bucket
+ * of their slot, modulo the number of buckets, and each bucket with pending
+ * opportunities holds a single simulator event, for its earliest slot: all
+ * devices due in that slot are then handled together. Cancelling an
+ * opportunity only marks it, and it is dropped when its bucket is next
+ * visited.
+ */
+class ReceiveWindowWheel : public SimpleRefCount<ReceiveWindowWheel>
+{
+  public:
+    /**
+     * Callback handling a receive window opportunity of a device.
+     */
+    typedef Callback<void, LoraDeviceAddress, int> ExpireCallback;
+
+    /**
+     * Handle on an opportunity in the wheel, similar to an EventId.
+     */
+    class Timer
+    {
+      public:
+        Timer();
+
+        /**
+         * \return Whether the opportunity is still to come.
+         */
+        bool IsPending() const;
+
+        /**
+         * Cancel the opportunity, if it is still to come.
+         */
+        void Cancel();
+
+      private:
+        friend class ReceiveWindowWheel;
+
+        Ptr<ReceiveWindowWheel> m_wheel; //!< The wheel the opportunity is in
+        uint32_t m_entry;                //!< Index of the opportunity in the wheel
+        uint32_t m_generation;           //!< Generation of the entry when scheduled
+    };
+
+    /**
+     * \param slot The duration of a slot.
+     * \param buckets The number of buckets, a power of two.
+     * \param expire The callback handling opportunities.
+     */
+    ReceiveWindowWheel(Time slot, uint32_t buckets, ExpireCallback expire);
+    ~ReceiveWindowWheel();
+
+    /**
+     * Add an opportunity, handled at the first slot boundary after a delay.
+     *
+     * \param delay The delay from now.
+     * \param device The device the opportunity is for.
+     * \param window The receive window, 1 or 2.
+     * \return The handle on the opportunity.
+     */
+    Timer Schedule(Time delay, LoraDeviceAddress device, int window);
+
+    /**
+     * Drop all opportunities and cancel the simulator events of the wheel.
+     */
+    void Clear();
+
+    /**
+     * \return The number of simulator events scheduled by the wheel so far.
+     */
+    uint64_t GetNScheduledEvents() const;
+
+  private:
+    /**
+     * An opportunity in the wheel, linked with the others of its bucket.
+     */
+    struct Entry
+    {
+        uint64_t slot;            //!< Slot the opportunity is due in
+        LoraDeviceAddress device; //!< Device the opportunity is for
+        int window;               //!< Receive window
+        uint32_t generation;      //!< Incremented when the entry is released
+        uint32_t next;            //!< Index + 1 of the next entry of the bucket, or 0
+        bool pending;             //!< Whether the opportunity is still to come
+    };
+
+    /**
+     * A list of entries, with the simulator event of its earliest slot.
+     */
+    struct Bucket
+    {
+        uint32_t head = 0; //!< Index + 1 of the first entry, or 0
+        uint32_t tail = 0; //!< Index + 1 of the last entry, or 0
+        uint64_t slot = 0; //!< Slot the event is scheduled for
+        EventId event;     //!< Event visiting the bucket
+    };
+
+    /**
+     * Append an entry to the list of a bucket.
+     *
+     * \param bucket The bucket.
+     * \param entry The index of the entry.
+     */
+    void Link(Bucket& bucket, uint32_t entry);
+
+    /**
+     * Make sure the event of a bucket fires no later than a slot.
+     *
+     * \param b The index of the bucket.
+     * \param slot The slot.
+     */
+    void Arm(uint32_t b, uint64_t slot);
+
+    /**
+     * Handle the opportunities of a bucket that are due, keeping the others.
+     *
+     * \param b The index of the bucket.
+     */
+    void Expire(uint32_t b);
+
+    /**
+     * Make an entry available again, invalidating its handles.
+     *
+     * \param entry The index of the entry.
+     */
+    void Release(uint32_t entry);
+
+    int64_t m_slot;                //!< Duration of a slot [time steps]
+    uint32_t m_mask;               //!< Number of buckets - 1
+    ExpireCallback m_expire;       //!< Where due opportunities go
+    std::vector<Entry> m_entries;  //!< Pool of entries
+    std::vector<uint32_t> m_free;  //!< Indexes of the available entries
+    std::vector<Bucket> m_buckets; //!< Entries by slot, modulo the number of buckets
+    uint64_t m_nEvents;            //!< Number of simulator events scheduled
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* RECEIVE_WINDOW_WHEEL_H */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "uplink-context.h"
+
+#include "end-device-status.h"
+#include "network-status.h"
+
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+
+namespace ns3
+{
+namespace lorawan
+{
+
+NS_LOG_COMPONENT_DEFINE("UplinkContext");
+
+UplinkContext::UplinkContext(Ptr<const Packet> packet,
+                             const Address& gwAddress,
+                             Ptr<NetworkStatus> networkStatus,
+                             Time arrivalTime)
+    : m_packet(packet),
+      m_gwAddress(gwAddress),
+      m_gwId(UNKNOWN_GATEWAY),
+      m_arrivalTime(arrivalTime),
+      m_status(nullptr)
+{
+    NS_LOG_FUNCTION(this << packet << gwAddress);
+    Parse();
+    if (networkStatus)
+    {
+        m_gwId = networkStatus->GetGatewayId(gwAddress);
+        m_status = PeekPointer(networkStatus->GetEndDeviceStatus(m_frameHeader.GetAddress()));
+    }
+}
+
+UplinkContext::UplinkContext(Ptr<const Packet> packet,
+                             const Address& gwAddress,
+                             Ptr<NetworkStatus> networkStatus)
+    : UplinkContext(packet, gwAddress, networkStatus, Simulator::Now())
+{
+}
+
+UplinkContext::UplinkContext(Ptr<const Packet> packet,
+                             const Address& gwAddress,
+                             Ptr<EndDeviceStatus> status,
+                             uint32_t gwId)
+    : m_packet(packet),
+      m_gwAddress(gwAddress),
+      m_gwId(gwId),
+      m_arrivalTime(Simulator::Now()),
+      m_status(PeekPointer(status))
+{
+    NS_LOG_FUNCTION(this << packet << gwAddress);
+    Parse();
+}
+
+void
+UplinkContext::Parse()
+{
+    Ptr<Packet> myPacket = m_packet->Copy();
+    myPacket->RemoveHeader(m_macHeader);
+    m_frameHeader.SetAsUplink();
+    myPacket->RemoveHeader(m_frameHeader);
+    m_packet->PeekPacketTag(m_tag);
+    NS_LOG_DEBUG("Parsed uplink " << m_macHeader << " " << m_frameHeader);
+}
+
+Ptr<const Packet>
+UplinkContext::GetPacket() const
+{
+    return m_packet;
+}
+
+const Address&
+UplinkContext::GetGatewayAddress() const
+{
+    return m_gwAddress;
+}
+
+uint32_t
+UplinkContext::GetGatewayId() const
+{
+    return m_gwId;
+}
+
+const LorawanMacHeader&
+UplinkContext::GetMacHeader() const
+{
+    return m_macHeader;
+}
+
+const LoraFrameHeader&
+UplinkContext::GetFrameHeader() const
+{
+    return m_frameHeader;
+}
+
+const LoraTag&
+UplinkContext::GetTag() const
+{
+    return m_tag;
+}
+
+LoraDeviceAddress
+UplinkContext::GetDeviceAddress() const
+{
+    return m_frameHeader.GetAddress();
+}
+
+Time
+UplinkContext::GetArrivalTime() const
+{
+    return m_arrivalTime;
+}
+
+EndDeviceStatus*
+UplinkContext::GetEndDeviceStatus() const
+{
+    return m_status;
+}
+
+} // namespace lorawan
+} // namespace ns3
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef UPLINK_CONTEXT_H
+#define UPLINK_CONTEXT_H
+
+#include "ns3/address.h"
+#include "ns3/lora-device-address.h"
+#include "ns3/lora-frame-header.h"
+#include "ns3/lora-tag.h"
+#include "ns3/lorawan-mac-header.h"
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/simple-ref-count.h"
+
+namespace ns3
+{
+namespace lorawan
+{
+
+class EndDeviceStatus; // Forward declaration
+class NetworkStatus;   // Forward declaration
+
+/**
+ * An uplink received by the NetworkServer, parsed once on arrival.
+ *
+ * The context holds the headers and the reception metadata of the uplink,
+ * along with the EndDeviceStatus of its sender, so that the scheduler, the
+ * status and the controller components do not each copy and deserialize the
+ * packet again. It is not modified after construction.
+ */
+class UplinkContext : public SimpleRefCount<UplinkContext>
+{
+  public:
+    /// Index of a gateway that is not known to the NetworkStatus
+    static constexpr uint32_t UNKNOWN_GATEWAY = UINT32_MAX;
+
+    /**
+     * Parse an uplink and look up its sender in the status of the network.
+     *
+     * \param packet The uplink, from the MAC header on.
+     * \param gwAddress The address of the gateway that forwarded it.
+     * \param networkStatus The status of the network, or nullptr.
+     * \param arrivalTime The time the uplink arrived at the server.
+     */
+    UplinkContext(Ptr<const Packet> packet,
+                  const Address& gwAddress,
+                  Ptr<NetworkStatus> networkStatus,
+                  Time arrivalTime);
+
+    /**
+     * Parse an uplink arriving now and look up its sender in the status of
+     * the network.
+     *
+     * \param packet The uplink, from the MAC header on.
+     * \param gwAddress The address of the gateway that forwarded it.
+     * \param networkStatus The status of the network, or nullptr.
+     */
+    UplinkContext(Ptr<const Packet> packet,
+                  const Address& gwAddress,
+                  Ptr<NetworkStatus> networkStatus);
+
+    /**
+     * Parse an uplink arriving now whose sender is already known.
+     *
+     * \param packet The uplink, from the MAC header on.
+     * \param gwAddress The address of the gateway that forwarded it.
+     * \param status The status of the sender, or nullptr.
+     * \param gwId The index of the gateway in the NetworkStatus, if known.
+     */
+    UplinkContext(Ptr<const Packet> packet,
+                  const Address& gwAddress,
+                  Ptr<EndDeviceStatus> status,
+                  uint32_t gwId = UNKNOWN_GATEWAY);
+
+    /**
+     * Get the uplink as received.
+     *
+     * \return The packet.
+     */
+    Ptr<const Packet> GetPacket() const;
+
+    /**
+     * Get the address of the gateway that forwarded the uplink.
+     *
+     * \return The address, empty if unknown.
+     */
+    const Address& GetGatewayAddress() const;
+
+    /**
+     * Get the index of the gateway that forwarded the uplink in the
+     * NetworkStatus.
+     *
+     * \return The index, or UNKNOWN_GATEWAY if the context was built without
+     * the status of the network.
+     */
+    uint32_t GetGatewayId() const;
+
+    /**
+     * Get the MAC header of the uplink.
+     *
+     * \return The MAC header.
+     */
+    const LorawanMacHeader& GetMacHeader() const;
+
+    /**
+     * Get the frame header of the uplink, with its MAC commands.
+     *
+     * \return The frame header.
+     */
+    const LoraFrameHeader& GetFrameHeader() const;
+
+    /**
+     * Get the reception metadata of the uplink.
+     *
+     * \return The tag of the packet.
+     */
+    const LoraTag& GetTag() const;
+
+    /**
+     * Get the address of the sender.
+     *
+     * \return The device address.
+     */
+    LoraDeviceAddress GetDeviceAddress() const;
+
+    /**
+     * Get the time the uplink arrived at the server.
+     *
+     * \return The time the server received it from a gateway.
+     */
+    Time GetArrivalTime() const;
+
+    /**
+     * Get the status of the sender.
+     *
+     * \return The status, or nullptr if the sender is unknown.
+     */
+    EndDeviceStatus* GetEndDeviceStatus() const;
+
+  private:
+    /**
+     * Deserialize the headers and the tag of the packet.
+     */
+    void Parse();
+
+    Ptr<const Packet> m_packet;    //!< The uplink as received
+    Address m_gwAddress;           //!< The gateway that forwarded it
+    uint32_t m_gwId;               //!< Its index in the NetworkStatus
+    LorawanMacHeader m_macHeader;  //!< The parsed MAC header
+    LoraFrameHeader m_frameHeader; //!< The parsed frame header
+    LoraTag m_tag;                 //!< The reception metadata
+    Time m_arrivalTime;            //!< The time the uplink arrived at the server
+    EndDeviceStatus* m_status;     //!< The status of the sender
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* UPLINK_CONTEXT_H */
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "uplink-crypto-stage.h"
+
+#include "ns3/log.h"
+#include "ns3/lora-device-address.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+NS_LOG_COMPONENT_DEFINE("UplinkCryptoStage");
+
+NS_OBJECT_ENSURE_REGISTERED(UplinkCryptoStage);
+
+TypeId
+UplinkCryptoStage::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::UplinkCryptoStage")
+            .SetParent<Object>()
+            .SetGroupName("lorawan")
+            .AddConstructor<UplinkCryptoStage>()
+            .AddAttribute("BatchWindow",
+                          "Time a frame waits for other frames to be processed with",
+                          TimeValue(Seconds(0)),
+                          MakeTimeAccessor(&UplinkCryptoStage::m_batchWindow),
+                          MakeTimeChecker(Seconds(0)))
+            .AddAttribute("MaxBatchSize",
+                          "Number of pending frames that triggers the processing of a batch",
+                          UintegerValue(64),
+                          MakeUintegerAccessor(&UplinkCryptoStage::m_maxBatchSize),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddTraceSource("MicFailure",
+                            "Trace source fired when a frame is dropped for its MIC",
+                            MakeTraceSourceAccessor(&UplinkCryptoStage::m_micFailure),
+                            "ns3::Packet::TracedCallback");
+    return tid;
+}
+
+UplinkCryptoStage::UplinkCryptoStage()
+    : m_batchWindow(Seconds(0)),
+      m_maxBatchSize(64)
+{
+    NS_LOG_FUNCTION(this);
+}
+
+UplinkCryptoStage::UplinkCryptoStage(Ptr<NetworkStatus> status)
+    : m_status(status),
+      m_batchWindow(Seconds(0)),
+      m_maxBatchSize(64)
+{
+    NS_LOG_FUNCTION(this << status);
+}
+
+UplinkCryptoStage::~UplinkCryptoStage()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+void
+UplinkCryptoStage::SetForwardCallback(ForwardCallback callback)
+{
+    NS_LOG_FUNCTION(this);
+    m_forward = callback;
+}
+
+void
+UplinkCryptoStage::Enqueue(Ptr<const Packet> packet, const Address& gwAddress, Time arrivalTime)
+{
+    NS_LOG_FUNCTION(this << packet << gwAddress << arrivalTime);
+    m_pending.push_back({packet, gwAddress, arrivalTime});
+    if (m_pending.size() >= m_maxBatchSize)
+    {
+        Flush();
+    }
+    else if (!m_flushEvent.IsPending())
+    {
+        m_flushEvent = Simulator::Schedule(m_batchWindow, &UplinkCryptoStage::Flush, this);
+    }
+}
+
+void
+UplinkCryptoStage::Flush()
+{
+    NS_LOG_FUNCTION(this << m_pending.size());
+    m_flushEvent.Cancel();
+    if (m_pending.empty())
+    {
+        return;
+    }
+    // Frames forwarded below may come back to Enqueue
+    m_batch.swap(m_pending);
+    size_t n = m_batch.size();
+    m_frames.resize(n);
+    m_jobs.clear();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; ++i)
+    {
+        Frame& frame = m_frames[i];
+        if (Parse(m_batch[i].packet, frame))
+        {
+            AES_CMAC_JOB job;
+            job.rijndael = &frame.keys->fNwkSIntKey;
+            job.K1 = frame.keys->k1;
+            job.K2 = frame.keys->k2;
+            job.prefix = frame.b0;
+            job.data = frame.bytes.data();
+            job.len = frame.size - 4;
+            m_jobs.push_back(job);
+        }
+    }
+    auto parsed = std::chrono::steady_clock::now();
+
+    AES_CMAC_Multi(m_jobs.data(), m_jobs.size());
+    // Jobs were created in the order of the frames that need them
+    auto job = m_jobs.begin();
+    for (auto& frame : m_frames)
+    {
+        if (frame.verdict == FORWARD && frame.keys)
+        {
+            // The MIC is made of the first bytes of the CMAC
+            if (std::memcmp(job->digest, frame.bytes.data() + frame.size - 4, 4) != 0)
+            {
+                frame.verdict = MIC_FAILURE;
+            }
+            ++job;
+        }
+    }
+    auto verified = std::chrono::steady_clock::now();
+
+    Decrypt(n);
+    auto decrypted = std::chrono::steady_clock::now();
+
+    m_stats.frames += n;
+    m_stats.batches++;
+    m_stats.parseSeconds += std::chrono::duration<double>(parsed - start).count();
+    m_stats.micSeconds += std::chrono::duration<double>(verified - parsed).count();
+    m_stats.decryptSeconds += std::chrono::duration<double>(decrypted - verified).count();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        switch (m_frames[i].verdict)
+        {
+        case FORWARD:
+            if (!m_forward.IsNull())
+            {
+                m_forward(m_batch[i].packet, m_batch[i].gwAddress, m_batch[i].arrivalTime);
+            }
+            break;
+        case MIC_FAILURE:
+            NS_LOG_DEBUG("Dropping frame " << m_batch[i].packet << " with a wrong MIC");
+            m_stats.micFailures++;
+            m_micFailure(m_batch[i].packet);
+            break;
+        case UNKNOWN_DEVICE:
+            NS_LOG_DEBUG("Dropping frame " << m_batch[i].packet << " of an unknown device");
+            m_stats.unknownDevices++;
+            break;
+        }
+    }
+    m_batch.clear();
+}
+
+bool
+UplinkCryptoStage::Parse(Ptr<const Packet> packet, Frame& frame)
+{
+    frame.keys = nullptr;
+    frame.fPort = 0;
+    frame.payloadSize = 0;
+    frame.verdict = FORWARD;
+    frame.size = packet->GetSize();
+    // MHDR (1 B), FHDR (at least 7 B) and MIC (4 B)
+    if (frame.size < 12 || frame.size > frame.bytes.size())
+    {
+        frame.verdict = MIC_FAILURE;
+        return false;
+    }
+    packet->CopyData(frame.bytes.data(), frame.size);
+    const uint8_t* bytes = frame.bytes.data();
+    // Only unconfirmed and confirmed data up frames carry a MIC computed with
+    // the session keys
+    uint8_t mType = bytes[0] >> 5;
+    if (mType != 0b010 && mType != 0b100)
+    {
+        return false;
+    }
+    // The FHDR fields are little-endian
+    frame.devAddr = bytes[1] | bytes[2] << 8 | bytes[3] << 16 | uint32_t(bytes[4]) << 24;
+    uint8_t fOptsLen = bytes[5] & 0x0f;
+    frame.fCnt = bytes[6] | bytes[7] << 8;
+    uint32_t fhdrEnd = 8 + fOptsLen;
+    uint32_t micStart = frame.size - 4;
+    if (fhdrEnd > micStart)
+    {
+        frame.verdict = MIC_FAILURE;
+        return false;
+    }
+    if (fhdrEnd < micStart)
+    {
+        frame.fPort = bytes[fhdrEnd];
+        frame.payloadOffset = fhdrEnd + 1;
+        frame.payloadSize = micStart - frame.payloadOffset;
+    }
+
+    Ptr<EndDeviceStatus> status;
+    if (m_status)
+    {
+        status = m_status->GetEndDeviceStatus(LoraDeviceAddress(frame.devAddr));
+    }
+    if (status)
+    {
+        frame.keys = status->GetSessionKeys();
+    }
+    if (!frame.keys)
+    {
+        frame.verdict = UNKNOWN_DEVICE;
+        return false;
+    }
+
+    // B0 block of an uplink, see LoRaMacCrypto::PrepareB0
+    std::memset(frame.b0, 0, sizeof(frame.b0));
+    frame.b0[0] = 0x49;
+    frame.b0[6] = frame.devAddr & 0xff;
+    frame.b0[7] = (frame.devAddr >> 8) & 0xff;
+    frame.b0[8] = (frame.devAddr >> 16) & 0xff;
+    frame.b0[9] = (frame.devAddr >> 24) & 0xff;
+    frame.b0[10] = frame.fCnt & 0xff;
+    frame.b0[11] = (frame.fCnt >> 8) & 0xff;
+    frame.b0[15] = micStart & 0xff;
+    return true;
+}
+
+void
+UplinkCryptoStage::Decrypt(size_t n)
+{
+    // Keystream blocks of all payloads go through AES together, the A blocks
+    // being encrypted in place
+    size_t blocks = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Frame& frame = m_frames[i];
+        if (frame.verdict == FORWARD && frame.keys)
+        {
+            blocks += (frame.payloadSize + 15) / 16;
+        }
+    }
+    m_keystream.resize(blocks);
+    m_blockIn.resize(blocks);
+    m_blockOut.resize(blocks);
+    m_blockKeys.resize(blocks);
+    size_t block = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const Frame& frame = m_frames[i];
+        if (frame.verdict != FORWARD || !frame.keys)
+        {
+            continue;
+        }
+        // Port 0 carries MAC commands, encrypted with the network key
+        const aes_context* key =
+            (frame.fPort == 0) ? &frame.keys->nwkSEncKey : &frame.keys->appSKey;
+        for (uint32_t ctr = 1; ctr <= (frame.payloadSize + 15) / 16; ++ctr, ++block)
+        {
+            // A block of an uplink, see LoRaMacCrypto::PayloadEncrypt
+            uint8_t* a = m_keystream[block].data();
+            std::memset(a, 0, 16);
+            a[0] = 0x01;
+            a[6] = frame.devAddr & 0xff;
+            a[7] = (frame.devAddr >> 8) & 0xff;
+            a[8] = (frame.devAddr >> 16) & 0xff;
+            a[9] = (frame.devAddr >> 24) & 0xff;
+            a[10] = frame.fCnt & 0xff;
+            a[11] = (frame.fCnt >> 8) & 0xff;
+            a[15] = ctr & 0xff;
+            m_blockIn[block] = a;
+            m_blockOut[block] = a;
+            m_blockKeys[block] = key;
+        }
+    }
+    aes_encrypt_multi(m_blockIn.data(), m_blockOut.data(), m_blockKeys.data(), blocks);
+
+    block = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        Frame& frame = m_frames[i];
+        if (frame.verdict != FORWARD || !frame.keys)
+        {
+            continue;
+        }
+        uint8_t* payload = frame.bytes.data() + frame.payloadOffset;
+        for (uint32_t j = 0; j < frame.payloadSize; ++j)
+        {
+            payload[j] ^= m_keystream[block + j / 16][j % 16];
+        }
+        block += (frame.payloadSize + 15) / 16;
+    }
+}
+
+const UplinkCryptoStage::Stats&
+UplinkCryptoStage::GetStats() const
+{
+    return m_stats;
+}
+
+double
+UplinkCryptoStage::GetFramesPerSecond() const
+{
+    double seconds = m_stats.parseSeconds + m_stats.micSeconds + m_stats.decryptSeconds;
+    return (seconds > 0) ? m_stats.frames / seconds : 0;
+}
+
+void
+UplinkCryptoStage::DoDispose()
+{
+    NS_LOG_FUNCTION(this);
+    m_flushEvent.Cancel();
+    m_pending.clear();
+    m_status = nullptr;
+    m_forward = MakeNullCallback<void, Ptr<const Packet>, const Address&, Time>();
+    Object::DoDispose();
+}
+
+} // namespace lorawan
+} // namespace ns3
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef UPLINK_CRYPTO_STAGE_H
+#define UPLINK_CRYPTO_STAGE_H
+
+#include "end-device-status.h"
+#include "network-status.h"
+
+#include "ns3/address.h"
+#include "ns3/callback.h"
+#include "ns3/cmac.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+#include "ns3/packet.h"
+#include "ns3/traced-callback.h"
+
+#include <array>
+#include <vector>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+class NetworkStatus; // Forward declaration
+
+/**
+ * Stage of the NetworkServer verifying the MIC of uplink data frames and
+ * decrypting their FRMPayload with the session keys of the device, registered
+ * in the NetworkStatus when the device is added.
+ *
+ * Frames are collected into batches, either for BatchWindow or until
+ * MaxBatchSize frames are pending, and processed together: the MICs of the
+ * whole batch are computed with AES_CMAC_Multi, and the keystream blocks of
+ * all payloads with aes_encrypt_multi. With a zero window, the frames
+ * forwarded by gateways at the same instant form a batch. Frames with a valid
+ * MIC, and frames that are not uplink data frames, are then passed on to the
+ * forward callback, while the others are dropped.
+ *
+ * The wall-clock time spent in each step is accumulated, to estimate the
+ * number of frames per second a core of the server can process.
+ */
+class UplinkCryptoStage : public Object
+{
+  public:
+    /**
+     * Counters of the work done by the stage.
+     */
+    struct Stats
+    {
+        uint64_t frames = 0;         //!< Frames processed
+        uint64_t batches = 0;        //!< Batches processed
+        uint64_t micFailures = 0;    //!< Frames dropped for a missing or wrong MIC
+        uint64_t unknownDevices = 0; //!< Frames dropped for an unknown device or keys
+        double parseSeconds = 0;     //!< Time spent parsing frames and looking up keys [s]
+        double micSeconds = 0;       //!< Time spent computing and checking MICs [s]
+        double decryptSeconds = 0;   //!< Time spent decrypting FRMPayloads [s]
+    };
+
+    /**
+     * Callback to pass verified frames on.
+     */
+    typedef Callback<void, Ptr<const Packet>, const Address&, Time> ForwardCallback;
+
+    /**
+     * Register this type.
+     * \return The object TypeId.
+     */
+    static TypeId GetTypeId();
+
+    UplinkCryptoStage();
+    UplinkCryptoStage(Ptr<NetworkStatus> status);
+    ~UplinkCryptoStage() override;
+
+    /**
+     * Set the callback frames that passed verification are forwarded to.
+     *
+     * \param callback The callback.
+     */
+    void SetForwardCallback(ForwardCallback callback);
+
+    /**
+     * Add a frame received from a gateway to the current batch.
+     *
+     * \param packet The frame, from the MAC header to the MIC.
+     * \param gwAddress The address of the gateway that forwarded it.
+     * \param arrivalTime The time the server received it, forwarded along.
+     */
+    void Enqueue(Ptr<const Packet> packet, const Address& gwAddress, Time arrivalTime);
+
+    /**
+     * Process the frames of the current batch.
+     */
+    void Flush();
+
+    /**
+     * Get the counters of the stage.
+     *
+     * \return The counters.
+     */
+    const Stats& GetStats() const;
+
+    /**
+     * Get the throughput of the stage, counting only the time spent
+     * processing frames.
+     *
+     * \return The number of frames processed per second of processing time.
+     */
+    double GetFramesPerSecond() const;
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    /**
+     * What happens to a frame of the batch.
+     */
+    enum Verdict
+    {
+        FORWARD,        //!< The frame is forwarded
+        MIC_FAILURE,    //!< The frame is dropped for its MIC
+        UNKNOWN_DEVICE, //!< The frame is dropped for lack of session keys
+    };
+
+    /**
+     * A frame received from a gateway.
+     */
+    struct Received
+    {
+        Ptr<const Packet> packet; //!< The frame
+        Address gwAddress;        //!< The gateway that forwarded it
+        Time arrivalTime;         //!< The time the server received it
+    };
+
+    /**
+     * A frame of the batch being processed.
+     */
+    struct Frame
+    {
+        std::array<uint8_t, 256> bytes; //!< Copy of the frame
+        uint32_t size;                  //!< Size of the frame [B]
+        uint32_t devAddr;               //!< Address of the sender
+        uint16_t fCnt;                  //!< Frame counter
+        uint8_t fPort;                  //!< Port of the FRMPayload
+        uint32_t payloadOffset;         //!< Position of the FRMPayload in the frame
+        uint32_t payloadSize;           //!< Size of the FRMPayload [B]
+        uint8_t b0[16];                 //!< First block authenticated by the MIC
+
+        const EndDeviceStatus::SessionKeys* keys; //!< Session keys of the sender
+        Verdict verdict;                          //!< What happens to the frame
+    };
+
+    /**
+     * Copy a frame, parse the fields needed to verify and decrypt it and look
+     * up the session keys of its sender.
+     *
+     * \param packet The frame.
+     * \param frame The parsed frame.
+     * \return Whether the MIC of the frame must be checked.
+     */
+    bool Parse(Ptr<const Packet> packet, Frame& frame);
+
+    /**
+     * Decrypt the FRMPayloads of the valid frames of the batch in place.
+     *
+     * \param n The number of frames of the batch.
+     */
+    void Decrypt(size_t n);
+
+    Ptr<NetworkStatus> m_status; //!< Where session keys are looked up
+    ForwardCallback m_forward;   //!< Where verified frames go
+    Time m_batchWindow;          //!< How long frames wait for a batch to fill
+    uint32_t m_maxBatchSize;     //!< Number of frames that triggers processing
+    EventId m_flushEvent;        //!< End of the batch window
+
+    std::vector<Received> m_pending; //!< Frames waiting
+    std::vector<Received> m_batch;   //!< Frames being processed
+
+    std::vector<Frame> m_frames;                      //!< Parsed frames of the batch
+    std::vector<AES_CMAC_JOB> m_jobs;                 //!< MIC computations of the batch
+    std::vector<std::array<uint8_t, 16>> m_keystream; //!< Keystream blocks of the batch
+    std::vector<const uint8_t*> m_blockIn;            //!< Counter blocks to encrypt
+    std::vector<uint8_t*> m_blockOut;                 //!< Where keystream blocks go
+    std::vector<const aes_context*> m_blockKeys;      //!< Key schedule of each block
+
+    Stats m_stats; //!< Counters of the stage
+
+    TracedCallback<Ptr<const Packet>> m_micFailure; //!< Frames dropped for their MIC
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* UPLINK_CRYPTO_STAGE_H */
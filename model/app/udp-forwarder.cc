@@ -11,6 +11,7 @@
 #include "udp-forwarder.h"
 
 #include "ns3/base64.h"
+#include "ns3/boolean.h"
 #include "ns3/gateway-lorawan-mac.h"
 #include "ns3/inet-socket-address.h"
 #include "ns3/log.h"
@@ -55,11 +56,29 @@ UdpForwarder::GetTypeId()
                                           "The destination port of the outbound packets",
                                           UintegerValue(1700),
                                           MakeUintegerAccessor(&UdpForwarder::m_peerPort),
-                                          MakeUintegerChecker<uint16_t>());
+                                          MakeUintegerChecker<uint16_t>())
+                            .AddAttribute("EventDriven",
+                                          "Whether the uplink loop sleeps until a packet or a "
+                                          "status report is ready, instead of polling the "
+                                          "reception buffer every " STR(FETCH_SLEEP_MS) " ms, "
+                                          "and the jit loop until the next downlink is due, "
+                                          "instead of polling the jit queue every 10 ms",
+                                          BooleanValue(false),
+                                          MakeBooleanAccessor(&UdpForwarder::m_eventDriven),
+                                          MakeBooleanChecker())
+                            .AddAttribute("AggregationTime",
+                                          "In event-driven mode, time the first packet waits "
+                                          "for others to share its PUSH_DATA",
+                                          TimeValue(Seconds(0)),
+                                          MakeTimeAccessor(&UdpForwarder::m_aggregationTime),
+                                          MakeTimeChecker(Seconds(0)));
     return tid;
 }
 
 UdpForwarder::UdpForwarder()
+    : m_eventDriven(false),
+      m_aggregationTime(Seconds(0)),
+      m_upIdle(false)
 {
     NS_LOG_FUNCTION(this);
 }
@@ -76,6 +95,7 @@ UdpForwarder::DoDispose()
     m_sockUp = nullptr;
     m_sockDown = nullptr;
     m_mac = nullptr;
+    jit_queue_free(&jit_queue);
     Application::DoDispose();
 }
 
@@ -158,6 +178,7 @@ UdpForwarder::ReceiveFromLora(Ptr<LorawanMac> mac, Ptr<const Packet> packet)
     pktcpy->CopyData(p.payload, 256);
 
     m_rxPktBuff.push(p);
+    WakeUp();
     return true;
 }
 
@@ -228,6 +249,7 @@ UdpForwarder::StartApplication()
 #endif // NS3_LOG_ENABLE
 
     // Start uplink thread loop
+    m_upIdle = false;
     m_upEvent = Simulator::ScheduleNow(&UdpForwarder::ThreadUp, this);
 
     // Start downlink thread loop
@@ -253,6 +275,7 @@ UdpForwarder::StopApplication()
     Simulator::Cancel(m_statsEvent);
 
     Simulator::Cancel(m_upEvent);
+    m_upIdle = false;
     NS_LOG_INFO("\nEnd of upstream thread");
 
     Simulator::Cancel(m_downEvent);
@@ -396,8 +419,16 @@ UdpForwarder::ThreadUp()
     /* wait a short time if no packets, nor status report */
     if ((nb_pkt == 0) && (!send_report))
     {
-        m_upEvent =
-            Simulator::Schedule(MilliSeconds(FETCH_SLEEP_MS), &UdpForwarder::ThreadUp, this);
+        if (m_eventDriven)
+        {
+            /* sleep until ReceiveFromLora or CollectStatistics wake us up */
+            m_upIdle = true;
+        }
+        else
+        {
+            m_upEvent =
+                Simulator::Schedule(MilliSeconds(FETCH_SLEEP_MS), &UdpForwarder::ThreadUp, this);
+        }
         /* do not listen for acks in the meantime */
         m_remainingRecvAckAttempts = 0;
         return;
@@ -478,230 +509,18 @@ UdpForwarder::ThreadUp()
         meas_up_payload_byte += p->size;
 
         /* Start of packet, add inter-packet separator if necessary */
-        if (pkt_in_dgram == 0)
-        {
-            buff_up[buff_index] = '{';
-            ++buff_index;
-        }
-        else
+        if (pkt_in_dgram > 0)
         {
             buff_up[buff_index] = ',';
-            buff_up[buff_index + 1] = '{';
-            buff_index += 2;
-        }
-
-        /* RAW timestamp, 8-17 useful chars */
-        j = snprintf((char*)(buff_up + buff_index),
-                     TX_BUFF_SIZE - buff_index,
-                     "\"tmst\":%u",
-                     p->count_us);
-        if (j > 0)
-        {
-            buff_index += j;
-        }
-        else
-        {
-            NS_FATAL_ERROR("[up] snprintf failed line " << (unsigned)(__LINE__ - 4));
-        }
-
-        /* Packet concentrator channel, RF chain & RX frequency, 34-36 useful chars */
-        j = snprintf((char*)(buff_up + buff_index),
-                     TX_BUFF_SIZE - buff_index,
-                     ",\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf",
-                     p->if_chain,
-                     p->rf_chain,
-                     ((double)p->freq_hz / 1e6));
-        if (j > 0)
-        {
-            buff_index += j;
-        }
-        else
-        {
-            NS_FATAL_ERROR("[up] snprintf failed line " << (unsigned)(__LINE__ - 4));
-        }
-
-        /* Packet status, 9-10 useful chars */
-        switch (p->status)
-        {
-        case STAT_CRC_OK:
-            memcpy((void*)(buff_up + buff_index), (void*)",\"stat\":1", 9);
-            buff_index += 9;
-            break;
-        case STAT_CRC_BAD:
-            memcpy((void*)(buff_up + buff_index), (void*)",\"stat\":-1", 10);
-            buff_index += 10;
-            break;
-        case STAT_NO_CRC:
-            memcpy((void*)(buff_up + buff_index), (void*)",\"stat\":0", 9);
-            buff_index += 9;
-            break;
-        default:
-            memcpy((void*)(buff_up + buff_index), (void*)",\"stat\":?", 9);
-            buff_index += 9;
-            NS_FATAL_ERROR("[up] received packet with unknown status");
-        }
-
-        /* Packet modulation, 13-14 useful chars */
-        if (p->modulation == MOD_LORA)
-        {
-            memcpy((void*)(buff_up + buff_index), (void*)",\"modu\":\"LORA\"", 14);
-            buff_index += 14;
-
-            /* Lora datarate & bandwidth, 16-19 useful chars */
-            switch (p->datarate)
-            {
-            case DR_LORA_SF7:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF7", 12);
-                buff_index += 12;
-                break;
-            case DR_LORA_SF8:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF8", 12);
-                buff_index += 12;
-                break;
-            case DR_LORA_SF9:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF9", 12);
-                buff_index += 12;
-                break;
-            case DR_LORA_SF10:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF10", 13);
-                buff_index += 13;
-                break;
-            case DR_LORA_SF11:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF11", 13);
-                buff_index += 13;
-                break;
-            case DR_LORA_SF12:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF12", 13);
-                buff_index += 13;
-                break;
-            default:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"datr\":\"SF?", 12);
-                buff_index += 12;
-                NS_FATAL_ERROR("[up] lora packet with unknown datarate");
-            }
-            switch (p->bandwidth)
-            {
-            case BW_125KHZ:
-                memcpy((void*)(buff_up + buff_index), (void*)"BW125\"", 6);
-                buff_index += 6;
-                break;
-            case BW_250KHZ:
-                memcpy((void*)(buff_up + buff_index), (void*)"BW250\"", 6);
-                buff_index += 6;
-                break;
-            case BW_500KHZ:
-                memcpy((void*)(buff_up + buff_index), (void*)"BW500\"", 6);
-                buff_index += 6;
-                break;
-            default:
-                memcpy((void*)(buff_up + buff_index), (void*)"BW?\"", 4);
-                buff_index += 4;
-                NS_FATAL_ERROR("[up] lora packet with unknown bandwidth");
-            }
-
-            /* Packet ECC coding rate, 11-13 useful chars */
-            switch (p->coderate)
-            {
-            case CR_LORA_4_5:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"codr\":\"4/5\"", 13);
-                buff_index += 13;
-                break;
-            case CR_LORA_4_6:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"codr\":\"4/6\"", 13);
-                buff_index += 13;
-                break;
-            case CR_LORA_4_7:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"codr\":\"4/7\"", 13);
-                buff_index += 13;
-                break;
-            case CR_LORA_4_8:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"codr\":\"4/8\"", 13);
-                buff_index += 13;
-                break;
-            case 0: /* treat the CR0 case (mostly false sync) */
-                memcpy((void*)(buff_up + buff_index), (void*)",\"codr\":\"OFF\"", 13);
-                buff_index += 13;
-                break;
-            default:
-                memcpy((void*)(buff_up + buff_index), (void*)",\"codr\":\"?\"", 11);
-                buff_index += 11;
-                NS_FATAL_ERROR("[up] lora packet with unknown coderate");
-            }
-
-            /* Lora SNR, 11-13 useful chars */
-            j = snprintf((char*)(buff_up + buff_index),
-                         TX_BUFF_SIZE - buff_index,
-                         ",\"lsnr\":%.1f",
-                         p->snr);
-            if (j > 0)
-            {
-                buff_index += j;
-            }
-            else
-            {
-                NS_FATAL_ERROR("[up] snprintf failed line " << (unsigned)(__LINE__ - 4));
-            }
-        }
-        else if (p->modulation == MOD_FSK)
-        {
-            memcpy((void*)(buff_up + buff_index), (void*)",\"modu\":\"FSK\"", 13);
-            buff_index += 13;
-
-            /* FSK datarate, 11-14 useful chars */
-            j = snprintf((char*)(buff_up + buff_index),
-                         TX_BUFF_SIZE - buff_index,
-                         ",\"datr\":%u",
-                         p->datarate);
-            if (j > 0)
-            {
-                buff_index += j;
-            }
-            else
-            {
-                NS_FATAL_ERROR("[up] snprintf failed line " << (unsigned)(__LINE__ - 4));
-            }
-        }
-        else
-        {
-            NS_FATAL_ERROR("[up] received packet with unknown modulation");
-        }
-
-        /* Packet RSSI, payload size, 18-23 useful chars */
-        j = snprintf((char*)(buff_up + buff_index),
-                     TX_BUFF_SIZE - buff_index,
-                     ",\"rssi\":%.0f,\"size\":%u",
-                     p->rssi,
-                     p->size);
-        if (j > 0)
-        {
-            buff_index += j;
-        }
-        else
-        {
-            NS_FATAL_ERROR("[up] snprintf failed line " << (unsigned)(__LINE__ - 4));
-        }
-
-        /* Packet base64-encoded payload, 14-350 useful chars */
-        memcpy((void*)(buff_up + buff_index), (void*)",\"data\":\"", 9);
-        buff_index += 9;
-        j = bin_to_b64(p->payload,
-                       p->size,
-                       (char*)(buff_up + buff_index),
-                       341); /* 255 bytes = 340 chars in b64 + null char */
-        if (j >= 0)
-        {
-            buff_index += j;
+            ++buff_index;
         }
-        else
+        if (TX_BUFF_SIZE - buff_index < (int)RxpkWriter::MAX_SIZE)
         {
-            NS_FATAL_ERROR("[up] bin_to_b64 failed line " << (unsigned)(__LINE__ - 5));
+            NS_FATAL_ERROR("[up] no room left for packet " << i << " in PUSH_DATA");
         }
-        buff_up[buff_index] = '"';
-        ++buff_index;
 
-        /* End of packet serialization */
-        buff_up[buff_index] = '}';
-        ++buff_index;
+        /* Packet metadata and base64-encoded payload, from the opening to the closing brace */
+        buff_index += m_rxpkWriter.Write(*p, buff_up + buff_index);
         ++pkt_in_dgram;
     }
 
@@ -783,6 +602,19 @@ UdpForwarder::ThreadUp()
                                     this);
 }
 
+void
+UdpForwarder::WakeUp()
+{
+    /* only an idle loop needs waking up: a busy one fetches new packets and reports on its own
+     * once done with the current datagram */
+    if (!m_upIdle)
+    {
+        return;
+    }
+    m_upIdle = false;
+    m_upEvent = Simulator::Schedule(m_aggregationTime, &UdpForwarder::ThreadUp, this);
+}
+
 void
 UdpForwarder::ReceiveAck(Ptr<Socket> sockUp)
 {
@@ -1303,6 +1135,11 @@ UdpForwarder::ReceiveDatagram(Ptr<Socket> sockDown)
         {
             NS_LOG_ERROR("Packet REJECTED (jit error=" << jit_result << ")");
         }
+        else if (m_eventDriven)
+        {
+            /* the new packet may be due before the one the jit loop sleeps for */
+            ScheduleJit();
+        }
         meas_nb_tx_requested += 1;
     }
 
@@ -1347,8 +1184,7 @@ UdpForwarder::ThreadJit()
                     {
                         NS_LOG_ERROR("concentrator is currently emitting");
                         print_tx_status(tx_status);
-                        m_jitEvent =
-                            Simulator::Schedule(MilliSeconds(10), &UdpForwarder::ThreadJit, this);
+                        ScheduleJit();
                         return;
                     }
                     else if (tx_status == TX_SCHEDULED)
@@ -1368,8 +1204,7 @@ UdpForwarder::ThreadJit()
                 {
                     meas_nb_tx_fail += 1;
                     NS_LOG_WARN("[jit] lgw_send failed");
-                    m_jitEvent =
-                        Simulator::Schedule(MilliSeconds(10), &UdpForwarder::ThreadJit, this);
+                    ScheduleJit();
                     return;
                 }
                 else
@@ -1393,7 +1228,31 @@ UdpForwarder::ThreadJit()
         NS_LOG_ERROR("jit_peek failed with " << jit_result);
     }
 
-    m_jitEvent = Simulator::Schedule(MilliSeconds(10), &UdpForwarder::ThreadJit, this);
+    ScheduleJit();
+}
+
+void
+UdpForwarder::ScheduleJit()
+{
+    struct timeval current_unix_time;
+    struct timeval current_concentrator_time;
+    uint32_t delay_us;
+
+    if (!m_eventDriven)
+    {
+        m_jitEvent = Simulator::Schedule(MilliSeconds(10), &UdpForwarder::ThreadJit, this);
+        return;
+    }
+
+    /* sleep until the earliest packet of the queue is to be programmed, or until ReceiveDatagram
+     * enqueues a new one */
+    Simulator::Cancel(m_jitEvent);
+    GetTimeOfDay(&current_unix_time);
+    get_concentrator_time(&current_concentrator_time, current_unix_time);
+    if (jit_peek_delay(&jit_queue, &current_concentrator_time, &delay_us) == JIT_ERROR_OK)
+    {
+        m_jitEvent = Simulator::Schedule(MicroSeconds(delay_us), &UdpForwarder::ThreadJit, this);
+    }
 }
 
 void
@@ -1594,6 +1453,7 @@ UdpForwarder::CollectStatistics()
                  meas_nb_tx_ok);
     }
     report_ready = true;
+    WakeUp();
 
     /* reset upstream statistics variables */
     meas_nb_rx_rcv = 0;
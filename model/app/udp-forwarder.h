@@ -19,6 +19,7 @@
 #include "ns3/loragw_hal.h"
 #include "ns3/packet.h"
 #include "ns3/ptr.h"
+#include "ns3/rxpk-writer.h"
 #include "ns3/socket.h"
 
 #include <queue>
@@ -152,9 +153,14 @@ class UdpForwarder : public Application
     static const struct coord_s m_center;
 
     void ThreadUp(); //!< Emulate lora_pkt_fwd.c uplink forwarding loop
+    void WakeUp();   //!< Resume an idle uplink loop, in event-driven mode
     /* THREAD UP auxiliary variables */
-    Ptr<Socket> m_sockUp; //!< Socket Up
-    EventId m_upEvent;    //!< Event to forward packets uplink
+    Ptr<Socket> m_sockUp;    //!< Socket Up
+    EventId m_upEvent;       //!< Event to forward packets uplink
+    bool m_eventDriven;      //!< Whether the idle uplink loop waits for packets instead of polling
+    Time m_aggregationTime;  //!< Time packets wait for others before the loop resumes
+    bool m_upIdle;           //!< Whether the uplink loop waits to be woken up
+    RxpkWriter m_rxpkWriter; //!< Serializer of the rxpk objects of PUSH_DATA
     /* protocol variables */
     uint8_t m_upTokenH; /* random token for acknowledgement matching */
     uint8_t m_upTokenL; /* random token for acknowledgement matching */
@@ -181,7 +187,8 @@ class UdpForwarder : public Application
     void SockDownTimeout();
     void ReceiveDatagram(Ptr<Socket> sockDown);
 
-    void ThreadJit(); //!< Emulate lora_pkt_fwd.c loop to send downlink packets in jit queue
+    void ThreadJit();   //!< Emulate lora_pkt_fwd.c loop to send downlink packets in jit queue
+    void ScheduleJit(); //!< Schedule the next iteration of the jit loop
     EventId m_jitEvent;
 
     void CollectStatistics(); //!< Emulate lora_pkt_fwd.c stats collection loop
@@ -271,7 +278,7 @@ class UdpForwarder : public Application
         0; /* enable auto-quit after a number of non-acknowledged PULL_DATA (0 = disabled)*/
 
     /* Just In Time TX scheduling */
-    struct jit_queue_s jit_queue;
+    struct jit_queue_s jit_queue = {};
 
     /* Gateway specificities */
     int8_t antenna_gain = 0;
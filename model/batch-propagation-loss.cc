@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "batch-propagation-loss.h"
+
+#include "ns3/double.h"
+#include "ns3/enum.h"
+#include "ns3/log.h"
+#include "ns3/okumura-hata-propagation-loss-model.h"
+#include "ns3/propagation-environment.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+NS_LOG_COMPONENT_DEFINE("BatchPropagationLoss");
+
+void
+ReceiverBatch::Add(Ptr<MobilityModel> mobility)
+{
+    Vector position = mobility->GetPosition();
+    x.push_back(position.x);
+    y.push_back(position.y);
+    z.push_back(position.z);
+    this->mobility.push_back(mobility);
+}
+
+void
+ReceiverBatch::Clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    mobility.clear();
+}
+
+size_t
+ReceiverBatch::GetN() const
+{
+    return mobility.size();
+}
+
+void
+BatchPropagationLoss::CalcRxPower(Ptr<PropagationLossModel> model,
+                                  double txPowerDbm,
+                                  Ptr<MobilityModel> sender,
+                                  const ReceiverBatch& receivers,
+                                  std::vector<double>& rxPowerDbm)
+{
+    NS_LOG_FUNCTION(model << txPowerDbm << sender << receivers.GetN());
+    size_t n = receivers.GetN();
+    rxPowerDbm.assign(n, txPowerDbm);
+    Vector position = sender->GetPosition();
+    static const TypeId logDistance = TypeId::LookupByName("ns3::LogDistancePropagationLossModel");
+    static const TypeId okumuraHata = TypeId::LookupByName("ns3::OkumuraHataPropagationLossModel");
+    for (; model; model = model->GetNext())
+    {
+        TypeId tid = model->GetInstanceTypeId();
+        if (tid == logDistance)
+        {
+            LogDistance(model, position, receivers, rxPowerDbm.data());
+        }
+        else if (tid == okumuraHata)
+        {
+            OkumuraHata(model, position, receivers, rxPowerDbm.data());
+        }
+        else if (auto batchModel = dynamic_cast<BatchLossModel*>(PeekPointer(model)))
+        {
+            batchModel->CalcRxPowerBatch(sender, receivers, rxPowerDbm.data());
+        }
+        else
+        {
+            NS_LOG_DEBUG("Evaluating " << tid.GetName() << " and the next models one by one");
+            for (size_t i = 0; i < n; ++i)
+            {
+                rxPowerDbm[i] = model->CalcRxPower(rxPowerDbm[i], sender, receivers.mobility[i]);
+            }
+            return;
+        }
+    }
+}
+
+void
+BatchPropagationLoss::LogDistance(Ptr<PropagationLossModel> model,
+                                  const Vector& sender,
+                                  const ReceiverBatch& receivers,
+                                  double* rxPowerDbm)
+{
+    NS_LOG_FUNCTION(model << sender);
+    DoubleValue value;
+    model->GetAttribute("Exponent", value);
+    const double exponent = value.Get();
+    model->GetAttribute("ReferenceDistance", value);
+    const double referenceDistance = value.Get();
+    model->GetAttribute("ReferenceLoss", value);
+    const double referenceLoss = value.Get();
+    const double* x = receivers.x.data();
+    const double* y = receivers.y.data();
+    const double* z = receivers.z.data();
+    const size_t n = receivers.GetN();
+    for (size_t i = 0; i < n; ++i)
+    {
+        double dx = x[i] - sender.x;
+        double dy = y[i] - sender.y;
+        double dz = z[i] - sender.z;
+        double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        // Within the reference distance, only the reference loss applies
+        double ratio = std::max(distance / referenceDistance, 1.0);
+        double pathLossDb = 10 * exponent * std::log10(ratio);
+        rxPowerDbm[i] += -referenceLoss - pathLossDb;
+    }
+}
+
+void
+BatchPropagationLoss::OkumuraHata(Ptr<PropagationLossModel> model,
+                                  const Vector& sender,
+                                  const ReceiverBatch& receivers,
+                                  double* rxPowerDbm)
+{
+    NS_LOG_FUNCTION(model << sender);
+    DoubleValue frequency;
+    model->GetAttribute("Frequency", frequency);
+    EnumValue<EnvironmentType> environment;
+    model->GetAttribute("Environment", environment);
+    EnumValue<CitySize> citySize;
+    model->GetAttribute("CitySize", citySize);
+    // Terms only depending on the configuration of the model
+    const double fmhz = frequency.Get() / 1e6;
+    const double logF = std::log10(fmhz);
+    const bool largeCity = citySize.Get() == LargeCity;
+    double constant = 0;
+    if (fmhz <= 1500)
+    {
+        // Standard Okumura Hata, eq. (4.4.1) in the COST 231 final report
+        constant = 69.55 + 26.16 * logF;
+        if (environment.Get() == SubUrbanEnvironment)
+        {
+            constant += -2 * std::pow(std::log10(fmhz / 28), 2) - 5.4;
+        }
+        else if (environment.Get() == OpenAreasEnvironment)
+        {
+            constant += -4.70 * std::pow(logF, 2) + 18.33 * logF - 40.94;
+        }
+    }
+    else
+    {
+        // COST 231 Okumura model, eq. (4.4.3) in the COST 231 final report,
+        // whose metropolitan centre correction ns-3 applies to all large
+        // cities, whatever the environment
+        constant = 46.3 + 33.9 * logF;
+        if (largeCity)
+        {
+            constant += 3;
+        }
+    }
+    // Mobile antenna height correction: a * hm + b for small and medium
+    // cities, c * log10(d * hm)^2 + e for large ones
+    const double a = (largeCity) ? 0 : 1.1 * logF - 0.7;
+    const double b = (largeCity) ? 0 : 0.8 - 1.56 * logF;
+    const double c = (!largeCity) ? 0 : (fmhz < 200) ? 8.29 : 3.2;
+    const double d = (fmhz < 200) ? 1.54 : 11.75;
+    const double e = (!largeCity) ? 0 : (fmhz < 200) ? -1.1 : -4.97;
+    const double* x = receivers.x.data();
+    const double* y = receivers.y.data();
+    const double* z = receivers.z.data();
+    const size_t n = receivers.GetN();
+    for (size_t i = 0; i < n; ++i)
+    {
+        double dx = x[i] - sender.x;
+        double dy = y[i] - sender.y;
+        double dz = z[i] - sender.z;
+        double distanceKm = std::sqrt(dx * dx + dy * dy + dz * dz) / 1000.0;
+        // The highest node is the base station
+        double hb = std::max(sender.z, z[i]);
+        double hm = std::min(sender.z, z[i]);
+        double logHb = std::log10(hb);
+        double logDhm = std::log10(d * hm);
+        double mobileCorrection = a * hm + b + c * logDhm * logDhm + e;
+        double loss = constant - 13.82 * logHb + (44.9 - 6.55 * logHb) * std::log10(distanceKm) -
+                      mobileCorrection;
+        rxPowerDbm[i] -= loss;
+    }
+}
+
+} // namespace lorawan
+} // namespace ns3
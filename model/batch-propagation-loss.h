@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef BATCH_PROPAGATION_LOSS_H
+#define BATCH_PROPAGATION_LOSS_H
+
+#include "ns3/mobility-model.h"
+#include "ns3/propagation-loss-model.h"
+
+#include <vector>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+/**
+ * The receivers of a batch evaluation of propagation loss models, with their
+ * positions in structure of arrays layout.
+ */
+struct ReceiverBatch
+{
+    /**
+     * Add a receiver at the end of the batch.
+     *
+     * \param mobility The mobility model of the receiver.
+     */
+    void Add(Ptr<MobilityModel> mobility);
+
+    /**
+     * Remove all receivers from the batch.
+     */
+    void Clear();
+
+    /**
+     * Get the number of receivers in the batch.
+     *
+     * \return The number of receivers.
+     */
+    size_t GetN() const;
+
+    std::vector<double> x;                    //!< The x coordinates of the receivers [m]
+    std::vector<double> y;                    //!< The y coordinates of the receivers [m]
+    std::vector<double> z;                    //!< The z coordinates of the receivers [m]
+    std::vector<Ptr<MobilityModel>> mobility; //!< The mobility models of the receivers
+};
+
+/**
+ * Interface of propagation loss models that can apply their loss to a whole
+ * batch of receivers at once.
+ */
+class BatchLossModel
+{
+  public:
+    virtual ~BatchLossModel() = default;
+
+    /**
+     * Apply the loss of this model, and not of the next ones of the chain, to
+     * the power received by a batch of receivers from a sender.
+     *
+     * Receivers must be handled in order, so that random values are drawn in
+     * the same order as when receivers are evaluated one by one.
+     *
+     * \param sender The mobility model of the sender.
+     * \param receivers The receivers.
+     * \param rxPowerDbm The power [dBm] at each receiver before this model,
+     * replaced by the power after it.
+     */
+    virtual void CalcRxPowerBatch(Ptr<MobilityModel> sender,
+                                  const ReceiverBatch& receivers,
+                                  double* rxPowerDbm) const = 0;
+};
+
+/**
+ * Evaluation of a chain of propagation loss models for a sender and a batch
+ * of receivers.
+ *
+ * LogDistancePropagationLossModel and OkumuraHataPropagationLossModel are
+ * evaluated with branchless loops over the position arrays, which compilers
+ * can vectorize, and models implementing BatchLossModel with their own batch
+ * implementation. From the first other model of the chain on, the rest of the
+ * chain is evaluated one receiver at a time with CalcRxPower.
+ */
+class BatchPropagationLoss
+{
+  public:
+    /**
+     * Compute the power received by a batch of receivers from a sender.
+     *
+     * \param model The first model of the chain.
+     * \param txPowerDbm The transmission power [dBm].
+     * \param sender The mobility model of the sender.
+     * \param receivers The receivers.
+     * \param rxPowerDbm The power [dBm] at each receiver, in the order of the
+     * batch.
+     */
+    static void CalcRxPower(Ptr<PropagationLossModel> model,
+                            double txPowerDbm,
+                            Ptr<MobilityModel> sender,
+                            const ReceiverBatch& receivers,
+                            std::vector<double>& rxPowerDbm);
+
+  private:
+    /**
+     * Apply the loss of a LogDistancePropagationLossModel to a batch.
+     *
+     * \param model The model.
+     * \param sender The position of the sender.
+     * \param receivers The receivers.
+     * \param rxPowerDbm The power at each receiver, updated in place.
+     */
+    static void LogDistance(Ptr<PropagationLossModel> model,
+                            const Vector& sender,
+                            const ReceiverBatch& receivers,
+                            double* rxPowerDbm);
+
+    /**
+     * Apply the loss of an OkumuraHataPropagationLossModel to a batch.
+     *
+     * \param model The model.
+     * \param sender The position of the sender.
+     * \param receivers The receivers.
+     * \param rxPowerDbm The power at each receiver, updated in place.
+     */
+    static void OkumuraHata(Ptr<PropagationLossModel> model,
+                            const Vector& sender,
+                            const ReceiverBatch& receivers,
+                            double* rxPowerDbm);
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* BATCH_PROPAGATION_LOSS_H */
@@ -36,6 +36,7 @@ BuildingPenetrationLoss::GetTypeId()
 }
 
 BuildingPenetrationLoss::BuildingPenetrationLoss()
+    : m_perPacketLossEnabled(true)
 {
     NS_LOG_FUNCTION_NOARGS();
 
@@ -51,6 +52,13 @@ BuildingPenetrationLoss::~BuildingPenetrationLoss()
     m_wallLossMap.clear();
 }
 
+void
+BuildingPenetrationLoss::SetPerPacketLossEnabled(bool enabled)
+{
+    NS_LOG_FUNCTION(this << enabled);
+    m_perPacketLossEnabled = enabled;
+}
+
 double
 BuildingPenetrationLoss::DoCalcRxPower(double txPowerDbm,
                                        Ptr<MobilityModel> a,
@@ -58,6 +66,36 @@ BuildingPenetrationLoss::DoCalcRxPower(double txPowerDbm,
 {
     NS_LOG_FUNCTION(this << txPowerDbm << a << b);
 
+    if (!m_perPacketLossEnabled)
+    {
+        return txPowerDbm;
+    }
+    return txPowerDbm - GetPerPacketLoss(a, b);
+}
+
+void
+BuildingPenetrationLoss::CalcRxPowerBatch(Ptr<MobilityModel> sender,
+                                          const ReceiverBatch& receivers,
+                                          double* rxPowerDbm) const
+{
+    NS_LOG_FUNCTION(this << sender << receivers.GetN());
+
+    if (!m_perPacketLossEnabled)
+    {
+        return;
+    }
+    // Building information is needed, so receivers are handled one by one
+    for (size_t i = 0; i < receivers.GetN(); ++i)
+    {
+        rxPowerDbm[i] -= GetPerPacketLoss(sender, receivers.mobility[i]);
+    }
+}
+
+double
+BuildingPenetrationLoss::GetPerPacketLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const
+{
+    NS_LOG_FUNCTION(this << a << b);
+
     Ptr<MobilityBuildingInfo> a1 = a->GetObject<MobilityBuildingInfo>();
     Ptr<MobilityBuildingInfo> b1 = b->GetObject<MobilityBuildingInfo>();
 
@@ -121,7 +159,100 @@ BuildingPenetrationLoss::DoCalcRxPower(double txPowerDbm,
 
     NS_LOG_DEBUG("Total loss due to building penetration: " << loss);
 
-    return txPowerDbm - loss;
+    return loss;
+}
+
+uint32_t
+BuildingPenetrationLoss::GetLinkState(Ptr<MobilityModel> a, Ptr<MobilityModel> b)
+{
+    NS_LOG_FUNCTION(this << a << b);
+
+    // All the values of a link fit in 11 bits
+    Link link = DescribeLink(a, b);
+    uint32_t state = link.nNodes | (link.externalWalls << 2);
+    for (uint8_t n = 0; n < 2; ++n)
+    {
+        state |= (link.wallLoss[n] << (3 + 4 * n)) | (link.p[n] << (5 + 4 * n));
+    }
+    return state;
+}
+
+double
+BuildingPenetrationLoss::DrawLinkLoss(uint32_t state) const
+{
+    Link link;
+    link.nNodes = state & 3;
+    link.externalWalls = (state >> 2) & 1;
+    for (uint8_t n = 0; n < 2; ++n)
+    {
+        link.wallLoss[n] = (state >> (3 + 4 * n)) & 3;
+        link.p[n] = (state >> (5 + 4 * n)) & 3;
+    }
+    return DrawLoss(link, *m_uniformRV);
+}
+
+BuildingPenetrationLoss::Link
+BuildingPenetrationLoss::DescribeLink(Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver)
+{
+    auto getValue = [this](std::map<Ptr<MobilityModel>, int>& values,
+                           Ptr<MobilityModel> node,
+                           int (BuildingPenetrationLoss::*draw)() const) {
+        auto it = values.find(node);
+        if (it == values.end())
+        {
+            it = values.emplace(node, (this->*draw)()).first;
+        }
+        return it->second;
+    };
+    Ptr<MobilityBuildingInfo> a1 = sender->GetObject<MobilityBuildingInfo>();
+    Ptr<MobilityBuildingInfo> b1 = receiver->GetObject<MobilityBuildingInfo>();
+    // Same cases as GetPerPacketLoss, the receiver coming first
+    Ptr<MobilityModel> nodes[2];
+    Link link = {0, true, {0, 0}, {0, 0}};
+    if (b1->IsIndoor())
+    {
+        nodes[link.nNodes++] = receiver;
+    }
+    if (a1->IsIndoor())
+    {
+        nodes[link.nNodes++] = sender;
+    }
+    if (link.nNodes == 2 && a1->GetBuilding() == b1->GetBuilding())
+    {
+        link.nNodes = 1;
+        link.externalWalls = false;
+    }
+    for (uint8_t n = 0; n < link.nNodes; ++n)
+    {
+        if (link.externalWalls)
+        {
+            link.wallLoss[n] =
+                getValue(m_wallLossMap, nodes[n], &BuildingPenetrationLoss::GetWallLossValue);
+        }
+        link.p[n] = getValue(m_pMap, nodes[n], &BuildingPenetrationLoss::GetPValue);
+    }
+    return link;
+}
+
+double
+BuildingPenetrationLoss::DrawLoss(const Link& link, UniformRandomVariable& rv)
+{
+    if (link.nNodes == 0)
+    {
+        return 0;
+    }
+    double externalWallLoss = 0;
+    double tor1 = 0;
+    for (uint8_t n = 0; n < link.nNodes; ++n)
+    {
+        if (link.externalWalls)
+        {
+            externalWallLoss += DrawWallLoss(link.wallLoss[n], rv);
+        }
+        tor1 += rv.GetValue(4, 10) * link.p[n];
+    }
+    double tor3 = 0.6 * rv.GetValue(0, 15);
+    return externalWallLoss + std::max(tor1, tor3);
 }
 
 int64_t
@@ -197,14 +328,20 @@ BuildingPenetrationLoss::GetWallLoss(Ptr<MobilityModel> b) const
         NS_LOG_DEBUG("Inserted a new wall loss value: " << m_wallLossMap.find(b)->second);
     }
 
-    switch (m_wallLossMap.find(b)->second)
+    return DrawWallLoss(m_wallLossMap.find(b)->second, *m_uniformRV);
+}
+
+double
+BuildingPenetrationLoss::DrawWallLoss(int wallLossValue, UniformRandomVariable& rv)
+{
+    switch (wallLossValue)
     {
     case 0:
-        return m_uniformRV->GetValue(4, 11);
+        return rv.GetValue(4, 11);
     case 1:
-        return m_uniformRV->GetValue(11, 19);
+        return rv.GetValue(11, 19);
     case 2:
-        return m_uniformRV->GetValue(19, 23);
+        return rv.GetValue(19, 23);
     }
 
     // Case in which something goes wrong
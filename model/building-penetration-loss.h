@@ -11,6 +11,9 @@
 #ifndef BUILDING_PENETRATION_LOSS_H
 #define BUILDING_PENETRATION_LOSS_H
 
+#include "batch-propagation-loss.h"
+#include "per-packet-loss-model.h"
+
 #include "ns3/mobility-model.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/random-variable-stream.h"
@@ -25,8 +28,14 @@ namespace lorawan
 
 /**
  * A class implementing the TR 45.820 model for building losses
+ *
+ * All the components of this loss are drawn anew for every packet (only the
+ * p value and the wall loss class of each node are kept), so the whole loss
+ * is a per-packet loss.
  */
-class BuildingPenetrationLoss : public PropagationLossModel
+class BuildingPenetrationLoss : public PropagationLossModel,
+                                public PerPacketLossModel,
+                                public BatchLossModel
 {
   public:
     static TypeId GetTypeId();
@@ -35,7 +44,49 @@ class BuildingPenetrationLoss : public PropagationLossModel
 
     ~BuildingPenetrationLoss() override;
 
+    // Inherited from PerPacketLossModel
+    void SetPerPacketLossEnabled(bool enabled) override;
+    double GetPerPacketLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const override;
+    uint32_t GetLinkState(Ptr<MobilityModel> a, Ptr<MobilityModel> b) override;
+    double DrawLinkLoss(uint32_t state) const override;
+
+    // Inherited from BatchLossModel
+    void CalcRxPowerBatch(Ptr<MobilityModel> sender,
+                          const ReceiverBatch& receivers,
+                          double* rxPowerDbm) const override;
+
   private:
+    /**
+     * What decides the loss of a link, apart from the values drawn for every
+     * packet.
+     */
+    struct Link
+    {
+        uint8_t nNodes;     //!< Number of indoor nodes whose walls are crossed
+        bool externalWalls; //!< Whether the external walls of the nodes are crossed
+        int wallLoss[2];    //!< Wall loss values of the nodes
+        int p[2];           //!< p values of the nodes
+    };
+
+    /**
+     * Find out which walls a link crosses, drawing the values of the nodes
+     * that don't have any yet.
+     *
+     * \param sender The mobility model of the sender.
+     * \param receiver The mobility model of the receiver.
+     * \return The link, its receiver coming first.
+     */
+    Link DescribeLink(Ptr<MobilityModel> sender, Ptr<MobilityModel> receiver);
+
+    /**
+     * Draw the loss of a link for a packet.
+     *
+     * \param link The link.
+     * \param rv The random variable to draw from.
+     * \return The building penetration loss [dB].
+     */
+    static double DrawLoss(const Link& link, UniformRandomVariable& rv);
+
     /**
      * Perform the computation of the received power according to the current
      * model.
@@ -68,6 +119,15 @@ class BuildingPenetrationLoss : public PropagationLossModel
      */
     double GetWallLoss(Ptr<MobilityModel> b) const;
 
+    /**
+     * Draw an external wall loss.
+     *
+     * \param wallLossValue The wall loss value of the node.
+     * \param rv The random variable to draw from.
+     * \returns The power loss due to external walls.
+     */
+    static double DrawWallLoss(int wallLossValue, UniformRandomVariable& rv);
+
     /**
      * Get the Tor1 value used in the TR 45.820 standard to account for internal
      * wall loss.
@@ -78,6 +138,8 @@ class BuildingPenetrationLoss : public PropagationLossModel
 
     Ptr<UniformRandomVariable> m_uniformRV; //!< An uniform RV
 
+    bool m_perPacketLossEnabled; //!< Whether DoCalcRxPower applies the loss
+
     /**
      * A map linking each mobility model to a p value
      */
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef CONCURRENT_LOSS_MODEL_H
+#define CONCURRENT_LOSS_MODEL_H
+
+#include "batch-propagation-loss.h"
+
+#include "ns3/vector.h"
+
+namespace ns3
+{
+namespace lorawan
+{
+
+/**
+ * Interface of propagation loss models that can only be evaluated by several
+ * threads at once for some links, for instance once some state is built.
+ *
+ * Before evaluating the links from a sender to a batch of receivers on
+ * several threads, LoraChannel calls PrepareConcurrentEvaluation on the
+ * simulator thread. The threads then only see stand-ins of the mobility
+ * models of the nodes, at the positions passed to this method.
+ */
+class ConcurrentLossModel
+{
+  public:
+    virtual ~ConcurrentLossModel() = default;
+
+    /**
+     * Get ready for the evaluation of the links from a sender to a batch of
+     * receivers on several threads.
+     *
+     * \param sender The position of the sender.
+     * \param receivers The receivers, whose positions are filled in.
+     * \return Whether CalcRxPower can then be called concurrently for these
+     * links, without modifying the model and with the results it has on the
+     * simulator thread.
+     */
+    virtual bool PrepareConcurrentEvaluation(const Vector& sender,
+                                             const ReceiverBatch& receivers) = 0;
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* CONCURRENT_LOSS_MODEL_H */
@@ -12,8 +12,19 @@
 
 #include "ns3/double.h"
 #include "ns3/log.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/string.h"
 
 #include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace ns3
 {
@@ -38,11 +49,27 @@ CorrelatedShadowingPropagationLossModel::GetTypeId()
                 "uncorrelated",
                 DoubleValue(110.0),
                 MakeDoubleAccessor(&CorrelatedShadowingPropagationLossModel::m_correlationDistance),
-                MakeDoubleChecker<double>());
+                MakeDoubleChecker<double>())
+            .AddAttribute(
+                "RasterSize",
+                "The side of the square region centered on the origin in which "
+                "shadowing values are precomputed in a raster (0 to disable)",
+                DoubleValue(0),
+                MakeDoubleAccessor(&CorrelatedShadowingPropagationLossModel::m_rasterSize),
+                MakeDoubleChecker<double>(0))
+            .AddAttribute(
+                "RasterFile",
+                "The file the raster is loaded from if it was generated with the same "
+                "parameters, seed, run and assigned stream, and saved to otherwise (empty "
+                "to keep it in memory)",
+                StringValue(""),
+                MakeStringAccessor(&CorrelatedShadowingPropagationLossModel::m_rasterFile),
+                MakeStringChecker());
     return tid;
 }
 
 CorrelatedShadowingPropagationLossModel::CorrelatedShadowingPropagationLossModel()
+    : m_rasterSize(0)
 {
     NS_LOG_FUNCTION_NOARGS();
 }
@@ -60,6 +87,78 @@ CorrelatedShadowingPropagationLossModel::DoCalcRxPower(double txPowerDbm,
 {
     NS_LOG_FUNCTION(this << txPowerDbm << a << b);
 
+    double loss;
+    auto raster = GetShadowingRaster();
+    if (raster && raster->GetLoss(a->GetPosition(), b->GetPosition(), loss))
+    {
+        NS_LOG_INFO("Shadowing loss: " << loss);
+        return txPowerDbm - loss;
+    }
+
+    // Get b's position in a's ShadowingMap
+    CorrelatedShadowingPropagationLossModel::Position bPosition(b->GetPosition().x,
+                                                                b->GetPosition().y);
+
+    // Use the map of the a MobilityModel to determine the value of shadowing
+    // that corresponds to the position of the MobilityModel b.
+    loss = GetShadowingMap(a)->GetLoss(bPosition);
+
+    NS_LOG_INFO("Shadowing loss: " << loss);
+
+    return txPowerDbm - loss;
+}
+
+void
+CorrelatedShadowingPropagationLossModel::CalcRxPowerBatch(Ptr<MobilityModel> sender,
+                                                          const ReceiverBatch& receivers,
+                                                          double* rxPowerDbm) const
+{
+    NS_LOG_FUNCTION(this << sender << receivers.GetN());
+    // All receivers are looked up in the raster, or else in the map of the sender
+    auto raster = GetShadowingRaster();
+    Vector senderPosition = sender->GetPosition();
+    Ptr<ShadowingMap> shadowingMap = (raster) ? nullptr : GetShadowingMap(sender);
+    for (size_t i = 0; i < receivers.GetN(); ++i)
+    {
+        double loss;
+        Vector position(receivers.x[i], receivers.y[i], receivers.z[i]);
+        if (!raster || !raster->GetLoss(senderPosition, position, loss))
+        {
+            if (!shadowingMap)
+            {
+                shadowingMap = GetShadowingMap(sender);
+            }
+            loss = shadowingMap->GetLoss(Position(position.x, position.y));
+        }
+        rxPowerDbm[i] -= loss;
+    }
+}
+
+bool
+CorrelatedShadowingPropagationLossModel::PrepareConcurrentEvaluation(const Vector& sender,
+                                                                     const ReceiverBatch& receivers)
+{
+    NS_LOG_FUNCTION(this << sender << receivers.GetN());
+    auto raster = GetShadowingRaster();
+    if (!raster || !raster->Contains(sender))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < receivers.GetN(); ++i)
+    {
+        if (!raster->Contains(Vector(receivers.x[i], receivers.y[i], receivers.z[i])))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+Ptr<CorrelatedShadowingPropagationLossModel::ShadowingMap>
+CorrelatedShadowingPropagationLossModel::GetShadowingMap(Ptr<MobilityModel> a) const
+{
+    NS_LOG_FUNCTION(this << a);
+
     /*
      * Check whether the a MobilityModel is in a grid square that already has
      * its shadowing map.
@@ -106,23 +205,49 @@ CorrelatedShadowingPropagationLossModel::DoCalcRxPower(double txPowerDbm,
     // Place the iterator on the coordinates
     it = m_shadowingGrid.find(coordinates);
 
-    // Get b's position in a's ShadowingMap
-    CorrelatedShadowingPropagationLossModel::Position bPosition(b->GetPosition().x,
-                                                                b->GetPosition().y);
-
-    // Use the map of the a MobilityModel to determine the value of shadowing
-    // that corresponds to the position of the MobilityModel b.
-    double loss = it->second->GetLoss(bPosition);
-
-    NS_LOG_INFO("Shadowing loss: " << loss);
+    return it->second;
+}
 
-    return txPowerDbm - loss;
+const CorrelatedShadowingPropagationLossModel::ShadowingRaster*
+CorrelatedShadowingPropagationLossModel::GetShadowingRaster() const
+{
+    if (m_rasterSize <= 0)
+    {
+        return nullptr;
+    }
+    if (!m_raster)
+    {
+        // The random variable is only created when the raster is enabled, so
+        // that the automatic stream numbers of other models are unchanged
+        if (!m_rasterValue)
+        {
+            m_rasterValue = CreateObject<NormalRandomVariable>();
+            m_rasterValue->SetAttribute("Mean", DoubleValue(0.0));
+            m_rasterValue->SetAttribute("Variance", DoubleValue(16.0));
+        }
+        m_raster = Create<ShadowingRaster>(m_correlationDistance,
+                                           m_rasterSize,
+                                           m_rasterValue,
+                                           m_rasterFile);
+    }
+    return PeekPointer(m_raster);
 }
 
 int64_t
 CorrelatedShadowingPropagationLossModel::DoAssignStreams(int64_t stream)
 {
-    return 0;
+    if (m_rasterSize <= 0)
+    {
+        return 0;
+    }
+    if (!m_rasterValue)
+    {
+        m_rasterValue = CreateObject<NormalRandomVariable>();
+        m_rasterValue->SetAttribute("Mean", DoubleValue(0.0));
+        m_rasterValue->SetAttribute("Variance", DoubleValue(16.0));
+    }
+    m_rasterValue->SetStream(stream);
+    return 1;
 }
 
 /*********************************
@@ -216,47 +341,286 @@ CorrelatedShadowingPropagationLossModel::ShadowingMap::GetLoss(
 
         NS_LOG_DEBUG(q11 << " " << q12 << " " << q21 << " " << q22 << " ");
 
-        // The c matrix contains the positions of the 4 vertices
-        double c[2][4] = {{xmin, xmax, xmax, xmin}, {ymin, ymin, ymax, ymax}};
+        double shadowing =
+            Interpolate(x, y, xmin, ymin, m_correlationDistance, q11, q12, q21, q22);
 
-        // For the following procedure, reference:
-        // S. Schlegel et al., "On the Interpolation of Data with Normally
-        // Distributed Uncertainty for Visualization", IEEE Transactions on
-        // Visualization and Computer Graphics, vol. 18, no. 12, Dec. 2012.
+        // Add the newly computed shadowing value to the shadowing map
+        m_shadowingMap[position] = shadowing;
+        NS_LOG_DEBUG("Created new shadowing map: " << shadowing);
+    }
+    else
+    {
+        NS_LOG_DEBUG("Shadowing map for this location already exists");
+    }
 
-        // Compute the phi coefficients
-        double phi1 = 0;
-        double phi2 = 0;
-        double phi3 = 0;
-        double phi4 = 0;
+    return m_shadowingMap[position];
+}
 
-        for (int j = 0; j < 4; j++)
-        {
-            double distance = sqrt((c[0][j] - x) * (c[0][j] - x) + (c[1][j] - y) * (c[1][j] - y));
+double
+CorrelatedShadowingPropagationLossModel::ShadowingMap::Interpolate(double x,
+                                                                   double y,
+                                                                   double xmin,
+                                                                   double ymin,
+                                                                   double correlationDistance,
+                                                                   double q11,
+                                                                   double q12,
+                                                                   double q21,
+                                                                   double q22)
+{
+    double xmax = xmin + correlationDistance;
+    double ymax = ymin + correlationDistance;
 
-            NS_LOG_DEBUG("Distance: " << distance);
+    // The c matrix contains the positions of the 4 vertices
+    double c[2][4] = {{xmin, xmax, xmax, xmin}, {ymin, ymin, ymax, ymax}};
 
-            double k = std::exp(-distance / m_correlationDistance);
-            phi1 = phi1 + m_kInv[0][j] * k;
-            phi2 = phi2 + m_kInv[1][j] * k;
-            phi3 = phi3 + m_kInv[2][j] * k;
-            phi4 = phi4 + m_kInv[3][j] * k;
-        }
+    // For the following procedure, reference:
+    // S. Schlegel et al., "On the Interpolation of Data with Normally
+    // Distributed Uncertainty for Visualization", IEEE Transactions on
+    // Visualization and Computer Graphics, vol. 18, no. 12, Dec. 2012.
 
-        NS_LOG_DEBUG("Phi: " << phi1 << " " << phi2 << " " << phi3 << " " << phi4 << " ");
+    // Compute the phi coefficients
+    double phi1 = 0;
+    double phi2 = 0;
+    double phi3 = 0;
+    double phi4 = 0;
 
-        double shadowing = q11 * phi1 + q21 * phi2 + q22 * phi3 + q12 * phi4;
+    for (int j = 0; j < 4; j++)
+    {
+        double distance = sqrt((c[0][j] - x) * (c[0][j] - x) + (c[1][j] - y) * (c[1][j] - y));
 
-        // Add the newly computed shadowing value to the shadowing map
-        m_shadowingMap[position] = shadowing;
-        NS_LOG_DEBUG("Created new shadowing map: " << shadowing);
+        NS_LOG_DEBUG("Distance: " << distance);
+
+        double k = std::exp(-distance / correlationDistance);
+        phi1 = phi1 + m_kInv[0][j] * k;
+        phi2 = phi2 + m_kInv[1][j] * k;
+        phi3 = phi3 + m_kInv[2][j] * k;
+        phi4 = phi4 + m_kInv[3][j] * k;
     }
-    else
+
+    NS_LOG_DEBUG("Phi: " << phi1 << " " << phi2 << " " << phi3 << " " << phi4 << " ");
+
+    return q11 * phi1 + q21 * phi2 + q22 * phi3 + q12 * phi4;
+}
+
+/************************************
+ *  ShadowingRaster implementation  *
+ ************************************/
+
+/// Identifier at the beginning of raster files
+static const char RASTER_MAGIC[8] = {'S', 'H', 'D', 'W', 'R', 'S', 'T', 'R'};
+
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::ShadowingRaster(
+    double correlationDistance,
+    double size,
+    Ptr<NormalRandomVariable> shadowingValue,
+    const std::string& file)
+    : m_header{},
+      m_data(nullptr),
+      m_mapping(nullptr),
+      m_mappingSize(0)
+{
+    NS_LOG_FUNCTION(this << correlationDistance << size << file);
+    NS_ASSERT_MSG(correlationDistance > 0, "The correlation distance must be positive");
+
+    std::memcpy(m_header.magic, RASTER_MAGIC, sizeof(m_header.magic));
+    m_header.version = 2;
+    // Squares from -half to half, the central one being centered on the origin
+    auto half = static_cast<uint32_t>(size / 2 / correlationDistance);
+    m_header.squares = 2 * half + 1;
+    m_header.correlationDistance = correlationDistance;
+    m_header.seed = RngSeedManager::GetSeed();
+    m_header.run = RngSeedManager::GetRun();
+    m_header.stream = shadowingValue->GetStream();
+
+    if (!file.empty() && Load(file))
     {
-        NS_LOG_DEBUG("Shadowing map for this location already exists");
+        NS_LOG_DEBUG("Loaded the shadowing raster from " << file);
+        return;
     }
 
-    return m_shadowingMap[position];
+    // One value per vertex of the region
+    size_t count = size_t(m_header.squares + 1) * (m_header.squares + 1);
+    NS_LOG_DEBUG("Generating " << count << " shadowing values");
+    m_values.resize(count);
+    for (auto& value : m_values)
+    {
+        value = shadowingValue->GetValue();
+    }
+    m_data = m_values.data();
+
+    if (!file.empty())
+    {
+        Save(file);
+    }
+}
+
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::~ShadowingRaster()
+{
+    NS_LOG_FUNCTION_NOARGS();
+#if defined(__unix__) || defined(__APPLE__)
+    if (m_mapping)
+    {
+        munmap(m_mapping, m_mappingSize);
+    }
+#endif
+}
+
+bool
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::GetLoss(const Vector& a,
+                                                                  const Vector& b,
+                                                                  double& loss) const
+{
+    double fieldA;
+    double fieldB;
+    if (!GetField(a, fieldA) || !GetField(b, fieldB))
+    {
+        return false;
+    }
+    // The sum of two independent values of the field has twice its variance
+    loss = (fieldA + fieldB) * M_SQRT1_2;
+    return true;
+}
+
+bool
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::GetField(const Vector& position,
+                                                                   double& value) const
+{
+    uint32_t x;
+    uint32_t y;
+    if (!GetSquare(position.x, x) || !GetSquare(position.y, y))
+    {
+        return false;
+    }
+
+    // Vertex (kx, ky) is the lower left corner of the square of coordinates
+    // kx - half and ky - half
+    size_t side = m_header.squares + 1;
+    double q11 = m_data[x * side + y];
+    double q12 = m_data[x * side + y + 1];
+    double q21 = m_data[(x + 1) * side + y];
+    double q22 = m_data[(x + 1) * side + y + 1];
+
+    double distance = m_header.correlationDistance;
+    double half = (m_header.squares - 1) / 2;
+    double xmin = (x - half) * distance - distance / 2;
+    double ymin = (y - half) * distance - distance / 2;
+    value = ShadowingMap::Interpolate(position.x,
+                                      position.y,
+                                      xmin,
+                                      ymin,
+                                      distance,
+                                      q11,
+                                      q12,
+                                      q21,
+                                      q22);
+    return true;
+}
+
+bool
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::Contains(const Vector& position) const
+{
+    uint32_t x;
+    uint32_t y;
+    return GetSquare(position.x, x) && GetSquare(position.y, y);
+}
+
+bool
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::GetSquare(double coordinate,
+                                                                    uint32_t& index) const
+{
+    // Same rounding as the coordinates of the squares of the shadowing grid
+    double distance = m_header.correlationDistance;
+    double rounded = std::trunc((std::fabs(coordinate) + distance / 2) / distance);
+    double half = (m_header.squares - 1) / 2;
+    if (!(rounded <= half))
+    {
+        return false;
+    }
+    index = static_cast<uint32_t>(half + ((coordinate < 0) ? -rounded : rounded));
+    return true;
+}
+
+bool
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::Load(const std::string& file)
+{
+    NS_LOG_FUNCTION(this << file);
+    // Values drawn from an automatically numbered stream depend on the
+    // number of random variables created before, so they are not reused
+    if (m_header.stream < 0)
+    {
+        NS_LOG_DEBUG("Not loading a raster for a random variable without assigned stream");
+        return false;
+    }
+    size_t count = size_t(m_header.squares + 1) * (m_header.squares + 1);
+    size_t size = sizeof(Header) + count * sizeof(float);
+
+    auto matches = [this](const Header& header) {
+        return std::memcmp(header.magic, m_header.magic, sizeof(header.magic)) == 0 &&
+               header.version == m_header.version && header.squares == m_header.squares &&
+               header.correlationDistance == m_header.correlationDistance &&
+               header.seed == m_header.seed && header.run == m_header.run &&
+               header.stream == m_header.stream;
+    };
+
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) != size)
+    {
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    Header header;
+    std::memcpy(&header, mapping, sizeof(Header));
+    if (!matches(header))
+    {
+        NS_LOG_DEBUG("The raster in " << file << " was generated with other parameters");
+        munmap(mapping, size);
+        return false;
+    }
+    m_mapping = mapping;
+    m_mappingSize = size;
+    m_data = reinterpret_cast<const float*>(static_cast<const char*>(mapping) + sizeof(Header));
+    return true;
+#else
+    std::ifstream stream(file, std::ios::binary);
+    Header header;
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(Header)) || !matches(header))
+    {
+        return false;
+    }
+    m_values.resize(count);
+    if (!stream.read(reinterpret_cast<char*>(m_values.data()), count * sizeof(float)))
+    {
+        m_values.clear();
+        return false;
+    }
+    m_data = m_values.data();
+    return true;
+#endif
+}
+
+void
+CorrelatedShadowingPropagationLossModel::ShadowingRaster::Save(const std::string& file) const
+{
+    NS_LOG_FUNCTION(this << file);
+    std::ofstream stream(file, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(&m_header), sizeof(Header));
+    stream.write(reinterpret_cast<const char*>(m_values.data()), m_values.size() * sizeof(float));
+    if (!stream)
+    {
+        NS_LOG_WARN("Could not save the shadowing raster to " << file);
+    }
 }
 
 /*****************************
@@ -11,11 +11,17 @@
 #ifndef CORRELATED_SHADOWING_PROPAGATION_LOSS_MODEL_H
 #define CORRELATED_SHADOWING_PROPAGATION_LOSS_MODEL_H
 
+#include "batch-propagation-loss.h"
+#include "concurrent-loss-model.h"
+
 #include "ns3/mobility-model.h"
 #include "ns3/propagation-loss-model.h"
 #include "ns3/random-variable-stream.h"
 #include "ns3/vector.h"
 
+#include <string>
+#include <vector>
+
 namespace ns3
 {
 class MobilityModel;
@@ -23,7 +29,9 @@ class MobilityModel;
 namespace lorawan
 {
 
-class CorrelatedShadowingPropagationLossModel : public PropagationLossModel
+class CorrelatedShadowingPropagationLossModel : public PropagationLossModel,
+                                                public BatchLossModel,
+                                                public ConcurrentLossModel
 {
   public:
     class Position
@@ -73,6 +81,31 @@ class CorrelatedShadowingPropagationLossModel : public PropagationLossModel
          */
         double GetLoss(CorrelatedShadowingPropagationLossModel::Position position);
 
+        /**
+         * Interpolate the shadowing at a position from the values at the 4
+         * vertices of the grid square containing it.
+         *
+         * \param x The x coordinate of the position [m].
+         * \param y The y coordinate of the position [m].
+         * \param xmin The x coordinate of the left side of the square [m].
+         * \param ymin The y coordinate of the lower side of the square [m].
+         * \param correlationDistance The side of the square [m].
+         * \param q11 The value at the lower left vertex.
+         * \param q12 The value at the upper left vertex.
+         * \param q21 The value at the lower right vertex.
+         * \param q22 The value at the upper right vertex.
+         * \return The interpolated shadowing [dB].
+         */
+        static double Interpolate(double x,
+                                  double y,
+                                  double xmin,
+                                  double ymin,
+                                  double correlationDistance,
+                                  double q11,
+                                  double q12,
+                                  double q21,
+                                  double q22);
+
       private:
         /**
          * For each Position, this map gives a corresponding loss.
@@ -100,6 +133,116 @@ class CorrelatedShadowingPropagationLossModel : public PropagationLossModel
         static const double m_kInv[4][4];
     };
 
+    /**
+     * A shadowing field precomputed on a regular grid, stored as a flat
+     * raster of floats that can be saved to a file and memory-mapped later
+     * on.
+     *
+     * The raster covers a square region centered on the origin, made of the
+     * grid squares of the model, and holds one independent shadowing value
+     * per vertex of the region. The field at any position is interpolated in
+     * constant time from the 4 vertices surrounding it, with the same kriging
+     * coefficients as ShadowingMap. Rather than one field per sender square,
+     * which would take a number of values growing as the fourth power of the
+     * side of the region, the loss of a link sums the fields at both of its
+     * ends, scaled to keep the variance of the field: links from or to nearby
+     * positions are correlated, and the loss is the same in both directions.
+     */
+    class ShadowingRaster
+        : public SimpleRefCount<CorrelatedShadowingPropagationLossModel::ShadowingRaster>
+    {
+      public:
+        /**
+         * Load the raster from a file if it exists and was generated with the
+         * same parameters, or generate it and save it to the file otherwise.
+         *
+         * \param correlationDistance The side of grid squares [m].
+         * \param size The side of the square region covered by the raster [m].
+         * \param shadowingValue The random variable shadowing values are drawn from.
+         * \param file The file to load the raster from and save it to, or the
+         * empty string to only keep it in memory.
+         */
+        ShadowingRaster(double correlationDistance,
+                        double size,
+                        Ptr<NormalRandomVariable> shadowingValue,
+                        const std::string& file);
+
+        ~ShadowingRaster();
+
+        /**
+         * Get the loss between two positions, if both are in the raster.
+         *
+         * \param a The position of the sender.
+         * \param b The position of the receiver.
+         * \param loss The loss [dB], set if both positions are in the raster.
+         * \return Whether both positions are in the raster.
+         */
+        bool GetLoss(const Vector& a, const Vector& b, double& loss) const;
+
+        /**
+         * Check whether a position is in the raster.
+         *
+         * \param position The position.
+         * \return Whether the position is in the region covered by the raster.
+         */
+        bool Contains(const Vector& position) const;
+
+      private:
+        /**
+         * Description of a raster, at the beginning of its files.
+         */
+        struct Header
+        {
+            char magic[8];              //!< Identifier of raster files
+            uint32_t version;           //!< Version of the file format
+            uint32_t squares;           //!< Number of grid squares per side of the region
+            double correlationDistance; //!< Side of grid squares [m]
+            uint64_t seed;              //!< Seed the values were drawn with
+            uint64_t run;               //!< Run the values were drawn with
+            int64_t stream;             //!< Stream the values were drawn from, -1 if automatic
+        };
+
+        /**
+         * Interpolate the shadowing field at a position.
+         *
+         * \param position The position.
+         * \param value The shadowing [dB], set if the position is in the raster.
+         * \return Whether the position is in the raster.
+         */
+        bool GetField(const Vector& position, double& value) const;
+
+        /**
+         * Memory-map the values of a raster file, if it matches m_header.
+         *
+         * \param file The file.
+         * \return Whether the file could be used.
+         */
+        bool Load(const std::string& file);
+
+        /**
+         * Write the header and values of the raster to a file.
+         *
+         * \param file The file.
+         */
+        void Save(const std::string& file) const;
+
+        /**
+         * Get the coordinate of the grid square containing a position, as an
+         * index from 0 to the number of squares per side.
+         *
+         * \param coordinate The x or y coordinate of the position [m].
+         * \param index The index of the square.
+         * \return Whether the position is in the region.
+         */
+        bool GetSquare(double coordinate, uint32_t& index) const;
+
+        Header m_header;             //!< The description of the raster
+        std::vector<float> m_values; //!< The values, if not memory-mapped
+        const float* m_data;         //!< The values, per vertex
+        void* m_mapping;             //!< The memory mapping of the file, if any
+        size_t m_mappingSize;        //!< The size of the memory mapping [B]
+    };
+
     static TypeId GetTypeId();
 
     /**
@@ -118,15 +261,63 @@ class CorrelatedShadowingPropagationLossModel : public PropagationLossModel
      */
     double GetCorrelationDistance();
 
+    // Inherited from BatchLossModel
+    void CalcRxPowerBatch(Ptr<MobilityModel> sender,
+                          const ReceiverBatch& receivers,
+                          double* rxPowerDbm) const override;
+
+    /**
+     * Generate or load the raster, and check that all positions are in it.
+     * Outside of the raster, shadowing maps are created as links are
+     * evaluated, which can't be done on several threads.
+     *
+     * \param sender The position of the sender.
+     * \param receivers The receivers.
+     * \return Whether the raster is enabled and contains all positions.
+     */
+    bool PrepareConcurrentEvaluation(const Vector& sender,
+                                     const ReceiverBatch& receivers) override;
+
   private:
     double DoCalcRxPower(double txPowerDbm,
                          Ptr<MobilityModel> a,
                          Ptr<MobilityModel> b) const override;
 
+    /**
+     * Get the ShadowingMap of the grid square of a node, creating it if
+     * needed.
+     *
+     * \param a The mobility model of the node.
+     * \return The ShadowingMap.
+     */
+    Ptr<ShadowingMap> GetShadowingMap(Ptr<MobilityModel> a) const;
+
+    /**
+     * Get the raster of shadowing values, generating or loading it at the
+     * first call.
+     *
+     * \return The raster, or nullptr if it is disabled. No reference is
+     * taken, so that threads can share it.
+     */
+    const ShadowingRaster* GetShadowingRaster() const;
+
     int64_t DoAssignStreams(int64_t stream) override;
 
     double m_correlationDistance; //!< The correlation distance for the ShadowingMap
 
+    double m_rasterSize;      //!< The side of the region covered by the raster (0 to disable) [m]
+    std::string m_rasterFile; //!< The file the raster is saved to and loaded from
+
+    /**
+     * The raster of shadowing values, once generated or loaded.
+     */
+    mutable Ptr<ShadowingRaster> m_raster;
+
+    /**
+     * The random variable the values of the raster are drawn from.
+     */
+    mutable Ptr<NormalRandomVariable> m_rasterValue;
+
     /**
      * Map linking a square to a ShadowingMap.
      * Each square of the shadowing grid has a corresponding ShadowingMap, and a
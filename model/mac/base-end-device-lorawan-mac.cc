@@ -163,13 +163,9 @@ BaseEndDeviceLorawanMac::GetNextTransmissionDelay()
     NS_LOG_FUNCTION(this);
 
     // Check legal duty cycle
-    Time waitingTime = Time::Max();
-    for (const auto& llc : m_channelManager->GetEnabledChannelList())
-    {
-        waitingTime = std::min(waitingTime, m_channelManager->GetWaitingTime(llc));
-        NS_LOG_DEBUG("Waiting time before the next transmission in channel with frequency "
-                     << llc->GetFrequency() << " is = " << waitingTime.GetSeconds() << ".");
-    }
+    Time waitingTime = m_channelManager->GetMinimumWaitingTime();
+    NS_LOG_DEBUG("Waiting time before the next transmission is = " << waitingTime.GetSeconds()
+                                                                    << ".");
 
     // Check if we are busy and if we need to postpone more (overridden function!)
     waitingTime = Max(waitingTime, GetBusyTransmissionDelay());
@@ -320,44 +316,8 @@ BaseEndDeviceLorawanMac::GetChannelForTx()
 {
     NS_LOG_FUNCTION(this);
 
-    auto channels = Shuffle(m_channelManager->GetEnabledChannelList());
-    for (auto& llc : channels)
-    {
-        NS_LOG_DEBUG("Frequency of the current channel: " << llc->GetFrequency());
-
-        // Verify that we can send the packet
-        Time waitingTime = m_channelManager->GetWaitingTime(llc);
-        NS_LOG_DEBUG("Waiting time for current channel = " << waitingTime.GetSeconds());
-
-        // Send immediately if we can
-        if (waitingTime == Seconds(0))
-        {
-            return llc;
-        }
-        else
-        {
-            NS_LOG_DEBUG("Packet cannot be immediately transmitted on "
-                         << "the current channel because of duty cycle limitations.");
-        }
-    }
-    return nullptr; // In this case, no suitable channel was found
-}
-
-std::vector<Ptr<LogicalChannel>>
-BaseEndDeviceLorawanMac::Shuffle(std::vector<Ptr<LogicalChannel>> vector)
-{
-    NS_LOG_FUNCTION(this << vector);
-
-    int size = vector.size();
-    for (int i = 0; i < size; ++i)
-    {
-        uint8_t random = m_uniformRV->GetInteger(0, size - 1);
-        auto tmp = vector.at(random);
-        vector.at(random) = vector.at(i);
-        vector.at(i) = tmp;
-    }
-
-    return vector;
+    // Pick uniformly among the channels we can send the packet on right now
+    return m_channelManager->SelectUplinkChannel(m_uniformRV);
 }
 
 ////////////////////////
@@ -827,8 +787,10 @@ BaseEndDeviceLorawanMac::OnNewChannelReq(uint8_t chIndex,
 
     // Check whether the new data rate range is ok
     bool dataRateRangeOk = (minDataRate >= 0 && maxDataRate <= 5);
-    // Check whether the frequency is ok
-    bool channelFrequencyOk = bool(m_channelManager->GetSubBandFromFrequency(frequency));
+    // Check whether the frequency is ok, and whether a channel can be created
+    // at the index read off the air
+    bool channelFrequencyOk = bool(m_channelManager->GetSubBandFromFrequency(frequency)) &&
+                              chIndex < LogicalChannelManager::MAX_CHANNELS;
     if (dataRateRangeOk && channelFrequencyOk)
     {
         auto logicalChannel = Create<LogicalChannel>(frequency, minDataRate, maxDataRate);
@@ -875,6 +837,15 @@ BaseEndDeviceLorawanMac::GetDeviceAddress()
     return m_address;
 }
 
+std::array<uint8_t, SE_KEY_SIZE>
+BaseEndDeviceLorawanMac::GetKey(KeyIdentifier_t keyId) const
+{
+    std::array<uint8_t, SE_KEY_SIZE> key{};
+    auto status = m_crypto->GetKey(keyId, key.data());
+    NS_ASSERT_MSG(status == SECURE_ELEMENT_SUCCESS, "Unknown key " << keyId);
+    return key;
+}
+
 void
 BaseEndDeviceLorawanMac::SetFType(LorawanMacHeader::FType fType)
 {
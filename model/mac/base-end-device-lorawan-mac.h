@@ -25,6 +25,8 @@
 #include "ns3/LoRaMacCrypto.h"
 #include "ns3/traced-value.h"
 
+#include <array>
+
 #define ADR_ACK_LIMIT 64
 #define ADR_ACK_DELAY 32
 
@@ -113,6 +115,15 @@ class BaseEndDeviceLorawanMac : public LorawanMac
      */
     LoraDeviceAddress GetDeviceAddress();
 
+    /**
+     * Get the value of one of the keys of this device, e.g., to register its
+     * session keys at the network server.
+     *
+     * \param keyId The identifier of the key.
+     * \return The value of the key.
+     */
+    std::array<uint8_t, SE_KEY_SIZE> GetKey(KeyIdentifier_t keyId) const;
+
     /**
      * Set the message type to send when the Send method is called.
      */
@@ -303,8 +314,8 @@ class BaseEndDeviceLorawanMac : public LorawanMac
     /////////////////////////
 
     /**
-     * An uniform random variable, used by the Shuffle method to randomly reorder
-     * the channel list.
+     * An uniform random variable, used to pick a random channel among the
+     * available ones.
      */
     Ptr<UniformRandomVariable> m_uniformRV;
 
@@ -353,13 +364,6 @@ class BaseEndDeviceLorawanMac : public LorawanMac
     /* Check if we need to backoff parameters after long radio silence */
     void ExecuteADRBackoff();
 
-    /**
-     * Randomly shuffle a Ptr<LogicalChannel> vector.
-     *
-     * Used to pick a random channel on which to send the packet.
-     */
-    std::vector<Ptr<LogicalChannel>> Shuffle(std::vector<Ptr<LogicalChannel>> vector);
-
     /////////////////////////////////
     //  Private MAC layer actions  //
     /////////////////////////////////
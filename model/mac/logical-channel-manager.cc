@@ -15,6 +15,8 @@
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 
+#include <bit>
+
 namespace ns3
 {
 namespace lorawan
@@ -35,10 +37,12 @@ LogicalChannelManager::GetTypeId()
 }
 
 LogicalChannelManager::LogicalChannelManager()
-    : m_lastTxDuration(0),
+    : m_channelMask(0),
+      m_lastTxDuration(0),
       m_lastTxStart(0)
 {
     NS_LOG_FUNCTION(this);
+    m_channelSubBand.fill(NO_SUB_BAND);
 }
 
 LogicalChannelManager::~LogicalChannelManager()
@@ -52,10 +56,10 @@ LogicalChannelManager::GetChannelList()
     NS_LOG_FUNCTION(this);
 
     std::vector<Ptr<LogicalChannel>> vector;
-    vector.reserve(m_channelList.size());
-    for (auto& llc : m_channelList)
+    vector.reserve(std::popcount(m_channelMask));
+    for (uint16_t mask = m_channelMask; mask; mask &= mask - 1)
     {
-        vector.push_back(llc.second);
+        vector.push_back(m_channelList[std::countr_zero(mask)]);
     }
 
     return vector;
@@ -67,11 +71,12 @@ LogicalChannelManager::GetEnabledChannelList()
     NS_LOG_FUNCTION(this);
 
     std::vector<Ptr<LogicalChannel>> vector;
-    for (auto& llc : m_channelList)
+    for (uint16_t mask = m_channelMask; mask; mask &= mask - 1)
     {
-        if (llc.second->IsEnabledForUplink())
+        auto& llc = m_channelList[std::countr_zero(mask)];
+        if (llc->IsEnabledForUplink())
         {
-            vector.push_back(llc.second);
+            vector.push_back(llc);
         }
     }
 
@@ -83,25 +88,28 @@ LogicalChannelManager::GetChannel(uint8_t chIndex)
 {
     NS_LOG_FUNCTION(this);
 
-    return (m_channelList.count(chIndex)) ? m_channelList.at(chIndex) : nullptr;
+    return (chIndex < MAX_CHANNELS) ? m_channelList[chIndex] : nullptr;
 }
 
 Ptr<SubBand>
 LogicalChannelManager::GetSubBandFromChannel(const Ptr<LogicalChannel> channel)
 {
+    // Registered channels have their SubBand precomputed
+    uint8_t index = GetChannelSubBandIndex(channel);
+    if (index != NO_SUB_BAND)
+    {
+        return m_subBandList[index];
+    }
     return GetSubBandFromFrequency(channel->GetFrequency());
 }
 
 Ptr<SubBand>
 LogicalChannelManager::GetSubBandFromFrequency(double frequency)
 {
-    // Get the SubBand this frequency belongs to
-    for (auto& sub : m_subBandList)
+    uint8_t index = GetSubBandIndex(frequency);
+    if (index != NO_SUB_BAND)
     {
-        if (sub->BelongsToSubBand(frequency))
-        {
-            return sub;
-        }
+        return m_subBandList[index];
     }
 
     NS_LOG_ERROR("Requested frequency=" << frequency << " is outside any known SubBand.");
@@ -109,11 +117,44 @@ LogicalChannelManager::GetSubBandFromFrequency(double frequency)
     return nullptr; // If no SubBand is found, return 0
 }
 
+uint8_t
+LogicalChannelManager::GetSubBandIndex(double frequency) const
+{
+    // Get the SubBand this frequency belongs to
+    for (size_t i = 0; i < m_subBandList.size(); ++i)
+    {
+        if (m_subBandList[i]->BelongsToSubBand(frequency))
+        {
+            return i;
+        }
+    }
+    return NO_SUB_BAND;
+}
+
+uint8_t
+LogicalChannelManager::GetChannelSubBandIndex(const Ptr<LogicalChannel> channel) const
+{
+    // Channels are compared by identity: a copy may not be registered
+    for (uint16_t mask = m_channelMask; mask; mask &= mask - 1)
+    {
+        uint8_t i = std::countr_zero(mask);
+        if (PeekPointer(m_channelList[i]) == PeekPointer(channel))
+        {
+            return m_channelSubBand[i];
+        }
+    }
+    return NO_SUB_BAND;
+}
+
 void
 LogicalChannelManager::AddChannel(uint8_t chIndex, Ptr<LogicalChannel> logicalChannel)
 {
     NS_LOG_FUNCTION(this << (unsigned)chIndex << logicalChannel);
+    NS_ABORT_MSG_UNLESS(chIndex < MAX_CHANNELS,
+                        "Channel index " << (unsigned)chIndex << " too big");
     m_channelList[chIndex] = logicalChannel;
+    m_channelSubBand[chIndex] = GetSubBandIndex(logicalChannel->GetFrequency());
+    m_channelMask |= 1 << chIndex;
 }
 
 void
@@ -141,14 +182,29 @@ LogicalChannelManager::AddSubBand(Ptr<SubBand> subBand)
 {
     NS_LOG_FUNCTION(this << subBand);
 
+    NS_ASSERT_MSG(m_subBandList.size() < NO_SUB_BAND, "Too many SubBands");
     m_subBandList.push_back(subBand);
+
+    // Channels registered before their SubBand now belong to it
+    for (uint16_t mask = m_channelMask; mask; mask &= mask - 1)
+    {
+        uint8_t i = std::countr_zero(mask);
+        if (m_channelSubBand[i] == NO_SUB_BAND)
+        {
+            m_channelSubBand[i] = GetSubBandIndex(m_channelList[i]->GetFrequency());
+        }
+    }
 }
 
 void
 LogicalChannelManager::RemoveChannel(uint8_t chIndex)
 {
-    // Search and remove the channel from the list
-    m_channelList.erase(chIndex);
+    // Remove the channel from the list, if present
+    if (chIndex < MAX_CHANNELS)
+    {
+        m_channelList[chIndex] = nullptr;
+        m_channelMask &= ~(1 << chIndex);
+    }
 }
 
 Time
@@ -187,6 +243,68 @@ LogicalChannelManager::GetWaitingTime(const Ptr<LogicalChannel> channel)
     return subBandWaitingTime;
 }
 
+Time
+LogicalChannelManager::GetMinimumWaitingTime()
+{
+    NS_LOG_FUNCTION(this);
+
+    Time nextTransmissionTime = Time::Max();
+    for (uint16_t mask = m_channelMask; mask; mask &= mask - 1)
+    {
+        uint8_t i = std::countr_zero(mask);
+        if (m_channelList[i]->IsEnabledForUplink())
+        {
+            NS_ASSERT_MSG(m_channelSubBand[i] != NO_SUB_BAND,
+                          "Channel " << (unsigned)i << " is outside any known SubBand");
+            nextTransmissionTime =
+                Min(nextTransmissionTime,
+                    m_subBandList[m_channelSubBand[i]]->GetNextTransmissionTime());
+        }
+    }
+    if (nextTransmissionTime == Time::Max())
+    {
+        return nextTransmissionTime;
+    }
+
+    // Handle case in which waiting time is negative
+    Time waitingTime = Max(nextTransmissionTime - Simulator::Now(), Seconds(0));
+
+    NS_LOG_DEBUG("Minimum waiting time: " << waitingTime.GetSeconds());
+
+    return waitingTime;
+}
+
+Ptr<LogicalChannel>
+LogicalChannelManager::SelectUplinkChannel(Ptr<UniformRandomVariable> uniform)
+{
+    NS_LOG_FUNCTION(this);
+
+    // Gather the enabled channels whose SubBand is available right now
+    Time now = Simulator::Now();
+    std::array<uint8_t, MAX_CHANNELS> available;
+    uint8_t count = 0;
+    for (uint16_t mask = m_channelMask; mask; mask &= mask - 1)
+    {
+        uint8_t i = std::countr_zero(mask);
+        if (m_channelList[i]->IsEnabledForUplink() && m_channelSubBand[i] != NO_SUB_BAND &&
+            m_subBandList[m_channelSubBand[i]]->GetNextTransmissionTime() <= now)
+        {
+            available[count++] = i;
+        }
+    }
+
+    if (count == 0)
+    {
+        NS_LOG_DEBUG("No channel can be used because of duty cycle limitations.");
+        return nullptr;
+    }
+
+    auto& llc = m_channelList[available[uniform->GetInteger(0, count - 1)]];
+    NS_LOG_DEBUG("Selected channel with frequency " << llc->GetFrequency() << " among "
+                                                    << (unsigned)count << " available.");
+    return llc;
+}
+
 void
 LogicalChannelManager::AddEvent(Time duration, Ptr<LogicalChannel> channel)
 {
@@ -214,23 +332,17 @@ LogicalChannelManager::GetTxPowerForChannel(Ptr<LogicalChannel> logicalChannel)
     NS_LOG_FUNCTION_NOARGS();
 
     // Get the maxTxPowerDbm from the SubBand this channel is in
-    for (const auto& sub : m_subBandList)
-    {
-        // Check whether this channel is in this SubBand
-        if (sub->BelongsToSubBand(logicalChannel->GetFrequency()))
-        {
-            return sub->GetMaxTxPowerDbm();
-        }
-    }
-
-    NS_ABORT_MSG("Logical channel doesn't belong to a known SubBand");
+    auto subBand = GetSubBandFromChannel(logicalChannel);
+    NS_ABORT_MSG_UNLESS(subBand, "Logical channel doesn't belong to a known SubBand");
+    return subBand->GetMaxTxPowerDbm();
 }
 
 void
 LogicalChannelManager::DisableChannel(uint8_t chIndex)
 {
     NS_LOG_FUNCTION(this << (unsigned)chIndex);
-    m_channelList.at(chIndex)->DisableForUplink();
+    NS_ASSERT_MSG(GetChannel(chIndex), "Channel " << (unsigned)chIndex << " does not exist");
+    m_channelList[chIndex]->DisableForUplink();
 }
 
 void
@@ -238,7 +350,8 @@ LogicalChannelManager::DoDispose()
 {
     NS_LOG_FUNCTION(this);
     m_subBandList.clear();
-    m_channelList.clear();
+    m_channelList.fill(nullptr);
+    m_channelMask = 0;
     Object::DoDispose();
 }
 
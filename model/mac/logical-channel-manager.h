@@ -20,9 +20,9 @@
 #include "ns3/object.h"
 #include "ns3/packet.h"
 
-#include <iterator>
-#include <list>
-#include <map>
+#include "ns3/random-variable-stream.h"
+
+#include <array>
 #include <vector>
 
 namespace ns3
@@ -42,6 +42,12 @@ namespace lorawan
 class LogicalChannelManager : public Object
 {
   public:
+    /**
+     * The maximum number of channels, as addressed by the 16 bit channel mask
+     * of LinkAdrReq commands.
+     */
+    static constexpr uint8_t MAX_CHANNELS = 16;
+
     static TypeId GetTypeId();
 
     LogicalChannelManager();
@@ -70,6 +76,27 @@ class LogicalChannelManager : public Object
      */
     Time GetWaitingTime(const Ptr<LogicalChannel> channel);
 
+    /**
+     * Get the time it is necessary to wait for before transmitting on any of
+     * the channels enabled for uplink.
+     *
+     * \remark Like GetWaitingTime, this does not take into account aggregate
+     * waiting time.
+     *
+     * \return The smallest waiting time of the enabled channels, or Time::Max
+     * if no channel is enabled.
+     */
+    Time GetMinimumWaitingTime();
+
+    /**
+     * Pick a random channel among the ones enabled for uplink on which
+     * transmitting is currently allowed by duty cycle limitations.
+     *
+     * \param uniform The random variable used to pick the channel.
+     * \return The channel, or nullptr if there is none.
+     */
+    Ptr<LogicalChannel> SelectUplinkChannel(Ptr<UniformRandomVariable> uniform);
+
     /**
      * Preemptively register the transmission of a packet.
      *
@@ -103,6 +130,8 @@ class LogicalChannelManager : public Object
     /**
      * Add a new channel at a fixed index.
      *
+     * Indexes from MAX_CHANNELS on are a fatal error.
+     *
      * \param chIndex The index of the channel to substitute.
      * \param logicalChannel A pointer to the channel to add to the list.
      */
@@ -180,17 +209,48 @@ class LogicalChannelManager : public Object
     void DoDispose() override;
 
   private:
+    /**
+     * Value of m_channelSubBand for channels outside of any known SubBand.
+     */
+    static constexpr uint8_t NO_SUB_BAND = 0xff;
+
+    /**
+     * Get the index of the SubBand a frequency belongs to.
+     *
+     * \param frequency The frequency we want to check.
+     * \return The index in m_subBandList, or NO_SUB_BAND.
+     */
+    uint8_t GetSubBandIndex(double frequency) const;
+
+    /**
+     * Get the index in m_subBandList of the SubBand of a registered channel.
+     *
+     * \param channel The channel.
+     * \return The index of its SubBand, or NO_SUB_BAND if the channel is not
+     * registered or is outside any known SubBand.
+     */
+    uint8_t GetChannelSubBandIndex(const Ptr<LogicalChannel> channel) const;
+
     /**
      * A list of the SubBands that are currently registered within this helper.
      */
-    std::list<Ptr<SubBand>> m_subBandList;
+    std::vector<Ptr<SubBand>> m_subBandList;
+
+    /**
+     * The LogicalChannels that are currently registered within this helper,
+     * by index. The first N channels are the default ones for a fixed region.
+     */
+    std::array<Ptr<LogicalChannel>, MAX_CHANNELS> m_channelList;
+
+    /**
+     * The index in m_subBandList of the SubBand of each channel.
+     */
+    std::array<uint8_t, MAX_CHANNELS> m_channelSubBand;
 
     /**
-     * A vector of the LogicalChannels that are currently registered within
-     * this helper. This vector represents the node's channel mask. The first N
-     * channels are the default ones for a fixed region.
+     * Bit i is set if there is a channel at index i of m_channelList.
      */
-    std::map<uint8_t, Ptr<LogicalChannel>> m_channelList;
+    uint16_t m_channelMask;
 
     Time m_lastTxDuration; //!< Duration of the last frame (seconds).
 
@@ -205,7 +205,7 @@ class LoraFrameHeader : public Header
      * in this header.
      */
     template <typename T>
-    inline Ptr<T> GetMacCommand();
+    inline Ptr<T> GetMacCommand() const;
 
     /**
      * Byte lenght of serialized MacCommands coming from FRMPayload.
@@ -335,7 +335,7 @@ class LoraFrameHeader : public Header
 
 template <typename T>
 Ptr<T>
-LoraFrameHeader::GetMacCommand()
+LoraFrameHeader::GetMacCommand() const
 {
     // Iterate on MAC commands and try casting
     for (const auto& cmd : m_macCommands)
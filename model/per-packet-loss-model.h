@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef PER_PACKET_LOSS_MODEL_H
+#define PER_PACKET_LOSS_MODEL_H
+
+#include "ns3/mobility-model.h"
+#include "ns3/ptr.h"
+
+#include <cstdint>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+/**
+ * Interface of propagation loss models whose loss has a component that is
+ * drawn anew for every packet, on top of one that only depends on the link.
+ *
+ * The LoraChannel link gain cache evaluates the loss model chain once per
+ * link with the per-packet components disabled, and then adds them back for
+ * every packet by calling GetPerPacketLoss on each model of the chain
+ * implementing this interface. With the per-packet component disabled,
+ * CalcRxPower must be safe to call from several threads at once, so that
+ * LoraChannel can compute receptions in parallel.
+ *
+ * When it computes receptions in parallel, LoraChannel draws the per-packet
+ * losses on the simulator thread in receiver order, as it does otherwise, so
+ * that they do not depend on the number of threads.
+ *
+ * Models implementing GetLinkState and DrawLinkLoss let the link gain cache
+ * also keep what their per-packet loss depends on, so that it is only drawn
+ * for every packet, without looking up the nodes again.
+ */
+class PerPacketLossModel
+{
+  public:
+    virtual ~PerPacketLossModel() = default;
+
+    /**
+     * Set whether CalcRxPower includes the per-packet component of the loss.
+     *
+     * \param enabled False to only compute the component of the loss that
+     * depends on the link.
+     */
+    virtual void SetPerPacketLossEnabled(bool enabled) = 0;
+
+    /**
+     * Draw the per-packet component of the loss of a link.
+     *
+     * \param a The mobility model of the sender.
+     * \param b The mobility model of the receiver.
+     * \return The loss [dB] to add to the one computed with the per-packet
+     * component disabled.
+     */
+    virtual double GetPerPacketLoss(Ptr<MobilityModel> a, Ptr<MobilityModel> b) const = 0;
+
+    /// State of the links whose per-packet loss can't be drawn from a state
+    static constexpr uint32_t NO_LINK_STATE = UINT32_MAX;
+
+    /**
+     * Get what the per-packet loss of a link depends on, apart from the values
+     * drawn for every packet. It must stay valid until one of the nodes moves.
+     *
+     * \param a The mobility model of the sender.
+     * \param b The mobility model of the receiver.
+     * \return The state of the link, to pass to DrawLinkLoss. By default,
+     * NO_LINK_STATE.
+     */
+    virtual uint32_t GetLinkState(Ptr<MobilityModel> a, Ptr<MobilityModel> b)
+    {
+        return NO_LINK_STATE;
+    }
+
+    /**
+     * Draw the per-packet component of the loss of a link from its state.
+     *
+     * \param state The state of the link, returned by GetLinkState.
+     * \return The loss [dB] to add to the one computed with the per-packet
+     * component disabled.
+     */
+    virtual double DrawLinkLoss(uint32_t state) const
+    {
+        return 0;
+    }
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* PER_PACKET_LOSS_MODEL_H */
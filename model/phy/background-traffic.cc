@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#include "background-traffic.h"
+
+#include "gateway-lora-phy.h"
+#include "lora-phy.h"
+
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/double.h"
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+NS_LOG_COMPONENT_DEFINE("BackgroundTraffic");
+
+NS_OBJECT_ENSURE_REGISTERED(BackgroundTraffic);
+
+TypeId
+BackgroundTraffic::GetTypeId()
+{
+    static TypeId tid =
+        TypeId("ns3::BackgroundTraffic")
+            .SetParent<Object>()
+            .SetGroupName("lorawan")
+            .AddConstructor<BackgroundTraffic>()
+            .AddAttribute("Devices",
+                          "Number of background devices",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&BackgroundTraffic::m_devices),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("PacketInterval",
+                          "Mean time between two packets of a background device",
+                          TimeValue(Seconds(600)),
+                          MakeTimeAccessor(&BackgroundTraffic::m_interval),
+                          MakeTimeChecker(Seconds(0), Time::Max()))
+            .AddAttribute("PacketSize",
+                          "Size of the PHY payload of background packets [B]",
+                          UintegerValue(23),
+                          MakeUintegerAccessor(&BackgroundTraffic::m_size),
+                          MakeUintegerChecker<uint32_t>(0, 255))
+            .AddAttribute("Radius",
+                          "Radius of the disk background devices are deployed in [m]",
+                          DoubleValue(5000),
+                          MakeDoubleAccessor(&BackgroundTraffic::m_radius),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("Height",
+                          "Height of background devices [m]",
+                          DoubleValue(1.5),
+                          MakeDoubleAccessor(&BackgroundTraffic::m_height),
+                          MakeDoubleChecker<double>())
+            .AddAttribute("TxPower",
+                          "Transmission power of background devices [dBm]",
+                          DoubleValue(14),
+                          MakeDoubleAccessor(&BackgroundTraffic::m_txPowerDbm),
+                          MakeDoubleChecker<double>());
+    return tid;
+}
+
+BackgroundTraffic::BackgroundTraffic()
+    : m_devices(0),
+      m_interval(Seconds(600)),
+      m_size(23),
+      m_radius(5000),
+      m_height(1.5),
+      m_txPowerDbm(14),
+      m_frequencies({868100000, 868300000, 868500000}),
+      m_durations{}
+{
+    NS_LOG_FUNCTION(this);
+    m_sender = CreateObject<ConstantPositionMobilityModel>();
+    m_gap = CreateObject<ExponentialRandomVariable>();
+    m_uniform = CreateObject<UniformRandomVariable>();
+}
+
+BackgroundTraffic::~BackgroundTraffic()
+{
+    NS_LOG_FUNCTION(this);
+}
+
+void
+BackgroundTraffic::SetPropagationLossModel(Ptr<PropagationLossModel> loss)
+{
+    NS_LOG_FUNCTION(this << loss);
+    m_loss = loss;
+}
+
+void
+BackgroundTraffic::SetReceiver(Ptr<MobilityModel> receiver)
+{
+    NS_LOG_FUNCTION(this << receiver);
+    m_receiver = receiver;
+}
+
+void
+BackgroundTraffic::SetFrequencies(const std::vector<double>& frequenciesHz)
+{
+    NS_LOG_FUNCTION(this << frequenciesHz.size());
+    m_frequencies = frequenciesHz;
+}
+
+double
+BackgroundTraffic::GetArrivalRate() const
+{
+    if (m_frequencies.empty() || m_interval.IsZero())
+    {
+        return 0;
+    }
+    return m_devices / m_interval.GetSeconds() / m_frequencies.size();
+}
+
+void
+BackgroundTraffic::AddInterference(Time startTime,
+                                   Time endTime,
+                                   double frequencyHz,
+                                   std::array<double, 6>& energyJ)
+{
+    NS_LOG_FUNCTION(this << startTime << endTime << frequencyHz);
+    double rate = GetArrivalRate();
+    if (rate == 0 ||
+        std::find(m_frequencies.begin(), m_frequencies.end(), frequencyHz) == m_frequencies.end())
+    {
+        return;
+    }
+    NS_ASSERT_MSG(m_loss && m_receiver,
+                  "Background traffic needs a propagation loss model and a receiver");
+    if (m_durations[0].IsZero())
+    {
+        LoraPhyTxParameters params;
+        for (uint8_t sf = 7; sf <= 12; ++sf)
+        {
+            params.sf = sf;
+            params.lowDataRateOptimizationEnabled = LoraPhy::GetTSym(params) > MilliSeconds(16);
+            m_durations[sf - 7] = LoraPhy::GetTimeOnAir(m_size, params);
+        }
+    }
+    // Only packets sent after the start of the reception minus the longest
+    // duration can overlap with it. Arrivals being memoryless, the process can
+    // be started from there.
+    double start = startTime.GetSeconds();
+    double end = endTime.GetSeconds();
+    double mean = 1 / rate;
+    unsigned overlapping = 0;
+    for (double arrival = start - m_durations[5].GetSeconds() + m_gap->GetValue(mean, 0);
+         arrival < end;
+         arrival += m_gap->GetValue(mean, 0))
+    {
+        double rxPowerW;
+        uint8_t sf = DrawSignal(rxPowerW);
+        double overlap = std::min(end, arrival + m_durations[sf - 7].GetSeconds()) -
+                         std::max(start, arrival);
+        if (overlap > 0)
+        {
+            // Energy [J] = Time [s] * Power [W]
+            energyJ[sf - 7] += overlap * rxPowerW;
+            overlapping++;
+        }
+    }
+    NS_LOG_DEBUG("Found " << overlapping << " overlapping background packets");
+}
+
+uint8_t
+BackgroundTraffic::DrawSignal(double& rxPowerW)
+{
+    // Uniform position in the disk around the receiver
+    double distance = m_radius * std::sqrt(m_uniform->GetValue(0, 1));
+    double angle = m_uniform->GetValue(0, 2 * M_PI);
+    Vector center = m_receiver->GetPosition();
+    m_sender->SetPosition(Vector(center.x + distance * std::cos(angle),
+                                 center.y + distance * std::sin(angle),
+                                 m_height));
+    double rxPowerDbm = m_loss->CalcRxPower(m_txPowerDbm, m_sender, m_receiver);
+    // Equal to 10^(rxPowerDbm / 10) / 1000, but cheaper than pow
+    rxPowerW = std::exp(rxPowerDbm * (M_LN10 / 10)) / 1000;
+    // The lowest spreading factor the gateway can receive the signal with
+    uint8_t sf = 7;
+    while (sf < 12 && rxPowerDbm < GatewayLoraPhy::GetSensitivity(sf))
+    {
+        ++sf;
+    }
+    return sf;
+}
+
+int64_t
+BackgroundTraffic::AssignStreams(int64_t stream)
+{
+    NS_LOG_FUNCTION(this << stream);
+    m_gap->SetStream(stream);
+    m_uniform->SetStream(stream + 1);
+    int64_t streams = 2;
+    if (m_loss)
+    {
+        streams += m_loss->AssignStreams(stream + streams);
+    }
+    return streams;
+}
+
+void
+BackgroundTraffic::DoDispose()
+{
+    NS_LOG_FUNCTION(this);
+    m_loss = nullptr;
+    m_receiver = nullptr;
+    m_sender = nullptr;
+    Object::DoDispose();
+}
+
+} // namespace lorawan
+} // namespace ns3
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2022 Orange SA
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ */
+
+#ifndef BACKGROUND_TRAFFIC_H
+#define BACKGROUND_TRAFFIC_H
+
+#include "ns3/mobility-model.h"
+#include "ns3/nstime.h"
+#include "ns3/object.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/random-variable-stream.h"
+
+#include <array>
+#include <vector>
+
+namespace ns3
+{
+namespace lorawan
+{
+
+/**
+ * Statistical model of the uplink traffic of a large population of
+ * background devices, whose only role is to interfere with the receptions
+ * of a gateway.
+ *
+ * Background devices are not instantiated: they are assumed to be spread
+ * uniformly in a disk around the receiver and to send packets of the same
+ * size as a Poisson process, uniformly over a set of frequencies. When the
+ * interference affecting a reception is evaluated, the background packets
+ * overlapping with it are drawn on the fly. Each one is given a random
+ * position in the disk, a receive power obtained from the propagation loss
+ * model, and the lowest spreading factor whose gateway sensitivity the power
+ * is above, like the allocation of LorawanMacHelper::SetSpreadingFactorsUp.
+ * Arrivals per frequency and spreading factor are thus independent Poisson
+ * processes whose rates and power distributions follow from the geometry.
+ *
+ * Background packets do not occupy reception paths, and the propagation
+ * loss model should not keep state per position (e.g., correlated
+ * shadowing), since every background packet comes from a new one.
+ */
+class BackgroundTraffic : public Object
+{
+  public:
+    /**
+     * Register this type.
+     * \return The object TypeId.
+     */
+    static TypeId GetTypeId();
+
+    BackgroundTraffic();
+    ~BackgroundTraffic() override;
+
+    /**
+     * Set the propagation loss model between background devices and the
+     * receiver.
+     *
+     * \param loss The first model of the chain.
+     */
+    void SetPropagationLossModel(Ptr<PropagationLossModel> loss);
+
+    /**
+     * Set the receiver background devices are deployed around.
+     *
+     * \param receiver The mobility model of the receiver.
+     */
+    void SetReceiver(Ptr<MobilityModel> receiver);
+
+    /**
+     * Set the frequencies background devices send on.
+     *
+     * \param frequenciesHz The frequencies [Hz].
+     */
+    void SetFrequencies(const std::vector<double>& frequenciesHz);
+
+    /**
+     * Get the rate at which background packets are sent on each frequency.
+     *
+     * \return The rate [packets/s].
+     */
+    double GetArrivalRate() const;
+
+    /**
+     * Add the interference energy of the background packets overlapping with
+     * a reception.
+     *
+     * \param startTime The time the reception started.
+     * \param endTime The time the reception ends.
+     * \param frequencyHz The frequency of the reception.
+     * \param energyJ The cumulative interference energy per SF [J], to which
+     * the background energy is added.
+     */
+    void AddInterference(Time startTime,
+                         Time endTime,
+                         double frequencyHz,
+                         std::array<double, 6>& energyJ);
+
+    /**
+     * Assign a fixed random variable stream number to the random variables
+     * used by this model.
+     *
+     * \param stream The first stream index to use.
+     * \return The number of stream indices assigned by this model.
+     */
+    int64_t AssignStreams(int64_t stream);
+
+  protected:
+    void DoDispose() override;
+
+  private:
+    /**
+     * Draw the position of a background device and the parameters of its
+     * signal at the receiver.
+     *
+     * \param rxPowerW The power of the signal at the receiver [W].
+     * \return The spreading factor of the signal.
+     */
+    uint8_t DrawSignal(double& rxPowerW);
+
+    uint32_t m_devices;   //!< The number of background devices
+    Time m_interval;      //!< The mean time between packets of a device
+    uint32_t m_size;      //!< The size of the PHY payload of background packets [B]
+    double m_radius;      //!< The radius of the deployment disk [m]
+    double m_height;      //!< The height of background devices [m]
+    double m_txPowerDbm;  //!< The transmission power of background devices [dBm]
+
+    std::vector<double> m_frequencies;    //!< The frequencies background devices send on [Hz]
+    std::array<Time, 6> m_durations;      //!< The duration of background packets, per SF
+    Ptr<PropagationLossModel> m_loss;     //!< The propagation loss model
+    Ptr<MobilityModel> m_receiver;        //!< The receiver
+    Ptr<MobilityModel> m_sender;          //!< Position of the background device being drawn
+    Ptr<ExponentialRandomVariable> m_gap; //!< Time between consecutive arrivals
+    Ptr<UniformRandomVariable> m_uniform; //!< Positions of background devices
+};
+
+} // namespace lorawan
+} // namespace ns3
+#endif /* BACKGROUND_TRAFFIC_H */
@@ -138,13 +138,14 @@ EndDeviceLoraPhy::TxFinished(Ptr<Packet> packet)
 }
 
 void
-EndDeviceLoraPhy::StartReceive(Ptr<Packet> packet,
-                               double rxPowerDbm,
-                               uint8_t sf,
-                               Time duration,
-                               double frequency)
+EndDeviceLoraPhy::ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                                      double rxPowerDbm)
 {
-    NS_LOG_FUNCTION(this << packet << rxPowerDbm << unsigned(sf) << duration << frequency);
+    NS_LOG_FUNCTION(this << transmission->id << rxPowerDbm);
+    Ptr<Packet> packet = transmission->packet;
+    uint8_t sf = transmission->sf;
+    Time duration = transmission->duration;
+    double frequency = transmission->frequencyHz;
     // Notify the LoraInterferenceHelper of the impinging signal, and remember
     // the event it creates. This will be used then to correctly handle the end
     // of reception event.
@@ -152,7 +153,16 @@ EndDeviceLoraPhy::StartReceive(Ptr<Packet> packet,
     // We need to do this regardless of our state or frequency, since these could
     // change (and making the interference relevant) while the interference is
     // still incoming.
-    auto event = m_interference->Add(duration, rxPowerDbm, sf, packet, frequency);
+    //
+    // With lazy downlinks, interference is instead computed from the log of
+    // the channel at the end of the reception, and an event is only needed
+    // if we lock on the packet.
+    bool lazy = m_channel && m_channel->IsDownlinkLazy();
+    Ptr<LoraInterferenceHelper::Event> event;
+    if (!lazy)
+    {
+        event = m_interference->Add(transmission, rxPowerDbm);
+    }
     // Switch on the current PHY state
     switch (m_state)
     {
@@ -222,6 +232,10 @@ EndDeviceLoraPhy::StartReceive(Ptr<Packet> packet,
         {
             // Packet Filtering based on Preamble Start (SX1272 Datasheet)
             duration = GetFilteredDuration(packet, duration);
+            if (!event)
+            {
+                event = Create<LoraInterferenceHelper::Event>(transmission, rxPowerDbm);
+            }
             // Switch to RX state
             // EndReceive will handle the switch back to STANDBY state
             SwitchToRx();
@@ -254,7 +268,7 @@ EndDeviceLoraPhy::GetFilteredDuration(Ptr<const Packet> packet, Time duration) c
         LoraTag tag;
         copy->RemovePacketTag(tag);
         // MHDR (1B) + 4B of Addr in FHdr
-        return GetTimeOnAir(Create<Packet>(5), tag.GetTxParameters());
+        return GetTimeOnAir(5, tag.GetTxParameters());
     }
     return duration;
 }
@@ -291,7 +305,12 @@ EndDeviceLoraPhy::EndReceive(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Eve
 
     // Call the LoraInterferenceHelper to determine whether there was destructive
     // interference on this event.
-    uint8_t packetDestroyed = m_interference->IsDestroyedByInterference(event);
+    bool lazy = m_channel && m_channel->IsDownlinkLazy();
+    uint8_t packetDestroyed =
+        (lazy) ? m_interference->IsDestroyedByInterference(
+                     event,
+                     m_channel->GetDownlinkInterferers(this, event))
+               : m_interference->IsDestroyedByInterference(event);
     if (packetDestroyed)
     {
         NS_LOG_INFO("Packet destroyed by interference");
@@ -340,6 +359,11 @@ EndDeviceLoraPhy::SwitchToStandby()
 {
     NS_LOG_FUNCTION_NOARGS();
     m_state = STANDBY;
+    // Tell the channel whether downlinks can be locked on
+    if (m_channel)
+    {
+        m_channel->SetListening(this, true);
+    }
     // Notify listeners of the state change
     for (const auto& l : m_listeners)
     {
@@ -353,6 +377,11 @@ EndDeviceLoraPhy::SwitchToSleep()
     NS_LOG_FUNCTION_NOARGS();
     NS_ASSERT(m_state == STANDBY);
     m_state = SLEEP;
+    // Tell the channel whether downlinks can be locked on
+    if (m_channel)
+    {
+        m_channel->SetListening(this, false);
+    }
     // Notify listeners of the state change
     for (const auto& l : m_listeners)
     {
@@ -366,6 +395,11 @@ EndDeviceLoraPhy::SwitchToRx()
     NS_LOG_FUNCTION_NOARGS();
     NS_ASSERT(m_state == STANDBY);
     m_state = RX;
+    // Tell the channel whether downlinks can be locked on
+    if (m_channel)
+    {
+        m_channel->SetListening(this, false);
+    }
     // Notify listeners of the state change
     for (const auto& l : m_listeners)
     {
@@ -379,6 +413,11 @@ EndDeviceLoraPhy::SwitchToTx(double txPowerDbm)
     NS_LOG_FUNCTION_NOARGS();
     NS_ASSERT(m_state == STANDBY);
     m_state = TX;
+    // Tell the channel whether downlinks can be locked on
+    if (m_channel)
+    {
+        m_channel->SetListening(this, false);
+    }
     // Notify listeners of the state change
     for (const auto& l : m_listeners)
     {
@@ -420,6 +459,12 @@ EndDeviceLoraPhy::SetDeviceAddress(LoraDeviceAddress address)
     m_address = address;
 }
 
+double
+EndDeviceLoraPhy::GetSensitivity(uint8_t sf)
+{
+    return sensitivity[unsigned(sf) - 7];
+}
+
 void
 EndDeviceLoraPhy::RegisterListener(EndDeviceLoraPhyListener* listener)
 {
@@ -446,10 +491,5 @@ EndDeviceLoraPhy::DoDispose()
     LoraPhy::DoDispose();
 }
 
-// Downlink sensitivity (from SX1272 datasheet)
-// {SF7, SF8, SF9, SF10, SF11, SF12}
-// These sensitivites are for a bandwidth of 125000 Hz
-const double EndDeviceLoraPhy::sensitivity[6] = {-124, -127, -130, -133, -135, -137};
-
 } // namespace lorawan
 } // namespace ns3
@@ -145,11 +145,8 @@ class EndDeviceLoraPhy : public LoraPhy
               double txPowerDbm) override;
 
     // Implementation of LoraPhy's pure virtual functions
-    void StartReceive(Ptr<Packet> packet,
-                      double rxPowerDbm,
-                      uint8_t sf,
-                      Time duration,
-                      double frequency) override;
+    void ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                             double rxPowerDbm) override;
 
     // Implementation of LoraPhy's pure virtual functions
     bool IsTransmitting() override;
@@ -214,6 +211,14 @@ class EndDeviceLoraPhy : public LoraPhy
      */
     void SetDeviceAddress(LoraDeviceAddress address);
 
+    /**
+     * Get the sensitivity of this kind of PHY to a certain spreading factor.
+     *
+     * \param sf The spreading factor.
+     * \return The minimum power [dBm] a packet needs to be received with.
+     */
+    static double GetSensitivity(uint8_t sf);
+
   protected:
     void DoDispose() override;
 
@@ -252,7 +257,13 @@ class EndDeviceLoraPhy : public LoraPhy
      */
     LoraDeviceAddress m_address;
 
-    static const double sensitivity[6]; //!< The sensitivity vector of this device to different SFs
+    /**
+     * The sensitivity vector of this device to different SFs.
+     *
+     * Downlink sensitivity (from SX1272 datasheet), {SF7, SF8, SF9, SF10,
+     * SF11, SF12}, for a bandwidth of 125000 Hz.
+     */
+    static constexpr double sensitivity[6] = {-124, -127, -130, -133, -135, -137};
 
     std::vector<EndDeviceLoraPhyListener*> m_listeners; //!< PHY listeners
 
@@ -12,10 +12,14 @@
 
 #include "gateway-lora-phy.h"
 
+#include "background-traffic.h"
+
 #include "ns3/lora-tag.h"
 #include "ns3/node.h"
 #include "ns3/simulator.h"
 
+#include <bit>
+
 namespace ns3
 {
 namespace lorawan
@@ -31,6 +35,7 @@ NS_OBJECT_ENSURE_REGISTERED(GatewayLoraPhy);
 GatewayLoraPhy::ReceptionPath::ReceptionPath()
     : m_available(true),
       m_event(nullptr),
+      m_packet(nullptr),
       m_endReceiveEventId(EventId())
 {
 }
@@ -50,15 +55,18 @@ GatewayLoraPhy::ReceptionPath::Free()
 {
     m_available = true;
     m_event = nullptr;
+    m_packet = nullptr;
     m_endReceiveEventId.Cancel();
     m_endReceiveEventId = EventId();
 }
 
 void
-GatewayLoraPhy::ReceptionPath::LockOnEvent(Ptr<LoraInterferenceHelper::Event> event)
+GatewayLoraPhy::ReceptionPath::LockOnEvent(Ptr<LoraInterferenceHelper::Event> event,
+                                           Ptr<Packet> packet)
 {
     m_available = false;
     m_event = event;
+    m_packet = packet;
 }
 
 Ptr<LoraInterferenceHelper::Event>
@@ -67,6 +75,12 @@ GatewayLoraPhy::ReceptionPath::GetEvent()
     return m_event;
 }
 
+Ptr<Packet>
+GatewayLoraPhy::ReceptionPath::GetPacket()
+{
+    return m_packet;
+}
+
 EventId
 GatewayLoraPhy::ReceptionPath::GetEndReceive()
 {
@@ -129,13 +143,13 @@ GatewayLoraPhy::~GatewayLoraPhy()
 }
 
 void
-GatewayLoraPhy::StartReceive(Ptr<Packet> packet,
-                             double rxPowerDbm,
-                             uint8_t sf,
-                             Time duration,
-                             double frequency)
+GatewayLoraPhy::ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                                    double rxPowerDbm)
 {
-    NS_LOG_FUNCTION(this << packet << rxPowerDbm << duration << frequency);
+    NS_LOG_FUNCTION(this << transmission->id << rxPowerDbm);
+    Ptr<Packet> packet = transmission->packet;
+    uint8_t sf = transmission->sf;
+    Time duration = transmission->duration;
     if (m_isTransmitting)
     {
         // If we get to this point, there are no demodulators we can use
@@ -146,44 +160,45 @@ GatewayLoraPhy::StartReceive(Ptr<Packet> packet,
         return;
     }
     // Add the event to the LoraInterferenceHelper
-    auto event = m_interference->Add(duration, rxPowerDbm, sf, packet, frequency);
-    // Cycle over the receive paths to check availability to receive the packet
-    for (auto& path : m_receptionPaths)
+    auto event = m_interference->Add(transmission, rxPowerDbm);
+    // Take the first available receive path, if any
+    uint16_t index = FindAvailablePath();
+    if (index < m_receptionPaths.size())
     {
-        if (path->IsAvailable()) // If the receive path is available we have a candidate
+        // See whether the reception power is above or below the sensitivity
+        // for that spreading factor
+        double sensitivity = GatewayLoraPhy::sensitivity[unsigned(sf) - 7];
+        if (rxPowerDbm < sensitivity) // Packet arrived below sensitivity
         {
-            // See whether the reception power is above or below the sensitivity
-            // for that spreading factor
-            double sensitivity = GatewayLoraPhy::sensitivity[unsigned(sf) - 7];
-            if (rxPowerDbm < sensitivity) // Packet arrived below sensitivity
-            {
-                NS_LOG_INFO("Dropping packet reception of packet with sf = "
-                            << unsigned(sf) << " because under the sensitivity of " << sensitivity
-                            << " dBm");
-                // Fire the trace sources
-                m_underSensitivity(packet, m_nodeId);
-            }
-            else // We have sufficient sensitivity to start receiving
-            {
-                NS_LOG_INFO("Scheduling reception of a packet, occupying one demodulator");
-                // Block this resource
-                path->LockOnEvent(event);
-                m_occupiedReceptionPaths++;
-                // Schedule the end of the reception of the packet
-                path->SetEndReceive(Simulator::Schedule(duration,
-                                                        &GatewayLoraPhy::EndReceive,
-                                                        this,
-                                                        packet,
-                                                        event));
-                // Fire the trace source
-                m_phyRxBeginTrace(packet);
-            }
-            return;
+            NS_LOG_INFO("Dropping packet reception of packet with sf = "
+                        << unsigned(sf) << " because under the sensitivity of " << sensitivity
+                        << " dBm");
+            // Fire the trace sources
+            m_underSensitivity(packet, m_nodeId);
         }
+        else // We have sufficient sensitivity to start receiving
+        {
+            NS_LOG_INFO("Scheduling reception of a packet, occupying one demodulator");
+            // Block this resource
+            auto& path = m_receptionPaths[index];
+            path.LockOnEvent(event, packet);
+            m_availablePaths[index / 64] &= ~(uint64_t(1) << (index % 64));
+            m_occupiedReceptionPaths++;
+            // Schedule the end of the reception of the packet
+            path.SetEndReceive(Simulator::Schedule(duration,
+                                                   &GatewayLoraPhy::EndReceivePath,
+                                                   this,
+                                                   uint8_t(index),
+                                                   packet,
+                                                   event));
+            // Fire the trace source
+            m_phyRxBeginTrace(packet);
+        }
+        return;
     }
     // If we get to this point, there are no demodulators we can use
     NS_LOG_INFO("Dropping packet reception of packet with sf = "
-                << unsigned(sf) << " and frequency " << frequency
+                << unsigned(sf) << " and frequency " << transmission->frequencyHz
                 << "Hz because no suitable demodulator was found");
     // Fire the trace source
     m_noMoreDemodulators(packet, m_nodeId);
@@ -191,6 +206,39 @@ GatewayLoraPhy::StartReceive(Ptr<Packet> packet,
 
 void
 GatewayLoraPhy::EndReceive(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event)
+{
+    NS_LOG_FUNCTION(this << packet << *event);
+    FinishReception(packet, event);
+    // Search for the demodulator that was locked on this event to free it.
+    for (size_t i = 0; i < m_receptionPaths.size(); ++i)
+    {
+        if (m_receptionPaths[i].GetEvent() == event)
+        {
+            FreePath(uint8_t(i));
+            m_occupiedReceptionPaths--;
+            return;
+        }
+    }
+}
+
+void
+GatewayLoraPhy::EndReceivePath(uint8_t index,
+                               Ptr<Packet> packet,
+                               Ptr<LoraInterferenceHelper::Event> event)
+{
+    NS_LOG_FUNCTION(this << unsigned(index) << packet << *event);
+    FinishReception(packet, event);
+    // The path may have been freed meanwhile, e.g. if upper layers sent a
+    // packet, or reallocated by SetReceptionPaths
+    if (index < m_receptionPaths.size() && m_receptionPaths[index].GetEvent() == event)
+    {
+        FreePath(index);
+        m_occupiedReceptionPaths--;
+    }
+}
+
+void
+GatewayLoraPhy::FinishReception(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event)
 {
     NS_LOG_FUNCTION(this << packet << *event);
     // Call the trace source
@@ -238,16 +286,6 @@ GatewayLoraPhy::EndReceive(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event
             m_phySniffRxTrace(packet);
         }
     }
-    // Search for the demodulator that was locked on this event to free it.
-    for (auto& path : m_receptionPaths)
-    {
-        if (path->GetEvent() == event)
-        {
-            path->Free();
-            m_occupiedReceptionPaths--;
-            return;
-        }
-    }
 }
 
 void
@@ -258,17 +296,25 @@ GatewayLoraPhy::Send(Ptr<Packet> packet,
 {
     NS_LOG_FUNCTION(this << packet << txParams << frequency << txPowerDbm);
 
-    // Interrupt all receive operations
-    for (auto& path : m_receptionPaths)
+    // Interrupt all receive operations, visiting the occupied reception paths
+    for (size_t word = 0; word < m_availablePaths.size(); ++word)
     {
-        if (!path->IsAvailable()) // Reception path is occupied
+        uint64_t occupied = ~m_availablePaths[word];
+        size_t paths = m_receptionPaths.size() - word * 64;
+        if (paths < 64)
         {
+            occupied &= (uint64_t(1) << paths) - 1;
+        }
+        for (; occupied; occupied &= occupied - 1)
+        {
+            auto index = uint8_t(word * 64 + std::countr_zero(occupied));
+            auto& path = m_receptionPaths[index];
             // Fire the trace source for reception interrupted by transmission
-            m_noReceptionBecauseTransmitting(path->GetEvent()->GetPacket(), m_nodeId);
+            m_noReceptionBecauseTransmitting(path.GetPacket(), m_nodeId);
             // Cancel the scheduled EndReceive call
-            Simulator::Cancel(path->GetEndReceive());
+            Simulator::Cancel(path.GetEndReceive());
             // Free it and resets all parameters
-            path->Free();
+            FreePath(index);
         }
     }
 
@@ -322,29 +368,59 @@ void
 GatewayLoraPhy::SetReceptionPaths(uint8_t number)
 {
     NS_LOG_FUNCTION(this << (unsigned)number);
-    m_receptionPaths.clear();
+    m_receptionPaths.assign(number, ReceptionPath());
+    m_availablePaths.assign((number + 63) / 64, 0);
     for (uint32_t i = 0; i < number; ++i)
     {
-        m_receptionPaths.push_back(Create<ReceptionPath>());
+        m_availablePaths[i / 64] |= uint64_t(1) << (i % 64);
+    }
+}
+
+uint16_t
+GatewayLoraPhy::FindAvailablePath() const
+{
+    for (size_t word = 0; word < m_availablePaths.size(); ++word)
+    {
+        if (m_availablePaths[word])
+        {
+            return word * 64 + std::countr_zero(m_availablePaths[word]);
+        }
     }
+    return m_receptionPaths.size();
+}
+
+void
+GatewayLoraPhy::FreePath(uint8_t index)
+{
+    m_receptionPaths[index].Free();
+    m_availablePaths[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+void
+GatewayLoraPhy::SetBackgroundTraffic(Ptr<BackgroundTraffic> background)
+{
+    NS_LOG_FUNCTION(this << background);
+    m_interference->SetBackgroundTraffic(background);
+}
+
+double
+GatewayLoraPhy::GetSensitivity(uint8_t sf)
+{
+    return sensitivity[unsigned(sf) - 7];
 }
 
 void
 GatewayLoraPhy::DoDispose()
 {
     NS_LOG_FUNCTION(this);
-    for (auto rp : m_receptionPaths)
+    for (auto& path : m_receptionPaths)
     {
-        rp->Free();
+        path.Free();
     }
     m_receptionPaths.clear();
+    m_availablePaths.clear();
     LoraPhy::DoDispose();
 }
 
-// Uplink sensitivity (Source: SX1301 datasheet)
-// {SF7, SF8, SF9, SF10, SF11, SF12}
-// These sensitivities are for a bandwidth of 125000 Hz
-const double GatewayLoraPhy::sensitivity[6] = {-126.5, -129, -131.5, -134, -136.5, -139.5};
-
 } // namespace lorawan
 } // namespace ns3
@@ -41,7 +41,7 @@ class GatewayLoraPhy : public LoraPhy
      * listen for a certain SF. ReceptionPaths be either locked on an event or
      * free.
      */
-    class ReceptionPath : public SimpleRefCount<GatewayLoraPhy::ReceptionPath>
+    class ReceptionPath
     {
       public:
         /**
@@ -62,7 +62,8 @@ class GatewayLoraPhy : public LoraPhy
          * Set this reception path as available.
          *
          * This function sets the m_available variable as true, and deletes the
-         * LoraInterferenceHelper Event this ReceivePath was previously locked on.
+         * LoraInterferenceHelper Event and the packet this ReceivePath was
+         * previously locked on.
          */
         void Free();
 
@@ -71,8 +72,9 @@ class GatewayLoraPhy : public LoraPhy
          * provided event.
          *
          * \param event The LoraInterferenceHelper Event to lock on.
+         * \param packet The packet carried by the signal of the event.
          */
-        void LockOnEvent(Ptr<LoraInterferenceHelper::Event> event);
+        void LockOnEvent(Ptr<LoraInterferenceHelper::Event> event, Ptr<Packet> packet);
 
         /**
          * Get the event this reception path is currently on.
@@ -82,6 +84,14 @@ class GatewayLoraPhy : public LoraPhy
          */
         Ptr<LoraInterferenceHelper::Event> GetEvent();
 
+        /**
+         * Get the packet this reception path is currently receiving.
+         *
+         * \returns 0 if no event is currently being received, a pointer to
+         * the packet otherwise.
+         */
+        Ptr<Packet> GetPacket();
+
         /**
          * Get the EventId of the EndReceive call associated to this ReceptionPath's
          * packet.
@@ -105,6 +115,11 @@ class GatewayLoraPhy : public LoraPhy
          */
         Ptr<LoraInterferenceHelper::Event> m_event;
 
+        /**
+         * The packet this reception path is currently receiving.
+         */
+        Ptr<Packet> m_packet;
+
         /**
          * The EventId associated of the call to EndReceive that is scheduled to
          * happen when the packet this ReceivePath is locked on finishes reception.
@@ -118,11 +133,8 @@ class GatewayLoraPhy : public LoraPhy
     GatewayLoraPhy();
     ~GatewayLoraPhy() override;
 
-    void StartReceive(Ptr<Packet> packet,
-                      double rxPowerDbm,
-                      uint8_t sf,
-                      Time duration,
-                      double frequency) override;
+    void ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                             double rxPowerDbm) override;
 
     void Send(Ptr<Packet> packet,
               LoraPhyTxParameters txParams,
@@ -139,29 +151,101 @@ class GatewayLoraPhy : public LoraPhy
      */
     void SetReceptionPaths(uint8_t number);
 
+    /**
+     * Make the receptions of this gateway interfered by a statistical model of
+     * background traffic, in addition to the signals of the channel.
+     *
+     * \param background The background traffic, which must have its receiver
+     * and propagation loss model set.
+     */
+    void SetBackgroundTraffic(Ptr<BackgroundTraffic> background);
+
+    /**
+     * Get the sensitivity of this kind of PHY to a certain spreading factor.
+     *
+     * \param sf The spreading factor.
+     * \return The minimum power [dBm] a packet needs to be received with.
+     */
+    static double GetSensitivity(uint8_t sf);
+
   protected:
     void DoDispose() override;
 
+    /**
+     * Finish the reception of a packet and free the reception path locked on
+     * its event, if any.
+     *
+     * Receptions started by this PHY end through EndReceivePath instead,
+     * which knows the reception path without searching for it.
+     *
+     * \param packet The packet being received.
+     * \param event The event of the packet.
+     */
     void EndReceive(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event) override;
 
+    /**
+     * Finish a reception started on a reception path, and free the path if
+     * it is still locked on it.
+     *
+     * \param index The index of the reception path.
+     * \param packet The packet being received.
+     * \param event The event of the packet.
+     */
+    void EndReceivePath(uint8_t index,
+                        Ptr<Packet> packet,
+                        Ptr<LoraInterferenceHelper::Event> event);
+
+    /**
+     * Determine the outcome of a reception and fire the corresponding trace
+     * sources and callbacks.
+     *
+     * \param packet The packet being received.
+     * \param event The event of the packet.
+     */
+    void FinishReception(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event);
+
+    /**
+     * Find the first available reception path.
+     *
+     * \return The index of the reception path, or the number of reception
+     * paths if none is available.
+     */
+    uint16_t FindAvailablePath() const;
+
+    /**
+     * Free a reception path and mark it as available.
+     *
+     * \param index The index of the reception path.
+     */
+    void FreePath(uint8_t index);
+
     /**
      * Used to schedule a change in the gateway transmission state
      */
     virtual void TxFinished(Ptr<Packet> packet);
 
     /**
-     * A vector containing the various parallel receivers that are managed by this
-     * Gateway.
+     * The various parallel receivers that are managed by this Gateway, stored
+     * contiguously and only allocated when their number is set.
      */
-    std::vector<Ptr<ReceptionPath>> m_receptionPaths;
+    std::vector<ReceptionPath> m_receptionPaths;
+
+    /**
+     * Bitmask of the available reception paths, 64 per word, so that finding
+     * one takes a count of trailing zeros.
+     */
+    std::vector<uint64_t> m_availablePaths;
 
     bool m_isTransmitting; //!< Flag indicating whether a transmission is going on
 
     /**
      * A vector containing the sensitivities required to correctly decode
      * different spreading factors.
+     *
+     * Uplink sensitivity (Source: SX1301 datasheet), {SF7, SF8, SF9, SF10,
+     * SF11, SF12}, for a bandwidth of 125000 Hz.
      */
-    static const double sensitivity[6];
+    static constexpr double sensitivity[6] = {-126.5, -129, -131.5, -134, -136.5, -139.5};
 
     /**
      * The number of occupied reception paths.
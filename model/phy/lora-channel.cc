@@ -13,9 +13,23 @@
 #include "lora-channel.h"
 
 #include "end-device-lora-phy.h"
+#include "gateway-lora-phy.h"
 
+#include "ns3/boolean.h"
+#include "ns3/concurrent-loss-model.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/double.h"
 #include "ns3/pointer.h"
 #include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 namespace ns3
 {
@@ -26,6 +40,106 @@ NS_LOG_COMPONENT_DEFINE("LoraChannel");
 
 NS_OBJECT_ENSURE_REGISTERED(LoraChannel);
 
+/**
+ * Threads running the same job, each on its own part of the data, while the
+ * simulator thread waits. The simulator thread takes part as worker 0.
+ */
+class LoraChannel::WorkerPool
+{
+  public:
+    /**
+     * Start the threads of the pool.
+     *
+     * \param nWorkers The number of workers, including the calling thread.
+     */
+    WorkerPool(uint32_t nWorkers)
+        : m_nWorkers(nWorkers)
+    {
+        for (uint32_t worker = 1; worker < nWorkers; ++worker)
+        {
+            m_threads.emplace_back(&WorkerPool::Work, this, worker);
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start.notify_all();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+    }
+
+    /**
+     * \return The number of workers, including the calling thread.
+     */
+    uint32_t GetNWorkers() const
+    {
+        return m_nWorkers;
+    }
+
+    /**
+     * Run a job on all workers, and wait for all of them to be done.
+     *
+     * \param job The job, called with the index of the worker.
+     */
+    void Run(const std::function<void(uint32_t)>& job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_job = &job;
+            m_pending = m_threads.size();
+            m_generation++;
+        }
+        m_start.notify_all();
+        job(0);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_pending == 0; });
+    }
+
+  private:
+    /**
+     * The loop of a thread of the pool.
+     *
+     * \param worker The index of the worker.
+     */
+    void Work(uint32_t worker)
+    {
+        uint64_t generation = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_start.wait(lock, [&] { return m_stop || m_generation != generation; });
+            if (m_stop)
+            {
+                return;
+            }
+            generation = m_generation;
+            lock.unlock();
+            (*m_job)(worker);
+            lock.lock();
+            if (--m_pending == 0)
+            {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    uint32_t m_nWorkers;                          //!< Number of workers
+    std::vector<std::thread> m_threads;           //!< The threads of workers 1 and above
+    std::mutex m_mutex;                           //!< Protects the members below
+    std::condition_variable m_start;              //!< Signals a new job or the stop
+    std::condition_variable m_done;               //!< Signals that all threads are done
+    const std::function<void(uint32_t)>* m_job{}; //!< The current job
+    uint64_t m_generation{0};                     //!< Number of jobs started
+    size_t m_pending{0};                          //!< Threads still running the job
+    bool m_stop{false};                           //!< Whether threads must exit
+};
+
 TypeId
 LoraChannel::GetTypeId()
 {
@@ -44,14 +158,97 @@ LoraChannel::GetTypeId()
                           PointerValue(),
                           MakePointerAccessor(&LoraChannel::m_delay),
                           MakePointerChecker<PropagationDelayModel>())
+            .AddAttribute("SensitivityCulling",
+                          "Skip receptions arriving below the receiver sensitivity minus "
+                          "CullingMargin, that can neither be received nor matter as "
+                          "interference. Receptions are evaluated as usual when disabled.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&LoraChannel::m_culling),
+                          MakeBooleanChecker())
+            .AddAttribute("CullingMargin",
+                          "Margin [dB] below the sensitivity of the receiver for the SF in use "
+                          "under which receptions are skipped. If negative, it is derived for "
+                          "each SF from the SIR matrices of the receivers: the power under which "
+                          "a signal can't destroy a reception at the sensitivity of any SF, plus "
+                          "CullingHeadroom. With the ALOHA matrix, nothing is then skipped.",
+                          DoubleValue(-1),
+                          MakeDoubleAccessor(&LoraChannel::m_cullingMargin),
+                          MakeDoubleChecker<double>())
+            .AddAttribute("CullingHeadroom",
+                          "Headroom [dB] added to the derived CullingMargin for the "
+                          "accumulation of interferers, each too weak to matter alone.",
+                          DoubleValue(3),
+                          MakeDoubleAccessor(&LoraChannel::m_cullingHeadroom),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("CullingRange",
+                          "Distance [m] beyond which receivers are skipped without evaluating "
+                          "the propagation loss model. Receivers are found through a grid of "
+                          "cells of this size. Use 0 to evaluate all receivers.",
+                          DoubleValue(0),
+                          MakeDoubleAccessor(&LoraChannel::m_cullingRange),
+                          MakeDoubleChecker<double>(0))
+            .AddAttribute("LinkGainCache",
+                          "Cache the gain of the links between end devices and gateways, so that "
+                          "the propagation loss model is only evaluated again when one of them "
+                          "moves. Per-packet losses of models implementing PerPacketLossModel "
+                          "are still drawn for every packet, while other random components of "
+                          "the loss are frozen at their first value.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&LoraChannel::m_linkGainCaching),
+                          MakeBooleanChecker())
+            .AddAttribute("LazyDownlink",
+                          "Only deliver downlinks to the end devices listening for them (in "
+                          "STANDBY), instead of to all end devices. End devices then compute the "
+                          "interference of other downlinks on demand, from the downlink log of "
+                          "the channel.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&LoraChannel::m_lazyDownlink),
+                          MakeBooleanChecker())
+            .AddAttribute("Threads",
+                          "Number of threads computing the power and delay of a transmission at "
+                          "its receivers. Several threads are only used when the link gain cache "
+                          "is disabled and the propagation models are known to allow it: models "
+                          "that only depend on the positions of the nodes, models implementing "
+                          "ConcurrentLossModel that accept the links (such as the correlated "
+                          "shadowing model when its raster covers them), and models implementing "
+                          "PerPacketLossModel. Positions are read and per-packet losses are drawn "
+                          "in receiver order on the simulator thread, so that results do not "
+                          "depend on the number of threads.",
+                          UintegerValue(1),
+                          MakeUintegerAccessor(&LoraChannel::m_threads),
+                          MakeUintegerChecker<uint32_t>(1))
+            .AddAttribute("BatchPropagationLoss",
+                          "Evaluate the propagation loss model chain for all the receivers of a "
+                          "transmission at once, through BatchPropagationLoss, instead of one "
+                          "receiver at a time. Only used when link gains are not cached and "
+                          "receptions are computed on a single thread.",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&LoraChannel::m_batchLoss),
+                          MakeBooleanChecker())
             .AddTraceSource("PacketSent",
                             "Trace source fired whenever a packet goes out on the channel",
                             MakeTraceSourceAccessor(&LoraChannel::m_packetSent),
-                            "ns3::Packet::TracedCallback");
+                            "ns3::Packet::TracedCallback")
+            .AddTraceSource("TransmissionSent",
+                            "Trace source fired whenever a transmission is sent on the channel, "
+                            "with the transmission shared by all its receivers",
+                            MakeTraceSourceAccessor(&LoraChannel::m_transmissionSent),
+                            "ns3::LoraChannel::TransmissionTracedCallback");
     return tid;
 }
 
 LoraChannel::LoraChannel()
+    : m_lastTransmissionId(0),
+      m_culling(false),
+      m_cullingMargin(-1),
+      m_cullingHeadroom(3),
+      m_cullingMarginsValid{false, false},
+      m_cullingRange(0),
+      m_linkGainCaching(false),
+      m_lazyDownlink(false),
+      m_threads(1),
+      m_batchLoss(false),
+      m_batchesValid{false, false}
 {
     NS_LOG_FUNCTION(this);
 }
@@ -59,6 +256,17 @@ LoraChannel::LoraChannel()
 LoraChannel::~LoraChannel()
 {
     NS_LOG_FUNCTION(this);
+    m_pool.reset();
+    m_senderProxies.clear();
+    m_receiverProxies.clear();
+    m_snapshot.Clear();
+    m_batches[0].Clear();
+    m_batches[1].Clear();
+    m_receiverSubset.Clear();
+    m_downlinks.clear();
+    m_listening.clear();
+    m_linkGains = LinkGainCache();
+    m_trackedMobility.clear();
     m_phyListUp.clear();
     m_phyListDown.clear();
     m_delay = nullptr;
@@ -66,8 +274,19 @@ LoraChannel::~LoraChannel()
 }
 
 LoraChannel::LoraChannel(Ptr<PropagationLossModel> loss, Ptr<PropagationDelayModel> delay)
-    : m_loss(loss),
-      m_delay(delay)
+    : m_lastTransmissionId(0),
+      m_loss(loss),
+      m_delay(delay),
+      m_culling(false),
+      m_cullingMargin(-1),
+      m_cullingHeadroom(3),
+      m_cullingMarginsValid{false, false},
+      m_cullingRange(0),
+      m_linkGainCaching(false),
+      m_lazyDownlink(false),
+      m_threads(1),
+      m_batchLoss(false),
+      m_batchesValid{false, false}
 {
     NS_LOG_FUNCTION(this << loss << delay);
 }
@@ -77,7 +296,12 @@ LoraChannel::Add(Ptr<LoraPhy> phy)
 {
     NS_LOG_FUNCTION(this << phy);
     // Add the new phy to the right destination vector
-    ((DynamicCast<EndDeviceLoraPhy>(phy)) ? m_phyListDown : m_phyListUp).push_back(phy);
+    bool down = bool(DynamicCast<EndDeviceLoraPhy>(phy));
+    ((down) ? m_phyListDown : m_phyListUp).push_back(phy);
+    m_cullingMarginsValid[down] = false;
+    m_grids[down].valid = false;
+    m_batchesValid[down] = false;
+    m_linkGains.valid = false;
 }
 
 void
@@ -85,12 +309,18 @@ LoraChannel::Remove(Ptr<LoraPhy> phy)
 {
     NS_LOG_FUNCTION(this << phy);
     // Remove the phy from the right vector
-    auto& phyList = (DynamicCast<EndDeviceLoraPhy>(phy)) ? m_phyListDown : m_phyListUp;
+    bool down = bool(DynamicCast<EndDeviceLoraPhy>(phy));
+    auto& phyList = (down) ? m_phyListDown : m_phyListUp;
     auto i = find(phyList.begin(), phyList.end(), phy);
     if (i != phyList.end())
     {
         phyList.erase(i);
+        m_cullingMarginsValid[down] = false;
+        m_grids[down].valid = false;
+        m_batchesValid[down] = false;
+        m_linkGains.valid = false;
     }
+    SetListening(phy, false);
 }
 
 std::size_t
@@ -115,54 +345,717 @@ LoraChannel::Send(Ptr<LoraPhy> sender,
                   double txPowerDbm,
                   uint8_t sf,
                   Time duration,
-                  double frequency) const
+                  double frequency)
 {
     NS_LOG_FUNCTION(this << sender << packet << txPowerDbm << (unsigned)sf << duration
                          << frequency);
+    // Describe the transmission once, it will be shared by all receivers
+    auto transmission = Create<LoraInterferenceHelper::Transmission>();
+    transmission->id = ++m_lastTransmissionId;
+    transmission->startTime = Simulator::Now();
+    transmission->duration = duration;
+    transmission->sf = sf;
+    transmission->frequencyHz = frequency;
+    transmission->packet = packet;
+    m_transmissionSent(transmission);
     // Get the mobility model of the sender
     auto senderMobility = sender->GetMobility();
     NS_ASSERT(bool(senderMobility) != 0); // Make sure it's available
     NS_LOG_INFO("Sender mobility: " << senderMobility->GetPosition());
     // Determine direction (uplink or downlink)
     bool down = !DynamicCast<EndDeviceLoraPhy>(sender);
-    auto& receivers = (down) ? m_phyListDown : m_phyListUp;
-    NS_LOG_INFO("Starting cycle over " << receivers.size() << " PHYs"
+    // Lazy downlinks are logged for end devices that start listening later on
+    bool lazy = down && m_lazyDownlink;
+    if (lazy)
+    {
+        CleanDownlinkLog();
+        m_downlinks.push_back({transmission, senderMobility, txPowerDbm});
+        m_longestDownlink = std::max(m_longestDownlink, duration);
+    }
+    auto& receivers = (lazy) ? m_listening : (down) ? m_phyListDown : m_phyListUp;
+    // Only consider receivers close to the sender, if a range is set
+    bool useGrid = m_cullingRange > 0 && !lazy;
+    if (useGrid)
+    {
+        FindNearbyReceivers(down, senderMobility->GetPosition());
+    }
+    size_t nReceivers = (useGrid) ? m_nearby.size() : receivers.size();
+    // Power under which receptions can be skipped
+    double cullingThreshold = -std::numeric_limits<double>::infinity();
+    if (m_culling)
+    {
+        double sensitivity = (down) ? EndDeviceLoraPhy::GetSensitivity(sf)
+                                    : GatewayLoraPhy::GetSensitivity(sf);
+        cullingThreshold = sensitivity - GetCullingMargin(down, sf);
+    }
+    // Compute the receptions on several threads, if the models allow it
+    std::vector<PerPacketLossModel*> perPacketModels;
+    bool parallel = m_threads > 1 && nReceivers >= m_threads && !m_linkGainCaching &&
+                    ComputeReceptions(receivers,
+                                      nReceivers,
+                                      useGrid,
+                                      senderMobility,
+                                      txPowerDbm,
+                                      perPacketModels);
+    // Otherwise, evaluate the loss model chain for all receivers at once
+    bool batch = !parallel && m_batchLoss && !m_linkGainCaching;
+    if (batch)
+    {
+        BatchPropagationLoss::CalcRxPower(m_loss,
+                                          txPowerDbm,
+                                          senderMobility,
+                                          GetReceiverBatch(down, useGrid, lazy),
+                                          m_rxPowers);
+    }
+    NS_LOG_INFO("Starting cycle over " << nReceivers << " PHYs"
                                        << ((down) ? " in downlink" : " in uplink"));
-    // Cycle over all registered PHYs
-    for (auto& phy : receivers)
+    // Cycle over the registered PHYs, in registration order
+    for (size_t k = 0; k < nReceivers; ++k)
     {
+        auto& phy = receivers[(useGrid) ? m_nearby[k] : k];
         // Get the receiver's mobility model
         auto receiverMobility = phy->GetMobility();
         NS_LOG_INFO("Receiver mobility: " << receiverMobility->GetPosition());
+        // Compute received power using the loss model, drawing the per-packet
+        // losses in receiver order if the rest was computed in parallel
+        double rxPowerDbm = 0;
+        if (parallel || batch)
+        {
+            rxPowerDbm = m_rxPowers[k];
+            for (auto model : perPacketModels)
+            {
+                rxPowerDbm -= model->GetPerPacketLoss(senderMobility, receiverMobility);
+            }
+        }
+        else
+        {
+            rxPowerDbm = GetRxPower(txPowerDbm, senderMobility, receiverMobility);
+        }
+        if (rxPowerDbm < cullingThreshold)
+        {
+            NS_LOG_DEBUG("Skipping reception at " << rxPowerDbm << " dBm, below the culling "
+                                                  << "threshold of " << cullingThreshold
+                                                  << " dBm");
+            continue;
+        }
         // Compute delay using the delay model
-        Time delay = m_delay->GetDelay(senderMobility, receiverMobility);
-        // Compute received power using the loss model
-        double rxPowerDbm = GetRxPower(txPowerDbm, senderMobility, receiverMobility);
+        Time delay =
+            (parallel) ? m_delays[k] : m_delay->GetDelay(senderMobility, receiverMobility);
         NS_LOG_DEBUG("Propagation: txPower="
                      << txPowerDbm << "dbm, rxPower=" << rxPowerDbm << "dbm, distance="
                      << senderMobility->GetDistanceFrom(receiverMobility) << "m, delay=" << delay);
         // Schedule the receive event
         NS_LOG_INFO("Scheduling reception of the packet");
         Simulator::Schedule(delay,
-                            &LoraPhy::StartReceive,
+                            &LoraPhy::ReceiveTransmission,
                             phy,
-                            packet,
-                            rxPowerDbm,
-                            sf,
-                            duration,
-                            frequency);
+                            Ptr<const LoraInterferenceHelper::Transmission>(transmission),
+                            rxPowerDbm);
         // Fire the trace source for sent packet
         m_packetSent(packet);
     }
 }
 
+const ReceiverBatch&
+LoraChannel::GetReceiverBatch(bool down, bool useGrid, bool lazy)
+{
+    NS_LOG_FUNCTION(this << down << useGrid << lazy);
+    if (lazy)
+    {
+        m_receiverSubset.Clear();
+        for (const auto& phy : m_listening)
+        {
+            m_receiverSubset.Add(phy->GetMobility());
+        }
+        return m_receiverSubset;
+    }
+    // Positions of all receivers are kept until one of them moves
+    auto& batch = m_batches[down];
+    if (!m_batchesValid[down])
+    {
+        batch.Clear();
+        for (const auto& phy : (down) ? m_phyListDown : m_phyListUp)
+        {
+            auto mobility = phy->GetMobility();
+            batch.Add(mobility);
+            TrackMobility(mobility);
+        }
+        m_batchesValid[down] = true;
+    }
+    if (!useGrid)
+    {
+        return batch;
+    }
+    m_receiverSubset.Clear();
+    for (auto r : m_nearby)
+    {
+        m_receiverSubset.x.push_back(batch.x[r]);
+        m_receiverSubset.y.push_back(batch.y[r]);
+        m_receiverSubset.z.push_back(batch.z[r]);
+        m_receiverSubset.mobility.push_back(batch.mobility[r]);
+    }
+    return m_receiverSubset;
+}
+
+bool
+LoraChannel::CanComputeInParallel(const Vector& senderPosition)
+{
+    NS_LOG_FUNCTION(this << senderPosition);
+    // Models whose result only depends on the positions of the nodes, and
+    // that do not modify their state when evaluated.
+    static const std::set<std::string> deterministicModels = {
+        "ns3::ConstantSpeedPropagationDelayModel",
+        "ns3::FixedRssLossModel",
+        "ns3::FriisPropagationLossModel",
+        "ns3::LogDistancePropagationLossModel",
+        "ns3::OkumuraHataPropagationLossModel",
+        "ns3::RangePropagationLossModel",
+        "ns3::ThreeLogDistancePropagationLossModel",
+        "ns3::TwoRayGroundPropagationLossModel",
+    };
+    for (auto model = m_loss; model; model = model->GetNext())
+    {
+        if (dynamic_cast<PerPacketLossModel*>(PeekPointer(model)) ||
+            deterministicModels.count(model->GetInstanceTypeId().GetName()))
+        {
+            continue;
+        }
+        auto concurrentModel = dynamic_cast<ConcurrentLossModel*>(PeekPointer(model));
+        if (!concurrentModel ||
+            !concurrentModel->PrepareConcurrentEvaluation(senderPosition, m_snapshot))
+        {
+            NS_LOG_DEBUG(model->GetInstanceTypeId().GetName()
+                         << " can't be evaluated in parallel");
+            return false;
+        }
+    }
+    return deterministicModels.count(m_delay->GetInstanceTypeId().GetName());
+}
+
+bool
+LoraChannel::ComputeReceptions(const std::vector<Ptr<LoraPhy>>& receivers,
+                               size_t nReceivers,
+                               bool useGrid,
+                               Ptr<MobilityModel> senderMobility,
+                               double txPowerDbm,
+                               std::vector<PerPacketLossModel*>& perPacketModels)
+{
+    NS_LOG_FUNCTION(this << nReceivers << useGrid << senderMobility << txPowerDbm);
+    // Positions are read on this thread: getting the position of a node can
+    // update its mobility model and fire its course changes, which modify the
+    // state of the channel.
+    Vector senderPosition = senderMobility->GetPosition();
+    m_snapshot.Clear();
+    for (size_t k = 0; k < nReceivers; ++k)
+    {
+        m_snapshot.Add(receivers[(useGrid) ? m_nearby[k] : k]->GetMobility());
+    }
+    if (!CanComputeInParallel(senderPosition))
+    {
+        return false;
+    }
+    // Per-packet losses are drawn by the caller in receiver order, so that
+    // which values each receiver gets does not depend on the threads
+    for (auto model = m_loss; model; model = model->GetNext())
+    {
+        if (auto perPacketModel = dynamic_cast<PerPacketLossModel*>(PeekPointer(model)))
+        {
+            perPacketModel->SetPerPacketLossEnabled(false);
+            perPacketModels.push_back(perPacketModel);
+        }
+    }
+    if (!m_pool || m_pool->GetNWorkers() != m_threads)
+    {
+        m_pool = std::make_unique<WorkerPool>(m_threads);
+    }
+    // Reference counts are not atomic: instead of sharing the mobility models
+    // of the nodes, each thread uses its own stand-ins, placed at the
+    // positions read above.
+    while (m_senderProxies.size() < m_threads)
+    {
+        m_senderProxies.push_back(CreateObject<ConstantPositionMobilityModel>());
+        m_receiverProxies.push_back(CreateObject<ConstantPositionMobilityModel>());
+    }
+    for (auto& proxy : m_senderProxies)
+    {
+        proxy->SetPosition(senderPosition);
+    }
+    m_rxPowers.resize(nReceivers);
+    m_delays.resize(nReceivers);
+    // Each thread handles a contiguous range of receivers
+    m_pool->Run([&](uint32_t worker) {
+        size_t begin = nReceivers * worker / m_threads;
+        size_t end = nReceivers * (worker + 1) / m_threads;
+        const auto& senderProxy = m_senderProxies[worker];
+        const auto& receiverProxy = m_receiverProxies[worker];
+        for (size_t k = begin; k < end; ++k)
+        {
+            receiverProxy->SetPosition(Vector(m_snapshot.x[k], m_snapshot.y[k], m_snapshot.z[k]));
+            m_rxPowers[k] = m_loss->CalcRxPower(txPowerDbm, senderProxy, receiverProxy);
+            m_delays[k] = m_delay->GetDelay(senderProxy, receiverProxy);
+        }
+    });
+    for (auto model = m_loss; model; model = model->GetNext())
+    {
+        if (auto perPacketModel = dynamic_cast<PerPacketLossModel*>(PeekPointer(model)))
+        {
+            perPacketModel->SetPerPacketLossEnabled(true);
+        }
+    }
+    return true;
+}
+
+void
+LoraChannel::BuildGrid(bool down)
+{
+    NS_LOG_FUNCTION(this << down);
+    auto& receivers = (down) ? m_phyListDown : m_phyListUp;
+    auto& grid = m_grids[down];
+    grid.cells.clear();
+    grid.indexes.clear();
+    grid.positions.assign(receivers.size(), Vector());
+    grid.unplaced.clear();
+    grid.cellSize = m_cullingRange;
+    for (uint32_t i = 0; i < receivers.size(); ++i)
+    {
+        auto mobility = receivers[i]->GetMobility();
+        if (!mobility)
+        {
+            // Without a position we can't rule it out
+            grid.unplaced.push_back(i);
+            continue;
+        }
+        // Rebuild the grid whenever this receiver moves
+        TrackMobility(mobility);
+        grid.indexes[PeekPointer(mobility)] = i;
+        grid.positions[i] = mobility->GetPosition();
+        grid.cells[grid.GetCell(grid.positions[i])].push_back(i);
+    }
+    grid.valid = true;
+}
+
+uint64_t
+LoraChannel::ReceiverGrid::GetCell(const Vector& position) const
+{
+    auto x = int32_t(std::floor(position.x / cellSize));
+    auto y = int32_t(std::floor(position.y / cellSize));
+    return (uint64_t(uint32_t(x)) << 32) | uint32_t(y);
+}
+
+double
+LoraChannel::GetCullingMargin(bool down, uint8_t sf)
+{
+    if (m_cullingMargin >= 0)
+    {
+        return m_cullingMargin;
+    }
+    double* margins = m_cullingMargins[down];
+    if (!m_cullingMarginsValid[down])
+    {
+        // A signal of SF s matters to a reception of SF r at the sensitivity
+        // of SF r if it is above it minus their isolation
+        auto sensitivity = (down) ? &EndDeviceLoraPhy::GetSensitivity
+                                  : &GatewayLoraPhy::GetSensitivity;
+        std::fill(margins, margins + 6, 0);
+        for (const auto& phy : (down) ? m_phyListDown : m_phyListUp)
+        {
+            auto interference = phy->GetInterferenceHelper();
+            if (!interference)
+            {
+                continue;
+            }
+            for (uint8_t s = 7; s <= 12; ++s)
+            {
+                for (uint8_t r = 7; r <= 12; ++r)
+                {
+                    double margin =
+                        sensitivity(s) - sensitivity(r) + interference->GetIsolation(r, s);
+                    margins[s - 7] = std::max(margins[s - 7], margin);
+                }
+            }
+        }
+        for (uint8_t s = 7; s <= 12; ++s)
+        {
+            margins[s - 7] += m_cullingHeadroom;
+            NS_LOG_DEBUG("Culling margin of SF" << unsigned(s) << " in "
+                                                << ((down) ? "downlink" : "uplink") << ": "
+                                                << margins[s - 7] << " dB");
+        }
+        m_cullingMarginsValid[down] = true;
+    }
+    return margins[sf - 7];
+}
+
+void
+LoraChannel::FindNearbyReceivers(bool down, const Vector& position)
+{
+    NS_LOG_FUNCTION(this << down << position);
+    auto& grid = m_grids[down];
+    if (!grid.valid || grid.cellSize != m_cullingRange)
+    {
+        BuildGrid(down);
+    }
+    m_nearby = grid.unplaced;
+    // Since cells are as large as the range, only the 3x3 block of cells
+    // around the sender can contain receivers in range.
+    auto x = int32_t(std::floor(position.x / grid.cellSize));
+    auto y = int32_t(std::floor(position.y / grid.cellSize));
+    for (int32_t i = x - 1; i <= x + 1; ++i)
+    {
+        for (int32_t j = y - 1; j <= y + 1; ++j)
+        {
+            auto it = grid.cells.find((uint64_t(uint32_t(i)) << 32) | uint32_t(j));
+            if (it == grid.cells.end())
+            {
+                continue;
+            }
+            for (auto r : it->second)
+            {
+                if (CalculateDistance(grid.positions[r], position) <= m_cullingRange)
+                {
+                    m_nearby.push_back(r);
+                }
+            }
+        }
+    }
+    // Deliver in registration order, as when no grid is used
+    std::sort(m_nearby.begin(), m_nearby.end());
+    NS_LOG_DEBUG("Found " << m_nearby.size() << " receivers in range");
+}
+
+void
+LoraChannel::BuildLinkGainCache()
+{
+    NS_LOG_FUNCTION(this);
+    m_linkGains = LinkGainCache();
+    // Before the simulation starts, PHYs may not know their mobility model yet
+    auto getMobility = [](Ptr<LoraPhy> phy) -> Ptr<MobilityModel> {
+        auto mobility = phy->GetMobility();
+        if (!mobility && phy->GetDevice() && phy->GetDevice()->GetNode())
+        {
+            mobility = phy->GetDevice()->GetNode()->GetObject<MobilityModel>();
+        }
+        return mobility;
+    };
+    for (uint32_t i = 0; i < m_phyListDown.size(); ++i)
+    {
+        if (auto mobility = getMobility(m_phyListDown[i]))
+        {
+            m_linkGains.devices.emplace(PeekPointer(mobility), i);
+            TrackMobility(mobility);
+        }
+    }
+    for (uint32_t i = 0; i < m_phyListUp.size(); ++i)
+    {
+        if (auto mobility = getMobility(m_phyListUp[i]))
+        {
+            m_linkGains.gateways.emplace(PeekPointer(mobility), i);
+            TrackMobility(mobility);
+        }
+    }
+    for (auto model = m_loss; model; model = model->GetNext())
+    {
+        if (auto perPacketModel = dynamic_cast<PerPacketLossModel*>(PeekPointer(model)))
+        {
+            m_linkGains.perPacketModels.push_back(perPacketModel);
+        }
+    }
+    m_linkGains.valid = true;
+}
+
+LoraChannel::LinkGain*
+LoraChannel::FindLinkGain(Ptr<MobilityModel> senderMobility, Ptr<MobilityModel> receiverMobility)
+{
+    NS_LOG_FUNCTION(this << senderMobility << receiverMobility);
+    if (!m_linkGains.valid)
+    {
+        BuildLinkGainCache();
+    }
+    auto& devices = m_linkGains.devices;
+    auto& gateways = m_linkGains.gateways;
+    // Find out the direction of the link
+    bool down = false;
+    auto device = devices.find(PeekPointer(senderMobility));
+    auto gateway = gateways.find(PeekPointer(receiverMobility));
+    if (device == devices.end())
+    {
+        down = true;
+        device = devices.find(PeekPointer(receiverMobility));
+        gateway = gateways.find(PeekPointer(senderMobility));
+    }
+    if (device == devices.end() || gateway == gateways.end())
+    {
+        return nullptr;
+    }
+    // Entries are only added when a link is first used
+    if (m_linkGains.links.empty())
+    {
+        m_linkGains.links.resize(m_phyListDown.size());
+    }
+    auto& links = m_linkGains.links[device->second];
+    auto link = std::lower_bound(links.begin(),
+                                 links.end(),
+                                 gateway->second,
+                                 [](const CachedLink& l, uint32_t g) { return l.gateway < g; });
+    if (link == links.end() || link->gateway != gateway->second)
+    {
+        link = links.insert(link, CachedLink());
+        link->gateway = gateway->second;
+    }
+    return &link->gains[down];
+}
+
+void
+LoraChannel::TrackMobility(Ptr<MobilityModel> mobility)
+{
+    NS_LOG_FUNCTION(this << mobility);
+    if (m_trackedMobility.insert(mobility).second)
+    {
+        mobility->TraceConnectWithoutContext("CourseChange",
+                                             MakeCallback(&LoraChannel::CourseChange, this));
+    }
+}
+
+void
+LoraChannel::CourseChange(Ptr<const MobilityModel> mobility)
+{
+    NS_LOG_FUNCTION(this << mobility);
+    // Move the node to its new cell in the receiver grids
+    for (auto& grid : m_grids)
+    {
+        auto index = grid.indexes.find(PeekPointer(mobility));
+        if (!grid.valid || index == grid.indexes.end())
+        {
+            continue;
+        }
+        uint32_t i = index->second;
+        uint64_t from = grid.GetCell(grid.positions[i]);
+        grid.positions[i] = mobility->GetPosition();
+        uint64_t to = grid.GetCell(grid.positions[i]);
+        if (from != to)
+        {
+            auto& cell = grid.cells[from];
+            cell.erase(std::find(cell.begin(), cell.end(), i));
+            if (cell.empty())
+            {
+                grid.cells.erase(from);
+            }
+            grid.cells[to].push_back(i);
+        }
+    }
+    m_batchesValid[0] = false;
+    m_batchesValid[1] = false;
+    if (!m_linkGains.valid)
+    {
+        return;
+    }
+    // Forget all the links of this node
+    auto& links = m_linkGains.links;
+    if (links.empty())
+    {
+        return;
+    }
+    auto device = m_linkGains.devices.find(PeekPointer(mobility));
+    if (device != m_linkGains.devices.end())
+    {
+        links[device->second].clear();
+    }
+    auto gateway = m_linkGains.gateways.find(PeekPointer(mobility));
+    if (gateway != m_linkGains.gateways.end())
+    {
+        for (auto& deviceLinks : links)
+        {
+            auto link = std::lower_bound(
+                deviceLinks.begin(),
+                deviceLinks.end(),
+                gateway->second,
+                [](const CachedLink& l, uint32_t g) { return l.gateway < g; });
+            if (link != deviceLinks.end() && link->gateway == gateway->second)
+            {
+                deviceLinks.erase(link);
+            }
+        }
+    }
+}
+
+void
+LoraChannel::SetListening(Ptr<LoraPhy> phy, bool listening)
+{
+    NS_LOG_FUNCTION(this << phy << listening);
+    if (!m_lazyDownlink)
+    {
+        return;
+    }
+    auto i = std::find(m_listening.begin(), m_listening.end(), phy);
+    if (!listening)
+    {
+        if (i != m_listening.end())
+        {
+            m_listening.erase(i);
+        }
+        return;
+    }
+    if (i != m_listening.end())
+    {
+        return;
+    }
+    m_listening.push_back(phy);
+    // Deliver the downlinks already sent that did not reach the device yet
+    auto receiverMobility = phy->GetMobility();
+    Time now = Simulator::Now();
+    for (const auto& downlink : m_downlinks)
+    {
+        const auto& transmission = downlink.transmission;
+        Time arrival = transmission->startTime +
+                       m_delay->GetDelay(downlink.senderMobility, receiverMobility);
+        if (arrival <= now)
+        {
+            continue;
+        }
+        double rxPowerDbm =
+            GetRxPower(downlink.txPowerDbm, downlink.senderMobility, receiverMobility);
+        NS_LOG_INFO("Scheduling reception of a downlink sent before the device listened");
+        Simulator::Schedule(arrival - now,
+                            &LoraPhy::ReceiveTransmission,
+                            phy,
+                            Ptr<const LoraInterferenceHelper::Transmission>(transmission),
+                            rxPowerDbm);
+    }
+}
+
+bool
+LoraChannel::IsDownlinkLazy() const
+{
+    return m_lazyDownlink;
+}
+
+std::vector<Ptr<LoraInterferenceHelper::Event>>
+LoraChannel::GetDownlinkInterferers(Ptr<LoraPhy> phy,
+                                    Ptr<const LoraInterferenceHelper::Event> event)
+{
+    NS_LOG_FUNCTION(this << phy << event);
+    auto receiverMobility = phy->GetMobility();
+    std::vector<Ptr<LoraInterferenceHelper::Event>> interferers;
+    for (const auto& downlink : m_downlinks)
+    {
+        const auto& transmission = downlink.transmission;
+        if (transmission->id == event->GetTransmissionId() ||
+            transmission->frequencyHz != event->GetFrequency())
+        {
+            continue;
+        }
+        Time start = transmission->startTime +
+                     m_delay->GetDelay(downlink.senderMobility, receiverMobility);
+        if (start >= event->GetEndTime() || start + transmission->duration <= event->GetStartTime())
+        {
+            continue;
+        }
+        double rxPowerDbm =
+            GetRxPower(downlink.txPowerDbm, downlink.senderMobility, receiverMobility);
+        interferers.push_back(
+            Create<LoraInterferenceHelper::Event>(transmission, rxPowerDbm, start));
+    }
+    NS_LOG_DEBUG("Found " << interferers.size() << " downlinks interfering at " << phy);
+    return interferers;
+}
+
+void
+LoraChannel::CleanDownlinkLog()
+{
+    NS_LOG_FUNCTION(this);
+    // Downlinks are sorted by start time: pop them from the front until we
+    // find one that may still be needed. Propagation delays are far below a
+    // second.
+    Time limit = Simulator::Now() - m_longestDownlink - Seconds(1);
+    while (!m_downlinks.empty() && m_downlinks.front().transmission->startTime +
+                                           m_downlinks.front().transmission->duration <
+                                       limit)
+    {
+        m_downlinks.pop_front();
+    }
+}
+
+int64_t
+LoraChannel::AssignStreams(int64_t stream)
+{
+    NS_LOG_FUNCTION(this << stream);
+    int64_t currentStream = stream;
+    if (m_loss)
+    {
+        currentStream += m_loss->AssignStreams(currentStream);
+    }
+    return currentStream - stream;
+}
+
 double
 LoraChannel::GetRxPower(double txPowerDbm,
                         Ptr<MobilityModel> senderMobility,
-                        Ptr<MobilityModel> receiverMobility) const
+                        Ptr<MobilityModel> receiverMobility)
 {
     NS_LOG_FUNCTION(this << txPowerDbm << senderMobility << receiverMobility);
-    return m_loss->CalcRxPower(txPowerDbm, senderMobility, receiverMobility);
+    LinkGain* link =
+        (m_linkGainCaching) ? FindLinkGain(senderMobility, receiverMobility) : nullptr;
+    if (!link)
+    {
+        return m_loss->CalcRxPower(txPowerDbm, senderMobility, receiverMobility);
+    }
+    auto& perPacketModels = m_linkGains.perPacketModels;
+    size_t nStates = std::min(perPacketModels.size(), MAX_LINK_STATES);
+    if (std::isnan(link->gain))
+    {
+        // Evaluate the loss chain without its per-packet components
+        for (auto model : perPacketModels)
+        {
+            model->SetPerPacketLossEnabled(false);
+        }
+        link->gain = float(m_loss->CalcRxPower(0, senderMobility, receiverMobility));
+        for (auto model : perPacketModels)
+        {
+            model->SetPerPacketLossEnabled(true);
+        }
+        // Also keep what the per-packet losses depend on, when the models can
+        for (size_t i = 0; i < nStates; ++i)
+        {
+            link->states[i] = perPacketModels[i]->GetLinkState(senderMobility, receiverMobility);
+        }
+        NS_LOG_DEBUG("Cached link gain: " << link->gain << " dB");
+    }
+    double rxPowerDbm = txPowerDbm + link->gain;
+    for (size_t i = 0; i < perPacketModels.size(); ++i)
+    {
+        if (i < nStates && link->states[i] != PerPacketLossModel::NO_LINK_STATE)
+        {
+            rxPowerDbm -= perPacketModels[i]->DrawLinkLoss(link->states[i]);
+        }
+        else
+        {
+            rxPowerDbm -= perPacketModels[i]->GetPerPacketLoss(senderMobility, receiverMobility);
+        }
+    }
+    return rxPowerDbm;
+}
+
+void
+LoraChannel::GetRxPowers(double txPowerDbm,
+                         Ptr<MobilityModel> senderMobility,
+                         const ReceiverBatch& receivers,
+                         std::vector<double>& rxPowerDbm)
+{
+    NS_LOG_FUNCTION(this << txPowerDbm << senderMobility << receivers.GetN());
+    if (m_batchLoss && !m_linkGainCaching)
+    {
+        BatchPropagationLoss::CalcRxPower(m_loss,
+                                          txPowerDbm,
+                                          senderMobility,
+                                          receivers,
+                                          rxPowerDbm);
+        return;
+    }
+    rxPowerDbm.resize(receivers.GetN());
+    for (size_t i = 0; i < receivers.GetN(); ++i)
+    {
+        rxPowerDbm[i] = GetRxPower(txPowerDbm, senderMobility, receivers.mobility[i]);
+    }
 }
 
 } // namespace lorawan
@@ -16,15 +16,25 @@
 #ifndef LORA_CHANNEL_H
 #define LORA_CHANNEL_H
 
+#include "lora-interference-helper.h"
 #include "lora-phy.h"
 
+#include "ns3/batch-propagation-loss.h"
 #include "ns3/channel.h"
 #include "ns3/log.h"
 #include "ns3/mobility-model.h"
 #include "ns3/nstime.h"
 #include "ns3/packet.h"
+#include "ns3/per-packet-loss-model.h"
 #include "ns3/propagation-delay-model.h"
 #include "ns3/propagation-loss-model.h"
+#include "ns3/random-variable-stream.h"
+
+#include <deque>
+#include <limits>
+#include <memory>
+#include <set>
+#include <unordered_map>
 
 namespace ns3
 {
@@ -42,6 +52,13 @@ struct LoraPhyTxParameters;
  * computing the power at every receiver using a PropagationLossModel and
  * notifying them of the reception event after a delay based on some
  * PropagationDelayModel.
+ *
+ * Each Send is described once, by a LoraInterferenceHelper::Transmission that
+ * all receivers share. The channel does not keep a log of past transmissions,
+ * except for lazy downlinks, and receivers do not share interference state:
+ * each PHY still records its own Event per received signal in its own
+ * LoraInterferenceHelper, since arrival times and powers, and hence overlaps,
+ * differ from one receiver to the other.
  */
 class LoraChannel : public Channel
 {
@@ -91,9 +108,13 @@ class LoraChannel : public Channel
      *
      * This method is typically invoked by a PHY that needs to send a packet.
      * Every connected Phy will be notified of this packet send through a call to
-     * their StartReceive methods after a delay based on the channel's
+     * their ReceiveTransmission methods after a delay based on the channel's
      * PropagationDelayModel.
      *
+     * If the SensitivityCulling or CullingRange attributes are set, receivers
+     * that could neither receive this packet nor be disturbed by it are not
+     * notified at all.
+     *
      * \param sender The phy that is sending this packet.
      * \param packet The PHY layer packet that is being sent over the channel.
      * \param txPowerDbm The power of the transmission.
@@ -103,15 +124,58 @@ class LoraChannel : public Channel
      *
      * \internal
      *
-     * When this method is called, the channel schedules an internal Receive call
-     * that performs the actual call to the PHY's StartReceive function.
+     * When this method is called, the channel describes the transmission once
+     * and schedules, for every receiver, a call to the PHY's
+     * ReceiveTransmission function sharing this description.
      */
     void Send(Ptr<LoraPhy> sender,
               Ptr<Packet> packet,
               double txPowerDbm,
               uint8_t sf,
               Time duration,
-              double frequency) const;
+              double frequency);
+
+    /**
+     * TracedCallback signature for transmissions sent on the channel.
+     *
+     * \param transmission The transmission shared by all the receivers.
+     */
+    typedef void (*TransmissionTracedCallback)(
+        Ptr<const LoraInterferenceHelper::Transmission> transmission);
+
+    /**
+     * Tell the channel whether an end device is listening for downlinks.
+     *
+     * When downlinks are delivered lazily, they only reach the end devices
+     * that are listening when they are sent, and an end device that starts
+     * listening is delivered the downlinks that did not reach it yet.
+     * Otherwise, this method has no effect.
+     *
+     * \param phy The PHY of the end device.
+     * \param listening Whether the end device is listening.
+     */
+    void SetListening(Ptr<LoraPhy> phy, bool listening);
+
+    /**
+     * Check whether downlinks are delivered lazily (see the LazyDownlink
+     * attribute).
+     *
+     * \return True if downlinks only reach listening end devices.
+     */
+    bool IsDownlinkLazy() const;
+
+    /**
+     * Get, from the downlink log, the downlinks overlapping with a reception
+     * at an end device.
+     *
+     * \param phy The PHY of the end device.
+     * \param event The reception.
+     * \return An event per downlink on the frequency of the reception that
+     * overlapped with it at the end device, except the reception itself.
+     */
+    std::vector<Ptr<LoraInterferenceHelper::Event>> GetDownlinkInterferers(
+        Ptr<LoraPhy> phy,
+        Ptr<const LoraInterferenceHelper::Event> event);
 
     /**
      * Compute the received power when transmitting from a point to another one.
@@ -120,6 +184,11 @@ class LoraChannel : public Channel
      * transmission from one point to another using this Channel's
      * PropagationLossModel.
      *
+     * If the LinkGainCache attribute is set and the two mobility models belong
+     * to an end device and a gateway connected to this channel, the loss model
+     * is only evaluated once for the link, and per-packet losses are added to
+     * the cached gain.
+     *
      * \param txPowerDbm The power the transmitter is using, in dBm.
      * \param senderMobility The mobility model of the sender.
      * \param receiverMobility The mobility model of the receiver.
@@ -127,9 +196,239 @@ class LoraChannel : public Channel
      */
     double GetRxPower(double txPowerDbm,
                       Ptr<MobilityModel> senderMobility,
-                      Ptr<MobilityModel> receiverMobility) const;
+                      Ptr<MobilityModel> receiverMobility);
+
+    /**
+     * Compute the power received by a batch of receivers from a sender.
+     *
+     * This is equivalent to calling GetRxPower for each receiver, in order.
+     * If the BatchPropagationLoss attribute is set and link gains are not
+     * cached, the loss model chain is evaluated for all receivers at once.
+     *
+     * \param txPowerDbm The power the transmitter is using, in dBm.
+     * \param senderMobility The mobility model of the sender.
+     * \param receivers The receivers.
+     * \param rxPowerDbm The received power at each receiver, in dBm.
+     */
+    void GetRxPowers(double txPowerDbm,
+                     Ptr<MobilityModel> senderMobility,
+                     const ReceiverBatch& receivers,
+                     std::vector<double>& rxPowerDbm);
+
+    /**
+     * Assign a fixed random variable stream number to the random variables
+     * used by the loss model chain.
+     *
+     * \param stream The first stream index to use.
+     * \return The number of stream indexes assigned.
+     */
+    int64_t AssignStreams(int64_t stream);
 
   private:
+    /**
+     * Receivers of one direction bucketed by position into square cells, so
+     * that those far from a sender can be skipped without evaluating the
+     * propagation loss model.
+     */
+    struct ReceiverGrid
+    {
+        bool valid = false;                                        //!< Whether it is up to date
+        double cellSize = 0;                                       //!< Side of a cell [m]
+        std::unordered_map<uint64_t, std::vector<uint32_t>> cells; //!< Receiver indexes per cell
+        std::vector<Vector> positions;                             //!< Receiver positions
+        std::vector<uint32_t> unplaced; //!< Receivers without a mobility model
+        std::unordered_map<const MobilityModel*, uint32_t> indexes; //!< Placed receiver indexes
+
+        /**
+         * Get the key of the cell containing a position.
+         *
+         * \param position The position.
+         * \return The key of the cell.
+         */
+        uint64_t GetCell(const Vector& position) const;
+    };
+
+    /// Number of per-packet loss models whose link states are cached
+    static constexpr size_t MAX_LINK_STATES = 2;
+
+    /**
+     * What is cached about a link in one direction.
+     */
+    struct LinkGain
+    {
+        float gain = std::numeric_limits<float>::quiet_NaN(); //!< Gain [dB], NaN if unknown
+        uint32_t states[MAX_LINK_STATES]; //!< Link states of the first per-packet loss models
+    };
+
+    /**
+     * The cached gains of the links between an end device and a gateway.
+     */
+    struct CachedLink
+    {
+        uint32_t gateway;  //!< Gateway index
+        LinkGain gains[2]; //!< Uplink (0) and downlink (1) gains
+    };
+
+    /**
+     * Gains of the links between the end devices and the gateways connected
+     * to the channel. Each end device only has entries for the gateways it
+     * exchanged packets with, sorted by gateway index, so that the cache
+     * grows with the links in use rather than with the size of the network.
+     */
+    struct LinkGainCache
+    {
+        bool valid = false; //!< Whether the indexes match the PHY lists
+        std::unordered_map<const MobilityModel*, uint32_t> devices;  //!< End device indexes
+        std::unordered_map<const MobilityModel*, uint32_t> gateways; //!< Gateway indexes
+        std::vector<std::vector<CachedLink>> links; //!< Links of each end device
+        std::vector<PerPacketLossModel*> perPacketModels; //!< Models with per-packet losses
+    };
+
+    /**
+     * A downlink in the downlink log, with what is needed to compute its power
+     * and arrival time at any end device.
+     */
+    struct Downlink
+    {
+        Ptr<LoraInterferenceHelper::Transmission> transmission; //!< The transmission
+        Ptr<MobilityModel> senderMobility;                      //!< Mobility of the gateway
+        double txPowerDbm;                                      //!< Transmission power [dBm]
+    };
+
+    class WorkerPool;
+
+    /**
+     * Check whether the propagation models can be evaluated by several
+     * threads at once for the links from a sender to the receivers in
+     * m_snapshot, with results that do not depend on the number of threads
+     * (except for the per-packet losses drawn by the threads).
+     *
+     * This is the case when every model of the loss chain either is a
+     * deterministic model only depending on the positions of the nodes,
+     * implements ConcurrentLossModel and accepts the links, or implements
+     * PerPacketLossModel, and the delay model is deterministic.
+     *
+     * \param senderPosition The position of the sender.
+     * \return Whether receptions can be computed in parallel.
+     */
+    bool CanComputeInParallel(const Vector& senderPosition);
+
+    /**
+     * Compute, on m_threads threads if the propagation models allow it, the
+     * power and delay at which a transmission reaches each receiver into
+     * m_rxPowers and m_delays.
+     *
+     * The positions of the nodes are read on the calling thread. Per-packet
+     * losses are not included, and must be drawn afterwards in receiver
+     * order.
+     *
+     * \param receivers The receivers of the transmission.
+     * \param nReceivers The number of receivers to consider.
+     * \param useGrid Whether receivers are taken from m_nearby.
+     * \param senderMobility The mobility model of the sender.
+     * \param txPowerDbm The power of the transmission.
+     * \param perPacketModels Set to the models whose per-packet losses are
+     * left to draw.
+     * \return Whether the receptions were computed.
+     */
+    bool ComputeReceptions(const std::vector<Ptr<LoraPhy>>& receivers,
+                           size_t nReceivers,
+                           bool useGrid,
+                           Ptr<MobilityModel> senderMobility,
+                           double txPowerDbm,
+                           std::vector<PerPacketLossModel*>& perPacketModels);
+
+    /**
+     * Get the positions of the receivers of a transmission.
+     *
+     * \param down Whether the transmission is a downlink.
+     * \param useGrid Whether receivers are taken from m_nearby.
+     * \param lazy Whether receivers are the listening end devices.
+     * \return The receivers, in the order they are notified.
+     */
+    const ReceiverBatch& GetReceiverBatch(bool down, bool useGrid, bool lazy);
+
+    /**
+     * Bucket the receivers of one direction into the grid.
+     *
+     * \param down Whether to build the grid of downlink receivers.
+     */
+    void BuildGrid(bool down);
+
+    /**
+     * Fill m_nearby with the indexes of the receivers of one direction that
+     * are closer than m_cullingRange to a position, in increasing order.
+     *
+     * \param down Whether to look among downlink receivers.
+     * \param position The position of the sender.
+     */
+    void FindNearbyReceivers(bool down, const Vector& position);
+
+    /**
+     * Get the margin below the sensitivity of the receivers under which a
+     * transmission is skipped, deriving it from the SIR matrices of the
+     * receivers on the first transmission after they change.
+     *
+     * \param down Whether the transmission is a downlink.
+     * \param sf The spreading factor of the transmission.
+     * \return The margin [dB].
+     */
+    double GetCullingMargin(bool down, uint8_t sf);
+
+    /**
+     * Index the mobility models of the PHYs connected to the channel, and
+     * find the models of the loss chain drawing per-packet losses.
+     */
+    void BuildLinkGainCache();
+
+    /**
+     * Find the cached gain of the link between two nodes.
+     *
+     * \param senderMobility The mobility model of the sender.
+     * \param receiverMobility The mobility model of the receiver.
+     * \return A pointer to the cached gain, added on the first use of the
+     * link, or nullptr if the link is not between an end device and a gateway
+     * connected to the channel.
+     */
+    LinkGain* FindLinkGain(Ptr<MobilityModel> senderMobility, Ptr<MobilityModel> receiverMobility);
+
+    /**
+     * Get notified of the course changes of a node.
+     *
+     * \param mobility The mobility model of the node.
+     */
+    void TrackMobility(Ptr<MobilityModel> mobility);
+
+    /**
+     * Move a node to its new cell in the receiver grids, and invalidate the
+     * receiver batches and its cached link gains when it moves.
+     *
+     * \param mobility The mobility model of the node.
+     */
+    void CourseChange(Ptr<const MobilityModel> mobility);
+
+    /**
+     * Delete the downlinks that can't reach nor overlap with a reception
+     * anymore from the downlink log.
+     */
+    void CleanDownlinkLog();
+
+    /**
+     * The identifier of the last transmission sent on this channel.
+     */
+    uint64_t m_lastTransmissionId;
+
+    /**
+     * The downlinks sent on this channel, when they are delivered lazily.
+     */
+    std::deque<Downlink> m_downlinks;
+
+    /**
+     * The longest downlink logged so far. A reception ending now started at
+     * most this long ago, so that older downlinks can't overlap with it.
+     */
+    Time m_longestDownlink;
+
     /**
      * The vector containing the PHYs that are currently connected to the
      * channel.
@@ -150,10 +449,92 @@ class LoraChannel : public Channel
      */
     Ptr<PropagationDelayModel> m_delay;
 
+    /**
+     * Whether receptions arriving too weak to be received or to cause
+     * interference are skipped.
+     */
+    bool m_culling;
+
+    /**
+     * Margin [dB] below the receiver sensitivity under which receptions are
+     * skipped when culling is enabled, or a negative value to derive it from
+     * the SIR matrices of the receivers.
+     */
+    double m_cullingMargin;
+
+    double m_cullingHeadroom;      //!< Headroom added to the derived margins [dB]
+    double m_cullingMargins[2][6]; //!< Derived margins of uplink (0) and downlink (1), per SF
+    bool m_cullingMarginsValid[2]; //!< Whether the derived margins match the receivers
+
+    /**
+     * Distance [m] beyond which receivers are skipped without evaluating the
+     * loss model, or 0 to evaluate all of them.
+     */
+    double m_cullingRange;
+
+    ReceiverGrid m_grids[2]; //!< Receiver grids for uplink (0) and downlink (1)
+
+    std::vector<uint32_t> m_nearby; //!< Receivers found by the last grid lookup
+
+    /**
+     * Whether the gains of the links between end devices and gateways are
+     * cached.
+     */
+    bool m_linkGainCaching;
+
+    LinkGainCache m_linkGains; //!< Cached link gains
+
+    /**
+     * Whether downlinks are only delivered to listening end devices.
+     */
+    bool m_lazyDownlink;
+
+    std::vector<Ptr<LoraPhy>> m_listening; //!< End devices listening for downlinks
+
+    /**
+     * Number of threads computing the receptions of a transmission.
+     */
+    uint32_t m_threads;
+
+    std::unique_ptr<WorkerPool> m_pool; //!< Threads helping the simulator one
+
+    /**
+     * Stand-ins for the sender and for the receivers, one per thread, so that
+     * threads never share a reference count nor read a mobility model.
+     */
+    std::vector<Ptr<MobilityModel>> m_senderProxies;
+    std::vector<Ptr<MobilityModel>> m_receiverProxies;
+
+    ReceiverBatch m_snapshot; //!< Positions of the receivers the threads handle
+
+    std::vector<double> m_rxPowers; //!< Receive powers computed in advance [dBm]
+    std::vector<Time> m_delays;     //!< Propagation delays computed in parallel
+
+    /**
+     * Whether the loss model chain is evaluated for all receivers of a
+     * transmission at once.
+     */
+    bool m_batchLoss;
+
+    ReceiverBatch m_batches[2];     //!< Uplink (0) and downlink (1) receiver positions
+    bool m_batchesValid[2];         //!< Whether m_batches are up to date
+    ReceiverBatch m_receiverSubset; //!< Positions of a subset of the receivers
+
+    /**
+     * Mobility models whose course changes are already tracked.
+     */
+    std::set<Ptr<MobilityModel>> m_trackedMobility;
+
     /**
      * Callback for when a packet is being sent on the channel.
      */
     TracedCallback<Ptr<const Packet>> m_packetSent;
+
+    /**
+     * Callback for when a transmission is sent on the channel, once for all
+     * its receivers.
+     */
+    TracedCallback<Ptr<const LoraInterferenceHelper::Transmission>> m_transmissionSent;
 };
 
 } // namespace lorawan
@@ -12,8 +12,16 @@
 
 #include "lora-interference-helper.h"
 
+#include "background-traffic.h"
+
+#include "ns3/boolean.h"
 #include "ns3/simulator.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+
 namespace ns3
 {
 namespace lorawan
@@ -23,6 +31,100 @@ NS_LOG_COMPONENT_DEFINE("LoraInterferenceHelper");
 
 NS_OBJECT_ENSURE_REGISTERED(LoraInterferenceHelper);
 
+/**
+ * Convert a power from dBm to W.
+ */
+static double
+DbmToW(double dbm)
+{
+    // Power [mW] = 10^(Power[dBm]/10)
+    // Power [W] = Power [mW] / 1000
+    return pow(10, dbm / 10) / 1000;
+}
+
+/**
+ * Storage for Event objects, carved from slabs and recycled through a free
+ * list, so that the many short-lived events of dense simulations do not go
+ * through the global allocator.
+ *
+ * Events can outlive the helper that created them, since PHYs keep them in
+ * scheduled calls, so a single pool is shared by all helpers. Slabs are never
+ * given back to the system.
+ */
+class EventPool
+{
+  public:
+    /**
+     * Take storage for an event.
+     *
+     * \return The storage.
+     */
+    void* Allocate()
+    {
+        if (!m_free)
+        {
+            Refill();
+        }
+        Slot* slot = m_free;
+        m_free = slot->next;
+        return slot;
+    }
+
+    /**
+     * Give back the storage of an event.
+     *
+     * \param storage The storage.
+     */
+    void Release(void* storage)
+    {
+        auto slot = static_cast<Slot*>(storage);
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+  private:
+    /**
+     * The storage of one event, linked to the next free one while unused.
+     */
+    union Slot
+    {
+        Slot* next; //!< The next free slot
+        alignas(LoraInterferenceHelper::Event) unsigned char
+            storage[sizeof(LoraInterferenceHelper::Event)]; //!< The storage of the event
+    };
+
+    /**
+     * Allocate a new slab and add its slots to the free list.
+     */
+    void Refill()
+    {
+        m_slabs.push_back(std::make_unique<Slot[]>(SLAB_SIZE));
+        Slot* slab = m_slabs.back().get();
+        for (size_t i = SLAB_SIZE; i-- > 0;)
+        {
+            slab[i].next = m_free;
+            m_free = &slab[i];
+        }
+    }
+
+    static constexpr size_t SLAB_SIZE = 1024;      //!< Number of events per slab
+    std::vector<std::unique_ptr<Slot[]>> m_slabs; //!< The slabs
+    Slot* m_free = nullptr;                       //!< The first free slot
+};
+
+/**
+ * Get the pool of events. It is never destroyed, so that events released
+ * during static destruction still find it.
+ *
+ * \return The pool.
+ */
+static EventPool&
+GetEventPool()
+{
+    static auto pool = new EventPool();
+    return *pool;
+}
+
 /***************************************
  *    Event    *
  ***************************************/
@@ -31,14 +133,32 @@ NS_OBJECT_ENSURE_REGISTERED(LoraInterferenceHelper);
 LoraInterferenceHelper::Event::Event(Time duration,
                                      double rxPowerdBm,
                                      uint8_t spreadingFactor,
-                                     Ptr<Packet> packet,
                                      double frequency)
     : m_startTime(Simulator::Now()),
       m_endTime(m_startTime + duration),
-      m_sf(spreadingFactor),
       m_rxPowerdBm(rxPowerdBm),
-      m_packet(packet),
-      m_frequencyHz(frequency)
+      m_rxPowerW(std::numeric_limits<double>::quiet_NaN()),
+      m_frequency(frequency),
+      m_transmissionId(0),
+      m_sf(spreadingFactor)
+{
+}
+
+LoraInterferenceHelper::Event::Event(Ptr<const Transmission> transmission, double rxPowerdBm)
+    : Event(transmission, rxPowerdBm, Simulator::Now())
+{
+}
+
+LoraInterferenceHelper::Event::Event(Ptr<const Transmission> transmission,
+                                     double rxPowerdBm,
+                                     Time startTime)
+    : m_startTime(startTime),
+      m_endTime(startTime + transmission->duration),
+      m_rxPowerdBm(rxPowerdBm),
+      m_rxPowerW(std::numeric_limits<double>::quiet_NaN()),
+      m_frequency(transmission->frequencyHz),
+      m_transmissionId(transmission->id),
+      m_sf(transmission->sf)
 {
 }
 
@@ -47,6 +167,19 @@ LoraInterferenceHelper::Event::~Event()
 {
 }
 
+void*
+LoraInterferenceHelper::Event::operator new(size_t size)
+{
+    NS_ASSERT(size == sizeof(Event));
+    return GetEventPool().Allocate();
+}
+
+void
+LoraInterferenceHelper::Event::operator delete(void* storage)
+{
+    GetEventPool().Release(storage);
+}
+
 // Getters
 Time
 LoraInterferenceHelper::Event::GetStartTime() const
@@ -72,29 +205,41 @@ LoraInterferenceHelper::Event::GetRxPowerdBm() const
     return m_rxPowerdBm;
 }
 
+double
+LoraInterferenceHelper::Event::GetRxPowerW() const
+{
+    // Converted on first use, since many events are never looked at in W
+    if (std::isnan(m_rxPowerW))
+    {
+        m_rxPowerW = DbmToW(m_rxPowerdBm);
+    }
+    return m_rxPowerW;
+}
+
 uint8_t
 LoraInterferenceHelper::Event::GetSpreadingFactor() const
 {
     return m_sf;
 }
 
-Ptr<Packet>
-LoraInterferenceHelper::Event::GetPacket() const
+double
+LoraInterferenceHelper::Event::GetFrequency() const
 {
-    return m_packet;
+    return m_frequency;
 }
 
-double
-LoraInterferenceHelper::Event::GetFrequency() const
+uint64_t
+LoraInterferenceHelper::Event::GetTransmissionId() const
 {
-    return m_frequencyHz;
+    return m_transmissionId;
 }
 
 void
 LoraInterferenceHelper::Event::Print(std::ostream& stream) const
 {
-    stream << "(" << m_startTime.GetSeconds() << " s - " << m_endTime.GetSeconds() << " s), SF"
-           << unsigned(m_sf) << ", " << m_rxPowerdBm << " dBm, " << m_frequencyHz << " Hz";
+    stream << "(" << m_startTime.GetSeconds() << " s - " << GetEndTime().GetSeconds() << " s), SF"
+           << unsigned(m_sf) << ", " << m_rxPowerdBm << " dBm, "
+           << m_frequency << " Hz";
 }
 
 std::ostream&
@@ -122,13 +267,27 @@ LoraInterferenceHelper::GetTypeId()
                 "if a packet is destroyed by interference on collision event",
                 EnumValue(CROCE),
                 MakeEnumAccessor<IsolationMatrix>(&LoraInterferenceHelper::SetIsolationMatrix),
-                MakeEnumChecker(CROCE, "CROCE", GOURSAUD, "GOURSAUD", ALOHA, "ALOHA"));
+                MakeEnumChecker(CROCE, "CROCE", GOURSAUD, "GOURSAUD", ALOHA, "ALOHA"))
+            .AddAttribute("IncrementalInterference",
+                          "Compute the interference affecting a reception from running per-SF "
+                          "energy integrals updated as signals start and end, instead of "
+                          "scanning all overlapping signals when the reception ends. Must be "
+                          "set before the first signal is added",
+                          BooleanValue(false),
+                          MakeBooleanAccessor(&LoraInterferenceHelper::m_incremental),
+                          MakeBooleanChecker());
 
     return tid;
 }
 
+LoraInterferenceHelper::FrequencyState::FrequencyState()
+    : nextEnd(events.end())
+{
+}
+
 LoraInterferenceHelper::LoraInterferenceHelper()
-    : m_isolationMatrix(CROCE)
+    : m_incremental(false),
+      m_isolationMatrix(&m_CROCE)
 {
     NS_LOG_FUNCTION(this);
 }
@@ -148,47 +307,130 @@ LoraInterferenceHelper::Add(Time duration,
     NS_LOG_FUNCTION(this << duration.GetSeconds() << rxPower << unsigned(spreadingFactor) << packet
                          << frequency);
     // Create an event based on the parameters
-    auto event = Create<Event>(duration, rxPower, spreadingFactor, packet, frequency);
-    // Add the event to the list
-    m_events.push_back(event);
-    // Clean the event list
-    if (m_events.size() > 100)
-    {
-        CleanOldEvents();
-    }
+    auto event = Create<Event>(duration, rxPower, spreadingFactor, frequency);
+    // Register the event on its frequency
+    auto& state = m_events[frequency];
+    StartEvent(state, event);
+    // Clean the frequency from old events
+    CleanOldEvents(state);
+    CleanAllOldEventsPeriodically();
     return event;
 }
 
-uint8_t
-LoraInterferenceHelper::IsDestroyedByInterference(Ptr<Event> event)
+Ptr<LoraInterferenceHelper::Event>
+LoraInterferenceHelper::Add(Ptr<const Transmission> transmission, double rxPower)
+{
+    NS_LOG_FUNCTION(this << transmission->id << rxPower);
+    // Create an event referencing the shared transmission
+    auto event = Create<Event>(transmission, rxPower);
+    // Register the event on its frequency
+    auto& state = m_events[transmission->frequencyHz];
+    StartEvent(state, event);
+    // Clean the frequency from old events
+    CleanOldEvents(state);
+    CleanAllOldEventsPeriodically();
+    return event;
+}
+
+void
+LoraInterferenceHelper::StartEvent(FrequencyState& state, Ptr<Event> event)
 {
     NS_LOG_FUNCTION(this << event);
-    // We want to see the interference affecting this event: cycle through events
-    // that overlap with this one and see whether it survives the interference or
-    // not.
-    NS_LOG_INFO("Current number of events in LoraInterferenceHelper: " << m_events.size());
-    // Gather information about the event
-    double rxPowerDbm = event->GetRxPowerdBm();
-    uint8_t sf = event->GetSpreadingFactor();
-    double frequency = event->GetFrequency();
-    // Handy information about the time frame when the packet was received
+    if (!m_incremental)
+    {
+        // Only the incremental mode needs the integrals and counters
+        state.events.emplace(event->GetEndTime(), event);
+        return;
+    }
     Time now = Simulator::Now();
-    Time duration = event->GetDuration();
-    Time packetStartTime = now - duration;
-    // Energy for interferers of various SFs
-    std::vector<double> cumulativeInterferenceEnergy(6, 0);
-    // Cycle over the events
-    for (auto& interferer : m_events)
+    // Bring integrals up to date before the power on air changes
+    Advance(state, now);
+    // Add the event to the bucket, ordered by end time
+    auto it = state.events.emplace(event->GetEndTime(), event);
+    if (event->GetEndTime() <= now)
+    {
+        // Zero-duration signals do not contribute to the integrals
+        return;
+    }
+    // Keep track of the next end that will need to be accounted
+    if (state.nextEnd == state.events.end() || it->first < state.nextEnd->first)
+    {
+        state.nextEnd = it;
+    }
+    // Add the signal to the power currently on air
+    unsigned i = unsigned(event->GetSpreadingFactor()) - 7;
+    state.powerW.at(i) += event->GetRxPowerW();
+    state.active[i]++;
+    state.starts[i]++;
+    if (state.lastStart != now)
+    {
+        state.lastStart = now;
+        state.startsNow.fill(0);
+    }
+    state.startsNow[i]++;
+    // Remember where integrals were at the beginning of this event
+    Snapshot snapshot;
+    snapshot.period = state.period;
+    snapshot.energyJ = state.energyJ;
+    for (unsigned j = 0; j < 6; ++j)
+    {
+        snapshot.overlap[j] = int64_t(state.active[j]) - int64_t(state.starts[j]);
+    }
+    m_snapshots[PeekPointer(event)] = snapshot;
+}
+
+void
+LoraInterferenceHelper::Advance(FrequencyState& state, Time time)
+{
+    NS_LOG_FUNCTION(this << time);
+    auto integrate = [&state](Time t) {
+        double dt = (t - state.lastUpdate).GetSeconds();
+        for (unsigned i = 0; i < 6; ++i)
+        {
+            state.energyJ[i] += state.powerW[i] * dt;
+        }
+        state.lastUpdate = t;
+    };
+    // Account for the events that ended in the meantime, in end time order
+    while (state.nextEnd != state.events.end() && state.nextEnd->first <= time)
+    {
+        const auto& e = state.nextEnd->second;
+        integrate(state.nextEnd->first);
+        unsigned i = unsigned(e->GetSpreadingFactor()) - 7;
+        // Reset the power to exactly 0 when the last signal leaves, so that
+        // rounding errors of additions and subtractions do not accumulate
+        state.powerW[i] =
+            (--state.active[i] == 0) ? 0 : state.powerW[i] - e->GetRxPowerW();
+        ++state.nextEnd;
+        // When the frequency goes idle, start a new busy period from zero
+        if (state.active == std::array<uint32_t, 6>{})
+        {
+            state.lastEnergyJ = state.energyJ;
+            state.energyJ.fill(0);
+            state.period++;
+        }
+    }
+    integrate(time);
+}
+
+void
+LoraInterferenceHelper::ScanInterference(const FrequencyState& state,
+                                         Ptr<Event> event,
+                                         std::array<double, 6>& energyJ)
+{
+    NS_LOG_FUNCTION(this << event);
+    // Events that ended before this one started cannot overlap with it, so we
+    // start from the first event ending after its start time.
+    const auto& bucket = state.events;
+    for (auto it = bucket.upper_bound(event->GetStartTime()); it != bucket.end(); ++it)
     {
-        // Only consider the current event if the channel is the same: we
-        // assume there's no interchannel interference. Also skip the current
-        // event if it's the same that we want to analyze.
-        if (!(interferer->GetFrequency() == frequency) || interferer == event)
+        const auto& interferer = it->second;
+        // Skip the current event if it's the same that we want to analyze.
+        if (interferer == event)
         {
-            NS_LOG_DEBUG("Different channel or same event");
+            NS_LOG_DEBUG("Same event");
             continue; // Continues from the first line inside the for cycle
         }
-        NS_LOG_DEBUG("Interferer on same channel");
         // Gather information about this interferer
         uint8_t interfererSf = interferer->GetSpreadingFactor();
         double interfererPower = interferer->GetRxPowerdBm();
@@ -202,31 +444,155 @@ LoraInterferenceHelper::IsDestroyedByInterference(Ptr<Event> event)
         Time overlap = GetOverlapTime(event, interferer);
         NS_LOG_DEBUG("The two events overlap for " << overlap.GetSeconds() << " s.");
         // Compute the equivalent energy of the interference
-        // Power [mW] = 10^(Power[dBm]/10)
-        // Power [W] = Power [mW] / 1000
-        double interfererPowerW = pow(10, interfererPower / 10) / 1000;
+        double interfererPowerW = interferer->GetRxPowerW();
         // Energy [J] = Time [s] * Power [W]
         double interferenceEnergy = overlap.GetSeconds() * interfererPowerW;
-        cumulativeInterferenceEnergy.at(unsigned(interfererSf) - 7) += interferenceEnergy;
+        energyJ.at(unsigned(interfererSf) - 7) += interferenceEnergy;
         NS_LOG_DEBUG("Interferer power in W: " << interfererPowerW);
         NS_LOG_DEBUG("Interference energy: " << interferenceEnergy);
     }
+}
+
+bool
+LoraInterferenceHelper::IntegrateInterference(FrequencyState& state,
+                                              Ptr<Event> event,
+                                              std::array<double, 6>& energyJ)
+{
+    NS_LOG_FUNCTION(this << event);
+    Time now = Simulator::Now();
+    auto snapshotIt = m_snapshots.find(PeekPointer(event));
+    if (snapshotIt == m_snapshots.end() || now != event->GetEndTime())
+    {
+        NS_LOG_DEBUG("Integrals can't be used for this event, falling back to a full scan");
+        return false;
+    }
+    const auto& snapshot = snapshotIt->second;
+    Advance(state, now);
+    // If the frequency went idle when this event ended, the integrals we need
+    // are the final ones of the previous busy period.
+    const std::array<double, 6>* endEnergyJ = &state.energyJ;
+    if (snapshot.period + 1 == state.period)
+    {
+        endEnergyJ = &state.lastEnergyJ;
+    }
+    else if (snapshot.period != state.period)
+    {
+        return false;
+    }
+    unsigned own = unsigned(event->GetSpreadingFactor()) - 7;
+    bool startsNow = (state.lastStart == now);
+    for (unsigned i = 0; i < 6; ++i)
+    {
+        // Count the interferers that overlapped with this event: those on air
+        // when it started, plus those that started after it, excluding itself
+        // and signals starting exactly when it ends.
+        int64_t interferers = int64_t(state.starts[i]) + snapshot.overlap[i] -
+                              (startsNow ? state.startsNow[i] : 0) - (i == own ? 1 : 0);
+        if (interferers <= 0)
+        {
+            energyJ[i] = 0;
+            continue;
+        }
+        double energy = (*endEnergyJ)[i] - snapshot.energyJ[i];
+        if (i == own)
+        {
+            energy -= event->GetRxPowerW() * event->GetDuration().GetSeconds();
+        }
+        // Rounding can cancel interference that is negligible with respect to
+        // the energy on air: keep it strictly positive, since some signal did
+        // overlap with this event.
+        energyJ[i] = std::max(energy, std::numeric_limits<double>::denorm_min());
+        NS_LOG_DEBUG("Interference energy from SF" << i + 7 << ": " << energyJ[i] << " J from "
+                                                   << interferers << " interferers");
+    }
+    return true;
+}
+
+uint8_t
+LoraInterferenceHelper::IsDestroyedByInterference(Ptr<Event> event)
+{
+    NS_LOG_FUNCTION(this << event);
+    // We want to see the interference affecting this event: gather the energy
+    // of the events that overlap with this one and see whether it survives the
+    // interference or not.
+    double frequency = event->GetFrequency();
+    // Energy for interferers of various SFs
+    std::array<double, 6> cumulativeInterferenceEnergy{};
+    // We assume there's no interchannel interference: only events on the same
+    // frequency are relevant.
+    auto stateIt = m_events.find(frequency);
+    if (stateIt != m_events.end())
+    {
+        auto& state = stateIt->second;
+        NS_LOG_INFO("Current number of events on this frequency: " << state.events.size());
+        if (!m_incremental || !IntegrateInterference(state, event, cumulativeInterferenceEnergy))
+        {
+            ScanInterference(state, event, cumulativeInterferenceEnergy);
+        }
+    }
+    if (!m_snapshots.empty())
+    {
+        m_snapshots.erase(PeekPointer(event));
+    }
+    if (m_background)
+    {
+        m_background->AddInterference(event->GetStartTime(),
+                                      event->GetEndTime(),
+                                      frequency,
+                                      cumulativeInterferenceEnergy);
+    }
+    return CheckIsolation(event, cumulativeInterferenceEnergy);
+}
+
+uint8_t
+LoraInterferenceHelper::IsDestroyedByInterference(Ptr<Event> event,
+                                                  const std::vector<Ptr<Event>>& interferers)
+{
+    NS_LOG_FUNCTION(this << event << interferers.size());
+    std::array<double, 6> cumulativeInterferenceEnergy{};
+    for (const auto& interferer : interferers)
+    {
+        if (interferer == event || interferer->GetFrequency() != event->GetFrequency())
+        {
+            continue;
+        }
+        Time overlap = GetOverlapTime(event, interferer);
+        NS_LOG_DEBUG("Found an interferer overlapping for " << overlap.GetSeconds() << " s.");
+        // Energy [J] = Time [s] * Power [W]
+        cumulativeInterferenceEnergy.at(unsigned(interferer->GetSpreadingFactor()) - 7) +=
+            overlap.GetSeconds() * interferer->GetRxPowerW();
+    }
+    if (m_background)
+    {
+        m_background->AddInterference(event->GetStartTime(),
+                                      event->GetEndTime(),
+                                      event->GetFrequency(),
+                                      cumulativeInterferenceEnergy);
+    }
+    return CheckIsolation(event, cumulativeInterferenceEnergy);
+}
+
+uint8_t
+LoraInterferenceHelper::CheckIsolation(Ptr<Event> event,
+                                       const std::array<double, 6>& energyJ) const
+{
+    NS_LOG_FUNCTION(this << event);
+    uint8_t sf = event->GetSpreadingFactor();
+    Time duration = event->GetDuration();
     // For each SF, check if there was destructive interference
     for (uint8_t currentSf = 7; currentSf <= 12; ++currentSf)
     {
-        NS_LOG_DEBUG("Cumulative Interference Energy: "
-                     << cumulativeInterferenceEnergy.at(unsigned(currentSf) - 7));
+        NS_LOG_DEBUG("Cumulative Interference Energy: " << energyJ.at(unsigned(currentSf) - 7));
         // Use the computed cumulativeInterferenceEnergy to determine whether the
         // interference with this SF destroys the packet
-        double signalPowerW = pow(10, rxPowerDbm / 10) / 1000;
+        double signalPowerW = event->GetRxPowerW();
         double signalEnergy = duration.GetSeconds() * signalPowerW;
         NS_LOG_DEBUG("Signal power in W: " << signalPowerW);
         NS_LOG_DEBUG("Signal energy: " << signalEnergy);
         // Check whether the packet survives the interference of this SF
-        double sirIsolation = m_isolationMatrix[unsigned(sf) - 7][unsigned(currentSf) - 7];
+        double sirIsolation = (*m_isolationMatrix)[unsigned(sf) - 7][unsigned(currentSf) - 7];
         NS_LOG_DEBUG("The needed isolation to survive is " << sirIsolation << " dB");
-        double sir =
-            10 * log10(signalEnergy / cumulativeInterferenceEnergy.at(unsigned(currentSf) - 7));
+        double sir = 10 * log10(signalEnergy / energyJ.at(unsigned(currentSf) - 7));
         NS_LOG_DEBUG("The current SIR is " << sir << " dB");
         if (sir >= sirIsolation)
         {
@@ -248,7 +614,21 @@ LoraInterferenceHelper::IsDestroyedByInterference(Ptr<Event> event)
 std::list<Ptr<LoraInterferenceHelper::Event>>
 LoraInterferenceHelper::GetInterferers()
 {
-    return m_events;
+    // Frequencies nothing was added to lately may still hold old events
+    CleanAllOldEvents();
+    std::list<Ptr<Event>> interferers;
+    for (const auto& [frequency, state] : m_events)
+    {
+        for (const auto& [endTime, e] : state.events)
+        {
+            interferers.push_back(e);
+        }
+    }
+    // Present events in arrival order, regardless of their frequency
+    interferers.sort([](const Ptr<Event>& a, const Ptr<Event>& b) {
+        return a->GetStartTime() < b->GetStartTime();
+    });
+    return interferers;
 }
 
 void
@@ -256,7 +636,7 @@ LoraInterferenceHelper::PrintEvents(std::ostream& stream)
 {
     NS_LOG_FUNCTION_NOARGS();
     stream << "Currently registered events:" << std::endl;
-    for (const auto& e : m_events)
+    for (const auto& e : GetInterferers())
     {
         stream << e << std::endl;
     }
@@ -303,6 +683,7 @@ LoraInterferenceHelper::ClearAllEvents()
 {
     NS_LOG_FUNCTION_NOARGS();
     m_events.clear();
+    m_snapshots.clear();
 }
 
 void
@@ -310,18 +691,63 @@ LoraInterferenceHelper::DoDispose()
 {
     NS_LOG_FUNCTION(this);
     m_events.clear();
+    m_snapshots.clear();
+    m_background = nullptr;
     Object::DoDispose();
 }
 
 void
-LoraInterferenceHelper::CleanOldEvents()
+LoraInterferenceHelper::CleanOldEvents(FrequencyState& state)
 {
     NS_LOG_FUNCTION(this);
-    // Cycle the events, and clean up if an event is old.
+    // Events are sorted by end time: pop them from the front until we find
+    // one that is not old. Once the integrals are up to date, old events have
+    // been accounted for, so this never invalidates state.nextEnd, which stays
+    // at the end of the bucket when the integrals are not kept.
+    auto& bucket = state.events;
     Time now = Simulator::Now();
-    Time threshold = m_oldEventThreshold;
-    auto isOld = [&now, &threshold](Ptr<Event> e) { return e->GetEndTime() + threshold < now; };
-    m_events.remove_if(isOld);
+    if (m_incremental)
+    {
+        Advance(state, now);
+    }
+    Time limit = now - m_oldEventThreshold;
+    while (!bucket.empty() && bucket.begin()->first < limit)
+    {
+        if (!m_snapshots.empty())
+        {
+            m_snapshots.erase(PeekPointer(bucket.begin()->second));
+        }
+        bucket.erase(bucket.begin());
+    }
+}
+
+void
+LoraInterferenceHelper::CleanAllOldEvents()
+{
+    NS_LOG_FUNCTION(this);
+    for (auto& [frequency, state] : m_events)
+    {
+        CleanOldEvents(state);
+    }
+    m_nextFullClean = Simulator::Now() + m_oldEventThreshold;
+}
+
+void
+LoraInterferenceHelper::CleanAllOldEventsPeriodically()
+{
+    // Events can't get old faster than the threshold, so sweeping all
+    // frequencies once per threshold bounds what idle ones keep
+    if (Simulator::Now() >= m_nextFullClean)
+    {
+        CleanAllOldEvents();
+    }
+}
+
+void
+LoraInterferenceHelper::SetBackgroundTraffic(Ptr<BackgroundTraffic> background)
+{
+    NS_LOG_FUNCTION(this << background);
+    m_background = background;
 }
 
 void
@@ -331,19 +757,25 @@ LoraInterferenceHelper::SetIsolationMatrix(IsolationMatrix matrix)
     {
     case ALOHA:
         NS_LOG_DEBUG("Setting the ALOHA collision matrix");
-        m_isolationMatrix = LoraInterferenceHelper::m_ALOHA;
+        m_isolationMatrix = &LoraInterferenceHelper::m_ALOHA;
         break;
     case GOURSAUD:
         NS_LOG_DEBUG("Setting the GOURSAUD collision matrix");
-        m_isolationMatrix = LoraInterferenceHelper::m_GOURSAUD;
+        m_isolationMatrix = &LoraInterferenceHelper::m_GOURSAUD;
         break;
     case CROCE:
         NS_LOG_DEBUG("Setting the CROCE collision matrix");
-        m_isolationMatrix = LoraInterferenceHelper::m_CROCE;
+        m_isolationMatrix = &LoraInterferenceHelper::m_CROCE;
         break;
     }
 }
 
+double
+LoraInterferenceHelper::GetIsolation(uint8_t sf, uint8_t interfererSf) const
+{
+    return (*m_isolationMatrix)[unsigned(sf) - 7][unsigned(interfererSf) - 7];
+}
+
 const Time LoraInterferenceHelper::m_oldEventThreshold = Seconds(2);
 
 using sirMatrix_t = std::vector<std::vector<double>>;
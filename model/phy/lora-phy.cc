@@ -13,6 +13,10 @@
 #include "lora-phy.h"
 
 #include "ns3/node.h"
+#include "ns3/simulator.h"
+
+#include <array>
+#include <cmath>
 
 #define NOISE_FIGURE 6 //! Noise Figure (dB)
 
@@ -25,6 +29,59 @@ NS_LOG_COMPONENT_DEFINE("LoraPhy");
 
 NS_OBJECT_ENSURE_REGISTERED(LoraPhy);
 
+/**
+ * Get the index of a combination of parameters in the payloadBlocks table.
+ *
+ * \param sf The spreading factor, from 7 to 12.
+ * \param de Whether low data rate optimization is enabled.
+ * \param h Whether the header is implicit.
+ * \param crc Whether the CRC is enabled.
+ * \param pl The size of the payload [B], up to 255.
+ * \return The index.
+ */
+static constexpr size_t
+PayloadBlocksIndex(unsigned sf, bool de, bool h, bool crc, uint32_t pl)
+{
+    return ((((sf - 7) * 2 + de) * 2 + h) * 2 + crc) * 256 + pl;
+}
+
+/**
+ * The number of blocks of (codingRate + 4) payload symbols of the SX1272
+ * designer's guide formula, ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF -
+ * 2DE))), for every combination of SF7 to SF12, low data rate optimization,
+ * header mode, CRC and payloads of 0 to 255 bytes.
+ */
+static constexpr auto payloadBlocks = [] {
+    std::array<int8_t, PayloadBlocksIndex(13, false, false, false, 0)> table{};
+    for (unsigned sf = 7; sf <= 12; ++sf)
+    {
+        for (int de = 0; de < 2; ++de)
+        {
+            for (int h = 0; h < 2; ++h)
+            {
+                for (int crc = 0; crc < 2; ++crc)
+                {
+                    for (int pl = 0; pl < 256; ++pl)
+                    {
+                        int num = 8 * pl - 4 * int(sf) + 28 + 16 * crc - 20 * h;
+                        int den = 4 * (int(sf) - 2 * de);
+                        // Integer division truncates, which is the ceiling
+                        // of negative quotients only
+                        int blocks = num / den + ((num > 0 && num % den) ? 1 : 0);
+                        table[PayloadBlocksIndex(sf, de, h, crc, pl)] = int8_t(blocks);
+                    }
+                }
+            }
+        }
+    }
+    return table;
+}();
+
+/**
+ * Minimum SNR needed to demodulate each SF, from SF7 to SF12 [dB].
+ */
+static constexpr double snrThreshold[6] = {-7.5, -10.0, -12.5, -15.0, -17.5, -20.0};
+
 TypeId
 LoraPhy::GetTypeId()
 {
@@ -79,7 +136,8 @@ LoraPhy::GetTypeId()
 }
 
 LoraPhy::LoraPhy()
-    : m_nodeId(0)
+    : m_receivingTransmission(false),
+      m_nodeId(0)
 {
     NS_LOG_FUNCTION(this);
     m_interference = CreateObject<LoraInterferenceHelper>();
@@ -135,12 +193,54 @@ LoraPhy::DoDispose()
     Object::DoDispose();
 }
 
+void
+LoraPhy::StartReceive(Ptr<Packet> packet,
+                      double rxPowerDbm,
+                      uint8_t sf,
+                      Time duration,
+                      double frequency)
+{
+    NS_LOG_FUNCTION(this << packet << rxPowerDbm << unsigned(sf) << duration << frequency);
+    if (m_receivingTransmission)
+    {
+        NS_FATAL_ERROR("PHYs must override StartReceive or ReceiveTransmission");
+    }
+    auto transmission = Create<LoraInterferenceHelper::Transmission>();
+    transmission->startTime = Simulator::Now();
+    transmission->duration = duration;
+    transmission->sf = sf;
+    transmission->frequencyHz = frequency;
+    transmission->packet = packet;
+    ReceiveTransmission(transmission, rxPowerDbm);
+}
+
+void
+LoraPhy::ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                             double rxPowerDbm)
+{
+    NS_LOG_FUNCTION(this << transmission->id << rxPowerDbm);
+    // Coming back here from the default StartReceive would never end
+    m_receivingTransmission = true;
+    StartReceive(transmission->packet,
+                 rxPowerDbm,
+                 transmission->sf,
+                 transmission->duration,
+                 transmission->frequencyHz);
+    m_receivingTransmission = false;
+}
+
 void
 LoraPhy::SetInterferenceHelper(const Ptr<LoraInterferenceHelper> helper)
 {
     m_interference = helper;
 }
 
+Ptr<LoraInterferenceHelper>
+LoraPhy::GetInterferenceHelper() const
+{
+    return m_interference;
+}
+
 void
 LoraPhy::SetChannel(Ptr<LoraChannel> channel)
 {
@@ -209,13 +309,20 @@ Time
 LoraPhy::GetTSym(const LoraPhyTxParameters& txParams)
 {
     NS_LOG_FUNCTION(txParams);
-    return Seconds(pow(2, int(txParams.sf)) / (txParams.bandwidthHz));
+    return Seconds(std::ldexp(1.0, int(txParams.sf)) / (txParams.bandwidthHz));
 }
 
 Time
 LoraPhy::GetTimeOnAir(Ptr<const Packet> packet, const LoraPhyTxParameters& txParams)
 {
     NS_LOG_FUNCTION(packet << txParams);
+    return GetTimeOnAir(packet->GetSize(), txParams);
+}
+
+Time
+LoraPhy::GetTimeOnAir(uint32_t size, const LoraPhyTxParameters& txParams)
+{
+    NS_LOG_FUNCTION(size << txParams);
 
     // The contents of this function are based on [1].
     // [1] SX1272 LoRa modem designer's guide.
@@ -227,27 +334,40 @@ LoraPhy::GetTimeOnAir(Ptr<const Packet> packet, const LoraPhyTxParameters& txPar
     Time tPreamble = (double(txParams.nPreamble) + 4.25) * tSym;
 
     // Payload size
-    uint32_t pl = packet->GetSize(); // Size in bytes
+    uint32_t pl = size; // Size in bytes
     NS_LOG_DEBUG("Packet of size " << pl << " bytes");
 
-    // This step is needed since the formula deals with double values.
-    // de = 1 when the low data rate optimization is enabled, 0 otherwise
-    // h = 1 when header is implicit, 0 otherwise
-    double de = txParams.lowDataRateOptimizationEnabled ? 1 : 0;
-    double h = txParams.headerDisabled ? 1 : 0;
-    double crc = txParams.crcEnabled ? 1 : 0;
-
-    // num and den refer to numerator and denominator of the time on air formula
-    double num = 8 * pl - 4 * txParams.sf + 28 + 16 * crc - 20 * h;
-    double den = 4 * (txParams.sf - 2 * de);
-    double payloadSymbNb =
-        8 + std::max(std::ceil(num / den) * (txParams.codingRate + 4), double(0));
+    // Number of blocks of (codingRate + 4) payload symbols
+    double blocks;
+    if (txParams.sf >= 7 && txParams.sf <= 12 && pl < 256)
+    {
+        blocks = payloadBlocks[PayloadBlocksIndex(txParams.sf,
+                                                  txParams.lowDataRateOptimizationEnabled,
+                                                  txParams.headerDisabled,
+                                                  txParams.crcEnabled,
+                                                  pl)];
+    }
+    else
+    {
+        // This step is needed since the formula deals with double values.
+        // de = 1 when the low data rate optimization is enabled, 0 otherwise
+        // h = 1 when header is implicit, 0 otherwise
+        double de = txParams.lowDataRateOptimizationEnabled ? 1 : 0;
+        double h = txParams.headerDisabled ? 1 : 0;
+        double crc = txParams.crcEnabled ? 1 : 0;
+
+        // num and den refer to numerator and denominator of the time on air formula
+        double num = 8.0 * pl - 4 * txParams.sf + 28 + 16 * crc - 20 * h;
+        double den = 4 * (txParams.sf - 2 * de);
+        blocks = std::ceil(num / den);
+    }
+    double payloadSymbNb = 8 + std::max(blocks * (txParams.codingRate + 4), double(0));
 
     // Time to transmit the payload
     Time tPayload = payloadSymbNb * tSym;
 
-    NS_LOG_DEBUG("Time computation: num = " << num << ", den = " << den << ", payloadSymbNb = "
-                                            << payloadSymbNb << ", tSym = " << tSym);
+    NS_LOG_DEBUG("Time computation: blocks = " << blocks << ", payloadSymbNb = " << payloadSymbNb
+                                               << ", tSym = " << tSym);
     NS_LOG_DEBUG("tPreamble = " << tPreamble);
     NS_LOG_DEBUG("tPayload = " << tPayload);
     NS_LOG_DEBUG("Total time = " << tPreamble + tPayload);
@@ -256,6 +376,12 @@ LoraPhy::GetTimeOnAir(Ptr<const Packet> packet, const LoraPhyTxParameters& txPar
     return tPreamble + tPayload;
 }
 
+double
+LoraPhy::GetSnrThreshold(uint8_t sf)
+{
+    return snrThreshold[unsigned(sf) - 7];
+}
+
 double
 LoraPhy::RxPowerToSNR(double transmissionPower, double bandwidth)
 {
@@ -85,7 +85,11 @@ class LoraPhy : public Object
     /**
      * Start receiving a packet.
      *
-     * This method is typically called by LoraChannel.
+     * This method can be used to inject signals that do not come from a
+     * LoraChannel: by default, it describes the signal with a standalone
+     * transmission and passes it to ReceiveTransmission. PHYs written before
+     * ReceiveTransmission existed can still override it instead. When neither
+     * method is overridden, the first reception is a fatal error.
      *
      * \param packet The packet that is arriving at this PHY layer.
      * \param rxPowerDbm The power of the arriving packet (assumed to be constant
@@ -98,7 +102,22 @@ class LoraPhy : public Object
                               double rxPowerDbm,
                               uint8_t sf,
                               Time duration,
-                              double frequency) = 0;
+                              double frequency);
+
+    /**
+     * Start receiving a transmission.
+     *
+     * This method is typically called by LoraChannel, which shares the same
+     * transmission among all the receivers. By default, it passes the
+     * parameters of the transmission to StartReceive: PHYs must override at
+     * least one of the two methods.
+     *
+     * \param transmission The transmission that is arriving at this PHY layer.
+     * \param rxPowerDbm The power of the arriving transmission (assumed to be
+     * constant for the whole reception).
+     */
+    virtual void ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                                     double rxPowerDbm);
 
     /**
      * Whether this device is transmitting or not.
@@ -164,6 +183,13 @@ class LoraPhy : public Object
      */
     virtual void SetInterferenceHelper(const Ptr<LoraInterferenceHelper> helper);
 
+    /**
+     * Get the interference helper.
+     *
+     * \return The interference helper of this PHY, if any.
+     */
+    Ptr<LoraInterferenceHelper> GetInterferenceHelper() const;
+
     /**
      * Set the LoraChannel instance PHY transmits on.
      *
@@ -231,6 +257,28 @@ class LoraPhy : public Object
      */
     static Time GetTimeOnAir(Ptr<const Packet> packet, const LoraPhyTxParameters& txParams);
 
+    /**
+     * Compute the time that a payload of a certain size will take to be
+     * transmitted.
+     *
+     * For SF7 to SF12 and payloads of up to 255 bytes, the number of payload
+     * symbols is read from a table computed at compile time.
+     *
+     * \param size The size of the PHY payload [B].
+     * \param txParams The set of parameters that will be used for transmission.
+     * \return The time necessary to transmit the payload.
+     */
+    static Time GetTimeOnAir(uint32_t size, const LoraPhyTxParameters& txParams);
+
+    /**
+     * Get the minimum SNR needed to demodulate a signal with a certain
+     * spreading factor.
+     *
+     * \param sf The spreading factor, from 7 to 12.
+     * \return The SNR threshold [dB].
+     */
+    static double GetSnrThreshold(uint8_t sf);
+
     /**
      * Compute the Signal to Noise Ratio (SNR) from the transmission power
      * measured at packet reception.
@@ -264,6 +312,8 @@ class LoraPhy : public Object
     Ptr<LoraChannel> m_channel;                 //!< The channel this PHY transmits on.
     Ptr<LoraInterferenceHelper> m_interference; //!< The InterferenceHelper associated to this PHY.
 
+    bool m_receivingTransmission; //!< Whether the default ReceiveTransmission is running
+
     // Callbacks (communication with MAC layer)
     RxOkCallback m_rxOkCallback;             //! Callback to perform upon correct reception
     RxFailedCallback m_rxFailedCallback;     //! Callback to perform upon failed reception
@@ -16,6 +16,7 @@ cpp_examples = [
     ("parallel-reception-example", "True", "True"),
     ("frame-counter-update", "True", "True"),
     ("pcap-example", "True", "True"),
+    ("udp-forwarder-benchmark --nDatagrams=1000", "True", "False"),
 ]
 
 # A list of Python examples to run in order to ensure that they remain
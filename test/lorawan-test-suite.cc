@@ -7,12 +7,40 @@
  */
 
 // An essential include is test.h
+#include "ns3/boolean.h"
+#include "ns3/building.h"
 #include "ns3/constant-position-mobility-model.h"
+#include "ns3/double.h"
+#include "ns3/enum.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/mobility-building-info.h"
+#include "ns3/mobility-helper.h"
+#include "ns3/okumura-hata-propagation-loss-model.h"
+#include "ns3/point-to-point-helper.h"
+#include "ns3/pointer.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/random-variable-stream.h"
 #include "ns3/simulator.h"
+#include "ns3/string.h"
 #include "ns3/test.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/uinteger.h"
 
 // Include headers of classes to test
+#include "ns3/base64.h"
+#include "ns3/cmac.h"
 #include "ns3/elora-module.h"
+#include "ns3/jitqueue.h"
+#include "ns3/udp-forwarder-helper.h"
+#include "ns3/udp-forwarder.h"
+
+#include "utilities.h"
+
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace ns3;
 using namespace lorawan;
@@ -183,6 +211,234 @@ InterferenceTest::DoRun()
                           0,
                           "Packet did not survive interference as expected");
     interferenceHelper.ClearAllEvents();
+
+    // Events do not keep the packets of their transmissions alive
+    auto packet = Create<Packet>(10);
+    auto transmission = Create<LoraInterferenceHelper::Transmission>();
+    transmission->id = 1;
+    transmission->duration = Seconds(1);
+    transmission->sf = 7;
+    transmission->frequencyHz = frequencyHz;
+    transmission->packet = packet;
+    event = interferenceHelper.Add(transmission, 14);
+    transmission = nullptr;
+    NS_TEST_EXPECT_MSG_EQ(packet->GetReferenceCount(), 1, "The event kept the packet alive");
+    NS_TEST_EXPECT_MSG_EQ(event->GetTransmissionId(), 1, "Wrong transmission identifier");
+    NS_TEST_EXPECT_MSG_EQ(event->GetEndTime(), Seconds(1), "Wrong end time");
+    interferenceHelper.ClearAllEvents();
+
+    // Old events are cleaned from all frequencies, not only from the one of
+    // the signal being added
+    interferenceHelper.Add(Seconds(1), 14, 7, nullptr, differentFrequencyHz);
+    Simulator::Stop(Seconds(4));
+    Simulator::Run();
+    interferenceHelper.Add(Seconds(1), 14, 7, nullptr, frequencyHz);
+    NS_TEST_EXPECT_MSG_EQ(interferenceHelper.GetInterferers().size(),
+                          1,
+                          "Old event of another frequency was kept");
+    interferenceHelper.ClearAllEvents();
+
+    Simulator::Destroy();
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests that the incremental interference computation of LoraInterferenceHelper yields the
+ * same outcomes as the full scan of overlapping events, with all isolation matrices
+ */
+class IncrementalInterferenceTest : public TestCase
+{
+  public:
+    IncrementalInterferenceTest();           //!< Default constructor
+    ~IncrementalInterferenceTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Register a signal on both interference helpers and schedule the comparison of their
+     * outcomes at its end.
+     *
+     * @param duration The duration of the signal.
+     * @param rxPower The received power in dBm.
+     * @param sf The spreading factor of the signal.
+     * @param frequency The frequency of the signal.
+     */
+    void AddSignal(Time duration, double rxPower, uint8_t sf, double frequency);
+
+    /**
+     * Compare the outcome of the two interference helpers for the same signal.
+     *
+     * @param scanned The event registered in the helper scanning overlapping events.
+     * @param integrated The event registered in the helper using running integrals.
+     */
+    void Compare(Ptr<LoraInterferenceHelper::Event> scanned,
+                 Ptr<LoraInterferenceHelper::Event> integrated);
+
+    Ptr<LoraInterferenceHelper> m_scan;        //!< Helper scanning overlapping events
+    Ptr<LoraInterferenceHelper> m_incremental; //!< Helper using running integrals
+
+    int m_mismatches = 0; //!< Number of signals with different outcomes
+    int m_destroyed = 0;  //!< Number of signals destroyed by interference
+};
+
+// Add some help text to this case to describe what it is intended to test
+IncrementalInterferenceTest::IncrementalInterferenceTest()
+    : TestCase("Verify that incremental interference computation matches the full scan")
+{
+}
+
+// Reminder that the test case should clean up after itself
+IncrementalInterferenceTest::~IncrementalInterferenceTest()
+{
+}
+
+void
+IncrementalInterferenceTest::AddSignal(Time duration, double rxPower, uint8_t sf, double frequency)
+{
+    auto scanned = m_scan->Add(duration, rxPower, sf, nullptr, frequency);
+    auto integrated = m_incremental->Add(duration, rxPower, sf, nullptr, frequency);
+    Simulator::Schedule(duration,
+                        &IncrementalInterferenceTest::Compare,
+                        this,
+                        scanned,
+                        integrated);
+}
+
+void
+IncrementalInterferenceTest::Compare(Ptr<LoraInterferenceHelper::Event> scanned,
+                                     Ptr<LoraInterferenceHelper::Event> integrated)
+{
+    uint8_t expected = m_scan->IsDestroyedByInterference(scanned);
+    uint8_t actual = m_incremental->IsDestroyedByInterference(integrated);
+    if (expected != actual)
+    {
+        NS_LOG_DEBUG("Mismatch for " << *scanned << ": " << unsigned(expected) << " vs "
+                                     << unsigned(actual));
+        m_mismatches++;
+    }
+    if (expected)
+    {
+        m_destroyed++;
+    }
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+IncrementalInterferenceTest::DoRun()
+{
+    NS_LOG_DEBUG("IncrementalInterferenceTest");
+
+    for (auto matrix : {LoraInterferenceHelper::CROCE,
+                        LoraInterferenceHelper::GOURSAUD,
+                        LoraInterferenceHelper::ALOHA})
+    {
+        m_mismatches = 0;
+        m_destroyed = 0;
+
+        m_scan = CreateObject<LoraInterferenceHelper>();
+        m_scan->SetIsolationMatrix(matrix);
+        m_incremental = CreateObject<LoraInterferenceHelper>();
+        m_incremental->SetAttribute("IncrementalInterference", BooleanValue(true));
+        m_incremental->SetIsolationMatrix(matrix);
+
+        auto uniform = CreateObject<UniformRandomVariable>();
+        uniform->SetStream(1);
+        auto interArrival = CreateObject<ExponentialRandomVariable>();
+        interArrival->SetAttribute("Mean", DoubleValue(50));
+        interArrival->SetStream(2);
+
+        // Signals on two frequencies, with millisecond granularity so that
+        // simultaneous starts and back-to-back signals happen as well
+        Time start;
+        for (int i = 0; i < 2000; ++i)
+        {
+            start += MilliSeconds(std::round(interArrival->GetValue()));
+            Time duration = MilliSeconds(uniform->GetInteger(20, 1500));
+            double rxPower = uniform->GetValue(-130, -90);
+            auto sf = uint8_t(uniform->GetInteger(7, 12));
+            double frequency = (uniform->GetValue() < 0.5) ? 868100000 : 868300000;
+            Simulator::Schedule(start,
+                                &IncrementalInterferenceTest::AddSignal,
+                                this,
+                                duration,
+                                rxPower,
+                                sf,
+                                frequency);
+        }
+
+        Simulator::Run();
+        Simulator::Destroy();
+
+        NS_TEST_EXPECT_MSG_EQ(m_mismatches, 0, "Incremental outcomes differ from the full scan");
+        NS_TEST_EXPECT_MSG_GT(m_destroyed, 0, "Scenario did not exercise interference");
+    }
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests that the statistical background traffic model interferes with receptions on its
+ * frequencies only
+ */
+class BackgroundTrafficTest : public TestCase
+{
+  public:
+    BackgroundTrafficTest();           //!< Default constructor
+    ~BackgroundTrafficTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+};
+
+// Add some help text to this case to describe what it is intended to test
+BackgroundTrafficTest::BackgroundTrafficTest()
+    : TestCase("Verify that background traffic interferes with receptions")
+{
+}
+
+// Reminder that the test case should clean up after itself
+BackgroundTrafficTest::~BackgroundTrafficTest()
+{
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+BackgroundTrafficTest::DoRun()
+{
+    NS_LOG_DEBUG("BackgroundTrafficTest");
+
+    auto interferenceHelper = CreateObject<LoraInterferenceHelper>();
+    auto event = interferenceHelper->Add(Seconds(1), -120, 12, nullptr, 868100000);
+    NS_TEST_EXPECT_MSG_EQ(interferenceHelper->IsDestroyedByInterference(event),
+                          0,
+                          "Packet did not survive without interference as expected");
+
+    // A million devices sending every 10 minutes within 1 km of the gateway
+    auto receiver = CreateObject<ConstantPositionMobilityModel>();
+    receiver->SetPosition(Vector(0, 0, 15));
+    auto background = CreateObject<BackgroundTraffic>();
+    background->SetAttribute("Devices", UintegerValue(1000000));
+    background->SetAttribute("Radius", DoubleValue(1000));
+    background->SetPropagationLossModel(CreateObject<LogDistancePropagationLossModel>());
+    background->SetReceiver(receiver);
+    NS_TEST_EXPECT_MSG_EQ_TOL(background->GetArrivalRate(),
+                              1000000 / 600.0 / 3,
+                              1e-9,
+                              "Unexpected arrival rate per frequency");
+    interferenceHelper->SetBackgroundTraffic(background);
+
+    NS_TEST_EXPECT_MSG_NE(interferenceHelper->IsDestroyedByInterference(event),
+                          0,
+                          "Packet was not destroyed by background traffic as expected");
+    event = interferenceHelper->Add(Seconds(1), -120, 12, nullptr, 869525000);
+    NS_TEST_EXPECT_MSG_EQ(interferenceHelper->IsDestroyedByInterference(event),
+                          0,
+                          "Background traffic interfered on another frequency");
+    interferenceHelper->Dispose();
 }
 
 /**
@@ -670,6 +926,33 @@ ReceivePathTest::DoRun()
     NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 2, "Unexpected value");
     NS_TEST_EXPECT_MSG_EQ(m_maxOccupiedReceptionPaths, 2, "Unexpected value");
 
+    ///////////////////////////////////////////////////////////////////////////////
+    // Concentrators with more than 64 ReceptionPaths use all of them, and no more.
+    ///////////////////////////////////////////////////////////////////////////////
+
+    Reset();
+    gatewayPhy->SetReceptionPaths(70);
+
+    for (int i = 0; i < 71; ++i)
+    {
+        Simulator::Schedule(Seconds(2),
+                            &GatewayLoraPhy::StartReceive,
+                            gatewayPhy,
+                            packet,
+                            14,
+                            7,
+                            Seconds(4),
+                            868100000 + i * 1000);
+    }
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+    Simulator::Destroy();
+
+    NS_TEST_EXPECT_MSG_EQ(m_noMoreDemodulatorsCalls, 1, "Unexpected value");
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 70, "Unexpected value");
+    NS_TEST_EXPECT_MSG_EQ(m_maxOccupiedReceptionPaths, 70, "Unexpected value");
+
     //////////////////////////////////////////////////////////////////////////////////
     // Interference between packets on the same frequency and different ReceptionPaths
     //////////////////////////////////////////////////////////////////////////////////
@@ -1211,6 +1494,33 @@ LogicalChannelTest::DoRun()
     NS_TEST_EXPECT_MSG_EQ(channelHelper->GetWaitingTime(channel3),
                           Time(0),
                           "Wait time affects other subbands");
+
+    // Channel selection
+    ////////////////////
+
+    // Only the channels of the other SubBand can be picked
+    auto uniform = CreateObject<UniformRandomVariable>();
+    for (int i = 0; i < 20; ++i)
+    {
+        auto selected = channelHelper->SelectUplinkChannel(uniform);
+        NS_TEST_ASSERT_MSG_EQ(bool(selected), true, "No channel was selected");
+        NS_TEST_EXPECT_MSG_EQ((selected == channel3 || selected == channel4),
+                              true,
+                              "A channel of an unavailable SubBand was selected");
+    }
+    NS_TEST_EXPECT_MSG_EQ(channelHelper->GetMinimumWaitingTime(),
+                          Time(0),
+                          "Minimum waiting time doesn't behave as expected");
+
+    // Disabled channels are never picked
+    channel3->DisableForUplink();
+    channelHelper->DisableChannel(4);
+    NS_TEST_EXPECT_MSG_EQ(bool(channelHelper->SelectUplinkChannel(uniform)),
+                          false,
+                          "A channel was selected while none is available");
+    NS_TEST_EXPECT_MSG_EQ(channelHelper->GetMinimumWaitingTime(),
+                          expectedTimeOff,
+                          "Minimum waiting time doesn't behave as expected");
 }
 
 /**
@@ -1324,8 +1634,131 @@ TimeOnAirTest::DoRun()
     txParams.codingRate = 1;
     duration = LoraPhy::GetTimeOnAir(packet, txParams);
     NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(), 2.301952, 0.0001, "Unexpected duration");
+
+    // Durations can be computed from the size alone, from the table up to 255 bytes
+    NS_TEST_EXPECT_MSG_EQ(LoraPhy::GetTimeOnAir(50, txParams), duration, "Unexpected duration");
+
+    duration = LoraPhy::GetTimeOnAir(255, txParams);
+    NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(), 9.019392, 0.0001, "Unexpected duration");
+
+    duration = LoraPhy::GetTimeOnAir(300, txParams);
+    NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(), 10.493952, 0.0001, "Unexpected duration");
+
+    // Small payloads at SF11 and SF12 with the LoRaWAN settings, where the
+    // numerator of the payload formula is close to or below zero
+    txParams.headerDisabled = false;
+    txParams.codingRate = 1;
+    txParams.bandwidthHz = 125000;
+    txParams.nPreamble = 8;
+    txParams.crcEnabled = true;
+    txParams.lowDataRateOptimizationEnabled = true;
+
+    struct Reference
+    {
+        uint8_t sf;
+        uint32_t size;
+        double seconds;
+    };
+
+    const Reference references[] = {
+        {11, 0, 0.331776},
+        {11, 1, 0.413696},
+        {11, 13, 0.577536},
+        {12, 0, 0.663552},
+        {12, 1, 0.827392},
+        {12, 13, 1.155072},
+    };
+    for (const auto& reference : references)
+    {
+        txParams.sf = reference.sf;
+        duration = LoraPhy::GetTimeOnAir(reference.size, txParams);
+        NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(),
+                                  reference.seconds,
+                                  1e-9,
+                                  "Unexpected duration at SF" << unsigned(reference.sf) << " for "
+                                                              << reference.size << " bytes");
+        duration = LoraPhy::GetTimeOnAir(Create<Packet>(reference.size), txParams);
+        NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(),
+                                  reference.seconds,
+                                  1e-9,
+                                  "Unexpected packet duration at SF" << unsigned(reference.sf));
+    }
+
+    // A negative numerator gives the minimum of 8 payload symbols
+    txParams.sf = 12;
+    txParams.headerDisabled = true;
+    txParams.crcEnabled = false;
+    duration = LoraPhy::GetTimeOnAir(0, txParams);
+    NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(), 0.663552, 1e-9, "Unexpected duration");
+
+    txParams.lowDataRateOptimizationEnabled = false;
+    duration = LoraPhy::GetTimeOnAir(0, txParams);
+    NS_TEST_EXPECT_MSG_EQ_TOL(duration.GetSeconds(), 0.663552, 1e-9, "Unexpected duration");
 }
 
+/**
+ * @ingroup lorawan
+ *
+ * A PHY only overriding StartReceive, as PHYs written before ReceiveTransmission existed
+ */
+class StartReceiveLoraPhy : public LoraPhy
+{
+  public:
+    void Send(Ptr<Packet> packet,
+              LoraPhyTxParameters txParams,
+              double frequency,
+              double txPowerDbm) override
+    {
+    }
+
+    void StartReceive(Ptr<Packet> packet,
+                      double rxPowerDbm,
+                      uint8_t sf,
+                      Time duration,
+                      double frequency) override
+    {
+        m_packets.push_back(packet);
+    }
+
+    bool IsTransmitting() override
+    {
+        return false;
+    }
+
+    std::vector<Ptr<Packet>> m_packets; //!< The packets that started being received
+
+  protected:
+    void EndReceive(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event) override
+    {
+    }
+};
+
+/**
+ * @ingroup lorawan
+ *
+ * A PHY overriding neither StartReceive nor ReceiveTransmission
+ */
+class NoReceiveLoraPhy : public LoraPhy
+{
+  public:
+    void Send(Ptr<Packet> packet,
+              LoraPhyTxParameters txParams,
+              double frequency,
+              double txPowerDbm) override
+    {
+    }
+
+    bool IsTransmitting() override
+    {
+        return false;
+    }
+
+  protected:
+    void EndReceive(Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event) override
+    {
+    }
+};
+
 /**
  * @ingroup lorawan
  *
@@ -1383,6 +1816,13 @@ class PhyConnectivityTest : public TestCase
      */
     void WrongSf(Ptr<const Packet> packet, uint32_t node);
 
+    /**
+     * Callback for tracing TransmissionSent.
+     *
+     * @param transmission The transmission sent on the channel.
+     */
+    void TransmissionSent(Ptr<const LoraInterferenceHelper::Transmission> transmission);
+
     /**
      * Compare two packets to check if they are equal.
      *
@@ -1408,6 +1848,9 @@ class PhyConnectivityTest : public TestCase
     int m_interferenceCalls = 0;        //!< Counter for LostPacketBecauseInterference calls
     int m_wrongSfCalls = 0;             //!< Counter for LostPacketBecauseWrongSpreadingFactor calls
     int m_wrongFrequencyCalls = 0;      //!< Counter for LostPacketBecauseWrongFrequency calls
+
+    /// Transmissions traced by the channel
+    std::vector<Ptr<const LoraInterferenceHelper::Transmission>> m_transmissions;
 };
 
 // Add some help text to this case to describe what it is intended to test
@@ -1463,6 +1906,14 @@ PhyConnectivityTest::WrongFrequency(Ptr<const Packet> packet, uint32_t node)
     m_wrongFrequencyCalls++;
 }
 
+void
+PhyConnectivityTest::TransmissionSent(Ptr<const LoraInterferenceHelper::Transmission> transmission)
+{
+    NS_LOG_FUNCTION(transmission);
+
+    m_transmissions.push_back(transmission);
+}
+
 bool
 PhyConnectivityTest::IsSamePacket(Ptr<Packet> packet1, Ptr<Packet> packet2)
 {
@@ -1478,6 +1929,7 @@ PhyConnectivityTest::Reset()
     m_interferenceCalls = 0;
     m_wrongSfCalls = 0;
     m_wrongFrequencyCalls = 0;
+    m_transmissions.clear();
 
     auto loss = CreateObject<LogDistancePropagationLossModel>();
     loss->SetPathLossExponent(3.76);
@@ -1819,74 +2271,1492 @@ PhyConnectivityTest::DoRun()
                           "State didn't switch to STANDBY as expected");
 
     Simulator::Destroy();
-}
 
-/**
- * @ingroup lorawan
- *
- * It tests the functionalities of the MAC layer of LoRaWAN devices
- *
- * @todo Not implemented yet.
- */
-class LorawanMacTest : public TestCase
-{
-  public:
-    LorawanMacTest();           //!< Default constructor
-    ~LorawanMacTest() override; //!< Destructor
+    // The channel describes each transmission once, for all receivers
 
-  private:
-    void DoRun() override;
-};
+    Reset();
+    txParams.sf = 12;
+    channel->TraceConnectWithoutContext("TransmissionSent",
+                                        MakeCallback(&PhyConnectivityTest::TransmissionSent, this));
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
 
-// Add some help text to this case to describe what it is intended to test
-LorawanMacTest::LorawanMacTest()
-    : TestCase("Verify that the MAC layer of end devices behaves as expected")
-{
-}
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
 
-// Reminder that the test case should clean up after itself
-LorawanMacTest::~LorawanMacTest()
-{
-}
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 2, "Both GW PHYs should receive the packet");
+    NS_TEST_ASSERT_MSG_EQ(m_transmissions.size(), 1, "Channel did not trace one transmission");
+    auto transmission = m_transmissions[0];
+    NS_TEST_EXPECT_MSG_EQ(transmission->id, 1, "Wrong transmission identifier");
+    NS_TEST_EXPECT_MSG_EQ(IsSamePacket(transmission->packet, packet),
+                          true,
+                          "Traced transmission does not carry the sent packet");
+    NS_TEST_EXPECT_MSG_EQ(unsigned(transmission->sf), 12, "Traced transmission has wrong SF");
+    NS_TEST_EXPECT_MSG_EQ(transmission->startTime, Seconds(2), "Wrong start time in trace");
 
-// This method is the pure virtual method from class TestCase that every
-// TestCase must implement
-void
-LorawanMacTest::DoRun()
-{
-    NS_LOG_DEBUG("LorawanMacTest");
-}
+    Simulator::Destroy();
 
-/**
- * @ingroup lorawan
- *
- * It tests the functionalities of LoRaWAN MAC commands received by devices.
- *
- * This means testing that (i) settings in the downlink MAC commands are correctly applied/rejected
- * by the device, and that (ii) the correct answer (if expected) is produced by the device.
- */
-class MacCommandTest : public TestCase
-{
-  public:
-    MacCommandTest();           //!< Default constructor
-    ~MacCommandTest() override; //!< Destructor
+    // Sensitivity culling skips receptions that can't matter
 
-  private:
-    /**
-     * Have this class' MAC layer receive a downlink packet carrying the input MAC command.
-     * After, trigger a new empty uplink packet send that can then be used to examine the MAC
-     * command answers in the header.
-     *
-     * @tparam T  \explicit The type of MAC command to create.
-     * @tparam Ts \deduced Types of the constructor arguments.
-     * @param  [in] args MAC command constructor arguments.
-     * @return The list of MAC commands produced by the device as an answer.
-     */
-    template <typename T, typename... Ts>
-    std::list<Ptr<MacCommand>> RunMacCommand(Ts&&... args);
+    Reset();
+    txParams.sf = 7;
+    channel->SetAttribute("SensitivityCulling", BooleanValue(true));
+    channel->SetAttribute("CullingMargin", DoubleValue(0));
+    DynamicCast<ConstantPositionMobilityModel>(gwPhy2->GetMobility())
+        ->SetPosition(Vector(3410, 0, 0));
 
-    /**
-     * This function resets the state of the MAC layer used for tests. Use it before each call
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_underSensitivityCalls,
+                          0,
+                          "Reception under the culling threshold was delivered");
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 1, "Reception in range was culled");
+
+    Simulator::Destroy();
+
+    // The default margin is derived from the SIR matrix: with CROCE, an SF7
+    // uplink 2 dB under the sensitivity can still destroy a reception
+
+    Reset();
+    txParams.sf = 7;
+    channel->SetAttribute("SensitivityCulling", BooleanValue(true));
+    DynamicCast<ConstantPositionMobilityModel>(gwPhy2->GetMobility())
+        ->SetPosition(Vector(3847, 0, 0));
+
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_underSensitivityCalls, 1, "Reception within the margin was culled");
+
+    DynamicCast<ConstantPositionMobilityModel>(gwPhy2->GetMobility())
+        ->SetPosition(Vector(5728, 0, 0));
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_underSensitivityCalls,
+                          1,
+                          "Reception under the derived margin was delivered");
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 2, "Reception in range was culled");
+
+    Simulator::Destroy();
+
+    // Receivers out of the culling range are skipped
+
+    Reset();
+    txParams.sf = 7;
+    channel->SetAttribute("CullingRange", DoubleValue(100));
+    DynamicCast<ConstantPositionMobilityModel>(gwPhy2->GetMobility())
+        ->SetPosition(Vector(3410, 0, 0));
+
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_underSensitivityCalls, 0, "Receiver out of range was evaluated");
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 1, "Receiver in range was skipped");
+
+    // A receiver moving into range is found in its new cell
+    DynamicCast<ConstantPositionMobilityModel>(gwPhy2->GetMobility())
+        ->SetPosition(Vector(20, 0, 0));
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 3, "Receiver moved into range was skipped");
+
+    Simulator::Destroy();
+
+    // Cached link gains follow the moves of the nodes
+
+    Reset();
+    channel->SetAttribute("LinkGainCache", BooleanValue(true));
+    PointerValue lossValue;
+    channel->GetAttribute("PropagationLossModel", lossValue);
+    auto loss = lossValue.Get<PropagationLossModel>();
+    auto edMobility = edPhy1->GetMobility();
+    auto gwMobility = gwPhy2->GetMobility();
+
+    NS_TEST_EXPECT_MSG_EQ_TOL(channel->GetRxPower(14, edMobility, gwMobility),
+                              loss->CalcRxPower(14, edMobility, gwMobility),
+                              1e-3,
+                              "Cached uplink gain differs from the loss model");
+    NS_TEST_EXPECT_MSG_EQ_TOL(channel->GetRxPower(14, gwMobility, edMobility),
+                              loss->CalcRxPower(14, gwMobility, edMobility),
+                              1e-3,
+                              "Cached downlink gain differs from the loss model");
+
+    DynamicCast<ConstantPositionMobilityModel>(gwMobility)->SetPosition(Vector(3410, 0, 0));
+
+    NS_TEST_EXPECT_MSG_EQ_TOL(channel->GetRxPower(14, edMobility, gwMobility),
+                              loss->CalcRxPower(14, edMobility, gwMobility),
+                              1e-3,
+                              "Cached gain was not invalidated by the move of the gateway");
+    NS_TEST_EXPECT_MSG_EQ_TOL(channel->GetRxPower(14, edMobility, gwPhy1->GetMobility()),
+                              loss->CalcRxPower(14, edMobility, gwPhy1->GetMobility()),
+                              1e-3,
+                              "Move of a gateway changed the gain of another gateway");
+
+    DynamicCast<ConstantPositionMobilityModel>(edMobility)->SetPosition(Vector(10, 0, 0));
+
+    NS_TEST_EXPECT_MSG_EQ_TOL(channel->GetRxPower(14, edMobility, gwPhy1->GetMobility()),
+                              loss->CalcRxPower(14, edMobility, gwPhy1->GetMobility()),
+                              1e-3,
+                              "Cached gain was not invalidated by the move of the device");
+
+    Simulator::Destroy();
+
+    // Lazy downlinks only reach listening devices
+
+    Reset();
+    txParams.sf = 12;
+    channel->SetAttribute("LazyDownlink", BooleanValue(true));
+    edPhy1->SwitchToStandby();
+    edPhy2->SwitchToSleep();
+    Simulator::Schedule(Seconds(2), &GatewayLoraPhy::Send, gwPhy1, packet, txParams, 868100000, 14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 1, "Listening device did not get the downlink");
+    NS_TEST_EXPECT_MSG_EQ(m_wrongFrequencyCalls + m_wrongSfCalls + m_underSensitivityCalls,
+                          0,
+                          "Downlink was delivered to a sleeping device");
+
+    Simulator::Destroy();
+
+    // Lazy downlinks interfere with each other through the channel log
+
+    Reset();
+    channel->SetAttribute("LazyDownlink", BooleanValue(true));
+    edPhy1->SwitchToStandby();
+    edPhy2->SwitchToSleep();
+    Simulator::Schedule(Seconds(2), &GatewayLoraPhy::Send, gwPhy1, packet, txParams, 868100000, 14);
+    Simulator::Schedule(Seconds(2), &GatewayLoraPhy::Send, gwPhy2, packet, txParams, 868100000, 14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 0, "Downlink survived an equal-power interferer");
+    NS_TEST_EXPECT_MSG_EQ(m_interferenceCalls, 1, "Interference from the log was not detected");
+
+    Simulator::Destroy();
+
+    // Receptions computed on several threads
+
+    Reset();
+    channel->SetAttribute("Threads", UintegerValue(2));
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketCalls, 2, "Both GW PHYs should receive the packet");
+    NS_TEST_EXPECT_MSG_EQ(IsSamePacket(packet, m_latestReceivedPacket),
+                          true,
+                          "Packet received through parallel fan-out is not the sent one");
+
+    Simulator::Destroy();
+
+    // PHYs only overriding StartReceive still get the transmissions of the channel
+
+    Reset();
+    auto legacyPhy = CreateObject<StartReceiveLoraPhy>();
+    auto legacyMobility = CreateObject<ConstantPositionMobilityModel>();
+    legacyMobility->SetPosition(Vector(0, -10, 0));
+    legacyPhy->SetMobility(legacyMobility);
+    channel->Add(legacyPhy);
+    Simulator::Schedule(Seconds(2),
+                        &EndDeviceLoraPhy::Send,
+                        edPhy1,
+                        packet,
+                        txParams,
+                        868100000,
+                        14);
+
+    Simulator::Stop(Hours(2));
+    Simulator::Run();
+
+    NS_TEST_ASSERT_MSG_EQ(legacyPhy->m_packets.size(), 1, "StartReceive was not called");
+    NS_TEST_EXPECT_MSG_EQ(IsSamePacket(packet, legacyPhy->m_packets[0]),
+                          true,
+                          "StartReceive got another packet than the sent one");
+
+    Simulator::Destroy();
+
+    // PHYs overriding neither receive method abort instead of overflowing the
+    // stack, so the transmission is received in a child
+
+    auto injected = Create<LoraInterferenceHelper::Transmission>();
+    injected->duration = Seconds(1);
+    injected->sf = 7;
+    injected->frequencyHz = 868100000;
+    injected->packet = packet;
+    auto noReceivePhy = CreateObject<NoReceiveLoraPhy>();
+    fflush(nullptr);
+    pid_t child = fork();
+    NS_TEST_ASSERT_MSG_NE(child, -1, "fork failed");
+    if (child == 0)
+    {
+        noReceivePhy->ReceiveTransmission(injected, -100);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    NS_TEST_ASSERT_MSG_EQ(waitpid(child, &status, 0), child, "Child lost");
+    NS_TEST_EXPECT_MSG_EQ(bool(WIFSIGNALED(status)), true, "Reception did not fail");
+    NS_TEST_EXPECT_MSG_EQ(WTERMSIG(status), SIGABRT, "Reception did not abort");
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests that batch evaluations of propagation loss models match evaluations receiver by
+ * receiver
+ */
+class BatchPropagationLossTest : public TestCase
+{
+  public:
+    BatchPropagationLossTest();           //!< Default constructor
+    ~BatchPropagationLossTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Compare the batch evaluation of a chain of loss models with CalcRxPower.
+     *
+     * @param loss The first model of the chain.
+     * @param name The name of the chain, for error messages.
+     */
+    void Compare(Ptr<PropagationLossModel> loss, std::string name);
+
+    Ptr<MobilityModel> m_sender; //!< The sender
+    ReceiverBatch m_receivers;   //!< Receivers around the sender
+};
+
+// Add some help text to this case to describe what it is intended to test
+BatchPropagationLossTest::BatchPropagationLossTest()
+    : TestCase("Verify that batch evaluations of propagation loss models match scalar ones")
+{
+}
+
+// Reminder that the test case should clean up after itself
+BatchPropagationLossTest::~BatchPropagationLossTest()
+{
+}
+
+void
+BatchPropagationLossTest::Compare(Ptr<PropagationLossModel> loss, std::string name)
+{
+    std::vector<double> rxPowers;
+    BatchPropagationLoss::CalcRxPower(loss, 14, m_sender, m_receivers, rxPowers);
+    NS_TEST_ASSERT_MSG_EQ(rxPowers.size(), m_receivers.GetN(), "Wrong number of results");
+    for (size_t i = 0; i < rxPowers.size(); ++i)
+    {
+        NS_TEST_EXPECT_MSG_EQ_TOL(rxPowers[i],
+                                  loss->CalcRxPower(14, m_sender, m_receivers.mobility[i]),
+                                  1e-9,
+                                  name << " differs at receiver " << i);
+    }
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+BatchPropagationLossTest::DoRun()
+{
+    NS_LOG_DEBUG("BatchPropagationLossTest");
+
+    // A gateway at 30 m, with a device within the reference distance and others around it
+    m_sender = CreateObject<ConstantPositionMobilityModel>();
+    m_sender->SetPosition(Vector(0, 0, 30));
+    auto close = CreateObject<ConstantPositionMobilityModel>();
+    close->SetPosition(Vector(0.5, 0, 30));
+    m_receivers.Add(close);
+    auto coordinate = CreateObject<UniformRandomVariable>();
+    for (int i = 0; i < 100; ++i)
+    {
+        auto mobility = CreateObject<ConstantPositionMobilityModel>();
+        mobility->SetPosition(
+            Vector(coordinate->GetValue(-5000, 5000), coordinate->GetValue(-5000, 5000), 1.5));
+        m_receivers.Add(mobility);
+    }
+
+    auto logDistance = CreateObject<LogDistancePropagationLossModel>();
+    logDistance->SetPathLossExponent(3.76);
+    logDistance->SetReference(1, 7.7);
+    Compare(logDistance, "LogDistance");
+
+    for (auto [environment, citySize] : {std::pair(UrbanEnvironment, LargeCity),
+                                         std::pair(SubUrbanEnvironment, SmallCity),
+                                         std::pair(OpenAreasEnvironment, MediumCity)})
+    {
+        auto okumuraHata = CreateObject<OkumuraHataPropagationLossModel>();
+        okumuraHata->SetAttribute("Frequency", DoubleValue(868100000.0));
+        okumuraHata->SetAttribute("Environment", EnumValue(environment));
+        okumuraHata->SetAttribute("CitySize", EnumValue(citySize));
+        Compare(okumuraHata, "OkumuraHata");
+    }
+
+    // Above 1500 MHz, the COST 231 extension, whose large city correction
+    // does not depend on the environment
+    for (auto [environment, citySize] : {std::pair(UrbanEnvironment, LargeCity),
+                                         std::pair(SubUrbanEnvironment, LargeCity),
+                                         std::pair(OpenAreasEnvironment, LargeCity),
+                                         std::pair(UrbanEnvironment, MediumCity),
+                                         std::pair(SubUrbanEnvironment, SmallCity)})
+    {
+        auto okumuraHata = CreateObject<OkumuraHataPropagationLossModel>();
+        okumuraHata->SetAttribute("Frequency", DoubleValue(1800e6));
+        okumuraHata->SetAttribute("Environment", EnumValue(environment));
+        okumuraHata->SetAttribute("CitySize", EnumValue(citySize));
+        Compare(okumuraHata, "OkumuraHata COST 231");
+    }
+
+    // Shadowing values are drawn by the batch evaluation, then reused
+    auto shadowing = CreateObject<CorrelatedShadowingPropagationLossModel>();
+    logDistance->SetNext(shadowing);
+    Compare(logDistance, "LogDistance + CorrelatedShadowing");
+
+    // Models without a batch implementation are evaluated one receiver at a time
+    shadowing->SetNext(CreateObject<FriisPropagationLossModel>());
+    Compare(logDistance, "LogDistance + CorrelatedShadowing + Friis");
+
+    // Shadowing precomputed in a raster around the gateway, with a last
+    // receiver outside of it using the shadowing map instead
+    m_receivers.Clear();
+    for (int i = 0; i < 50; ++i)
+    {
+        auto mobility = CreateObject<ConstantPositionMobilityModel>();
+        mobility->SetPosition(
+            Vector(coordinate->GetValue(-1000, 1000), coordinate->GetValue(-1000, 1000), 1.5));
+        m_receivers.Add(mobility);
+    }
+    auto far = CreateObject<ConstantPositionMobilityModel>();
+    far->SetPosition(Vector(3000, -3000, 1.5));
+    m_receivers.Add(far);
+    std::string file = CreateTempDirFilename("shadowing.raster");
+    auto raster = CreateObject<CorrelatedShadowingPropagationLossModel>();
+    raster->SetAttribute("RasterSize", DoubleValue(2000));
+    raster->SetAttribute("RasterFile", StringValue(file));
+    raster->AssignStreams(10);
+    Compare(raster, "CorrelatedShadowing raster");
+
+    // A second model with the same file and stream loads the same values
+    // instead of drawing new ones, a model with another stream draws its own
+    auto loaded = CreateObject<CorrelatedShadowingPropagationLossModel>();
+    loaded->SetAttribute("RasterSize", DoubleValue(2000));
+    loaded->SetAttribute("RasterFile", StringValue(file));
+    loaded->AssignStreams(10);
+    auto other = CreateObject<CorrelatedShadowingPropagationLossModel>();
+    other->SetAttribute("RasterSize", DoubleValue(2000));
+    other->SetAttribute("RasterFile", StringValue(file));
+    other->AssignStreams(11);
+    size_t differences = 0;
+    for (size_t i = 0; i + 1 < m_receivers.GetN(); ++i)
+    {
+        double rxPower = raster->CalcRxPower(14, m_sender, m_receivers.mobility[i]);
+        NS_TEST_EXPECT_MSG_EQ(loaded->CalcRxPower(14, m_sender, m_receivers.mobility[i]),
+                              rxPower,
+                              "The loaded raster differs at receiver " << i);
+        differences += (other->CalcRxPower(14, m_sender, m_receivers.mobility[i]) != rxPower);
+    }
+    NS_TEST_EXPECT_MSG_GT(differences, 0, "A raster drawn from another stream was loaded");
+
+    // The loss of a link is the same in both directions
+    NS_TEST_EXPECT_MSG_EQ_TOL(raster->CalcRxPower(14, m_receivers.mobility[0], m_sender),
+                              raster->CalcRxPower(14, m_sender, m_receivers.mobility[0]),
+                              1e-9,
+                              "The raster is not reciprocal");
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * A gateway PHY recording the transmissions reaching it, instead of receiving them
+ */
+class RecordingGatewayLoraPhy : public GatewayLoraPhy
+{
+  public:
+    void ReceiveTransmission(Ptr<const LoraInterferenceHelper::Transmission> transmission,
+                             double rxPowerDbm) override
+    {
+        m_rxPowers.push_back(rxPowerDbm);
+        m_arrivals.push_back(Simulator::Now());
+    }
+
+    std::vector<double> m_rxPowers; //!< The power of the transmissions [dBm]
+    std::vector<Time> m_arrivals;   //!< The arrival time of the transmissions
+};
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests that receptions computed by LoraChannel on several threads are the ones computed on a
+ * single thread
+ */
+class ParallelReceptionTest : public TestCase
+{
+  public:
+    ParallelReceptionTest();           //!< Default constructor
+    ~ParallelReceptionTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Send a packet from each end device on a channel with a number of threads, and record the
+     * receptions at the gateways.
+     *
+     * @param threads The number of threads of the channel.
+     * @param loss The loss model chain of the channel.
+     * @return The gateway PHYs, with the receptions they recorded.
+     */
+    std::vector<Ptr<RecordingGatewayLoraPhy>> Run(uint32_t threads,
+                                                  Ptr<PropagationLossModel> loss);
+
+    /**
+     * Check that the receptions with 2, 4 and 8 threads match the ones with a single thread.
+     *
+     * @param makeLoss Get the loss model chain of a run.
+     * @return The gateway PHYs of the single-threaded run.
+     */
+    std::vector<Ptr<RecordingGatewayLoraPhy>> CheckThreads(
+        Callback<Ptr<PropagationLossModel>> makeLoss);
+
+    /**
+     * Get the chain of the log-distance and correlated shadowing models, shared by all runs.
+     *
+     * @return The loss model chain.
+     */
+    Ptr<PropagationLossModel> GetShadowingLoss();
+
+    /**
+     * Create a chain of the log-distance and building penetration models, drawing the same
+     * values as the ones of the other runs.
+     *
+     * @return The loss model chain.
+     */
+    Ptr<PropagationLossModel> CreateBuildingLoss();
+
+    Ptr<PropagationLossModel> m_loss;           //!< The shadowing chain shared by all runs
+    std::vector<Ptr<MobilityModel>> m_devices;  //!< The positions of the end devices
+    std::vector<Ptr<MobilityModel>> m_gateways; //!< The positions of the gateways
+    std::vector<Box> m_buildings;               //!< The buildings created for each run
+};
+
+// Add some help text to this case to describe what it is intended to test
+ParallelReceptionTest::ParallelReceptionTest()
+    : TestCase("Verify that receptions computed on several threads match single-threaded ones")
+{
+}
+
+// Reminder that the test case should clean up after itself
+ParallelReceptionTest::~ParallelReceptionTest()
+{
+}
+
+std::vector<Ptr<RecordingGatewayLoraPhy>>
+ParallelReceptionTest::Run(uint32_t threads, Ptr<PropagationLossModel> loss)
+{
+    // Buildings are deleted with the simulator
+    for (const auto& box : m_buildings)
+    {
+        CreateObject<Building>()->SetBoundaries(box);
+    }
+    auto delay = CreateObject<ConstantSpeedPropagationDelayModel>();
+    auto channel = CreateObject<LoraChannel>(loss, delay);
+    channel->SetAttribute("Threads", UintegerValue(threads));
+    std::vector<Ptr<RecordingGatewayLoraPhy>> gateways;
+    for (const auto& mobility : m_gateways)
+    {
+        auto phy = CreateObject<RecordingGatewayLoraPhy>();
+        phy->SetMobility(mobility);
+        channel->Add(phy);
+        gateways.push_back(phy);
+    }
+    Time sendTime = Seconds(1);
+    for (const auto& mobility : m_devices)
+    {
+        auto phy = CreateObject<EndDeviceLoraPhy>();
+        phy->SetMobility(mobility);
+        channel->Add(phy);
+        Simulator::Schedule(sendTime,
+                            &LoraChannel::Send,
+                            channel,
+                            phy,
+                            Create<Packet>(10),
+                            14,
+                            7,
+                            MilliSeconds(50),
+                            868100000);
+        sendTime += Seconds(1);
+    }
+    Simulator::Run();
+    Simulator::Destroy();
+    return gateways;
+}
+
+std::vector<Ptr<RecordingGatewayLoraPhy>>
+ParallelReceptionTest::CheckThreads(Callback<Ptr<PropagationLossModel>> makeLoss)
+{
+    auto reference = Run(1, makeLoss());
+    for (uint32_t threads : {2, 4, 8})
+    {
+        auto gateways = Run(threads, makeLoss());
+        for (size_t g = 0; g < gateways.size(); ++g)
+        {
+            NS_TEST_EXPECT_MSG_EQ(gateways[g]->m_rxPowers.size(),
+                                  reference[g]->m_rxPowers.size(),
+                                  "Gateway " << g << " got other transmissions with " << threads
+                                             << " threads");
+            if (gateways[g]->m_rxPowers.size() != reference[g]->m_rxPowers.size())
+            {
+                continue;
+            }
+            for (size_t d = 0; d < reference[g]->m_rxPowers.size(); ++d)
+            {
+                NS_TEST_EXPECT_MSG_EQ(gateways[g]->m_rxPowers[d],
+                                      reference[g]->m_rxPowers[d],
+                                      "Different power at gateway " << g << " with " << threads
+                                                                    << " threads");
+                NS_TEST_EXPECT_MSG_EQ(gateways[g]->m_arrivals[d],
+                                      reference[g]->m_arrivals[d],
+                                      "Different arrival at gateway " << g << " with " << threads
+                                                                      << " threads");
+            }
+        }
+    }
+    return reference;
+}
+
+Ptr<PropagationLossModel>
+ParallelReceptionTest::GetShadowingLoss()
+{
+    if (!m_loss)
+    {
+        auto logDistance = CreateObject<LogDistancePropagationLossModel>();
+        logDistance->SetPathLossExponent(3.76);
+        logDistance->SetReference(1, 7.7);
+        auto shadowing = CreateObject<CorrelatedShadowingPropagationLossModel>();
+        shadowing->SetAttribute("RasterSize", DoubleValue(5000));
+        logDistance->SetNext(shadowing);
+        m_loss = logDistance;
+    }
+    return m_loss;
+}
+
+Ptr<PropagationLossModel>
+ParallelReceptionTest::CreateBuildingLoss()
+{
+    auto logDistance = CreateObject<LogDistancePropagationLossModel>();
+    logDistance->SetPathLossExponent(3.76);
+    logDistance->SetReference(1, 7.7);
+    auto buildingLoss = CreateObject<BuildingPenetrationLoss>();
+    logDistance->SetNext(buildingLoss);
+    logDistance->AssignStreams(5);
+    return logDistance;
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+ParallelReceptionTest::DoRun()
+{
+    NS_LOG_DEBUG("ParallelReceptionTest");
+
+    // Gateways and end devices spread in the raster of the shadowing model
+    auto coordinate = CreateObject<UniformRandomVariable>();
+    for (int i = 0; i < 37; ++i)
+    {
+        auto mobility = CreateObject<ConstantPositionMobilityModel>();
+        mobility->SetPosition(
+            Vector(coordinate->GetValue(-2000, 2000), coordinate->GetValue(-2000, 2000), 30));
+        m_gateways.push_back(mobility);
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+        auto mobility = CreateObject<ConstantPositionMobilityModel>();
+        mobility->SetPosition(
+            Vector(coordinate->GetValue(-2000, 2000), coordinate->GetValue(-2000, 2000), 1.5));
+        m_devices.push_back(mobility);
+    }
+    for (const auto& mobility : m_devices)
+    {
+        mobility->AggregateObject(CreateObject<MobilityBuildingInfo>());
+    }
+    for (const auto& mobility : m_gateways)
+    {
+        mobility->AggregateObject(CreateObject<MobilityBuildingInfo>());
+    }
+
+    auto reference = CheckThreads(MakeCallback(&ParallelReceptionTest::GetShadowingLoss, this));
+    for (size_t g = 0; g < m_gateways.size(); ++g)
+    {
+        NS_TEST_ASSERT_MSG_EQ(reference[g]->m_rxPowers.size(),
+                              m_devices.size(),
+                              "Gateway " << g << " missed transmissions");
+    }
+
+    // Per-packet losses are drawn in the same order whatever the number of
+    // threads: put two end devices and a gateway in buildings
+    for (const auto& mobility : {m_devices[0], m_devices[1], m_gateways[0]})
+    {
+        Vector p = mobility->GetPosition();
+        m_buildings.emplace_back(p.x - 10, p.x + 10, p.y - 10, p.y + 10, 0, 40);
+    }
+    CheckThreads(MakeCallback(&ParallelReceptionTest::CreateBuildingLoss, this));
+    m_buildings.clear();
+
+    // The powers are the ones of the loss model, whatever the number of threads
+    for (size_t g = 0; g < m_gateways.size(); ++g)
+    {
+        for (size_t d = 0; d < m_devices.size(); ++d)
+        {
+            NS_TEST_EXPECT_MSG_EQ(reference[g]->m_rxPowers[d],
+                                  m_loss->CalcRxPower(14, m_devices[d], m_gateways[g]),
+                                  "Wrong power at gateway " << g);
+        }
+    }
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests the AES and AES-CMAC implementations against known answers, with
+ * and without the AES-NI instructions
+ */
+class CryptoTest : public TestCase
+{
+  public:
+    CryptoTest();           //!< Default constructor
+    ~CryptoTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Check the known answers with the current AES implementation.
+     *
+     * \param name The name of the implementation.
+     */
+    void CheckKnownAnswers(std::string name);
+};
+
+// Add some help text to this case to describe what it is intended to test
+CryptoTest::CryptoTest()
+    : TestCase("Verify that AES and AES-CMAC give the known answers")
+{
+}
+
+// Reminder that the test case should clean up after itself
+CryptoTest::~CryptoTest()
+{
+}
+
+void
+CryptoTest::CheckKnownAnswers(std::string name)
+{
+    // FIPS-197 appendix C.1
+    uint8_t key[16];
+    uint8_t plaintext[16];
+    for (uint8_t i = 0; i < 16; ++i)
+    {
+        key[i] = i;
+        plaintext[i] = i * 0x11;
+    }
+    const uint8_t ciphertext[16] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+    aes_context context;
+    aes_set_key(key, 16, &context);
+    uint8_t block[16];
+    aes_encrypt(plaintext, block, &context);
+    NS_TEST_EXPECT_MSG_EQ(memcmp(block, ciphertext, 16), 0, name << ": wrong AES ciphertext");
+
+    // RFC 4493 section 4, for messages of 0, 16, 40 and 64 bytes
+    const uint8_t cmacKey[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+    const uint8_t message[64] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73,
+        0x93, 0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7,
+        0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51, 0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4,
+        0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef, 0xf6, 0x9f, 0x24, 0x45,
+        0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10};
+    const std::pair<uint32_t, std::array<uint8_t, 16>> macs[] = {
+        {0,
+         {0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28,
+          0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46}},
+        {16,
+         {0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+          0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c}},
+        {40,
+         {0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30,
+          0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27}},
+        {64,
+         {0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92,
+          0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe}}};
+    for (const auto& [length, mac] : macs)
+    {
+        AES_CMAC_CTX cmac;
+        AES_CMAC_Init(&cmac);
+        AES_CMAC_SetKey(&cmac, cmacKey);
+        AES_CMAC_Update(&cmac, message, length);
+        AES_CMAC_Final(block, &cmac);
+        NS_TEST_EXPECT_MSG_EQ(memcmp(block, mac.data(), 16),
+                              0,
+                              name << ": wrong AES-CMAC for " << length << " bytes");
+    }
+
+    // MIC and encryption of a frame with the default keys, as computed before
+    // key schedules were cached
+    LoRaMacCrypto crypto;
+    uint8_t frame[40];
+    for (uint8_t i = 0; i < 40; ++i)
+    {
+        frame[i] = i * 7;
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        uint32_t mic = 0;
+        crypto.ComputeCmacB0(frame, 40, F_NWK_S_INT_KEY, false, UPLINK, 0x01020304, 42, &mic);
+        NS_TEST_EXPECT_MSG_EQ(mic, 0x35884e60, name << ": wrong MIC");
+    }
+    crypto.PayloadEncrypt(frame, 40, F_NWK_S_INT_KEY, 0x01020304, DOWNLINK, 7);
+    NS_TEST_EXPECT_MSG_EQ((frame[0] << 8 | frame[39]), 0xe118, name << ": wrong encryption");
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+CryptoTest::DoRun()
+{
+    NS_LOG_DEBUG("CryptoTest");
+
+    if (aes_hw_available())
+    {
+        CheckKnownAnswers("AES-NI");
+    }
+    aes_hw_enable(0);
+    CheckKnownAnswers("Byte-oriented AES");
+    aes_hw_enable(1);
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests that the rxpk objects of the UdpForwarder and their base64
+ * payloads are the ones the snprintf calls of the packet forwarder give
+ */
+class RxpkWriterTest : public TestCase
+{
+  public:
+    RxpkWriterTest();           //!< Default constructor
+    ~RxpkWriterTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Serialize a packet with snprintf, as the packet forwarder does.
+     *
+     * @param p The LoRa packet.
+     * @return The rxpk object.
+     */
+    std::string Reference(const lgw_pkt_rx_s& p);
+};
+
+// Add some help text to this case to describe what it is intended to test
+RxpkWriterTest::RxpkWriterTest()
+    : TestCase("Verify that rxpk objects are serialized as by the packet forwarder")
+{
+}
+
+// Reminder that the test case should clean up after itself
+RxpkWriterTest::~RxpkWriterTest()
+{
+}
+
+std::string
+RxpkWriterTest::Reference(const lgw_pkt_rx_s& p)
+{
+    const char* sf[] = {"SF7", "SF8", "SF9", "SF10", "SF11", "SF12"};
+    int index = 0;
+    for (uint32_t datarate = p.datarate; datarate > DR_LORA_SF7; datarate >>= 1)
+    {
+        ++index;
+    }
+    char text[600];
+    int n = snprintf(text,
+                     sizeof(text),
+                     "{\"tmst\":%u,\"chan\":%1u,\"rfch\":%1u,\"freq\":%.6lf,\"stat\":1,"
+                     "\"modu\":\"LORA\",\"datr\":\"%sBW125\",\"codr\":\"4/5\",\"lsnr\":%.1f,"
+                     "\"rssi\":%.0f,\"size\":%u,\"data\":\"",
+                     p.count_us,
+                     p.if_chain,
+                     p.rf_chain,
+                     ((double)p.freq_hz / 1e6),
+                     sf[index],
+                     p.snr,
+                     p.rssi,
+                     p.size);
+    n += bin_to_b64(p.payload, p.size, text + n, 341);
+    return std::string(text, n) + "\"}";
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+RxpkWriterTest::DoRun()
+{
+    NS_LOG_DEBUG("RxpkWriterTest");
+
+    // Base64 with and without vector instructions, for all payload sizes
+    uint8_t payload[256];
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        payload[i] = i * 37 + 11;
+    }
+    for (int size = 0; size < 256; ++size)
+    {
+        char scalar[350];
+        char vector[350];
+        b64_simd_enable(0);
+        int scalarLength = bin_to_b64(payload, size, scalar, sizeof(scalar));
+        b64_simd_enable(1);
+        int vectorLength = bin_to_b64(payload, size, vector, sizeof(vector));
+        NS_TEST_EXPECT_MSG_EQ(vectorLength, scalarLength, "Wrong base64 length for " << size);
+        NS_TEST_EXPECT_MSG_EQ(std::string(vector, vectorLength),
+                              std::string(scalar, scalarLength),
+                              "Wrong base64 for " << size << " bytes");
+        uint8_t decoded[256];
+        int decodedLength = b64_to_bin(vector, vectorLength, decoded, sizeof(decoded));
+        NS_TEST_EXPECT_MSG_EQ(decodedLength, size, "Wrong decoded length");
+        NS_TEST_EXPECT_MSG_EQ(memcmp(decoded, payload, size), 0, "Wrong decoded bytes");
+    }
+
+    // Decoding with and without vector instructions, for all input lengths,
+    // of any characters of the alphabet and not only of what the encoder gives
+    const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char text[344];
+    for (int length = 0; length <= 344; ++length)
+    {
+        if (length % 4 == 1)
+        {
+            continue;
+        }
+        for (int i = 0; i < length; ++i)
+        {
+            text[i] = alphabet[(i * 29 + length * 7) % 64];
+        }
+        uint8_t scalar[258];
+        uint8_t vector[258];
+        b64_simd_enable(0);
+        int scalarLength = b64_to_bin_nopad(text, length, scalar, sizeof(scalar));
+        b64_simd_enable(1);
+        int vectorLength = b64_to_bin_nopad(text, length, vector, sizeof(vector));
+        NS_TEST_EXPECT_MSG_EQ(vectorLength, scalarLength, "Wrong decoded length for " << length);
+        NS_TEST_EXPECT_MSG_EQ(memcmp(vector, scalar, scalarLength),
+                              0,
+                              "Wrong decoded bytes for " << length << " characters");
+    }
+
+    // An invalid character stops the vector loop, and the scalar code it
+    // leaves the rest to rejects it by exiting, so it is decoded in a child
+    int length = bin_to_b64(payload, 150, text, sizeof(text));
+    text[4 * 20 + 1] = '!';
+    fflush(nullptr);
+    pid_t child = fork();
+    NS_TEST_ASSERT_MSG_NE(child, -1, "fork failed");
+    if (child == 0)
+    {
+        uint8_t decoded[150];
+        b64_to_bin(text, length, decoded, sizeof(decoded));
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    NS_TEST_ASSERT_MSG_EQ(waitpid(child, &status, 0), child, "Child lost");
+    NS_TEST_EXPECT_MSG_EQ(bool(WIFEXITED(status)), true, "Decoding crashed");
+    NS_TEST_EXPECT_MSG_EQ(WEXITSTATUS(status), EXIT_FAILURE, "Invalid character accepted");
+
+    // Rounding of SNR and RSSI, ties included, on the channels of a gateway
+    const float values[] = {-20.25, -7.5, -0.05, -0.0, 0.0, 0.05, 0.25, 0.35, 2.5, 9.96, -119.5};
+    const uint32_t datarates[] = {DR_LORA_SF7, DR_LORA_SF10, DR_LORA_SF12};
+    const uint32_t frequencies[] = {868100000, 868300000, 868500000, 867100000, 869525000};
+    RxpkWriter writer;
+    lgw_pkt_rx_s p = {};
+    p.status = STAT_CRC_OK;
+    p.modulation = MOD_LORA;
+    p.bandwidth = BW_125KHZ;
+    p.coderate = CR_LORA_4_5;
+    uint32_t n = 0;
+    for (float snr : values)
+    {
+        for (float rssi : values)
+        {
+            p.count_us = 4294967295U - n * 104729;
+            p.if_chain = n % 8;
+            p.freq_hz = frequencies[n % 5];
+            p.datarate = datarates[n % 3];
+            p.snr = snr;
+            p.rssi = rssi - 100;
+            p.size = n % 52;
+            memcpy(p.payload, payload + n % 200, p.size);
+            uint8_t buf[RxpkWriter::MAX_SIZE];
+            uint32_t size = writer.Write(p, buf);
+            NS_TEST_EXPECT_MSG_EQ(std::string((char*)buf, size),
+                                  Reference(p),
+                                  "Wrong rxpk for SNR " << snr << " and RSSI " << p.rssi);
+            ++n;
+        }
+    }
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests the ordering, growth and purge of the just-in-time queue of the UdpForwarder
+ */
+class JitQueueTest : public TestCase
+{
+  public:
+    JitQueueTest();           //!< Default constructor
+    ~JitQueueTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Enqueue a downlink.
+     *
+     * @param queue The queue.
+     * @param now The concentrator time [us].
+     * @param countUs The time of the transmission [us].
+     * @return The result of jit_enqueue.
+     */
+    jit_error_e Enqueue(jit_queue_s& queue, uint32_t now, uint32_t countUs);
+
+    /**
+     * Peek the queue.
+     *
+     * @param queue The queue.
+     * @param now The concentrator time [us].
+     * @return The index of the packet to send, or -1.
+     */
+    int Peek(jit_queue_s& queue, uint32_t now);
+
+    /**
+     * Dequeue the packets of the queue one by one, at the time they are peeked.
+     *
+     * @param queue The queue.
+     * @return The times of the transmissions, in the order they are dequeued [us].
+     */
+    std::vector<uint32_t> Drain(jit_queue_s& queue);
+};
+
+// Add some help text to this case to describe what it is intended to test
+JitQueueTest::JitQueueTest()
+    : TestCase("Verify that the jit queue hands out downlinks in order")
+{
+}
+
+// Reminder that the test case should clean up after itself
+JitQueueTest::~JitQueueTest()
+{
+}
+
+jit_error_e
+JitQueueTest::Enqueue(jit_queue_s& queue, uint32_t now, uint32_t countUs)
+{
+    timeval time = {static_cast<time_t>(now / 1000000), static_cast<suseconds_t>(now % 1000000)};
+    lgw_pkt_tx_s packet = {};
+    packet.count_us = countUs;
+    packet.tx_mode = TIMESTAMPED;
+    packet.modulation = MOD_LORA;
+    packet.bandwidth = BW_125KHZ;
+    packet.datarate = DR_LORA_SF7;
+    packet.coderate = CR_LORA_4_5;
+    packet.preamble = 8;
+    packet.size = 10;
+    return jit_enqueue(&queue, &time, &packet, JIT_PKT_TYPE_DOWNLINK_CLASS_A);
+}
+
+int
+JitQueueTest::Peek(jit_queue_s& queue, uint32_t now)
+{
+    timeval time = {static_cast<time_t>(now / 1000000), static_cast<suseconds_t>(now % 1000000)};
+    int index = -1;
+    jit_peek(&queue, &time, &index);
+    return index;
+}
+
+std::vector<uint32_t>
+JitQueueTest::Drain(jit_queue_s& queue)
+{
+    std::vector<uint32_t> times;
+    while (!jit_queue_is_empty(&queue))
+    {
+        // Peeked 10 ms before the transmission, within the 30 ms programming window
+        uint32_t now = queue.nodes[0].pkt.count_us - 10000;
+        int index = Peek(queue, now);
+        NS_TEST_ASSERT_MSG_EQ(index, 0, "Packet not peeked");
+        lgw_pkt_tx_s packet;
+        jit_pkt_type_e type;
+        NS_TEST_ASSERT_MSG_EQ(jit_dequeue(&queue, index, &packet, &type),
+                              JIT_ERROR_OK,
+                              "Dequeue failed");
+        times.push_back(packet.count_us);
+    }
+    return times;
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+JitQueueTest::DoRun()
+{
+    NS_LOG_DEBUG("JitQueueTest");
+
+    // Packets on both sides of the roll-over of the concentrator counter come
+    // out in the order of transmission
+    jit_queue_s queue = {};
+    jit_queue_init(&queue);
+    uint32_t now = UINT32_MAX - 300000;
+    for (uint32_t offset : {500000, 100000, 400000, 200000, 300000, 600000})
+    {
+        NS_TEST_ASSERT_MSG_EQ(Enqueue(queue, now, now + offset), JIT_ERROR_OK, "Enqueue failed");
+    }
+    timeval time = {static_cast<time_t>(now / 1000000), static_cast<suseconds_t>(now % 1000000)};
+    uint32_t delay;
+    NS_TEST_ASSERT_MSG_EQ(jit_peek_delay(&queue, &time, &delay), JIT_ERROR_OK, "No delay");
+    NS_TEST_EXPECT_MSG_EQ(delay, 100000 - 30000 + 1, "Wrong delay until the first packet");
+    NS_TEST_EXPECT_MSG_EQ(Peek(queue, now), -1, "Packet peeked too early");
+    std::vector<uint32_t> expected;
+    for (uint32_t offset = 100000; offset <= 600000; offset += 100000)
+    {
+        expected.push_back(now + offset);
+    }
+    NS_TEST_EXPECT_MSG_EQ((Drain(queue) == expected), true, "Wrong order across roll-over");
+    NS_TEST_EXPECT_MSG_EQ(jit_peek_delay(&queue, &time, &delay),
+                          JIT_ERROR_EMPTY,
+                          "Delay of an empty queue");
+
+    // The queue grows past its initial size, and keeps its order
+    now = 1000000;
+    const uint32_t nPackets = JIT_QUEUE_MAX + 8;
+    for (uint32_t i = nPackets; i > 0; --i)
+    {
+        NS_TEST_ASSERT_MSG_EQ(Enqueue(queue, now, now + i * 100000),
+                              JIT_ERROR_OK,
+                              "Enqueue failed with " << nPackets - i << " packets");
+    }
+    NS_TEST_EXPECT_MSG_EQ(queue.num_pkt, nPackets, "Packets lost");
+    NS_TEST_EXPECT_MSG_GT_OR_EQ(queue.num_nodes, nPackets, "Queue not grown");
+    expected.clear();
+    for (uint32_t i = 1; i <= nPackets; ++i)
+    {
+        expected.push_back(now + i * 100000);
+    }
+    NS_TEST_EXPECT_MSG_EQ((Drain(queue) == expected), true, "Wrong order after growth");
+
+    // Missed packets are dropped by the next peek
+    for (uint32_t offset : {1000000, 2000000, 3000000})
+    {
+        Enqueue(queue, now, now + offset);
+    }
+    NS_TEST_EXPECT_MSG_EQ(Peek(queue, now + 2500000), -1, "Packet peeked too early");
+    NS_TEST_ASSERT_MSG_EQ(queue.num_pkt, 1, "Outdated packets kept");
+    NS_TEST_EXPECT_MSG_EQ(queue.nodes[0].pkt.count_us, now + 3000000, "Wrong packet kept");
+    Drain(queue);
+
+    // A packet missed by more than half the range of the counter is no
+    // longer first in the heap, and is dropped all the same
+    Enqueue(queue, now, now + 1000000);
+    now += (1U << 31) + 2000000;
+    Enqueue(queue, now, now + 1000000);
+    NS_TEST_EXPECT_MSG_EQ(queue.nodes[0].pkt.count_us, now + 1000000, "Unexpected heap order");
+    NS_TEST_EXPECT_MSG_EQ(Peek(queue, now), -1, "Packet peeked too early");
+    NS_TEST_ASSERT_MSG_EQ(queue.num_pkt, 1, "Outdated packet kept below the top of the heap");
+    NS_TEST_EXPECT_MSG_EQ(queue.nodes[0].pkt.count_us, now + 1000000, "Wrong packet kept");
+
+    jit_queue_free(&queue);
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * A network server speaking the Semtech UDP protocol with a UdpForwarder: it acknowledges the
+ * datagrams of the gateway, records its PUSH_DATA and sends it downlinks
+ */
+class SemtechUdpServer
+{
+  public:
+    /**
+     * Listen on a node.
+     *
+     * @param node The node.
+     * @param port The UDP port.
+     */
+    void Install(Ptr<Node> node, uint16_t port);
+
+    /**
+     * Send a PULL_RESP to the gateway.
+     *
+     * @param json The JSON object with the txpk.
+     */
+    void SendDownlink(std::string json);
+
+    std::vector<std::string> m_pushData; //!< The JSON objects of the PUSH_DATA received
+    uint32_t m_txAcks = 0;               //!< The number of TX_ACK received
+
+  private:
+    /**
+     * Receive the datagrams of the gateway.
+     *
+     * @param socket The socket of the server.
+     */
+    void Receive(Ptr<Socket> socket);
+
+    Ptr<Socket> m_socket;  //!< The socket of the server
+    Address m_pullAddress; //!< The address the gateway sends PULL_DATA from
+};
+
+void
+SemtechUdpServer::Install(Ptr<Node> node, uint16_t port)
+{
+    m_socket = Socket::CreateSocket(node, UdpSocketFactory::GetTypeId());
+    m_socket->Bind(InetSocketAddress(Ipv4Address::GetAny(), port));
+    m_socket->SetRecvCallback(MakeCallback(&SemtechUdpServer::Receive, this));
+}
+
+void
+SemtechUdpServer::SendDownlink(std::string json)
+{
+    std::vector<uint8_t> datagram = {PROTOCOL_VERSION, 0, 0, PKT_PULL_RESP};
+    datagram.insert(datagram.end(), json.begin(), json.end());
+    m_socket->SendTo(Create<Packet>(datagram.data(), datagram.size()), 0, m_pullAddress);
+}
+
+void
+SemtechUdpServer::Receive(Ptr<Socket> socket)
+{
+    Address from;
+    while (Ptr<Packet> packet = socket->RecvFrom(from))
+    {
+        std::vector<uint8_t> datagram(packet->GetSize());
+        packet->CopyData(datagram.data(), datagram.size());
+        if (datagram.size() < 4)
+        {
+            continue;
+        }
+        uint8_t ack[] = {datagram[0], datagram[1], datagram[2], 0};
+        switch (datagram[3])
+        {
+        case PKT_PUSH_DATA:
+            m_pushData.emplace_back(datagram.begin() + 12, datagram.end());
+            ack[3] = PKT_PUSH_ACK;
+            socket->SendTo(ack, sizeof(ack), 0, from);
+            break;
+        case PKT_PULL_DATA:
+            m_pullAddress = from;
+            ack[3] = PKT_PULL_ACK;
+            socket->SendTo(ack, sizeof(ack), 0, from);
+            break;
+        case PKT_TX_ACK:
+            ++m_txAcks;
+            break;
+        }
+    }
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests that a UdpForwarder in event-driven mode exchanges the same datagrams with the server
+ * and sends downlinks at the same time as when polling, and that it aggregates the uplinks
+ * received within its AggregationTime
+ */
+class UdpForwarderTest : public TestCase
+{
+  public:
+    UdpForwarderTest();           //!< Default constructor
+    ~UdpForwarderTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Run a gateway forwarding uplinks to a server, which sends it downlinks.
+     *
+     * @param eventDriven The EventDriven attribute of the UdpForwarder.
+     * @param aggregationTime The AggregationTime attribute of the UdpForwarder.
+     * @param uplinks When the gateway receives uplinks.
+     */
+    void Run(bool eventDriven, Time aggregationTime, const std::vector<Time>& uplinks);
+
+    /**
+     * Hand an uplink to the forwarder, as the gateway MAC does.
+     *
+     * @param forwarder The forwarder.
+     * @param id A byte telling the uplink apart.
+     */
+    static void ReceiveUplink(Ptr<UdpForwarder> forwarder, uint8_t id);
+
+    /**
+     * Record the start of a downlink transmission.
+     *
+     * @param packet The packet sent.
+     */
+    void SentNewPacket(Ptr<const Packet> packet);
+
+    std::vector<Time> m_downlinks;       //!< The start of the downlink transmissions
+    uint32_t m_txAcks;                   //!< The number of TX_ACK the server received
+    std::vector<std::string> m_pushData; //!< The JSON objects of the PUSH_DATA received
+};
+
+// Add some help text to this case to describe what it is intended to test
+UdpForwarderTest::UdpForwarderTest()
+    : TestCase("Verify that the event-driven UdpForwarder exchanges the same datagrams as the "
+               "polling one")
+{
+}
+
+// Reminder that the test case should clean up after itself
+UdpForwarderTest::~UdpForwarderTest()
+{
+}
+
+void
+UdpForwarderTest::SentNewPacket(Ptr<const Packet> packet)
+{
+    m_downlinks.push_back(Simulator::Now());
+}
+
+void
+UdpForwarderTest::ReceiveUplink(Ptr<UdpForwarder> forwarder, uint8_t id)
+{
+    uint8_t payload[12] = {0x40, id, 0, 0, 0x26, 0, id};
+    Ptr<Packet> packet = Create<Packet>(payload, sizeof(payload));
+    LoraTag tag;
+    tag.SetFrequency(868100000);
+    tag.SetDataRate(5);
+    tag.SetReceivePower(-100);
+    tag.SetSnr(5);
+    packet->AddPacketTag(tag);
+    forwarder->ReceiveFromLora(nullptr, packet);
+}
+
+void
+UdpForwarderTest::Run(bool eventDriven, Time aggregationTime, const std::vector<Time>& uplinks)
+{
+    // A gateway linked to the server
+    Ptr<LoraChannel> channel = CreateChannel();
+    MobilityHelper mobility;
+    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    NodeContainer gateways = CreateGateways(1, mobility, channel);
+    Ptr<Node> serverNode = CreateObject<Node>();
+    PointToPointHelper p2p;
+    p2p.SetDeviceAttribute("DataRate", StringValue("5Mbps"));
+    p2p.SetChannelAttribute("Delay", StringValue("2ms"));
+    NetDeviceContainer devices = p2p.Install(serverNode, gateways.Get(0));
+    InternetStackHelper internet;
+    internet.Install(serverNode);
+    internet.Install(gateways);
+    Ipv4AddressHelper addresses;
+    addresses.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer interfaces = addresses.Assign(devices);
+
+    SemtechUdpServer server;
+    server.Install(serverNode, 1700);
+    UdpForwarderHelper forwarderHelper;
+    forwarderHelper.SetAttribute("RemoteAddress", AddressValue(interfaces.GetAddress(0)));
+    forwarderHelper.SetAttribute("EventDriven", BooleanValue(eventDriven));
+    forwarderHelper.SetAttribute("AggregationTime", TimeValue(aggregationTime));
+    auto forwarder = DynamicCast<UdpForwarder>(forwarderHelper.Install(gateways).Get(0));
+    for (uint32_t i = 0; i < uplinks.size(); ++i)
+    {
+        Simulator::Schedule(uplinks[i],
+                            &UdpForwarderTest::ReceiveUplink,
+                            forwarder,
+                            static_cast<uint8_t>(i));
+    }
+
+    m_downlinks.clear();
+    auto gwMac = GetMacLayerFromNode<GatewayLorawanMac>(gateways.Get(0));
+    gwMac->TraceConnectWithoutContext("SentNewPacket",
+                                      MakeCallback(&UdpForwarderTest::SentNewPacket, this));
+
+    // Downlinks are not received in the order of their transmission: the
+    // second one is due first, and the jit loop must wake up for it
+    auto txpk = [](uint32_t tmst) {
+        return "{\"txpk\":{\"imme\":false,\"tmst\":" + std::to_string(tmst) +
+               ",\"freq\":869.525,\"rfch\":0,\"powe\":14,\"modu\":\"LORA\","
+               "\"datr\":\"SF9BW125\",\"codr\":\"4/5\",\"ipol\":true,\"size\":10,"
+               "\"data\":\"AAAAAAAAAAAAAA==\"}}";
+    };
+    Simulator::Schedule(Seconds(1), &SemtechUdpServer::SendDownlink, &server, txpk(2000123));
+    Simulator::Schedule(Seconds(1.1), &SemtechUdpServer::SendDownlink, &server, txpk(1500321));
+
+    Simulator::Stop(Seconds(3));
+    Simulator::Run();
+    m_txAcks = server.m_txAcks;
+    m_pushData = server.m_pushData;
+    Simulator::Destroy();
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+UdpForwarderTest::DoRun()
+{
+    NS_LOG_DEBUG("UdpForwarderTest");
+
+    // Transmissions start at the timestamp of the txpk, plus the microsecond
+    // the concentrator takes to trigger them
+    std::vector<Time> expected = {MicroSeconds(1500322), MicroSeconds(2000124)};
+    // Uplinks far enough apart to be forwarded one by one by both loops
+    std::vector<Time> uplinks = {Seconds(0.5), Seconds(1.25), Seconds(1.75)};
+    Run(false, Seconds(0), uplinks);
+    NS_TEST_EXPECT_MSG_EQ((m_downlinks == expected), true, "Wrong polling downlinks");
+    NS_TEST_EXPECT_MSG_EQ(m_txAcks, 2, "Downlinks not acknowledged");
+    NS_TEST_ASSERT_MSG_EQ(m_pushData.size(), uplinks.size(), "Uplinks not forwarded one by one");
+    std::vector<std::string> pollingPushData = m_pushData;
+    Run(true, Seconds(0), uplinks);
+    NS_TEST_EXPECT_MSG_EQ((m_downlinks == expected), true, "Wrong event-driven downlinks");
+    NS_TEST_EXPECT_MSG_EQ(m_txAcks, 2, "Downlinks not acknowledged");
+    NS_TEST_EXPECT_MSG_EQ((m_pushData == pollingPushData), true, "Different PUSH_DATA");
+
+    // Uplinks received within the aggregation time share a PUSH_DATA, whose
+    // rxpk objects are the ones forwarded one by one
+    uplinks = {Seconds(0.5), Seconds(0.52), Seconds(0.54)};
+    Run(false, Seconds(0), uplinks);
+    std::string rxpks;
+    for (const auto& json : m_pushData)
+    {
+        // Without the opening {"rxpk":[ and the closing ]}
+        rxpks += (rxpks.empty() ? "" : ",") + json.substr(9, json.size() - 11);
+    }
+    Run(true, MilliSeconds(50), uplinks);
+    NS_TEST_ASSERT_MSG_EQ(m_pushData.size(), 1, "Uplinks not aggregated");
+    NS_TEST_EXPECT_MSG_EQ(m_pushData[0],
+                          "{\"rxpk\":[" + rxpks + "]}",
+                          "Wrong aggregated PUSH_DATA");
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests the functionalities of the MAC layer of LoRaWAN devices
+ *
+ * @todo Not implemented yet.
+ */
+class LorawanMacTest : public TestCase
+{
+  public:
+    LorawanMacTest();           //!< Default constructor
+    ~LorawanMacTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+};
+
+// Add some help text to this case to describe what it is intended to test
+LorawanMacTest::LorawanMacTest()
+    : TestCase("Verify that the MAC layer of end devices behaves as expected")
+{
+}
+
+// Reminder that the test case should clean up after itself
+LorawanMacTest::~LorawanMacTest()
+{
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+LorawanMacTest::DoRun()
+{
+    NS_LOG_DEBUG("LorawanMacTest");
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It tests the functionalities of LoRaWAN MAC commands received by devices.
+ *
+ * This means testing that (i) settings in the downlink MAC commands are correctly applied/rejected
+ * by the device, and that (ii) the correct answer (if expected) is produced by the device.
+ */
+class MacCommandTest : public TestCase
+{
+  public:
+    MacCommandTest();           //!< Default constructor
+    ~MacCommandTest() override; //!< Destructor
+
+  private:
+    /**
+     * Have this class' MAC layer receive a downlink packet carrying the input MAC command.
+     * After, trigger a new empty uplink packet send that can then be used to examine the MAC
+     * command answers in the header.
+     *
+     * @tparam T  \explicit The type of MAC command to create.
+     * @tparam Ts \deduced Types of the constructor arguments.
+     * @param  [in] args MAC command constructor arguments.
+     * @return The list of MAC commands produced by the device as an answer.
+     */
+    template <typename T, typename... Ts>
+    std::list<Ptr<MacCommand>> RunMacCommand(Ts&&... args);
+
+    /**
+     * This function resets the state of the MAC layer used for tests. Use it before each call
      * of RunMacCommand. Otherwise, on consecutive calls the MAC layer will not send due to
      * duty-cycle limitations.
      */
@@ -2304,6 +4174,30 @@ MacCommandTest::DoRun()
         NS_TEST_EXPECT_MSG_EQ(nca->GetChannelFrequencyOk(), false, "ChannelFrequencyOk != false");
     }
 
+    // NewChannelReq: channel index out of range
+    for (uint8_t chIndex : {16, 31, 32, 255})
+    {
+        Reset();
+        double frequencyHz = 865100000;
+        uint8_t minDataRate = 1;
+        uint8_t maxDataRate = 4;
+        auto answers = RunMacCommand<NewChannelReq>(chIndex, frequencyHz, minDataRate, maxDataRate);
+        NS_TEST_ASSERT_MSG_EQ(answers.size(), 1, "1 answer cmd was expected, found 0 or >1");
+        auto chanMgr = m_mac->GetLogicalChannelManager();
+        NS_TEST_EXPECT_MSG_EQ(chanMgr->GetChannel(chIndex),
+                              nullptr,
+                              "Channel " << unsigned(chIndex) << " expected to be nullptr");
+        NS_TEST_EXPECT_MSG_EQ(chanMgr->GetEnabledChannelList().size(),
+                              3,
+                              "Only the default channels were expected");
+        auto nca = DynamicCast<NewChannelAns>(*(answers.begin()));
+        NS_TEST_ASSERT_MSG_NE(nca, nullptr, "NewChannelAns was expected, cmd type cast failed");
+        NS_TEST_EXPECT_MSG_EQ(nca->GetDataRateRangeOk(), true, "DataRateRangeOk != true");
+        NS_TEST_EXPECT_MSG_EQ(nca->GetChannelFrequencyOk(),
+                              false,
+                              "ChannelFrequencyOk != false for index " << unsigned(chIndex));
+    }
+
     Reset();
     // RxTimingSetupReq: change first Rx window delay
     {
@@ -3101,12 +4995,20 @@ LorawanTestSuite::LorawanTestSuite()
     // LogComponentEnableAll(LOG_PREFIX_TIME);
 
     AddTestCase(new InterferenceTest, Duration::QUICK);
+    AddTestCase(new IncrementalInterferenceTest, Duration::QUICK);
+    AddTestCase(new BackgroundTrafficTest, Duration::QUICK);
     AddTestCase(new AddressTest, Duration::QUICK);
     AddTestCase(new HeaderTest, Duration::QUICK);
     AddTestCase(new ReceivePathTest, Duration::QUICK);
     AddTestCase(new LogicalChannelTest, Duration::QUICK);
     AddTestCase(new TimeOnAirTest, Duration::QUICK);
     AddTestCase(new PhyConnectivityTest, Duration::QUICK);
+    AddTestCase(new BatchPropagationLossTest, Duration::QUICK);
+    AddTestCase(new ParallelReceptionTest, Duration::QUICK);
+    AddTestCase(new CryptoTest, Duration::QUICK);
+    AddTestCase(new RxpkWriterTest, Duration::QUICK);
+    AddTestCase(new JitQueueTest, Duration::QUICK);
+    AddTestCase(new UdpForwarderTest, Duration::QUICK);
     AddTestCase(new MacCommandTest, Duration::QUICK);
     AddTestCase(new AdrBackoffTest, Duration::QUICK);
     AddTestCase(new RetransmissionTest, Duration::QUICK);
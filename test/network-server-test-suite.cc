@@ -19,11 +19,22 @@
 
 // An essential include is test.h
 #include "ns3/application.h"
+#include "ns3/config.h"
 #include "ns3/simulator.h"
 #include "ns3/test.h"
 
 // Include headers of classes to test
+#include "ns3/adr-component.h"
 #include "ns3/class-a-end-device-lorawan-mac.h"
+#include "ns3/network-controller-components.h"
+#include "ns3/network-server.h"
+#include "ns3/point-to-point-net-device.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/uplink-crypto-stage.h"
+
+#include <algorithm>
+#include <deque>
+#include <numeric>
 
 using namespace ns3;
 using namespace lorawan;
@@ -389,6 +400,445 @@ AdrAckReqTest::DoRun()
     NS_TEST_EXPECT_MSG_EQ(m_adrAckReceived, true, "No downlink received by the end device");
 }
 
+/**
+ * @ingroup lorawan
+ *
+ * A controller component recording the calls the NetworkServer makes to it
+ */
+class CountingComponent : public NetworkControllerComponent
+{
+  public:
+    void OnReceivedPacket(Ptr<const Packet> packet,
+                          Ptr<EndDeviceStatus> status,
+                          Ptr<NetworkStatus> networkStatus) override
+    {
+    }
+
+    void OnReceivedPacket(Ptr<const UplinkContext> uplink,
+                          Ptr<NetworkStatus> networkStatus) override
+    {
+        m_fCnts.push_back(uplink->GetFrameHeader().GetFCnt());
+    }
+
+    void BeforeSendingReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override
+    {
+        m_repliesPrepared++;
+    }
+
+    void OnFailedReply(Ptr<EndDeviceStatus> status, Ptr<NetworkStatus> networkStatus) override
+    {
+    }
+
+    std::vector<uint16_t> m_fCnts;  //!< Frame counters of the uplinks handed over
+    uint32_t m_repliesPrepared = 0; //!< Receive windows the scheduler found a gateway for
+};
+
+/**
+ * @ingroup lorawan
+ *
+ * It verifies that the NetworkServer drops uplinks with a wrong MIC when uplink verification is
+ * enabled
+ */
+class UplinkCryptoTest : public TestCase
+{
+  public:
+    UplinkCryptoTest();           //!< Default constructor
+    ~UplinkCryptoTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+};
+
+UplinkCryptoTest::UplinkCryptoTest()
+    : TestCase("Verify that the NetworkServer checks the MIC of uplinks")
+{
+}
+
+UplinkCryptoTest::~UplinkCryptoTest()
+{
+}
+
+void
+UplinkCryptoTest::DoRun()
+{
+    NS_LOG_DEBUG("UplinkCryptoTest");
+    auto components = InitializeNetwork(1, 1);
+    auto ed = components.endDevices.Get(0);
+    auto netdev = DynamicCast<LoraNetDevice>(ed->GetDevice(0));
+    auto mac = DynamicCast<ClassAEndDeviceLorawanMac>(netdev->GetMac());
+    auto server = DynamicCast<NetworkServer>(components.nsNode->GetApplication(0));
+    server->SetAttribute("VerifyUplinks", BooleanValue(true));
+    auto status = server->GetNetworkStatus()->GetEndDeviceStatus(mac->GetDeviceAddress());
+    auto stage = server->GetUplinkCryptoStage();
+    // Room for both frames, so that an accepted invalid frame would show
+    status->SetReceivedPacketHistorySize(8);
+    auto counter = CreateObject<CountingComponent>();
+    server->AddComponent(counter);
+
+    // A frame with a valid MIC reaches the network status
+    mac->SetAttribute("EnableCryptography", BooleanValue(true));
+    Simulator::Schedule(Seconds(1), &ClassAEndDeviceLorawanMac::Send, mac, Create<Packet>(20));
+    Simulator::Run();
+    NS_TEST_ASSERT_MSG_EQ(status->GetReceivedPacketList().size(), 1, "Valid frame dropped");
+    NS_TEST_EXPECT_MSG_EQ(stage->GetStats().micFailures, 0, "Valid MIC rejected");
+    uint16_t validFCnt = status->GetLastReceivedPacketInfo().fCnt;
+
+    // Without cryptography, the device sends an all-zero MIC
+    mac->SetAttribute("EnableCryptography", BooleanValue(false));
+    Simulator::Schedule(Minutes(20), &ClassAEndDeviceLorawanMac::Send, mac, Create<Packet>(20));
+    Simulator::Run();
+    NS_TEST_EXPECT_MSG_EQ(status->GetReceivedPacketList().size(), 1, "Invalid frame accepted");
+    NS_TEST_EXPECT_MSG_EQ((status->GetReceivedPacketList().Find(validFCnt + 1) == nullptr),
+                          true,
+                          "Invalid frame in the history");
+    NS_TEST_EXPECT_MSG_EQ(status->GetLastReceivedPacketInfo().fCnt,
+                          validFCnt,
+                          "Invalid frame taken as the last one");
+    NS_TEST_EXPECT_MSG_EQ((counter->m_fCnts == std::vector<uint16_t>{validFCnt}),
+                          true,
+                          "Invalid frame handed over to the controller");
+    NS_TEST_EXPECT_MSG_EQ(stage->GetStats().micFailures, 1, "Wrong MIC not detected");
+    NS_TEST_EXPECT_MSG_EQ(stage->GetStats().frames, 2, "Unexpected number of frames");
+    NS_TEST_EXPECT_MSG_GT(stage->GetFramesPerSecond(), 0, "Processing time not measured");
+
+    Simulator::Destroy();
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It verifies that the NetworkServer merges the copies of an uplink forwarded by several gateways
+ * before replying to it, when a de-duplication window is set
+ */
+class DeduplicationTest : public TestCase
+{
+  public:
+    DeduplicationTest();           //!< Default constructor
+    ~DeduplicationTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Callback for packet reception by the end device MAC layer
+     *
+     * @param packet The received packet
+     */
+    void OnReception(Ptr<const Packet> packet);
+
+    /**
+     * Trace changes in the last known gateway count of the end device.
+     *
+     * @param newValue The updated value.
+     * @param oldValue The previous value.
+     */
+    void LastKnownGatewayCount(uint8_t newValue, uint8_t oldValue);
+
+    /**
+     * Record the arrival of a copy of the uplink at the server.
+     *
+     * @param packet The copy.
+     */
+    void ServerReceivedPacket(Ptr<const Packet> packet);
+
+    /**
+     * Record the departure of the reply from the server.
+     *
+     * @param packet The reply.
+     */
+    void ServerSentPacket(Ptr<const Packet> packet);
+
+    uint32_t m_downlinks = 0;       //!< Downlink packets received by the end device
+    uint8_t m_gatewayCount = 0;     //!< Gateway count of the last LinkCheckAns
+    std::vector<Time> m_arrivals;   //!< Arrivals of the copies at the server
+    std::vector<Time> m_departures; //!< Departures of the replies from the server
+};
+
+DeduplicationTest::DeduplicationTest()
+    : TestCase("Verify that the NetworkServer merges the gateway copies of an uplink")
+{
+}
+
+DeduplicationTest::~DeduplicationTest()
+{
+}
+
+void
+DeduplicationTest::OnReception(Ptr<const Packet> packet)
+{
+    m_downlinks++;
+}
+
+void
+DeduplicationTest::LastKnownGatewayCount(uint8_t newValue, uint8_t oldValue)
+{
+    m_gatewayCount = newValue;
+}
+
+void
+DeduplicationTest::ServerReceivedPacket(Ptr<const Packet> packet)
+{
+    m_arrivals.push_back(Simulator::Now());
+}
+
+void
+DeduplicationTest::ServerSentPacket(Ptr<const Packet> packet)
+{
+    m_departures.push_back(Simulator::Now());
+}
+
+void
+DeduplicationTest::DoRun()
+{
+    NS_LOG_DEBUG("DeduplicationTest");
+    auto components = InitializeNetwork(1, 3);
+    auto ed = components.endDevices.Get(0);
+    auto netdev = DynamicCast<LoraNetDevice>(ed->GetDevice(0));
+    auto mac = DynamicCast<ClassAEndDeviceLorawanMac>(netdev->GetMac());
+    auto server = DynamicCast<NetworkServer>(components.nsNode->GetApplication(0));
+    server->SetAttribute("DeduplicationWindow", TimeValue(MilliSeconds(200)));
+    // Copies are also held for a batch of MIC checks before de-duplication
+    server->SetAttribute("VerifyUplinks", BooleanValue(true));
+    server->GetUplinkCryptoStage()->SetAttribute("BatchWindow", TimeValue(MilliSeconds(50)));
+    mac->SetAttribute("EnableCryptography", BooleanValue(true));
+    auto counter = CreateObject<CountingComponent>();
+    server->AddComponent(counter);
+    auto status = server->GetNetworkStatus()->GetEndDeviceStatus(mac->GetDeviceAddress());
+    // Room for every copy, so that copies recorded apart would show
+    status->SetReceivedPacketHistorySize(8);
+    server->TraceConnectWithoutContext(
+        "ReceivedPacket",
+        MakeCallback(&DeduplicationTest::ServerReceivedPacket, this));
+    for (uint32_t i = 0; i < components.nsNode->GetNDevices(); ++i)
+    {
+        components.nsNode->GetDevice(i)->TraceConnectWithoutContext(
+            "MacTx",
+            MakeCallback(&DeduplicationTest::ServerSentPacket, this));
+    }
+    mac->TraceConnectWithoutContext("ReceivedPacket",
+                                    MakeCallback(&DeduplicationTest::OnReception, this));
+    mac->TraceConnectWithoutContext(
+        "LastKnownGatewayCount",
+        MakeCallback(&DeduplicationTest::LastKnownGatewayCount, this));
+
+    // A confirmed uplink asking for a LinkCheck, heard by all gateways
+    mac->SetFType(LorawanMacHeader::CONFIRMED_DATA_UP);
+    mac->AddMacCommand(Create<LinkCheckReq>());
+    Simulator::Schedule(Seconds(1), &ClassAEndDeviceLorawanMac::Send, mac, Create<Packet>(20));
+    Simulator::Stop(Seconds(10));
+    Simulator::Run();
+
+    // The copies form a single record, answered once in the first receive window
+    size_t copies = status->GetLastReceivedPacketInfo().gwList.size();
+    NS_TEST_EXPECT_MSG_EQ(m_arrivals.size(), 3, "Not all gateways forwarded the uplink");
+    NS_TEST_EXPECT_MSG_EQ(status->GetReceivedPacketList().size(), 1, "Copies not merged");
+    NS_TEST_EXPECT_MSG_EQ(copies, 3, "Not all gateways recorded");
+    auto entry = status->GetReceivedPacketList().Find(status->GetLastReceivedPacketInfo().fCnt);
+    NS_TEST_ASSERT_MSG_EQ((entry != nullptr), true, "Uplink not found by its frame counter");
+    NS_TEST_EXPECT_MSG_EQ(entry->second.gwList.size(), 3, "Copies merged in the wrong entry");
+    NS_TEST_EXPECT_MSG_EQ(counter->m_fCnts.size(), 1, "Controller not called once");
+    NS_TEST_EXPECT_MSG_EQ(counter->m_repliesPrepared, 1, "Scheduler not called once");
+    NS_TEST_EXPECT_MSG_EQ(m_downlinks, 1, "Uplink not answered exactly once");
+    NS_TEST_EXPECT_MSG_EQ(size_t(m_gatewayCount), copies, "LinkCheck ignored some copies");
+
+    // RX1 opens one second after the first copy arrived, however long the
+    // copies were held
+    NS_TEST_ASSERT_MSG_EQ(m_departures.size(), 1, "Not a single reply");
+    NS_TEST_EXPECT_MSG_EQ(m_departures[0] - m_arrivals[0], Seconds(1), "RX1 missed");
+
+    Simulator::Destroy();
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It verifies that the timer wheel of the NetworkScheduler handles receive window opportunities
+ * at the end of their slot, with one simulator event per slot
+ */
+class ReceiveWindowWheelTest : public TestCase
+{
+  public:
+    ReceiveWindowWheelTest();           //!< Default constructor
+    ~ReceiveWindowWheelTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+
+    /**
+     * Record an opportunity handled by the wheel.
+     *
+     * @param deviceAddress The device of the opportunity.
+     * @param window The receive window of the opportunity.
+     */
+    void Expire(LoraDeviceAddress deviceAddress, int window);
+
+    /**
+     * Callback for packet reception by the end device MAC layer
+     *
+     * @param packet The received packet
+     */
+    void OnReception(Ptr<const Packet> packet);
+
+    std::vector<std::pair<uint32_t, Time>> m_expired; //!< Device and time of opportunities
+    bool m_receivedPacketAtEd = false;                 //!< Whether the device got its ACK
+};
+
+ReceiveWindowWheelTest::ReceiveWindowWheelTest()
+    : TestCase("Verify the timer wheel of receive window opportunities")
+{
+}
+
+ReceiveWindowWheelTest::~ReceiveWindowWheelTest()
+{
+}
+
+void
+ReceiveWindowWheelTest::Expire(LoraDeviceAddress deviceAddress, int window)
+{
+    m_expired.emplace_back(deviceAddress.Get(), Simulator::Now());
+}
+
+void
+ReceiveWindowWheelTest::OnReception(Ptr<const Packet> packet)
+{
+    m_receivedPacketAtEd = true;
+}
+
+void
+ReceiveWindowWheelTest::DoRun()
+{
+    NS_LOG_DEBUG("ReceiveWindowWheelTest");
+
+    // 16 buckets of 1 ms: slots 20 and 36 share a bucket
+    auto wheel = Create<ReceiveWindowWheel>(MilliSeconds(1),
+                                            16,
+                                            MakeCallback(&ReceiveWindowWheelTest::Expire, this));
+    wheel->Schedule(MicroSeconds(500), LoraDeviceAddress(1), 1);
+    wheel->Schedule(MicroSeconds(700), LoraDeviceAddress(2), 1);
+    auto cancelled = wheel->Schedule(MilliSeconds(5), LoraDeviceAddress(3), 1);
+    auto timer = wheel->Schedule(MilliSeconds(20), LoraDeviceAddress(4), 1);
+    wheel->Schedule(MilliSeconds(36), LoraDeviceAddress(5), 2);
+    wheel->Schedule(Seconds(1), LoraDeviceAddress(6), 2);
+    cancelled.Cancel();
+    NS_TEST_EXPECT_MSG_EQ(cancelled.IsPending(), false, "Opportunity not cancelled");
+    NS_TEST_EXPECT_MSG_EQ(timer.IsPending(), true, "Opportunity not pending");
+    Simulator::Run();
+
+    std::vector<std::pair<uint32_t, Time>> expected = {{1, MilliSeconds(1)},
+                                                       {2, MilliSeconds(1)},
+                                                       {4, MilliSeconds(20)},
+                                                       {5, MilliSeconds(36)},
+                                                       {6, Seconds(1)}};
+    NS_TEST_ASSERT_MSG_EQ(m_expired.size(), expected.size(), "Wrong number of opportunities");
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        NS_TEST_EXPECT_MSG_EQ(m_expired[i].first, expected[i].first, "Wrong device");
+        NS_TEST_EXPECT_MSG_EQ(m_expired[i].second, expected[i].second, "Wrong time");
+    }
+    NS_TEST_EXPECT_MSG_EQ(timer.IsPending(), false, "Opportunity still pending");
+    // Slots 1, 5, 20, 36 and 1000
+    NS_TEST_EXPECT_MSG_EQ(wheel->GetNScheduledEvents(), 5, "Wrong number of events");
+    Simulator::Destroy();
+
+    // Replies still reach devices in their first receive window
+    Config::SetDefault("ns3::NetworkScheduler::TimerWheelSlot", TimeValue(MilliSeconds(1)));
+    auto components = InitializeNetwork(1, 1);
+    Config::SetDefault("ns3::NetworkScheduler::TimerWheelSlot", TimeValue(Seconds(0)));
+    auto mac = DynamicCast<ClassAEndDeviceLorawanMac>(
+        DynamicCast<LoraNetDevice>(components.endDevices.Get(0)->GetDevice(0))->GetMac());
+    mac->TraceConnectWithoutContext("ReceivedPacket",
+                                    MakeCallback(&ReceiveWindowWheelTest::OnReception, this));
+    mac->SetFType(LorawanMacHeader::CONFIRMED_DATA_UP);
+    Simulator::Schedule(Seconds(1), &ClassAEndDeviceLorawanMac::Send, mac, Create<Packet>(20));
+    Simulator::Stop(Seconds(10));
+    Simulator::Run();
+    Simulator::Destroy();
+    NS_TEST_EXPECT_MSG_EQ(m_receivedPacketAtEd, true, "No reply received by the end device");
+}
+
+/**
+ * @ingroup lorawan
+ *
+ * It verifies that the SNR window of the AdrComponent gives the statistics computed from the
+ * history of the last packets
+ */
+class AdrSnrWindowTest : public TestCase
+{
+  public:
+    AdrSnrWindowTest();           //!< Default constructor
+    ~AdrSnrWindowTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+};
+
+AdrSnrWindowTest::AdrSnrWindowTest()
+    : TestCase("Verify that the ADR SNR window matches the statistics of the packet history")
+{
+}
+
+AdrSnrWindowTest::~AdrSnrWindowTest()
+{
+}
+
+void
+AdrSnrWindowTest::DoRun()
+{
+    NS_LOG_DEBUG("AdrSnrWindowTest");
+
+    // Integer values give ties, which must not be dropped too early from the queues
+    auto value = CreateObject<UniformRandomVariable>();
+    for (size_t capacity : {1, 2, 5, 20})
+    {
+        AdrComponent::SnrWindow window(capacity);
+        std::deque<double> history;
+        for (size_t i = 0; i < 5 * capacity + 3; ++i)
+        {
+            double snr = (i % 2) ? value->GetInteger(0, 4) : value->GetValue(-20, 10);
+            window.Push(snr);
+            history.push_back(snr);
+            if (history.size() > capacity)
+            {
+                history.pop_front();
+            }
+            NS_TEST_ASSERT_MSG_EQ(window.GetSize(), history.size(), "Wrong size");
+            NS_TEST_EXPECT_MSG_EQ(window.GetMin(),
+                                  *std::min_element(history.begin(), history.end()),
+                                  "Wrong minimum after " << i + 1 << " packets");
+            NS_TEST_EXPECT_MSG_EQ(window.GetMax(),
+                                  *std::max_element(history.begin(), history.end()),
+                                  "Wrong maximum after " << i + 1 << " packets");
+            NS_TEST_EXPECT_MSG_EQ_TOL(
+                window.GetAverage(),
+                std::accumulate(history.begin(), history.end(), 0.0) / history.size(),
+                1e-9,
+                "Wrong average after " << i + 1 << " packets");
+        }
+    }
+
+    // Monotonic sequences keep all values, or a single one, in the queues
+    AdrComponent::SnrWindow rising(4);
+    AdrComponent::SnrWindow falling(4);
+    for (int i = 0; i < 10; ++i)
+    {
+        rising.Push(i);
+        falling.Push(-i);
+    }
+    NS_TEST_EXPECT_MSG_EQ(rising.GetMin(), 6, "Wrong minimum of a rising sequence");
+    NS_TEST_EXPECT_MSG_EQ(rising.GetMax(), 9, "Wrong maximum of a rising sequence");
+    NS_TEST_EXPECT_MSG_EQ(falling.GetMin(), -9, "Wrong minimum of a falling sequence");
+    NS_TEST_EXPECT_MSG_EQ(falling.GetMax(), -6, "Wrong maximum of a falling sequence");
+
+    // The running sum loses the small values added to a huge one, and is
+    // recomputed from the values each time the window wraps around
+    AdrComponent::SnrWindow window(4);
+    for (double snr : {1e17, 0.5, 0.25, 0.125, 1.0, 2.0, 3.0, 4.0})
+    {
+        window.Push(snr);
+    }
+    NS_TEST_EXPECT_MSG_EQ(window.GetAverage(), 2.5, "Rounding errors kept in the running sum");
+}
+
 /**
  * @ingroup lorawan
  *
@@ -424,6 +874,10 @@ NetworkServerTestSuite::NetworkServerTestSuite()
     AddTestCase(new DownlinkPacketTest, Duration::QUICK);
     AddTestCase(new LinkCheckTest, Duration::QUICK);
     AddTestCase(new AdrAckReqTest, Duration::QUICK);
+    AddTestCase(new UplinkCryptoTest, Duration::QUICK);
+    AddTestCase(new DeduplicationTest, Duration::QUICK);
+    AddTestCase(new ReceiveWindowWheelTest, Duration::QUICK);
+    AddTestCase(new AdrSnrWindowTest, Duration::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
@@ -24,6 +24,7 @@
 
 // Include headers of classes to test
 #include "ns3/class-a-end-device-lorawan-mac.h"
+#include "ns3/gateway-lorawan-mac.h"
 #include "ns3/network-status.h"
 
 using namespace ns3;
@@ -66,6 +67,65 @@ EndDeviceStatusTest::DoRun()
 
     // Create an EndDeviceStatus object
     EndDeviceStatus eds = EndDeviceStatus();
+
+    // An uplink with the ADR bit set, received by two gateways
+    Ptr<Packet> packet = Create<Packet>(10);
+    LoraFrameHeader fHdr;
+    fHdr.SetAsUplink();
+    fHdr.SetAddress(LoraDeviceAddress(0x01020304));
+    fHdr.SetFCnt(5);
+    fHdr.SetAdr(true);
+    packet->AddHeader(fHdr);
+    LorawanMacHeader mHdr;
+    mHdr.SetFType(LorawanMacHeader::UNCONFIRMED_DATA_UP);
+    packet->AddHeader(mHdr);
+    LoraTag tag;
+    tag.SetDataRate(3);
+    tag.SetFrequency(868300000);
+    tag.SetReceivePower(-110);
+    packet->AddPacketTag(tag);
+    uint8_t gwIds[] = {1, 2};
+    Address firstGw(0, &gwIds[0], 1);
+    Address secondGw(0, &gwIds[1], 1);
+    eds.InsertReceivedPacket(packet, firstGw);
+    eds.InsertReceivedPacket(packet, secondGw);
+
+    NS_TEST_EXPECT_MSG_EQ(eds.GetReceivedPacketList().size(), 1, "Duplicate not merged");
+    NS_TEST_EXPECT_MSG_EQ(eds.GetLastReceivedPacketInfo().gwList.size(), 2, "Gateway missing");
+    NS_TEST_EXPECT_MSG_EQ(unsigned(eds.GetFirstReceiveWindowDataRate()), 3, "Wrong RX1 DR");
+    Ptr<const UplinkContext> uplink = eds.GetLastUplinkContext();
+    NS_TEST_ASSERT_MSG_NE(uplink, nullptr, "Uplink not kept");
+    NS_TEST_EXPECT_MSG_EQ(uplink->GetFrameHeader().GetFCnt(), 5, "Wrong FCnt");
+    NS_TEST_EXPECT_MSG_EQ(uplink->GetFrameHeader().GetAdr(), true, "Wrong ADR bit");
+    NS_TEST_EXPECT_MSG_EQ(uplink->GetDeviceAddress().Get(), 0x01020304, "Wrong address");
+    NS_TEST_EXPECT_MSG_EQ(uplink->GetGatewayAddress(), firstGw, "Wrong gateway");
+    NS_TEST_EXPECT_MSG_EQ(uplink->GetEndDeviceStatus(), &eds, "Wrong status");
+
+    // The history only keeps the newest packets, indexed by frame counter
+    EndDeviceStatus::ReceivedPacketList history(3);
+    EndDeviceStatus::ReceivedPacketInfo info;
+    for (uint16_t fCnt = 0; fCnt < 5; ++fCnt)
+    {
+        info.fCnt = fCnt;
+        history.emplace_back(packet, info);
+    }
+    NS_TEST_EXPECT_MSG_EQ(history.size(), 3, "History not bounded");
+    NS_TEST_EXPECT_MSG_EQ(history.begin()->second.fCnt, 2, "Wrong oldest packet");
+    NS_TEST_EXPECT_MSG_EQ(history.rbegin()->second.fCnt, 4, "Wrong newest packet");
+    NS_TEST_EXPECT_MSG_EQ(history.Find(1), nullptr, "Evicted packet found");
+    NS_TEST_ASSERT_MSG_NE(history.Find(3), nullptr, "Packet not found");
+    NS_TEST_EXPECT_MSG_EQ(history.Find(3)->second.fCnt, 3, "Wrong packet found");
+    // Counters 4 and 12 share a bucket
+    info.fCnt = 12;
+    history.emplace_back(packet, info);
+    NS_TEST_ASSERT_MSG_NE(history.Find(4), nullptr, "Colliding packet not found");
+    NS_TEST_EXPECT_MSG_EQ(history.Find(4)->second.fCnt, 4, "Wrong packet found");
+    NS_TEST_EXPECT_MSG_EQ(history.Find(12)->second.fCnt, 12, "Wrong packet found");
+    NS_TEST_EXPECT_MSG_EQ(history.Find(2), nullptr, "Evicted packet found");
+    history.SetCapacity(2);
+    NS_TEST_EXPECT_MSG_EQ(history.size(), 2, "History not shrunk");
+    NS_TEST_EXPECT_MSG_EQ(history.begin()->second.fCnt, 4, "Wrong oldest packet");
+    NS_TEST_EXPECT_MSG_EQ(history.Find(3), nullptr, "Dropped packet found");
 }
 
 /**
@@ -114,6 +174,130 @@ NetworkStatusTest::DoRun()
     ns.AddNode(GetMacLayerFromNode<ClassAEndDeviceLorawanMac>(endDevices.Get(0)));
 }
 
+/**
+ * @ingroup lorawan
+ *
+ * It tests the ranking of the gateways that can reply to an end device
+ */
+class GatewayRankingTest : public TestCase
+{
+  public:
+    GatewayRankingTest();           //!< Default constructor
+    ~GatewayRankingTest() override; //!< Destructor
+
+  private:
+    void DoRun() override;
+};
+
+// Add some help text to this case to describe what it is intended to test
+GatewayRankingTest::GatewayRankingTest()
+    : TestCase("Verify the ranking of reply gateways in the NetworkStatus object")
+{
+}
+
+// Reminder that the test case should clean up after itself
+GatewayRankingTest::~GatewayRankingTest()
+{
+}
+
+// This method is the pure virtual method from class TestCase that every
+// TestCase must implement
+void
+GatewayRankingTest::DoRun()
+{
+    NS_LOG_DEBUG("GatewayRankingTest");
+
+    // Create a bunch of actual devices, with more gateways than candidates
+    const size_t nGateways = EndDeviceStatus::MAX_GATEWAY_CANDIDATES + 2;
+    NetworkComponents components = InitializeNetwork(1, nGateways);
+
+    NodeContainer endDevices = components.endDevices;
+    NodeContainer gateways = components.gateways;
+
+    // Gateways are numbered in the order they are added
+    Ptr<NetworkStatus> status = CreateObject<NetworkStatus>();
+    std::vector<Address> gwAddresses;
+    std::vector<Ptr<GatewayStatus>> gwStatuses;
+    for (uint8_t id = 0; id < nGateways; ++id)
+    {
+        gwAddresses.emplace_back(0, &id, 1);
+        gwStatuses.push_back(CreateObject<GatewayStatus>(
+            gwAddresses.back(),
+            nullptr,
+            GetMacLayerFromNode<GatewayLorawanMac>(gateways.Get(id))));
+        // Available for transmission right away
+        gwStatuses.back()->SetNextTransmissionTime(Seconds(-1));
+        status->AddGateway(gwAddresses.back(), gwStatuses.back());
+    }
+    NS_TEST_EXPECT_MSG_EQ(status->GetGatewayId(gwAddresses[1]), 1, "Wrong gateway index");
+    NS_TEST_EXPECT_MSG_EQ(status->GetGatewayId(Address()),
+                          UplinkContext::UNKNOWN_GATEWAY,
+                          "Unknown gateway found");
+
+    // The gateways that received the last packet are ranked by power
+    auto mac = GetMacLayerFromNode<ClassAEndDeviceLorawanMac>(endDevices.Get(0));
+    status->AddNode(mac);
+    Ptr<EndDeviceStatus> eds = status->GetEndDeviceStatus(mac->GetDeviceAddress());
+    auto makePacket = [&](uint16_t fCnt, double rxPower) {
+        Ptr<Packet> packet = Create<Packet>(10);
+        LoraFrameHeader fHdr;
+        fHdr.SetAsUplink();
+        fHdr.SetAddress(mac->GetDeviceAddress());
+        fHdr.SetFCnt(fCnt);
+        packet->AddHeader(fHdr);
+        LorawanMacHeader mHdr;
+        mHdr.SetFType(LorawanMacHeader::UNCONFIRMED_DATA_UP);
+        packet->AddHeader(mHdr);
+        LoraTag tag;
+        tag.SetFrequency(868100000);
+        tag.SetReceivePower(rxPower);
+        packet->AddPacketTag(tag);
+        return packet;
+    };
+    auto receive = [&](uint16_t fCnt, size_t gw, double rxPower) {
+        status->OnReceivedPacket(makePacket(fCnt, rxPower), gwAddresses[gw]);
+    };
+    receive(1, 0, -120);
+    receive(1, 1, -100);
+    receive(1, 2, -110);
+    receive(1, 1, -90); // Same gateway again
+    NS_TEST_ASSERT_MSG_EQ(eds->GetNGatewayCandidates(), 3, "Wrong number of candidates");
+    NS_TEST_EXPECT_MSG_EQ(eds->GetGatewayCandidate(0).gwId, 1, "Wrong best gateway");
+    NS_TEST_EXPECT_MSG_EQ(eds->GetGatewayCandidate(1).gwId, 2, "Wrong second gateway");
+    NS_TEST_EXPECT_MSG_EQ(eds->GetGatewayCandidate(2).gwId, 0, "Wrong worst gateway");
+    receive(2, 2, -130);
+    NS_TEST_ASSERT_MSG_EQ(eds->GetNGatewayCandidates(), 1, "Candidates not reset");
+    NS_TEST_EXPECT_MSG_EQ(eds->GetGatewayCandidate(0).gwId, 2, "Wrong gateway");
+
+    // Packets inserted without their gateway index are ranked too
+    eds->InsertReceivedPacket(makePacket(3, -100), gwAddresses[1]);
+    eds->InsertReceivedPacket(makePacket(3, -90), gwAddresses[2]);
+    NS_TEST_ASSERT_MSG_EQ(eds->GetNGatewayCandidates(), 2, "Gateways not ranked");
+    NS_TEST_EXPECT_MSG_EQ(eds->HasAllGatewayCandidates(), true, "Gateway left out");
+    NS_TEST_EXPECT_MSG_EQ(status->GetBestGatewayForDevice(mac->GetDeviceAddress(), 1),
+                          gwAddresses[2],
+                          "Wrong reply gateway");
+
+    // Gateways beyond the candidates are still used when the candidates are
+    // not available
+    for (size_t gw = 0; gw < nGateways; ++gw)
+    {
+        receive(4, gw, -100 - double(gw));
+    }
+    NS_TEST_EXPECT_MSG_EQ(eds->GetNGatewayCandidates(),
+                          EndDeviceStatus::MAX_GATEWAY_CANDIDATES,
+                          "Wrong number of candidates");
+    NS_TEST_EXPECT_MSG_EQ(eds->HasAllGatewayCandidates(), false, "No gateway left out");
+    for (size_t gw = 0; gw < EndDeviceStatus::MAX_GATEWAY_CANDIDATES; ++gw)
+    {
+        gwStatuses[gw]->SetNextTransmissionTime(Seconds(100));
+    }
+    NS_TEST_EXPECT_MSG_EQ(status->GetBestGatewayForDevice(mac->GetDeviceAddress(), 1),
+                          gwAddresses[EndDeviceStatus::MAX_GATEWAY_CANDIDATES],
+                          "Left out gateway not used");
+    status->Dispose();
+}
+
 /**
  * @ingroup lorawan
  *
@@ -133,6 +317,7 @@ NetworkStatusTestSuite::NetworkStatusTestSuite()
 
     AddTestCase(new EndDeviceStatusTest, Duration::QUICK);
     AddTestCase(new NetworkStatusTest, Duration::QUICK);
+    AddTestCase(new GatewayRankingTest, Duration::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
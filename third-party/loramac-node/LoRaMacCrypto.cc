@@ -71,10 +71,18 @@ LoRaMacCrypto::LoRaMacCrypto ()
         * LoRaWAN key list
         */
              .KeyList = SOFT_SE_KEY_LIST};
+  for (uint8_t i = 0; i < NUM_OF_KEYS; i++)
+    {
+      m_keySchedules[i] = NULL;
+    }
 }
 
 LoRaMacCrypto::~LoRaMacCrypto ()
 {
+  for (uint8_t i = 0; i < NUM_OF_KEYS; i++)
+    {
+      delete m_keySchedules[i];
+    }
 }
 
 LoRaMacCryptoStatus_t
@@ -165,21 +173,16 @@ LoRaMacCrypto::SecureElementAesEncrypt (uint8_t *buffer, uint16_t size, KeyIdent
       return SECURE_ELEMENT_ERROR_BUF_SIZE;
     }
 
-  aes_context aesContext;
-  memset1 (aesContext.ksch, '\0', 240);
-
-  Key_t *pItem;
-  SecureElementStatus_t retval = GetKeyByID (keyID, &pItem);
+  const aes_context *aesContext;
+  SecureElementStatus_t retval = GetKeySchedule (keyID, &aesContext);
 
   if (retval == SECURE_ELEMENT_SUCCESS)
     {
-      aes_set_key (pItem->KeyValue, 16, &aesContext);
-
       uint8_t block = 0;
 
       while (size != 0)
         {
-          aes_encrypt (&buffer[block], &encBuffer[block], &aesContext);
+          aes_encrypt (&buffer[block], &encBuffer[block], aesContext);
           block = block + 16;
           size = size - 16;
         }
@@ -249,12 +252,12 @@ LoRaMacCrypto::ComputeCmac (uint8_t *micBxBuffer, uint8_t *buffer, uint16_t size
 
   AES_CMAC_Init (aesCmacCtx);
 
-  Key_t *keyItem;
-  SecureElementStatus_t retval = GetKeyByID (keyID, &keyItem);
+  const aes_context *aesContext;
+  SecureElementStatus_t retval = GetKeySchedule (keyID, &aesContext);
 
   if (retval == SECURE_ELEMENT_SUCCESS)
     {
-      AES_CMAC_SetKey (aesCmacCtx, keyItem->KeyValue);
+      AES_CMAC_SetKeySchedule (aesCmacCtx, aesContext);
 
       if (micBxBuffer != NULL)
         {
@@ -273,6 +276,23 @@ LoRaMacCrypto::ComputeCmac (uint8_t *micBxBuffer, uint8_t *buffer, uint16_t size
   return retval;
 }
 
+SecureElementStatus_t
+LoRaMacCrypto::GetKey (KeyIdentifier_t keyID, uint8_t *key)
+{
+  if (key == NULL)
+    {
+      return SECURE_ELEMENT_ERROR_NPE;
+    }
+
+  Key_t *keyItem;
+  SecureElementStatus_t retval = GetKeyByID (keyID, &keyItem);
+  if (retval == SECURE_ELEMENT_SUCCESS)
+    {
+      memcpy1 (key, keyItem->KeyValue, SE_KEY_SIZE);
+    }
+  return retval;
+}
+
 SecureElementStatus_t
 LoRaMacCrypto::GetKeyByID (KeyIdentifier_t keyID, Key_t **keyItem)
 {
@@ -286,3 +306,23 @@ LoRaMacCrypto::GetKeyByID (KeyIdentifier_t keyID, Key_t **keyItem)
     }
   return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
 }
+
+SecureElementStatus_t
+LoRaMacCrypto::GetKeySchedule (KeyIdentifier_t keyID, const aes_context **schedule)
+{
+  for (uint8_t i = 0; i < NUM_OF_KEYS; i++)
+    {
+      if (m_SeNvm.KeyList[i].KeyID == keyID)
+        {
+          if (m_keySchedules[i] == NULL)
+            {
+              m_keySchedules[i] = new aes_context;
+              memset1 (m_keySchedules[i]->ksch, '\0', 240);
+              aes_set_key (m_SeNvm.KeyList[i].KeyValue, 16, m_keySchedules[i]);
+            }
+          *schedule = m_keySchedules[i];
+          return SECURE_ELEMENT_SUCCESS;
+        }
+    }
+  return SECURE_ELEMENT_ERROR_INVALID_KEY_ID;
+}
@@ -41,6 +41,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "aes.h"
+
 /*
  * Frame direction definition for uplink communications
  */
@@ -344,6 +346,9 @@ public:
   LoRaMacCrypto ();
   ~LoRaMacCrypto ();
 
+  LoRaMacCrypto (const LoRaMacCrypto &) = delete;
+  LoRaMacCrypto &operator= (const LoRaMacCrypto &) = delete;
+
   /*
    * Prepares B0 block for cmac computation.
    *
@@ -378,6 +383,15 @@ public:
                                        bool isAck, uint8_t dir, uint32_t devAddr, uint32_t fCnt,
                                        uint32_t *cmac);
 
+  /*
+   * Gets the value of a key.
+   *
+   * \param[IN]  keyID          - Key identifier
+   * \param[OUT] key            - Key value, SE_KEY_SIZE bytes
+   * \retval                    - Status of the operation
+   */
+  SecureElementStatus_t GetKey (KeyIdentifier_t keyID, uint8_t *key);
+
 private:
   /*!
    * Encrypt a buffer
@@ -444,7 +458,22 @@ private:
    */
   SecureElementStatus_t GetKeyByID (KeyIdentifier_t keyID, Key_t **keyItem);
 
+  /*
+   * Gets the expanded AES key schedule of a key, expanding it at first use.
+   *
+   * \param[IN]  keyID          - Key identifier
+   * \param[OUT] schedule       - Key schedule reference
+   * \retval                    - Status of the operation
+   */
+  SecureElementStatus_t GetKeySchedule (KeyIdentifier_t keyID, const aes_context **schedule);
+
   SecureElementNvmData_t m_SeNvm;
+
+  /*
+   * Expanded key schedules, by position in the key list, allocated when a
+   * key is first used since devices only use a few of them
+   */
+  aes_context *m_keySchedules[NUM_OF_KEYS];
 };
 
 #endif // __LORAMAC_CRYPTO_H__
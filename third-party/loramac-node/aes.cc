@@ -563,10 +563,91 @@ return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ct
 
 #if defined( AES_ENC_PREKEYED )
 
+/*  AES-NI implementation, used instead of the byte-oriented one when the
+    processor supports it. The round keys of the pre-keyed schedule are in
+    the byte order the AESENC instructions expect, so the same schedule is
+    used by both implementations. */
+
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+#  define HAVE_AES_NI
+#  include <immintrin.h>
+
+__attribute__(( target( "aes,sse2" ) ))
+static void aes_ni_encrypt( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    const __m128i *ksch = ( const __m128i * )ctx->ksch;
+    __m128i s = _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )in ), _mm_loadu_si128( ksch ) );
+    uint8_t r;
+
+    for( r = 1 ; r < ctx->rnd ; ++r )
+        s = _mm_aesenc_si128( s, _mm_loadu_si128( ksch + r ) );
+    s = _mm_aesenclast_si128( s, _mm_loadu_si128( ksch + r ) );
+    _mm_storeu_si128( ( __m128i * )out, s );
+}
+
+#  define AES_MULTI_LANES 8
+
+__attribute__(( target( "aes,sse2" ) ))
+static void aes_ni_encrypt_multi( const uint8_t *const in[], uint8_t *const out[],
+                                  const aes_context *const ctx[], uint32_t n )
+{
+    uint8_t rnd = ctx[0]->rnd;
+    uint32_t base, i;
+    uint8_t r;
+
+    for( base = 0 ; base < n ; base += AES_MULTI_LANES )
+    {
+        uint32_t m = ( n - base < AES_MULTI_LANES ) ? n - base : AES_MULTI_LANES;
+        const __m128i *k[AES_MULTI_LANES];
+        __m128i s[AES_MULTI_LANES];
+
+        for( i = 0 ; i < m ; ++i )
+        {
+            k[i] = ( const __m128i * )ctx[base + i]->ksch;
+            s[i] = _mm_xor_si128( _mm_loadu_si128( ( const __m128i * )in[base + i] ),
+                                  _mm_loadu_si128( k[i] ) );
+        }
+        for( r = 1 ; r < rnd ; ++r )
+            for( i = 0 ; i < m ; ++i )
+                s[i] = _mm_aesenc_si128( s[i], _mm_loadu_si128( k[i] + r ) );
+        for( i = 0 ; i < m ; ++i )
+            _mm_storeu_si128( ( __m128i * )out[base + i],
+                              _mm_aesenclast_si128( s[i], _mm_loadu_si128( k[i] + rnd ) ) );
+    }
+}
+#endif
+
+/* 1 to use AES-NI, 0 not to, -1 if the processor was not probed yet */
+static int8_t aes_hw_state = -1;
+
+uint8_t aes_hw_available( void )
+{
+#if defined( HAVE_AES_NI )
+    __builtin_cpu_init();
+    return __builtin_cpu_supports( "aes" ) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+void aes_hw_enable( uint8_t enable )
+{
+    aes_hw_state = ( enable && aes_hw_available() ) ? 1 : 0;
+}
+
 /*  Encrypt a single block of 16 bytes */
 
 return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const aes_context ctx[1] )
 {
+#if defined( HAVE_AES_NI )
+    if( aes_hw_state < 0 )
+        aes_hw_state = aes_hw_available();
+    if( aes_hw_state && ctx->rnd )
+    {
+        aes_ni_encrypt( in, out, ctx );
+        return 0;
+    }
+#endif
     if( ctx->rnd )
     {
         uint8_t s1[N_BLOCK], r;
@@ -592,6 +673,33 @@ return_type aes_encrypt( const uint8_t in[N_BLOCK], uint8_t  out[N_BLOCK], const
     return 0;
 }
 
+/*  Encrypt a number of independent blocks */
+
+void aes_encrypt_multi( const uint8_t *const in[], uint8_t *const out[],
+                        const aes_context *const ctx[], uint32_t n )
+{
+    uint32_t i;
+#if defined( HAVE_AES_NI )
+    if( aes_hw_state < 0 )
+        aes_hw_state = aes_hw_available();
+    if( aes_hw_state && n > 0 )
+    {
+        /* The rounds of all blocks are interleaved, so all keys must have
+           the same length */
+        uint8_t same = ctx[0]->rnd != 0;
+        for( i = 1 ; i < n && same ; ++i )
+            same = ctx[i]->rnd == ctx[0]->rnd;
+        if( same )
+        {
+            aes_ni_encrypt_multi( in, out, ctx, n );
+            return;
+        }
+    }
+#endif
+    for( i = 0 ; i < n ; ++i )
+        aes_encrypt( in[i], out[i], ctx[i] );
+}
+
 /* CBC encrypt a number of blocks (input and return an IV) */
 
 return_type aes_cbc_encrypt( const uint8_t *in, uint8_t *out,
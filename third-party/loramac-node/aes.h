@@ -100,6 +100,27 @@ return_type aes_cbc_encrypt( const uint8_t *in,
                          int32_t n_block,
                          uint8_t iv[N_BLOCK],
                          const aes_context ctx[1] );
+
+/*  aes_encrypt uses the AES-NI instructions instead of the byte-oriented
+    implementation when the processor supports them. aes_hw_available tells
+    whether it does, and aes_hw_enable(0) forces the byte-oriented
+    implementation, e.g., to check both give the same output.
+*/
+
+uint8_t aes_hw_available( void );
+
+void aes_hw_enable( uint8_t enable );
+
+/*  Encrypt n independent blocks, each with its own key schedule. With
+    AES-NI, several blocks go through the rounds together so that the
+    latency of the instructions of one block is hidden by the others.
+    Output blocks may only overlap the input block of the same index.
+*/
+
+void aes_encrypt_multi( const uint8_t *const in[],
+                        uint8_t *const out[],
+                        const aes_context *const ctx[],
+                        uint32_t n );
 #endif
 
 #if defined( AES_DEC_PREKEYED )
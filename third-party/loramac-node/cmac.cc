@@ -68,6 +68,11 @@ void AES_CMAC_SetKey( AES_CMAC_CTX* ctx, const uint8_t key[AES_CMAC_KEY_LENGTH]
     aes_set_key( key, AES_CMAC_KEY_LENGTH, &ctx->rijndael );
 }
 
+void AES_CMAC_SetKeySchedule( AES_CMAC_CTX* ctx, const aes_context* schedule )
+{
+    ctx->rijndael = *schedule;
+}
+
 void AES_CMAC_Update( AES_CMAC_CTX* ctx, const uint8_t* data, uint32_t len )
 {
     uint32_t mlen;
@@ -152,3 +157,105 @@ void AES_CMAC_Final( uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX* ctx )
     aes_encrypt( in, digest, &ctx->rijndael );
     memset1( K, 0, sizeof K );
 }
+
+void AES_CMAC_Subkeys( const aes_context* rijndael, uint8_t K1[16], uint8_t K2[16] )
+{
+    uint8_t L[16];
+
+    memset1( L, '\0', 16 );
+    aes_encrypt( L, L, rijndael );
+
+    LSHIFT( L, K1 );
+    if( L[0] & 0x80 )
+        K1[15] ^= 0x87;
+    LSHIFT( K1, K2 );
+    if( K1[0] & 0x80 )
+        K2[15] ^= 0x87;
+    memset1( L, 0, sizeof L );
+}
+
+#define AES_CMAC_MULTI_LANES 16
+
+void AES_CMAC_Multi( AES_CMAC_JOB* jobs, uint32_t n )
+{
+    uint32_t base;
+
+    for( base = 0; base < n; base += AES_CMAC_MULTI_LANES )
+    {
+        AES_CMAC_JOB*      lanes = jobs + base;
+        uint32_t           m     = MIN( n - base, AES_CMAC_MULTI_LANES );
+        uint32_t           blocks[AES_CMAC_MULTI_LANES];
+        uint8_t            X[AES_CMAC_MULTI_LANES][16];
+        const uint8_t*     in[AES_CMAC_MULTI_LANES];
+        uint8_t*           out[AES_CMAC_MULTI_LANES];
+        const aes_context* ctx[AES_CMAC_MULTI_LANES];
+        uint32_t           maxBlocks = 0;
+        uint32_t           lane, j;
+
+        for( lane = 0; lane < m; lane++ )
+        {
+            uint32_t total = lanes[lane].len + ( lanes[lane].prefix ? 16 : 0 );
+            blocks[lane]   = ( total == 0 ) ? 1 : ( total + 15 ) / 16;
+            maxBlocks      = MAX( maxBlocks, blocks[lane] );
+            memset1( X[lane], 0, 16 );
+        }
+
+        /* Block j of all messages that have one, the last one of a message
+           being combined with its subkey */
+        for( j = 0; j < maxBlocks; j++ )
+        {
+            uint32_t active = 0;
+            for( lane = 0; lane < m; lane++ )
+            {
+                const AES_CMAC_JOB* job = &lanes[lane];
+                uint8_t*            x   = X[lane];
+                const uint8_t*      block;
+                uint32_t            avail;
+
+                if( j >= blocks[lane] )
+                    continue;
+                if( job->prefix && j == 0 )
+                {
+                    block = job->prefix;
+                    avail = 16;
+                }
+                else
+                {
+                    uint32_t offset = ( j - ( job->prefix ? 1 : 0 ) ) * 16;
+                    block           = job->data + offset;
+                    avail           = job->len - offset;
+                }
+
+                if( j + 1 < blocks[lane] )
+                {
+                    XOR( block, x );
+                }
+                else
+                {
+                    uint8_t M[16];
+                    if( avail >= 16 )
+                    {
+                        memcpy1( M, block, 16 );
+                        XOR( job->K1, M );
+                    }
+                    else
+                    {
+                        memcpy1( M, block, avail );
+                        M[avail] = 0x80;
+                        memset1( M + avail + 1, 0, 15 - avail );
+                        XOR( job->K2, M );
+                    }
+                    XOR( M, x );
+                }
+                in[active]  = x;
+                out[active] = x;
+                ctx[active] = job->rijndael;
+                active++;
+            }
+            aes_encrypt_multi( in, out, ctx, active );
+        }
+
+        for( lane = 0; lane < m; lane++ )
+            memcpy1( lanes[lane].digest, X[lane], 16 );
+    }
+}
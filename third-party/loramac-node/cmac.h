@@ -51,16 +51,35 @@ typedef struct _AES_CMAC_CTX {
             uint8_t        M_last[16];
             uint32_t       M_n;
     } AES_CMAC_CTX;
+
+/* A message to authenticate with AES_CMAC_Multi */
+typedef struct _AES_CMAC_JOB {
+            const aes_context *rijndael;    /* Key schedule */
+            const uint8_t     *K1;          /* Subkey for complete last blocks */
+            const uint8_t     *K2;          /* Subkey for padded last blocks */
+            const uint8_t     *prefix;      /* Block authenticated before data, or NULL */
+            const uint8_t     *data;
+            uint32_t           len;
+            uint8_t            digest[AES_CMAC_DIGEST_LENGTH];
+    } AES_CMAC_JOB;
    
 //#include <sys/cdefs.h>
     
 //__BEGIN_DECLS
 void     AES_CMAC_Init(AES_CMAC_CTX * ctx);
 void     AES_CMAC_SetKey(AES_CMAC_CTX * ctx, const uint8_t key[AES_CMAC_KEY_LENGTH]);
+void     AES_CMAC_SetKeySchedule(AES_CMAC_CTX * ctx, const aes_context * schedule);
 void     AES_CMAC_Update(AES_CMAC_CTX * ctx, const uint8_t * data, uint32_t len);
           //          __attribute__((__bounded__(__string__,2,3)));
 void     AES_CMAC_Final(uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX  * ctx);
             //     __attribute__((__bounded__(__minbytes__,1,AES_CMAC_DIGEST_LENGTH)));
+
+/* Compute the two subkeys of a key, which AES_CMAC_Final derives at every call */
+void     AES_CMAC_Subkeys(const aes_context * rijndael, uint8_t K1[16], uint8_t K2[16]);
+
+/* Compute the digests of several messages at once, their blocks being
+   encrypted together with aes_encrypt_multi */
+void     AES_CMAC_Multi(AES_CMAC_JOB * jobs, uint32_t n);
 //__END_DECLS
 
 #ifdef __cplusplus
@@ -92,9 +92,250 @@ uint8_t char_to_code(char x) {
     } //TODO: improve error management
 }
 
+/*  SSSE3 and AVX2 implementations of the full blocks, used before the scalar
+    code when the processor supports them. They follow the method of
+    W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2
+    Instructions", and leave partial and invalid blocks to the scalar code,
+    which does the error management. */
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#  define HAVE_B64_SIMD
+#  include <immintrin.h>
+
+/* split 12 bytes in 16 6-bit codes, one per byte */
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle(__m128i in) {
+    __m128i t0, t1, t2, t3;
+
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+/* add to each code the offset of its range in the alphabet */
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate(__m128i in) {
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+
+    indices = _mm_sub_epi8(indices, mask);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+
+/* pack 16 6-bit codes in 12 bytes, in the low bytes of the vector */
+__attribute__((target("ssse3")))
+static inline __m128i dec_reshuffle(__m128i in) {
+    __m128i merge_ab_and_bc = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    __m128i out = _mm_madd_epi16(merge_ab_and_bc, _mm_set1_epi32(0x00011000));
+
+    return _mm_shuffle_epi8(out, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+/* convert 16 characters to codes, return 0 if one of them is not in the alphabet */
+__attribute__((target("ssse3")))
+static inline int dec_translate(__m128i *str) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2F);
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(*str, 4), mask_2f);
+    __m128i lo_nibbles = _mm_and_si128(*str, mask_2f);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    __m128i eq_2f;
+
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+        return 0;
+    }
+    eq_2f = _mm_cmpeq_epi8(*str, mask_2f);
+    *str = _mm_add_epi8(*str, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles)));
+    return 1;
+}
+
+/* AVX2 versions, working on 2 lanes of 128 bits */
+__attribute__((target("avx2")))
+static inline __m256i enc_reshuffle_avx2(__m256i in) {
+    __m256i t0, t1, t2, t3;
+
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                                 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+    t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+    t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i enc_translate_avx2(__m256i in) {
+    const __m256i lut = _mm256_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+                                         65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    __m256i mask = _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25));
+
+    indices = _mm256_sub_epi8(indices, mask);
+    return _mm256_add_epi8(in, _mm256_shuffle_epi8(lut, indices));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i dec_reshuffle_avx2(__m256i in) {
+    __m256i merge_ab_and_bc = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+    __m256i out = _mm256_madd_epi16(merge_ab_and_bc, _mm256_set1_epi32(0x00011000));
+
+    return _mm256_shuffle_epi8(out, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                     2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("avx2")))
+static inline int dec_translate_avx2(__m256i *str) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+    __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(*str, 4), mask_2f);
+    __m256i lo_nibbles = _mm256_and_si256(*str, mask_2f);
+    __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    __m256i eq_2f;
+
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != 0) {
+        return 0;
+    }
+    eq_2f = _mm256_cmpeq_epi8(*str, mask_2f);
+    *str = _mm256_add_epi8(*str, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
+    return 1;
+}
+
+/* encode full blocks while 16 input bytes can be read, return the number of blocks done */
+__attribute__((target("ssse3")))
+static int b64_enc_ssse3(const uint8_t * in, int full_blocks, int size, char * out, int i) {
+    __m128i s;
+
+    for (; (i + 4 <= full_blocks) && (3*i + 16 <= size); i += 4) {
+        s = _mm_loadu_si128((const __m128i *)(in + 3*i));
+        _mm_storeu_si128((__m128i *)(out + 4*i), enc_translate(enc_reshuffle(s)));
+    }
+    return i;
+}
+
+/* encode full blocks while 28 input bytes can be read, the lanes being loaded 12 bytes apart */
+__attribute__((target("avx2")))
+static int b64_enc_avx2(const uint8_t * in, int full_blocks, int size, char * out, int i) {
+    __m256i s;
+
+    for (; (i + 8 <= full_blocks) && (3*i + 28 <= size); i += 8) {
+        s = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + 3*i))),
+                                    _mm_loadu_si128((const __m128i *)(in + 3*i + 12)), 1);
+        _mm256_storeu_si256((__m256i *)(out + 4*i), enc_translate_avx2(enc_reshuffle_avx2(s)));
+    }
+    return i;
+}
+
+/* decode full blocks while 16 output bytes can be written before the end of the result, stop at
+   the first invalid character, return the number of blocks done */
+__attribute__((target("ssse3")))
+static int b64_dec_ssse3(const char * in, int full_blocks, uint8_t * out, int result_len, int i) {
+    __m128i s;
+
+    for (; (i + 4 <= full_blocks) && (3*i + 16 <= result_len); i += 4) {
+        s = _mm_loadu_si128((const __m128i *)(in + 4*i));
+        if (!dec_translate(&s)) {
+            break;
+        }
+        _mm_storeu_si128((__m128i *)(out + 3*i), dec_reshuffle(s));
+    }
+    return i;
+}
+
+/* decode full blocks while 28 output bytes can be written, the lanes being stored 12 bytes apart */
+__attribute__((target("avx2")))
+static int b64_dec_avx2(const char * in, int full_blocks, uint8_t * out, int result_len, int i) {
+    __m256i s;
+
+    for (; (i + 8 <= full_blocks) && (3*i + 28 <= result_len); i += 8) {
+        s = _mm256_loadu_si256((const __m256i *)(in + 4*i));
+        if (!dec_translate_avx2(&s)) {
+            break;
+        }
+        s = dec_reshuffle_avx2(s);
+        _mm_storeu_si128((__m128i *)(out + 3*i), _mm256_castsi256_si128(s));
+        _mm_storeu_si128((__m128i *)(out + 3*i + 12), _mm256_extracti128_si256(s, 1));
+    }
+    return i;
+}
+#endif
+
+/* 2 to use AVX2, 1 to use SSSE3, 0 for scalar code only, -1 if the processor was not probed yet */
+static int8_t b64_simd_state = -1;
+
+/* encode the first full blocks with vector instructions, return the number of blocks done */
+static int b64_enc_simd(const uint8_t * in, int full_blocks, int size, char * out) {
+    int i = 0;
+
+#if defined(HAVE_B64_SIMD)
+    if (b64_simd_state < 0) {
+        b64_simd_state = b64_simd_available();
+    }
+    if (b64_simd_state >= 2) {
+        i = b64_enc_avx2(in, full_blocks, size, out, i);
+    }
+    if (b64_simd_state >= 1) {
+        i = b64_enc_ssse3(in, full_blocks, size, out, i);
+    }
+#endif
+    return i;
+}
+
+/* decode the first full blocks with vector instructions, return the number of blocks done */
+static int b64_dec_simd(const char * in, int full_blocks, uint8_t * out, int result_len) {
+    int i = 0;
+
+#if defined(HAVE_B64_SIMD)
+    if (b64_simd_state < 0) {
+        b64_simd_state = b64_simd_available();
+    }
+    if (b64_simd_state >= 2) {
+        i = b64_dec_avx2(in, full_blocks, out, result_len, i);
+    }
+    if (b64_simd_state >= 1) {
+        i = b64_dec_ssse3(in, full_blocks, out, result_len, i);
+    }
+#endif
+    return i;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+uint8_t b64_simd_available(void) {
+#if defined(HAVE_B64_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return 2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+void b64_simd_enable(uint8_t enable) {
+    b64_simd_state = enable ? b64_simd_available() : 0;
+}
+
 int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len) {
     int i;
     int result_len; /* size of the result */
@@ -138,7 +379,7 @@ int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len) {
     }
 
     /* process all the full blocks */
-    for (i=0; i < full_blocks; ++i) {
+    for (i=b64_enc_simd(in, full_blocks, size, out); i < full_blocks; ++i) {
         b  = (0xFF & in[3*i]    ) << 16;
         b |= (0xFF & in[3*i + 1]) << 8;
         b |=  0xFF & in[3*i + 2];
@@ -215,7 +456,7 @@ int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len) {
     }
 
     /* process all the full blocks */
-    for (i=0; i < full_blocks; ++i) {
+    for (i=b64_dec_simd(in, full_blocks, out, result_len); i < full_blocks; ++i) {
         b  = (0x3F & char_to_code(in[4*i]    )) << 18;
         b |= (0x3F & char_to_code(in[4*i + 1])) << 12;
         b |= (0x3F & char_to_code(in[4*i + 2])) << 6;
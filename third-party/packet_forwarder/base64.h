@@ -45,6 +45,18 @@ int bin_to_b64_nopad(const uint8_t * in, int size, char * out, int max_len);
 */
 int b64_to_bin_nopad(const char * in, int size, uint8_t * out, int max_len);
 
+/**
+@brief Check which vector instructions the encoder and decoder can use
+@return 2 for AVX2, 1 for SSSE3, 0 if the processor supports neither
+*/
+uint8_t b64_simd_available(void);
+
+/**
+@brief Enable or disable the vector implementations, enabled by default when available
+@param enable 0 to only use the scalar implementation
+*/
+void b64_simd_enable(uint8_t enable);
+
 /* === derivative functions === */
 
 /**
@@ -16,7 +16,7 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
-#include <stdlib.h> /* qsort_r */
+#include <stdlib.h> /* malloc, realloc, free */
 #include <stdio.h> /* printf, fprintf, snprintf, fopen, fputs */
 #include <string.h> /* memset, memcpy */
 #include <pthread.h>
@@ -48,65 +48,166 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
-/* -------------------------------------------------------------------------- */
-/* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
+/* Packets are ordered by timestamp.
+ *  Warning: signed arithmetic on the difference (handle roll-over), all packets of the queue being
+ *  within TX_MAX_ADVANCE_DELAY of the current time
+ */
+static bool
+jit_node_before (struct jit_node_s *p, struct jit_node_s *q)
+{
+  return (int32_t) (p->pkt.count_us - q->pkt.count_us) < 0;
+}
 
-bool
-jit_queue_is_full (struct jit_queue_s *queue)
+static void
+jit_swap_nodes (struct jit_queue_s *queue, uint32_t i, uint32_t j)
 {
-  return (queue->num_pkt == JIT_QUEUE_MAX) ? true : false;
+  struct jit_node_s node;
+
+  memcpy (&node, &(queue->nodes[i]), sizeof (struct jit_node_s));
+  memcpy (&(queue->nodes[i]), &(queue->nodes[j]), sizeof (struct jit_node_s));
+  memcpy (&(queue->nodes[j]), &node, sizeof (struct jit_node_s));
 }
 
-bool
-jit_queue_is_empty (struct jit_queue_s *queue)
+static void
+jit_sift_up (struct jit_queue_s *queue, uint32_t i)
 {
-  return (queue->num_pkt == 0) ? true : false;
+  while ((i > 0) && jit_node_before (&(queue->nodes[i]), &(queue->nodes[(i - 1) / 2])))
+    {
+      jit_swap_nodes (queue, i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
 }
 
-void
-jit_queue_init (struct jit_queue_s *queue)
+static void
+jit_sift_down (struct jit_queue_s *queue, uint32_t i)
 {
-  int i;
+  uint32_t child;
 
-  memset (queue, 0, sizeof (*queue));
-  for (i = 0; i < JIT_QUEUE_MAX; i++)
+  while ((child = 2 * i + 1) < queue->num_pkt)
     {
-      queue->nodes[i].pre_delay = 0;
-      queue->nodes[i].post_delay = 0;
+      if ((child + 1 < queue->num_pkt) &&
+          jit_node_before (&(queue->nodes[child + 1]), &(queue->nodes[child])))
+        {
+          child++;
+        }
+      if (!jit_node_before (&(queue->nodes[child]), &(queue->nodes[i])))
+        {
+          break;
+        }
+      jit_swap_nodes (queue, i, child);
+      i = child;
     }
 }
 
-int
-compare (const void *a, const void *b, void *arg)
+/* Replace a node with the last one of the queue, and restore the heap order */
+static void
+jit_remove_node (struct jit_queue_s *queue, uint32_t index)
 {
-  struct jit_node_s *p = (struct jit_node_s *) a;
-  struct jit_node_s *q = (struct jit_node_s *) b;
-  int *counter = (int *) arg;
-  int p_count, q_count;
+  queue->num_pkt--;
+  if (index < queue->num_pkt)
+    {
+      memcpy (&(queue->nodes[index]), &(queue->nodes[queue->num_pkt]), sizeof (struct jit_node_s));
+      jit_sift_down (queue, index);
+      jit_sift_up (queue, index);
+    }
+  memset (&(queue->nodes[queue->num_pkt]), 0, sizeof (struct jit_node_s));
+}
 
-  p_count = p->pkt.count_us;
-  q_count = q->pkt.count_us;
+/* Drop the outdated packets wherever they are, and rebuild the heap if any was dropped.
+ *  Outdated packets are usually at the top of the heap, but the signed order between packets no
+ *  longer holds once a packet is outdated by more than half the range of the counter.
+ *
+ *  Warning: unsigned arithmetic
+ *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
+ */
+static void
+jit_drop_outdated (struct jit_queue_s *queue, uint32_t time_us)
+{
+  uint32_t i;
+  uint32_t kept = 0;
 
-  if (p_count > q_count)
-    *counter = *counter + 1;
+  for (i = 0; i < queue->num_pkt; i++)
+    {
+      if ((queue->nodes[i].pkt.count_us - time_us) >= TX_MAX_ADVANCE_DELAY)
+        {
+          /* We drop the packet to avoid lock-up */
+          MSG_DEBUG (DEBUG_JIT_WARN, "Packet dropped (current_time=%u, packet_time=%u) ---\n",
+                     time_us, queue->nodes[i].pkt.count_us);
+          continue;
+        }
+      if (kept != i)
+        {
+          memcpy (&(queue->nodes[kept]), &(queue->nodes[i]), sizeof (struct jit_node_s));
+        }
+      kept++;
+    }
+  if (kept == queue->num_pkt)
+    {
+      return;
+    }
+  memset (&(queue->nodes[kept]), 0, (queue->num_pkt - kept) * sizeof (struct jit_node_s));
+  queue->num_pkt = kept;
+  for (i = kept / 2; i > 0; i--)
+    {
+      jit_sift_down (queue, i - 1);
+    }
+}
+
+static bool
+jit_grow_queue (struct jit_queue_s *queue)
+{
+  uint32_t num_nodes = (queue->num_nodes == 0) ? JIT_QUEUE_MAX : 2 * queue->num_nodes;
+  struct jit_node_s *nodes;
 
-  return p_count - q_count;
+  nodes = (struct jit_node_s *) realloc (queue->nodes, num_nodes * sizeof (struct jit_node_s));
+  if (nodes == NULL)
+    {
+      return false;
+    }
+  memset (&(nodes[queue->num_nodes]), 0,
+          (num_nodes - queue->num_nodes) * sizeof (struct jit_node_s));
+  MSG_DEBUG (DEBUG_JIT, "JIT queue grown from %u to %u nodes\n", queue->num_nodes, num_nodes);
+  queue->nodes = nodes;
+  queue->num_nodes = num_nodes;
+  return true;
 }
 
-void
-jit_sort_queue (struct jit_queue_s *queue)
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ----------------------------------------- */
+
+bool
+jit_queue_is_full (struct jit_queue_s *queue)
+{
+  return (queue->num_pkt == queue->num_nodes) ? true : false;
+}
+
+bool
+jit_queue_is_empty (struct jit_queue_s *queue)
 {
-  int counter = 0;
+  return (queue->num_pkt == 0) ? true : false;
+}
 
-  if (queue->num_pkt == 0)
+void
+jit_queue_init (struct jit_queue_s *queue)
+{
+  queue->num_pkt = 0;
+  queue->num_beacon = 0;
+  if (queue->nodes == NULL)
     {
-      return;
+      queue->num_nodes = 0;
+      jit_grow_queue (queue);
     }
+  else
+    {
+      memset (queue->nodes, 0, queue->num_nodes * sizeof (struct jit_node_s));
+    }
+}
 
-  MSG_DEBUG (DEBUG_JIT, "sorting queue in ascending order packet timestamp - queue size:%u\n",
-             queue->num_pkt);
-  qsort_r (queue->nodes, queue->num_pkt, sizeof (queue->nodes[0]), compare, &counter);
-  MSG_DEBUG (DEBUG_JIT, "sorting queue done - swapped:%d\n", counter);
+void
+jit_queue_free (struct jit_queue_s *queue)
+{
+  free (queue->nodes);
+  memset (queue, 0, sizeof (*queue));
 }
 
 bool
@@ -142,7 +243,7 @@ jit_enqueue (struct jit_queue_s *queue, struct timeval *time, struct lgw_pkt_tx_
       return JIT_ERROR_INVALID;
     }
 
-  if (jit_queue_is_full (queue))
+  if (jit_queue_is_full (queue) && !jit_grow_queue (queue))
     {
       MSG_DEBUG (DEBUG_JIT_ERROR, "ERROR: cannot enqueue packet, JIT queue is full\n");
       return JIT_ERROR_FULL;
@@ -190,7 +291,7 @@ jit_enqueue (struct jit_queue_s *queue, struct timeval *time, struct lgw_pkt_tx_
   /* Check criteria_3: does this new packet overlap with a packet already enqueued ?
      *  Note: - need to take into account packet's pre_delay and post_delay of each packet
      */
-  for (i = 0; i < queue->num_pkt; i++)
+  for (i = 0; i < (int) queue->num_pkt; i++)
     {
       target_pre_delay = queue->nodes[i].pre_delay;
 
@@ -218,8 +319,8 @@ jit_enqueue (struct jit_queue_s *queue, struct timeval *time, struct lgw_pkt_tx_
   queue->nodes[queue->num_pkt].post_delay = packet_post_delay;
   queue->nodes[queue->num_pkt].pkt_type = pkt_type;
   queue->num_pkt++;
-  /* Sort the queue in ascending order of packet timestamp */
-  jit_sort_queue (queue);
+  /* Move it up the heap, to keep the earliest packet first */
+  jit_sift_up (queue, queue->num_pkt - 1);
 
   /* Done */
 
@@ -241,29 +342,24 @@ jit_dequeue (struct jit_queue_s *queue, int index, struct lgw_pkt_tx_s *packet,
       return JIT_ERROR_INVALID;
     }
 
-  if ((index < 0) || (index >= JIT_QUEUE_MAX))
-    {
-      MSG ("ERROR: invalid parameter\n");
-      return JIT_ERROR_INVALID;
-    }
-
   if (jit_queue_is_empty (queue))
     {
       MSG ("ERROR: cannot dequeue packet, JIT queue is empty\n");
       return JIT_ERROR_EMPTY;
     }
 
+  if ((index < 0) || ((uint32_t) index >= queue->num_pkt))
+    {
+      MSG ("ERROR: invalid parameter\n");
+      return JIT_ERROR_INVALID;
+    }
+
   /* Dequeue requested packet */
   memcpy (packet, &(queue->nodes[index].pkt), sizeof (struct lgw_pkt_tx_s));
-  queue->num_pkt--;
   *pkt_type = queue->nodes[index].pkt_type;
 
   /* Replace dequeued packet with last packet of the queue */
-  memcpy (&(queue->nodes[index]), &(queue->nodes[queue->num_pkt]), sizeof (struct jit_node_s));
-  memset (&(queue->nodes[queue->num_pkt]), 0, sizeof (struct jit_node_s));
-
-  /* Sort queue in ascending order of packet timestamp */
-  jit_sort_queue (queue);
+  jit_remove_node (queue, index);
 
   /* Done */
 
@@ -279,8 +375,6 @@ enum jit_error_e
 jit_peek (struct jit_queue_s *queue, struct timeval *time, int *pkt_idx)
 {
   /* Return index of node containing a packet inline with given time */
-  int i = 0;
-  int idx_highest_priority = -1;
   uint32_t time_us;
 
   if ((time == NULL) || (pkt_idx == NULL))
@@ -296,60 +390,61 @@ jit_peek (struct jit_queue_s *queue, struct timeval *time, int *pkt_idx)
 
   time_us = time->tv_sec * 1000000UL + time->tv_usec;
 
-  /* Search for highest priority packet to be sent */
-  for (i = 0; i < queue->num_pkt; i++)
+  /* First check if some packets are outdated:
+     *  If a packet seems too much in advance, and was not rejected at enqueue time,
+     *  it means that we missed it for peeking, we need to drop it.
+     */
+  jit_drop_outdated (queue, time_us);
+
+  /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
+     *  Warning: unsigned arithmetic (handle roll-over)
+     *      t_packet < t_current + TX_JIT_DELAY
+     */
+  if (!jit_queue_is_empty (queue) && (queue->nodes[0].pkt.count_us - time_us) < TX_JIT_DELAY)
     {
-      /* First check if that packet is outdated:
-         *  If a packet seems too much in advance, and was not rejected at enqueue time,
-         *  it means that we missed it for peeking, we need to drop it
-         *
-         *  Warning: unsigned arithmetic
-         *      t_packet > t_current + TX_MAX_ADVANCE_DELAY
-         */
-      if ((queue->nodes[i].pkt.count_us - time_us) >= TX_MAX_ADVANCE_DELAY)
-        {
-          /* We drop the packet to avoid lock-up */
-          queue->num_pkt--;
-          MSG_DEBUG (DEBUG_JIT_WARN, "Packet dropped (current_time=%u, packet_time=%u) ---\n",
-                     time_us, queue->nodes[i].pkt.count_us);
+      *pkt_idx = 0;
+      MSG_DEBUG (DEBUG_JIT, "peek packet with count_us=%u at index %d\n",
+                 queue->nodes[0].pkt.count_us, 0);
+    }
+  else
+    {
+      *pkt_idx = -1;
+    }
 
-          /* Replace dropped packet with last packet of the queue */
-          memcpy (&(queue->nodes[i]), &(queue->nodes[queue->num_pkt]), sizeof (struct jit_node_s));
-          memset (&(queue->nodes[queue->num_pkt]), 0, sizeof (struct jit_node_s));
+  return JIT_ERROR_OK;
+}
 
-          /* Sort queue in ascending order of packet timestamp */
-          jit_sort_queue (queue);
+enum jit_error_e
+jit_peek_delay (struct jit_queue_s *queue, struct timeval *time, uint32_t *delay_us)
+{
+  uint32_t time_us;
+  uint32_t advance_us;
 
-          /* restart loop  after purge to find packet to be sent */
-          i = 0;
-          continue;
-        }
+  if ((time == NULL) || (delay_us == NULL))
+    {
+      MSG ("ERROR: invalid parameter\n");
+      return JIT_ERROR_INVALID;
+    }
 
-      /* Then look for highest priority packet to be sent:
-         *  Warning: unsigned arithmetic (handle roll-over)
-         *      t_packet < t_highest
-         */
-      if ((idx_highest_priority == -1) ||
-          (((queue->nodes[i].pkt.count_us - time_us) <
-            (queue->nodes[idx_highest_priority].pkt.count_us - time_us))))
-        {
-          idx_highest_priority = i;
-        }
+  if (jit_queue_is_empty (queue))
+    {
+      return JIT_ERROR_EMPTY;
     }
 
-  /* Peek criteria 1: look for a packet to be sent in next TX_JIT_DELAY ms timeframe
+  time_us = time->tv_sec * 1000000UL + time->tv_usec;
+
+  /* The packet with the highest priority is peeked once it enters the TX_JIT_DELAY timeframe,
+     *  and outdated packets are dropped by the next peek
      *  Warning: unsigned arithmetic (handle roll-over)
-     *      t_packet < t_current + TX_JIT_DELAY
      */
-  if ((queue->nodes[idx_highest_priority].pkt.count_us - time_us) < TX_JIT_DELAY)
+  advance_us = queue->nodes[0].pkt.count_us - time_us;
+  if ((advance_us >= TX_MAX_ADVANCE_DELAY) || (advance_us < TX_JIT_DELAY))
     {
-      *pkt_idx = idx_highest_priority;
-      MSG_DEBUG (DEBUG_JIT, "peek packet with count_us=%u at index %d\n",
-                 queue->nodes[idx_highest_priority].pkt.count_us, idx_highest_priority);
+      *delay_us = 0;
     }
   else
     {
-      *pkt_idx = -1;
+      *delay_us = advance_us - TX_JIT_DELAY + 1;
     }
 
   return JIT_ERROR_OK;
@@ -368,7 +463,7 @@ jit_print_queue (struct jit_queue_s *queue, bool show_all, int debug_level)
   else
     {
       MSG_DEBUG (debug_level, "INFO: [jit] queue contains %d packets:\n", queue->num_pkt);
-      loop_end = (show_all == true) ? JIT_QUEUE_MAX : queue->num_pkt;
+      loop_end = (show_all == true) ? queue->num_nodes : queue->num_pkt;
       for (i = 0; i < loop_end; i++)
         {
           MSG_DEBUG (debug_level, " - node[%d]: count_us=%u - type=%d\n", i,
@@ -395,7 +490,7 @@ jit_get_print_queue (struct jit_queue_s *queue, bool show_all, int debug_level)
   else
     {
       ss << "[jit] queue contains " << (unsigned) queue->num_pkt << " packets:\n";
-      loop_end = (show_all == true) ? JIT_QUEUE_MAX : queue->num_pkt;
+      loop_end = (show_all == true) ? queue->num_nodes : queue->num_pkt;
       for (i = 0; i < loop_end; i++)
         {
           ss << " - node[" << i << "]: count_us=" << (unsigned) queue->nodes[i].pkt.count_us
@@ -30,7 +30,7 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
 
-#define JIT_QUEUE_MAX           32  /* Maximum number of packets to be stored in JiT queue */
+#define JIT_QUEUE_MAX           32  /* Initial number of nodes of a JiT queue, doubled when full */
 #define JIT_NUM_BEACON_IN_QUEUE 3   /* Number of beacons to be loaded in JiT queue at any time */
 
 /* -------------------------------------------------------------------------- */
@@ -68,9 +68,10 @@ struct jit_node_s {
 };
 
 struct jit_queue_s {
-    uint8_t num_pkt;                /* Total number of packets in the queue (downlinks, beacons...) */
+    uint32_t num_pkt;               /* Total number of packets in the queue (downlinks, beacons...) */
     uint8_t num_beacon;             /* Number of beacons in the queue */
-    struct jit_node_s nodes[JIT_QUEUE_MAX]; /* Nodes/packets array in the queue */
+    uint32_t num_nodes;             /* Number of nodes allocated */
+    struct jit_node_s *nodes;       /* Nodes/packets heap, the earliest packet at index 0 */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -80,7 +81,9 @@ struct jit_queue_s {
 @brief Check if a JiT queue is full.
 
 @param queue[in] Just in Time queue to be checked.
-@return true if queue is full, false otherwise.
+@return true if all allocated nodes are used, false otherwise.
+
+A full queue is grown by the next jit_enqueue.
 */
 bool jit_queue_is_full(struct jit_queue_s *queue);
 
@@ -95,12 +98,20 @@ bool jit_queue_is_empty(struct jit_queue_s *queue);
 /**
 @brief Initialize a Just in Time queue.
 
-@param queue[in] Just in Time queue to be initialized. Memory should have been allocated already.
+@param queue[in] Just in Time queue to be initialized. It should be zeroed before the first call.
 
-This function is used to reset every elements in the allocated queue.
+This function is used to allocate the nodes of the queue on the first call, and to reset every
+elements in the allocated queue on the next ones.
 */
 void jit_queue_init(struct jit_queue_s *queue);
 
+/**
+@brief Release the nodes of a Just in Time queue.
+
+@param queue[in] Just in Time queue to be released. It can be initialized again afterwards.
+*/
+void jit_queue_free(struct jit_queue_s *queue);
+
 /**
 @brief Add a packet in a Just-in-Time queue
 
@@ -144,6 +155,19 @@ enough the current concentrator time.
 */
 enum jit_error_e jit_peek(struct jit_queue_s *queue, struct timeval *time, int *pkt_idx);
 
+/**
+@brief Get the time until jit_peek will return a packet from the JiT queue.
+
+@param queue[in] Just in Time queue to be checked
+@param time[in] Current concentrator time
+@param delay_us[out] Delay until the packet with the highest priority is soon to be sent, 0 if it
+is already, or if it is outdated.
+@return success if the function was able to check the queue, JIT_ERROR_EMPTY if it is empty.
+
+This function is typically used to sleep until the next call to jit_peek, instead of polling.
+*/
+enum jit_error_e jit_peek_delay(struct jit_queue_s *queue, struct timeval *time, uint32_t *delay_us);
+
 /**
 @brief Debug function to print the queue's content on console
 